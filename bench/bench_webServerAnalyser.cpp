@@ -0,0 +1,209 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <getopt.h>
+
+#include "../src/webServerAnalyser.h"
+#include "../src/mappedFile.h"
+#include "logGenerator.h"
+
+using namespace std;
+
+#define BENCH_DEFAULT_FILE "/tmp/bench_webServerAnalyser.log"
+
+/*
+ * @struct: stageResult
+ * @brief: best time of a benchmark stage over the repetitions
+ * @member - name: name of the stage
+ * @member - seconds: best elapsed time of the pipeline up to and including the stage
+ */
+typedef struct stageResult
+{
+    string name;
+    double seconds;
+} stageResult;
+
+void printUsageInstructions()
+{
+    cout << endl
+         << "Optional arguments:" << endl
+         << " --file=<path_to_webserver_logs>" << endl
+         << "   log to benchmark, a synthetic log is generated (see generateLog) when not provided" << endl
+         << " --size=MB" << endl
+         << "   size of the synthetic log in MB (default: 256)" << endl
+         << " --threads=N" << endl
+         << "   number of worker threads of the analyser stages (default: 1, 0: one per hardware thread)" << endl
+         << " --repeat=N" << endl
+         << "   number of runs of each stage, the best run is reported (default: 3)" << endl
+         << endl
+         << "Each stage runs the pipeline up to and including the stage, the reported rates are lines/s and bytes/s of log:" << endl
+         << "  read: map the log and read every byte" << endl
+         << "  tokenize: find every structural character (newline, space, quote, date delimiters)" << endl
+         << "  filter: parse every line and evaluate a query that rejects every line" << endl
+         << "  aggregate: count accesses per host (only the top host is ranked)" << endl
+         << "  sort/output: count accesses per host, rank and format every host" << endl;
+}
+
+/*
+ * @brief: runs a stage repeat times
+ * @return: returns the best elapsed time in seconds
+ */
+double timeStage( unsigned int repeat, const function <void()> &stage )
+{
+    double best = 0;
+    for (unsigned int run = 0; run < repeat; run++)
+    {
+        auto start = chrono::steady_clock::now();
+        stage();
+        double seconds = chrono::duration <double>( chrono::steady_clock::now() - start ).count();
+        best = run == 0 ? seconds : min( best, seconds );
+    }
+    return best;
+}
+
+int main( int argc, char **argv )
+{
+    int opt;
+    string filePath;
+    double sizeMB = 256;
+    unsigned int threads = 1, repeat = 3;
+
+    option long_opts[] = { { "file", required_argument, nullptr, 'f' },
+                           { "size", required_argument, nullptr, 's' },
+                           { "threads", required_argument, nullptr, 't' },
+                           { "repeat", required_argument, nullptr, 'r' },
+                           { nullptr, 0, nullptr, 0 } };
+
+    while ( ( opt = getopt_long( argc, argv, "f:s:t:r:", long_opts, nullptr ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'f':
+                filePath = optarg;
+                break;
+            case 's':
+                sizeMB = strtod( optarg, nullptr );
+                break;
+            case 't':
+                threads = strtoul( optarg, nullptr, 10 );
+                break;
+            case 'r':
+                repeat = max( 1ul, strtoul( optarg, nullptr, 10 ) );
+                break;
+            default:
+                printUsageInstructions();
+                return -1;
+        }
+    }
+
+    // Step 1: generate the synthetic log with the default shape, unless a log is provided
+    if ( filePath.empty() )
+    {
+        generatorConfig generator;
+        generator.targetBytes = static_cast <uint64_t>( sizeMB * ( 1 << 20 ) );
+        filePath = BENCH_DEFAULT_FILE;
+        cout << "Generating " << sizeMB << " MB into " << filePath << endl;
+        if ( logGenerator( generator ).generate( filePath ) == 0 )
+        {
+            cerr << "Failed to write " << filePath << endl;
+            return -1;
+        }
+    }
+
+    mappedFile inputFile( filePath );
+    if ( !inputFile.isOpen() )
+    {
+        cerr << "Failed to open " << filePath << endl;
+        return -1;
+    }
+    string_view contents = inputFile.data();
+    uint64_t lines = 0;
+    for (size_t position = 0; ( position = contents.find( '\n', position ) ) != string_view::npos; position++)
+    {
+        lines++;
+    }
+
+    analyserConfig config;
+    config.threads = threads;
+    config.useIndex = false;
+    accessQuery rejectQuery, hostQuery;
+    rejectQuery.httpMethod = "BENCH"; // no line uses this method: every line is parsed and filtered out
+    volatile uint64_t sink = 0;
+    vector <stageResult> results;
+
+    // Step 2: time each stage of the pipeline, the analyser stages include the stages before them
+    results.push_back( { "read", timeStage( repeat, [&]()
+    {
+        mappedFile stageFile( filePath );
+        string_view stageContents = stageFile.data();
+        uint64_t sum = 0;
+        for (size_t position = 0; position + sizeof( uint64_t ) <= stageContents.size(); position += sizeof( uint64_t ))
+        {
+            uint64_t word;
+            memcpy( &word, stageContents.data() + position, sizeof( word ) );
+            sum += word;
+        }
+        sink = sum;
+    } ) } );
+
+    results.push_back( { "tokenize", timeStage( repeat, [&]()
+    {
+        mappedFile stageFile( filePath );
+        string_view stageContents = stageFile.data();
+        logTokenizer tokens( stageContents );
+        uint64_t structural = 0;
+        for (size_t position = 0; ( position = tokens.next( position, TOKEN_NEWLINE | TOKEN_SPACE | TOKEN_QUOTE | TOKEN_DATE ) ) < stageContents.size(); position++)
+        {
+            structural++;
+        }
+        sink = structural;
+    } ) } );
+
+    results.push_back( { "filter", timeStage( repeat, [&]()
+    {
+        webServerAnalyser analyser( config );
+        analyser.addQuery( rejectQuery );
+        sink = analyser.runQueries( filePath )[0].size();
+    } ) } );
+
+    results.push_back( { "aggregate", timeStage( repeat, [&]()
+    {
+        analyserConfig topConfig = config;
+        topConfig.topKeys = 1;
+        topConfig.exactTop = true;
+        webServerAnalyser analyser( topConfig );
+        analyser.addQuery( hostQuery );
+        sink = analyser.runQueries( filePath )[0].size();
+    } ) } );
+
+    results.push_back( { "sort/output", timeStage( repeat, [&]()
+    {
+        webServerAnalyser analyser( config );
+        ostringstream output;
+        analyser.addQuery( hostQuery );
+        vector <vector <string>> queryOutput = analyser.runQueries( filePath );
+        for (const auto &line: queryOutput[0])
+        {
+            output << line << '\n';
+        }
+        sink = output.str().size();
+    } ) } );
+
+    // Step 3: report the throughput of each stage, and the time the stage adds to the previous ones
+    cout << filePath << ": " << contents.size() << " bytes, " << lines << " lines, " << threads << " thread(s), best of " << repeat << endl;
+    cout << left << setw( 12 ) << "stage" << right << setw( 10 ) << "seconds" << setw( 10 ) << "+seconds"
+         << setw( 14 ) << "Mlines/s" << setw( 12 ) << "MB/s" << endl;
+    for (size_t stage = 0; stage < results.size(); stage++)
+    {
+        double seconds = results[stage].seconds;
+        double added = stage == 0 ? seconds : seconds - results[stage - 1].seconds;
+        cout << left << setw( 12 ) << results[stage].name << right << fixed << setprecision( 3 )
+             << setw( 10 ) << seconds << setw( 10 ) << added
+             << setw( 14 ) << lines / seconds / 1e6 << setw( 12 ) << contents.size() / seconds / ( 1 << 20 ) << endl;
+    }
+
+    return 0;
+}
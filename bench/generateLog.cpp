@@ -0,0 +1,147 @@
+#include <iostream>
+#include <getopt.h>
+
+#include "logGenerator.h"
+
+using namespace std;
+
+void printUsageInstructions()
+{
+    cout << endl
+         << "Required arguments:" << endl
+         << "  --output=<path_to_generated_log>" << endl
+         << endl
+         << "Optional arguments:" << endl
+         << " --size=MB" << endl
+         << "   approximate size of the generated log in MB (default: 64)" << endl
+         << " --seed=N" << endl
+         << "   seed of the generated log, the same options always generate the same log" << endl
+         << " --hosts=N --host_skew=S" << endl
+         << "   number of distinct hosts and Zipf exponent of their popularity (default: 10000, 1.0)" << endl
+         << " --resources=N --resource_skew=S" << endl
+         << "   number of distinct resources and Zipf exponent of their popularity (default: 2000, 1.1)" << endl
+         << " --status=CODE:WEIGHT,..." << endl
+         << "   mix of HTTP responses (default: 200:85,304:8,404:5,500:2)" << endl
+         << " --methods=METHOD:WEIGHT,..." << endl
+         << "   mix of HTTP methods (default: GET:90,POST:6,HEAD:4)" << endl
+         << " --rate=N" << endl
+         << "   average number of lines per second of log (default: 500)" << endl
+         << " --unordered=SECONDS" << endl
+         << "   shifts each date time by up to SECONDS, the log is no longer time ordered" << endl
+         << endl
+         << "Sample usage:" << endl
+         << "./generateLog --output=access.log --size=1024 --hosts=100000 --status=200:95,404:5" << endl
+         << "  (Generate a 1 GB time ordered log with 100000 hosts, 5% of requests not found" << endl;
+}
+
+/*
+ * @brief: parses a VALUE:WEIGHT,... list into a weighted mix
+ * @return: returns false if an entry is malformed
+ */
+bool parseMix( const string &list, vector <pair <string, double>> &mix )
+{
+    size_t start = 0;
+    mix.clear();
+    while ( start < list.size() )
+    {
+        size_t end = list.find( ',', start );
+        end = end == string::npos ? list.size() : end;
+        size_t separator = list.find( ':', start );
+        if ( separator == string::npos || separator >= end || separator == start )
+        {
+            return false;
+        }
+        mix.emplace_back( list.substr( start, separator - start ), strtod( list.c_str() + separator + 1, nullptr ) );
+        start = end + 1;
+    }
+    return !mix.empty();
+}
+
+int main( int argc, char **argv )
+{
+    int opt;
+    string outputPath;
+    generatorConfig config;
+
+    option long_opts[] = { { "output", required_argument, nullptr, 'o' },
+                           { "size", required_argument, nullptr, 's' },
+                           { "seed", required_argument, nullptr, 'S' },
+                           { "hosts", required_argument, nullptr, 'h' },
+                           { "host_skew", required_argument, nullptr, 'H' },
+                           { "resources", required_argument, nullptr, 'r' },
+                           { "resource_skew", required_argument, nullptr, 'R' },
+                           { "status", required_argument, nullptr, 'c' },
+                           { "methods", required_argument, nullptr, 'm' },
+                           { "rate", required_argument, nullptr, 'l' },
+                           { "unordered", required_argument, nullptr, 'u' },
+                           { nullptr, 0, nullptr, 0 } };
+
+    while ( ( opt = getopt_long( argc, argv, "o:s:S:h:H:r:R:c:m:l:u:", long_opts, nullptr ) ) != -1 )
+    {
+        switch ( opt )
+        {
+            case 'o':
+                outputPath = optarg;
+                break;
+            case 's':
+                config.targetBytes = static_cast <uint64_t>( strtod( optarg, nullptr ) * ( 1 << 20 ) );
+                break;
+            case 'S':
+                config.seed = strtoull( optarg, nullptr, 0 );
+                break;
+            case 'h':
+                config.hosts = strtoul( optarg, nullptr, 10 );
+                break;
+            case 'H':
+                config.hostSkew = strtod( optarg, nullptr );
+                break;
+            case 'r':
+                config.resources = strtoul( optarg, nullptr, 10 );
+                break;
+            case 'R':
+                config.resourceSkew = strtod( optarg, nullptr );
+                break;
+            case 'c':
+                if ( !parseMix( optarg, config.statusMix ) )
+                {
+                    printUsageInstructions();
+                    return -1;
+                }
+                break;
+            case 'm':
+                if ( !parseMix( optarg, config.methodMix ) )
+                {
+                    printUsageInstructions();
+                    return -1;
+                }
+                break;
+            case 'l':
+                config.linesPerSecond = strtod( optarg, nullptr );
+                break;
+            case 'u':
+                config.timeOrdered = false;
+                config.timeJitter = strtoul( optarg, nullptr, 10 );
+                break;
+            default:
+                printUsageInstructions();
+                return -1;
+        }
+    }
+
+    if ( outputPath.empty() )
+    {
+        printUsageInstructions();
+        return -1;
+    }
+
+    logGenerator generator( config );
+    uint64_t lines = generator.generate( outputPath );
+    if ( lines == 0 )
+    {
+        cerr << "Failed to write " << outputPath << endl;
+        return -1;
+    }
+    cout << "Generated " << lines << " lines into " << outputPath << endl;
+
+    return 0;
+}
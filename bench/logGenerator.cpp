@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include "logGenerator.h"
+
+#define GENERATOR_BUFFER_SIZE ( 1 << 20 ) // bytes of log buffered before each write
+
+/*
+ * @method: logGenerator
+ * @brief: precomputes the cumulative distributions of the configuration
+ * @input - config: the shape of the log to generate
+ */
+logGenerator::logGenerator( const generatorConfig &config ) : config( config ), state( config.seed )
+{
+    this->config.hosts = std::max <size_t>( config.hosts, 1 );
+    this->config.resources = std::max <size_t>( config.resources, 1 );
+    this->config.linesPerSecond = config.linesPerSecond > 0 ? config.linesPerSecond : 1;
+    if ( this->config.statusMix.empty() )
+    {
+        this->config.statusMix = { { "200", 1 } };
+    }
+    if ( this->config.methodMix.empty() )
+    {
+        this->config.methodMix = { { "GET", 1 } };
+    }
+
+    hostWeights = zipfWeights( this->config.hosts, config.hostSkew );
+    resourceWeights = zipfWeights( this->config.resources, config.resourceSkew );
+    statusWeights = mixWeights( this->config.statusMix );
+    methodWeights = mixWeights( this->config.methodMix );
+}
+
+/*
+ * @method: nextRandom
+ * @brief: splitmix64 step, identical on every platform (unlike the std distributions)
+ * @return: returns the next 64-bit pseudo-random value
+ */
+uint64_t logGenerator::nextRandom()
+{
+    uint64_t value = ( state += 0x9e3779b97f4a7c15ULL );
+    value = ( value ^ ( value >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    value = ( value ^ ( value >> 27 ) ) * 0x94d049bb133111ebULL;
+    return value ^ ( value >> 31 );
+}
+
+/*
+ * @method: nextUniform
+ * @return: returns a pseudo-random value in [0, 1)
+ */
+double logGenerator::nextUniform()
+{
+    return ( nextRandom() >> 11 ) * ( 1.0 / ( 1ULL << 53 ) );
+}
+
+/*
+ * @method: pick
+ * @brief: inverse transform sampling over a cumulative distribution
+ * @input - cumulativeWeights: the cumulative distribution, ending with 1
+ * @input - uniform: a value in [0, 1)
+ * @return: returns the index of the picked value
+ */
+size_t logGenerator::pick( const std::vector <double> &cumulativeWeights, double uniform )
+{
+    size_t index = std::upper_bound( cumulativeWeights.begin(), cumulativeWeights.end(), uniform ) - cumulativeWeights.begin();
+    return std::min( index, cumulativeWeights.size() - 1 );
+}
+
+/*
+ * @method: zipfWeights
+ * @brief: cumulative Zipf distribution: value k is picked with a weight of 1 / (k + 1)^skew
+ * @input - count: the number of values
+ * @input - skew: the Zipf exponent, 0 for a uniform distribution
+ * @return: returns the cumulative distribution, normalized to 1
+ */
+std::vector <double> logGenerator::zipfWeights( size_t count, double skew )
+{
+    std::vector <double> weights( count );
+    double total = 0;
+    for (size_t value = 0; value < count; value++)
+    {
+        total += 1.0 / std::pow( static_cast <double>( value + 1 ), skew );
+        weights[value] = total;
+    }
+    for (auto &weight: weights)
+    {
+        weight /= total;
+    }
+    return weights;
+}
+
+/*
+ * @method: mixWeights
+ * @brief: cumulative distribution of weighted values
+ * @input - mix: the values with their relative weights
+ * @return: returns the cumulative distribution, normalized to 1
+ */
+std::vector <double> logGenerator::mixWeights( const std::vector <std::pair <std::string, double>> &mix )
+{
+    std::vector <double> weights( mix.size() );
+    double total = 0;
+    for (size_t value = 0; value < mix.size(); value++)
+    {
+        total += std::max( mix[value].second, 0.0 );
+        weights[value] = total;
+    }
+    for (auto &weight: weights)
+    {
+        weight = total > 0 ? weight / total : 1;
+    }
+    return weights;
+}
+
+/*
+ * @method: appendHost
+ * @brief: names host #host, a mix of IPv4 addresses and domain names (ex. "10.0.1.44", "host1045.example.net")
+ */
+void logGenerator::appendHost( std::string &line, size_t host )
+{
+    static const char *domains[] = { ".example.com", ".example.net", ".dialup.example.org", ".campus.example.edu" };
+
+    if ( host % 3 == 0 )
+    {
+        line += "10.";
+        line += std::to_string( ( host >> 16 ) & 0xff );
+        line += '.';
+        line += std::to_string( ( host >> 8 ) & 0xff );
+        line += '.';
+        line += std::to_string( host & 0xff );
+    }
+    else
+    {
+        line += "host";
+        line += std::to_string( host );
+        line += domains[host % 4];
+    }
+}
+
+/*
+ * @method: appendResource
+ * @brief: names resource #resource (ex. "/dir12/page3212.html")
+ */
+void logGenerator::appendResource( std::string &line, size_t resource )
+{
+    static const char *extensions[] = { ".html", ".gif", ".jpg", ".css", ".html", ".txt" };
+
+    line += "/dir";
+    line += std::to_string( resource % 64 );
+    line += "/page";
+    line += std::to_string( resource );
+    line += extensions[resource % 6];
+}
+
+/*
+ * @method: appendDate
+ * @brief: formats a number of seconds since day 0 as [DD:HH:MM:SS]
+ */
+void logGenerator::appendDate( std::string &line, uint64_t second )
+{
+    uint64_t fields[] = { second / 86400, second / 3600 % 24, second / 60 % 60, second % 60 };
+
+    line += '[';
+    for (int field = 0; field < 4; field++)
+    {
+        if ( fields[field] < 10 )
+        {
+            line += '0';
+        }
+        line += std::to_string( fields[field] );
+        line += field < 3 ? ':' : ']';
+    }
+}
+
+/*
+ * @method: generate
+ * @brief: writes the whole log to the provided stream
+ * @input - output: the stream receiving the log
+ * @return: returns the number of lines written
+ */
+uint64_t logGenerator::generate( std::ostream &output )
+{
+    std::string buffer;
+    uint64_t written = 0, lines = 0;
+    uint64_t startSecond = static_cast <uint64_t>( config.startDay ) * 86400;
+
+    buffer.reserve( GENERATOR_BUFFER_SIZE + 256 );
+    state = config.seed;
+    while ( written < config.targetBytes )
+    {
+        size_t lineStart = buffer.size();
+        uint64_t second = startSecond + static_cast <uint64_t>( lines / config.linesPerSecond );
+        if ( !config.timeOrdered && config.timeJitter > 0 )
+        {
+            uint64_t shift = nextRandom() % ( 2 * static_cast <uint64_t>( config.timeJitter ) + 1 );
+            second = second + shift > config.timeJitter ? second + shift - config.timeJitter : 0;
+        }
+        const std::string &status = config.statusMix[pick( statusWeights, nextUniform() )].first;
+
+        appendHost( buffer, pick( hostWeights, nextUniform() ) );
+        buffer += ' ';
+        appendDate( buffer, second );
+        buffer += " \"";
+        buffer += config.methodMix[pick( methodWeights, nextUniform() )].first;
+        buffer += ' ';
+        appendResource( buffer, pick( resourceWeights, nextUniform() ) );
+        buffer += " HTTP/1.0\" ";
+        buffer += status;
+        buffer += ' ';
+        if ( status == "304" )
+        {
+            buffer += '-'; // not modified: no body
+        }
+        else
+        {
+            buffer += std::to_string( 100 + nextRandom() % 65536 );
+        }
+        buffer += '\n';
+
+        written += buffer.size() - lineStart;
+        lines++;
+        if ( buffer.size() >= GENERATOR_BUFFER_SIZE )
+        {
+            output.write( buffer.data(), buffer.size() );
+            buffer.clear();
+        }
+    }
+    output.write( buffer.data(), buffer.size() );
+    output.flush();
+    return lines;
+}
+
+/*
+ * @method: generate
+ * @brief: writes the whole log to the provided file (replaced if it exists)
+ * @input - filePath: the file receiving the log
+ * @return: returns the number of lines written, 0 if the file could not be written
+ */
+uint64_t logGenerator::generate( const std::string &filePath )
+{
+    std::ofstream output( filePath, std::ios::binary | std::ios::trunc );
+    if ( !output )
+    {
+        return 0;
+    }
+    uint64_t lines = generate( static_cast <std::ostream &>( output ) );
+    return output ? lines : 0;
+}
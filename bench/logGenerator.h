@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#define GENERATOR_DEFAULT_SEED 0x5eed // seed of the default generator configuration
+
+/*
+ * @struct: generatorConfig
+ * @brief: shape of a synthetic webserver log, the same configuration always generates the same bytes
+ * @member - targetBytes: approximate size of the generated log (generation stops after the line crossing it)
+ * @member - seed: seed of the pseudo-random sequence
+ * @member - hosts: number of distinct hosts
+ * @member - hostSkew: Zipf exponent of the host popularity (0: uniform, ~1: a few hosts make most requests)
+ * @member - resources: number of distinct resource URIs
+ * @member - resourceSkew: Zipf exponent of the resource popularity
+ * @member - statusMix: HTTP responses with their relative weights
+ * @member - methodMix: HTTP methods with their relative weights
+ * @member - linesPerSecond: average number of lines per second of log, sets the time span of the log
+ * @member - timeOrdered: lines are sorted by date time, otherwise each date time is shifted by up to timeJitter seconds
+ * @member - timeJitter: maximum shift (in seconds) of the date times of a log that is not time ordered
+ * @member - startDay: day of the first date time ([DD:00:00:00])
+ */
+typedef struct generatorConfig
+{
+    uint64_t targetBytes = 64 << 20;
+    uint64_t seed = GENERATOR_DEFAULT_SEED;
+    size_t hosts = 10000;
+    double hostSkew = 1.0;
+    size_t resources = 2000;
+    double resourceSkew = 1.1;
+    std::vector <std::pair <std::string, double>> statusMix = { { "200", 85 }, { "304", 8 }, { "404", 5 }, { "500", 2 } };
+    std::vector <std::pair <std::string, double>> methodMix = { { "GET", 90 }, { "POST", 6 }, { "HEAD", 4 } };
+    double linesPerSecond = 500;
+    bool timeOrdered = true;
+    uint32_t timeJitter = 30;
+    uint32_t startDay = 1;
+} generatorConfig;
+
+/*
+ * @class: logGenerator
+ * @brief: writes synthetic logs in the webserver log format, from a few MB up to tens of GB:
+ *         host [DD:HH:MM:SS] "METHOD URI PROTO" status size
+ *         The output only depends on the configuration (own pseudo-random generator and distributions), so that
+ *         benchmarks on different machines and standard libraries parse the same log
+ */
+class logGenerator
+{
+    private:
+        generatorConfig config;
+        uint64_t state;
+        std::vector <double> hostWeights, resourceWeights, statusWeights, methodWeights; // cumulative, normalized to 1
+
+        uint64_t nextRandom();
+        double nextUniform();
+        static size_t pick( const std::vector <double> &cumulativeWeights, double uniform );
+        static std::vector <double> zipfWeights( size_t count, double skew );
+        static std::vector <double> mixWeights( const std::vector <std::pair <std::string, double>> &mix );
+        static void appendHost( std::string &line, size_t host );
+        static void appendResource( std::string &line, size_t resource );
+        static void appendDate( std::string &line, uint64_t second );
+
+    public:
+        explicit logGenerator( const generatorConfig &config );
+
+       /*
+        * @method: generate
+        * @brief: writes the whole log to the provided stream
+        * @input - output: the stream receiving the log
+        * @return: returns the number of lines written
+        */
+        uint64_t generate( std::ostream &output );
+
+       /*
+        * @method: generate
+        * @brief: writes the whole log to the provided file (replaced if it exists)
+        * @input - filePath: the file receiving the log
+        * @return: returns the number of lines written, 0 if the file could not be written
+        */
+        uint64_t generate( const std::string &filePath );
+};
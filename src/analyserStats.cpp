@@ -0,0 +1,139 @@
+#include <iomanip>
+#include <sstream>
+
+#include <sys/resource.h>
+#include <time.h>
+
+#include "analyserStats.h"
+
+static const char *stageNames[STATS_STAGES] = { "open", "scan", "merge", "rank" };
+static const char *filterNames[QUERY_FILTERS] = { "date", "response", "method", "host", "resource", "size" };
+
+/*
+ * @method: stageTimer
+ * @input - stats: the stats receiving the time, nullptr when stats are not collected
+ * @input - stage: the stage being timed
+ */
+stageTimer::stageTimer( analyserStats *stats, statsStage stage ) : stage( stats != nullptr ? &stats->stages[stage] : nullptr )
+{
+    if ( this->stage != nullptr )
+    {
+        wallStart = std::chrono::steady_clock::now();
+        cpuStart = processCpuTime();
+    }
+}
+
+/*
+ * @method: stop
+ * @brief: ends the timed stage before the destruction of the timer (later calls do nothing)
+ */
+void stageTimer::stop()
+{
+    if ( stage != nullptr )
+    {
+        stage->wall += std::chrono::duration <double>( std::chrono::steady_clock::now() - wallStart ).count();
+        stage->cpu += processCpuTime() - cpuStart;
+        stage = nullptr;
+    }
+}
+
+/*
+ * @method: processCpuTime
+ * @return: returns the CPU seconds used by the process so far (all threads)
+ */
+double stageTimer::processCpuTime()
+{
+    timespec now = {};
+    clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &now );
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+/*
+ * @method: peakResidentMemory
+ * @return: returns the peak resident set size of the process, in bytes
+ */
+uint64_t peakResidentMemory()
+{
+    rusage usage = {};
+    getrusage( RUSAGE_SELF, &usage );
+    return static_cast <uint64_t>( usage.ru_maxrss ) * 1024; // kilobytes on Linux
+}
+
+/*
+ * @method: formatStats
+ * @brief: formats the stats of a run as human-readable text or as a JSON object
+ * @input - stats: the stats to format
+ * @input - json: true for a JSON object, false for text
+ * @return: returns the formatted stats, ending with a newline
+ */
+std::string formatStats( const analyserStats &stats, bool json )
+{
+    std::ostringstream output;
+    double totalWall = 0;
+    for (const auto &stage: stats.stages)
+    {
+        totalWall += stage.wall;
+    }
+    double scanWall = stats.stages[STAGE_SCAN].wall;
+    double lineRate = scanWall > 0 ? stats.lines / scanWall : 0;
+    double byteRate = scanWall > 0 ? stats.bytes / scanWall : 0;
+
+    output << std::fixed << std::setprecision( 6 );
+    if ( json )
+    {
+        output << "{\"threads\":" << stats.threads << ",\"files\":" << stats.files << ",\"indexed_files\":" << stats.indexedFiles
+               << ",\"compressed\":" << ( stats.compressed ? "true" : "false" )
+               << ",\"lines\":" << stats.lines << ",\"bytes\":" << stats.bytes
+               << ",\"lines_per_second\":" << lineRate << ",\"bytes_per_second\":" << byteRate
+               << ",\"peak_memory\":" << stats.peakMemory << ",\"stages\":{";
+        for (int stage = 0; stage < STATS_STAGES; stage++)
+        {
+            output << ( stage > 0 ? "," : "" ) << "\"" << stageNames[stage] << "\":{\"wall\":" << stats.stages[stage].wall
+                   << ",\"cpu\":" << stats.stages[stage].cpu << "}";
+        }
+        output << "},\"queries\":[";
+        for (size_t query = 0; query < stats.queries.size(); query++)
+        {
+            const queryStats &counters = stats.queries[query];
+            output << ( query > 0 ? "," : "" ) << "{\"counted\":" << counters.counted << ",\"rejected\":{";
+            for (int filter = 0; filter < QUERY_FILTERS; filter++)
+            {
+                output << ( filter > 0 ? "," : "" ) << "\"" << filterNames[filter] << "\":" << counters.rejected[filter];
+            }
+            output << "},\"distinct_keys\":" << counters.distinctKeys << ",\"table_load\":" << counters.tableLoad
+                   << ",\"key_memory\":" << counters.keyMemory << ",\"spilled_bytes\":" << counters.spilledBytes << "}";
+        }
+        output << "]}\n";
+        return output.str();
+    }
+
+    output << "threads: " << stats.threads << ", files: " << stats.files << " (" << stats.indexedFiles << " answered from their index)"
+           << ( stats.compressed ? ", compressed log" : "" ) << "\n"
+           << "lines: " << stats.lines << ", bytes: " << stats.bytes << "\n"
+           << std::setprecision( 0 ) << "scan rate: " << lineRate << " lines/s, " << byteRate / ( 1 << 20 ) << " MB/s\n"
+           << "peak memory: " << stats.peakMemory / 1024 << " KB\n" << std::setprecision( 6 );
+    for (int stage = 0; stage < STATS_STAGES; stage++)
+    {
+        output << std::left << std::setw( 6 ) << stageNames[stage] << std::right
+               << " wall " << stats.stages[stage].wall << " s, cpu " << stats.stages[stage].cpu << " s ("
+               << std::setprecision( 1 ) << ( totalWall > 0 ? 100 * stats.stages[stage].wall / totalWall : 0 ) << "%)\n"
+               << std::setprecision( 6 );
+    }
+    for (size_t query = 0; query < stats.queries.size(); query++)
+    {
+        const queryStats &counters = stats.queries[query];
+        output << "query " << query << ": counted " << counters.counted << ", rejected by";
+        for (int filter = 0; filter < QUERY_FILTERS; filter++)
+        {
+            output << " " << filterNames[filter] << " " << counters.rejected[filter];
+        }
+        output << ", distinct keys " << counters.distinctKeys << ", table load " << std::setprecision( 2 ) << counters.tableLoad
+               << ", key memory " << counters.keyMemory / 1024 << " KB";
+        if ( counters.spilledBytes > 0 )
+        {
+            output << ", spilled " << counters.spilledBytes / 1024 << " KB";
+        }
+        output << "\n" << std::setprecision( 6 );
+    }
+    return output.str();
+}
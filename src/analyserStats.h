@@ -0,0 +1,147 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * @enum: statsStage
+ * @brief: stages of a run of the analyser, timed separately
+ */
+enum statsStage
+{
+    STAGE_OPEN,  // compile the queries, load the index or map the log (and locate the date time range of time ordered logs)
+    STAGE_SCAN,  // read, tokenize, parse, filter and count every line (fused per line, on the worker threads)
+    STAGE_MERGE, // merge the per-worker partial results
+    STAGE_RANK,  // sort the keys and format the output
+    STATS_STAGES
+};
+
+/*
+ * @enum: queryFilter
+ * @brief: predicates of a query: a rejected line is accounted to the first predicate it fails (the date time range first, then
+ *         the predicates of the query filter in their evaluation order, see logFilter)
+ */
+enum queryFilter
+{
+    FILTER_DATE,     // date time outside of the query range
+    FILTER_RESPONSE, // HTTP response different from the query response
+    FILTER_METHOD,   // HTTP method different from the query method
+    FILTER_HOST,     // host rejected by the filter expression of the query
+    FILTER_RESOURCE, // resource rejected by the filter expression of the query
+    FILTER_SIZE,     // reply size rejected by the filter expression of the query
+    QUERY_FILTERS,
+    FILTER_PASSED = QUERY_FILTERS // the line passes every predicate and is counted
+};
+
+/*
+ * @struct: stageTime
+ * @brief: time spent in a stage
+ * @member - wall: elapsed seconds
+ * @member - cpu: CPU seconds of the whole process (all threads) during the stage
+ */
+typedef struct stageTime
+{
+    double wall = 0;
+    double cpu = 0;
+} stageTime;
+
+/*
+ * @struct: queryStats
+ * @brief: counters of a single query
+ * @member - rejected: number of lines rejected by each predicate (see queryFilter)
+ * @member - counted: number of lines that passed every predicate
+ * @member - distinctKeys: number of distinct keys counted (monitored keys for a top keys summary)
+ * @member - tableLoad: fill ratio of the key table (counters in use for a top keys summary)
+ * @member - keyMemory: approximate number of bytes held by the key table, 0 when not measured
+ * @member - spilledBytes: number of bytes of exact counts spilled to disk (see analyserConfig.memoryLimit)
+ */
+typedef struct queryStats
+{
+    uint64_t rejected[QUERY_FILTERS] = {};
+    uint64_t counted = 0;
+    size_t distinctKeys = 0;
+    double tableLoad = 0;
+    size_t keyMemory = 0;
+    uint64_t spilledBytes = 0;
+} queryStats;
+
+/*
+ * @struct: analyserStats
+ * @brief: instrumentation of the last run of the analyser (see analyserConfig.collectStats)
+ *         Line counters are kept per worker thread and summed at the end of the scan: nothing is shared on the hot path
+ * @member - stages: time spent in each stage (see statsStage)
+ * @member - lines: number of non-empty lines parsed (rows for an indexed run)
+ * @member - bytes: number of bytes of log text read (compressed bytes for a compressed log, 0 for an indexed log)
+ * @member - threads: number of worker threads
+ * @member - files: number of log files
+ * @member - indexedFiles: number of log files answered from their sidecar index
+ * @member - compressed: a log was decompressed on the fly
+ * @member - queries: counters of each query, in the order of the batch
+ * @member - peakMemory: peak resident set size of the process, in bytes
+ */
+typedef struct analyserStats
+{
+    stageTime stages[STATS_STAGES];
+    uint64_t lines = 0;
+    uint64_t bytes = 0;
+    unsigned int threads = 0;
+    size_t files = 0;
+    size_t indexedFiles = 0;
+    bool compressed = false;
+    std::vector <queryStats> queries;
+    uint64_t peakMemory = 0;
+} analyserStats;
+
+/*
+ * @class: stageTimer
+ * @brief: adds the wall and CPU time elapsed between its construction and destruction to a stage
+ *         A timer built without stats does nothing, so that stages can be timed unconditionally
+ */
+class stageTimer
+{
+    private:
+        stageTime *stage;
+        std::chrono::steady_clock::time_point wallStart;
+        double cpuStart = 0;
+
+    public:
+       /*
+        * @method: stageTimer
+        * @input - stats: the stats receiving the time, nullptr when stats are not collected
+        * @input - stage: the stage being timed
+        */
+        stageTimer( analyserStats *stats, statsStage stage );
+        ~stageTimer() { stop(); }
+
+        stageTimer( const stageTimer & ) = delete;
+        stageTimer &operator=( const stageTimer & ) = delete;
+
+       /*
+        * @method: stop
+        * @brief: ends the timed stage before the destruction of the timer (later calls do nothing)
+        */
+        void stop();
+
+       /*
+        * @method: processCpuTime
+        * @return: returns the CPU seconds used by the process so far (all threads)
+        */
+        static double processCpuTime();
+};
+
+/*
+ * @method: peakResidentMemory
+ * @return: returns the peak resident set size of the process, in bytes
+ */
+uint64_t peakResidentMemory();
+
+/*
+ * @method: formatStats
+ * @brief: formats the stats of a run as human-readable text or as a JSON object
+ * @input - stats: the stats to format
+ * @input - json: true for a JSON object, false for text
+ * @return: returns the formatted stats, ending with a newline
+ */
+std::string formatStats( const analyserStats &stats, bool json );
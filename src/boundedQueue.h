@@ -0,0 +1,94 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/*
+ * @class: boundedQueue
+ * @brief: thread-safe FIFO holding at most capacity items, producers block while it is full
+ *         Used to hand buffers from a producer thread (ex. decompression) to the parsing threads
+ */
+template <typename Item>
+class boundedQueue
+{
+    private:
+        std::deque <Item> items;
+        size_t capacity;
+        bool closed = false;
+        std::mutex lock;
+        std::condition_variable notFull, notEmpty;
+
+    public:
+        explicit boundedQueue( size_t capacity ) : capacity( capacity > 0 ? capacity : 1 ) {}
+
+       /*
+        * @method: push
+        * @brief: adds an item, waiting for room if the queue is full
+        * @input - item: the item to add
+        * @return: returns false if the queue was closed (the item is dropped), true otherwise
+        */
+        bool push( Item item )
+        {
+            std::unique_lock <std::mutex> guard( lock );
+            notFull.wait( guard, [this] { return closed || items.size() < capacity; } );
+            if ( closed )
+            {
+                return false;
+            }
+            items.push_back( std::move( item ) );
+            notEmpty.notify_one();
+            return true;
+        }
+
+       /*
+        * @method: tryPush
+        * @brief: adds an item if there is room, without waiting
+        * @input - item: the item to add
+        * @return: returns false if the queue is full or closed (the item is not added), true otherwise
+        */
+        bool tryPush( Item item )
+        {
+            std::lock_guard <std::mutex> guard( lock );
+            if ( closed || items.size() >= capacity )
+            {
+                return false;
+            }
+            items.push_back( std::move( item ) );
+            notEmpty.notify_one();
+            return true;
+        }
+
+       /*
+        * @method: pop
+        * @brief: removes the oldest item, waiting for one if the queue is empty
+        * @output - item: the removed item
+        * @return: returns false once the queue is closed and drained, true otherwise
+        */
+        bool pop( Item &item )
+        {
+            std::unique_lock <std::mutex> guard( lock );
+            notEmpty.wait( guard, [this] { return closed || !items.empty(); } );
+            if ( items.empty() )
+            {
+                return false;
+            }
+            item = std::move( items.front() );
+            items.pop_front();
+            notFull.notify_one();
+            return true;
+        }
+
+       /*
+        * @method: close
+        * @brief: signals the end of the stream: pending items can still be popped, pushes are rejected
+        */
+        void close()
+        {
+            std::lock_guard <std::mutex> guard( lock );
+            closed = true;
+            notFull.notify_all();
+            notEmpty.notify_all();
+        }
+};
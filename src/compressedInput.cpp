@@ -0,0 +1,167 @@
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <iostream>
+
+#ifdef WEBSERVER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WEBSERVER_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "compressedInput.h"
+
+/*
+ * @method: decompressionStream
+ * @brief: starts decompressing in the background
+ * @input - compressed: the compressed log (ex. a memory-mapped file), must outlive the stream
+ * @input - format: the compression of the log
+ * @input - chunkSize: approximate size of the decompressed chunks
+ * @input - queueDepth: maximum number of decompressed chunks waiting to be parsed
+ */
+decompressionStream::decompressionStream( std::string_view compressed, compressionFormat format, size_t chunkSize, size_t queueDepth )
+    : compressed( compressed ), format( format ), chunkSize( chunkSize > 0 ? chunkSize : DECOMPRESSED_CHUNK_SIZE ),
+      chunks( queueDepth ), error( false )
+{
+    producer = std::thread( &decompressionStream::produce, this );
+}
+
+decompressionStream::~decompressionStream()
+{
+    // Unblocks the producer if the consumers stopped early
+    chunks.close();
+    producer.join();
+}
+
+/*
+ * @method: detect
+ * @brief: detects the compression of a log from its magic bytes
+ * @input - contents: the start of the log file
+ * @return: returns the compression format, compressionFormat::none for plain text logs
+ */
+compressionFormat decompressionStream::detect( std::string_view contents )
+{
+    if ( contents.size() >= 2 && static_cast <unsigned char>( contents[0] ) == 0x1f && static_cast <unsigned char>( contents[1] ) == 0x8b )
+    {
+        return compressionFormat::gzip;
+    }
+    if ( contents.size() >= 4 && memcmp( contents.data(), "\x28\xb5\x2f\xfd", 4 ) == 0 )
+    {
+        return compressionFormat::zstd;
+    }
+    return compressionFormat::none;
+}
+
+/*
+ * @method: produce
+ * @brief: decompression thread: decompresses the whole input and pushes the chunks, closes the queue at the end
+ */
+void decompressionStream::produce()
+{
+    decompressedChunk pending; // decompressed data not handed out yet
+    bool open = true;
+
+    // Hands out everything up to the last complete line once enough data is pending, the partial line is carried over
+    auto flush = [&]( bool last )
+    {
+        if ( !open || pending.data.empty() || ( !last && pending.data.size() < chunkSize ) )
+        {
+            return;
+        }
+        size_t cut = last ? pending.data.size() : pending.data.rfind( '\n' ) + 1;
+        if ( cut == 0 )
+        {
+            return; // a single line longer than the chunk size: keep accumulating
+        }
+
+        decompressedChunk next;
+        next.offset = pending.offset + cut;
+        next.data.reserve( chunkSize + chunkSize / 4 );
+        next.data.assign( pending.data, cut, std::string::npos );
+        pending.data.resize( cut );
+        open = chunks.push( std::move( pending ) );
+        pending = std::move( next );
+    };
+
+    switch ( format )
+    {
+#ifdef WEBSERVER_HAVE_ZLIB
+        case compressionFormat::gzip:
+        {
+            z_stream stream = {};
+            char output[1 << 16];
+            int status = Z_OK;
+            size_t fed = 0; // bytes of compressed handed to zlib so far
+
+            // 15 + 32: maximum window, detect the gzip header automatically
+            inflateInit2( &stream, 15 + 32 );
+            while ( open )
+            {
+                // avail_in is 32 bits: logs of 4 GB and more are fed in slices
+                if ( stream.avail_in == 0 && fed < compressed.size() )
+                {
+                    stream.next_in = reinterpret_cast <Bytef *>( const_cast <char *>( compressed.data() + fed ) );
+                    stream.avail_in = static_cast <uInt>( std::min <size_t>( compressed.size() - fed, UINT_MAX ) );
+                    fed += stream.avail_in;
+                }
+                stream.next_out = reinterpret_cast <Bytef *>( output );
+                stream.avail_out = sizeof( output );
+                status = inflate( &stream, Z_NO_FLUSH );
+                pending.data.append( output, sizeof( output ) - stream.avail_out );
+                flush( false );
+
+                if ( status == Z_STREAM_END )
+                {
+                    // Concatenated gzip members (ex. appended rotations): continue with the next member
+                    if ( stream.avail_in == 0 && fed == compressed.size() )
+                    {
+                        break;
+                    }
+                    inflateReset( &stream );
+                }
+                else if ( status != Z_OK )
+                {
+                    error = true;
+                    break;
+                }
+            }
+            inflateEnd( &stream );
+            break;
+        }
+#endif
+#ifdef WEBSERVER_HAVE_ZSTD
+        case compressionFormat::zstd:
+        {
+            ZSTD_DStream *stream = ZSTD_createDStream();
+            ZSTD_inBuffer input = { compressed.data(), compressed.size(), 0 };
+            char output[1 << 16];
+            size_t status = 0;
+
+            ZSTD_initDStream( stream );
+            while ( open && ( input.pos < input.size || status != 0 ) )
+            {
+                ZSTD_outBuffer outputBuffer = { output, sizeof( output ), 0 };
+                status = ZSTD_decompressStream( stream, &outputBuffer, &input );
+                if ( ZSTD_isError( status ) || ( outputBuffer.pos == 0 && input.pos == input.size && status != 0 ) )
+                {
+                    // Corrupted frame, or the input ends in the middle of a frame
+                    error = true;
+                    break;
+                }
+                pending.data.append( output, outputBuffer.pos );
+                flush( false );
+            }
+            ZSTD_freeDStream( stream );
+            break;
+        }
+#endif
+        default:
+            std::cerr << "Compressed log format not supported by this build" << std::endl;
+            error = true;
+            break;
+    }
+
+    flush( true );
+    chunks.close();
+}
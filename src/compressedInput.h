@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "boundedQueue.h"
+
+#define DECOMPRESSED_CHUNK_SIZE ( 4 << 20 ) // bytes of decompressed log handed to a parsing thread at a time
+
+/*
+ * @enum: compressionFormat
+ * @brief: compression of a log file, detected from its magic bytes
+ */
+enum class compressionFormat
+{
+    none,
+    gzip, // rotated logs compressed by gzip / logrotate (.gz)
+    zstd  // rotated logs compressed by zstd (.zst), requires building with libzstd
+};
+
+/*
+ * @struct: decompressedChunk
+ * @brief: newline aligned block of decompressed log
+ * @member - data: the decompressed lines
+ * @member - offset: offset of the first byte of data within the whole decompressed log
+ */
+typedef struct decompressedChunk
+{
+    std::string data;
+    uint64_t offset = 0;
+} decompressedChunk;
+
+/*
+ * @class: chunkStream
+ * @brief: producer of the newline aligned chunks of a log, shared by several parsing threads (see webServerAnalyser::scanFiles)
+ */
+class chunkStream
+{
+    public:
+        virtual ~chunkStream() = default;
+
+       /*
+        * @method: next
+        * @brief: waits for the next chunk (can be called concurrently by several parsing threads)
+        * @output - chunk: the next chunk, in file order
+        * @return: returns false once the whole log has been handed out, true otherwise
+        */
+        virtual bool next( decompressedChunk &chunk ) = 0;
+
+       /*
+        * @method: failed
+        * @return: returns true if the log could not be produced entirely
+        */
+        virtual bool failed() const = 0;
+};
+
+/*
+ * @class: decompressionStream
+ * @brief: decompresses a log on its own thread and hands newline aligned chunks to the parsing threads through a
+ *         bounded queue, so that decompression and parsing overlap and at most queueDepth chunks are buffered
+ */
+class decompressionStream : public chunkStream
+{
+    private:
+        std::string_view compressed;
+        compressionFormat format;
+        size_t chunkSize;
+        boundedQueue <decompressedChunk> chunks;
+        std::atomic <bool> error;
+        std::thread producer;
+
+       /*
+        * @method: produce
+        * @brief: decompression thread: decompresses the whole input and pushes the chunks, closes the queue at the end
+        */
+        void produce();
+
+    public:
+       /*
+        * @method: decompressionStream
+        * @brief: starts decompressing in the background
+        * @input - compressed: the compressed log (ex. a memory-mapped file), must outlive the stream
+        * @input - format: the compression of the log
+        * @input - chunkSize: approximate size of the decompressed chunks
+        * @input - queueDepth: maximum number of decompressed chunks waiting to be parsed
+        */
+        decompressionStream( std::string_view compressed, compressionFormat format, size_t chunkSize, size_t queueDepth );
+        ~decompressionStream() override;
+
+        decompressionStream( const decompressionStream & ) = delete;
+        decompressionStream &operator=( const decompressionStream & ) = delete;
+
+       /*
+        * @method: next
+        * @brief: waits for the next decompressed chunk (can be called concurrently by several parsing threads)
+        * @output - chunk: the next chunk, in order of decompression
+        * @return: returns false once the whole log has been handed out, true otherwise
+        */
+        bool next( decompressedChunk &chunk ) override { return chunks.pop( chunk ); }
+
+       /*
+        * @method: failed
+        * @return: returns true if the input is corrupted or the format is not supported by this build
+        */
+        bool failed() const override { return error; }
+
+       /*
+        * @method: detect
+        * @brief: detects the compression of a log from its magic bytes
+        * @input - contents: the start of the log file
+        * @return: returns the compression format, compressionFormat::none for plain text logs
+        */
+        static compressionFormat detect( std::string_view contents );
+};
@@ -0,0 +1,267 @@
+#include <algorithm>
+
+#include "heavyHitters.h"
+
+/*
+ * @method: heavyHitters
+ * @input - topKeys: number of top keys that will be requested, capacity is scaled from it
+ */
+heavyHitters::heavyHitters( size_t topKeys ) : capacity( std::max <size_t>( topKeys * HEAVY_HITTERS_FACTOR, HEAVY_HITTERS_MIN_CAPACITY ) )
+{
+    slots.reserve( capacity );
+    heap.reserve( capacity );
+    heapPosition.reserve( capacity );
+    keyIndex.reserve( capacity );
+}
+
+void heavyHitters::siftDown( size_t position )
+{
+    while ( true )
+    {
+        size_t smallest = position, left = 2 * position + 1, right = left + 1;
+        if ( left < heap.size() && slots[heap[left]].count < slots[heap[smallest]].count )
+        {
+            smallest = left;
+        }
+        if ( right < heap.size() && slots[heap[right]].count < slots[heap[smallest]].count )
+        {
+            smallest = right;
+        }
+        if ( smallest == position )
+        {
+            return;
+        }
+        std::swap( heap[position], heap[smallest] );
+        heapPosition[heap[position]] = position;
+        heapPosition[heap[smallest]] = smallest;
+        position = smallest;
+    }
+}
+
+void heavyHitters::siftUp( size_t position )
+{
+    while ( position > 0 )
+    {
+        size_t parent = ( position - 1 ) / 2;
+        if ( slots[heap[parent]].count <= slots[heap[position]].count )
+        {
+            return;
+        }
+        std::swap( heap[position], heap[parent] );
+        heapPosition[heap[position]] = position;
+        heapPosition[heap[parent]] = parent;
+        position = parent;
+    }
+}
+
+void heavyHitters::insert( std::string_view key, uint64_t count, uint64_t error, uint64_t firstSeen )
+{
+    uint32_t slot = static_cast <uint32_t>( slots.size() );
+    slots.push_back( { std::string( key ), count, error, firstSeen } );
+    heap.push_back( slot );
+    heapPosition.push_back( heap.size() - 1 );
+    keyIndex.emplace( std::string_view( slots[slot].key ), slot );
+    siftUp( heap.size() - 1 );
+}
+
+/*
+ * @method: add
+ * @brief: counts several accesses for the provided key (ex. exact counts computed elsewhere)
+ *         When every counter is in use, the key with the lowest count is replaced and its count inherited as error
+ * @input - key: the key being accessed
+ * @input - count: the number of accesses
+ * @input - position: position of the first access in the input, the earliest position of a key is kept
+ */
+void heavyHitters::add( std::string_view key, uint64_t count, uint64_t position )
+{
+    auto it = keyIndex.find( key );
+    if ( it != keyIndex.end() )
+    {
+        heavyHitter &entry = slots[it->second];
+        entry.count += count;
+        entry.firstSeen = std::min( entry.firstSeen, position );
+        siftDown( heapPosition[it->second] );
+    }
+    else if ( slots.size() < capacity )
+    {
+        insert( key, count, 0, position );
+    }
+    else
+    {
+        // Every counter is in use: the key with the lowest count is replaced by the new key
+        heavyHitter &evicted = slots[heap[0]];
+        keyIndex.erase( evicted.key );
+        evicted.key.assign( key );
+        evicted.error = evicted.count;
+        evicted.count += count;
+        evicted.firstSeen = position;
+        keyIndex.emplace( std::string_view( evicted.key ), heap[0] );
+        siftDown( 0 );
+    }
+}
+
+/*
+ * @method: merge
+ * @brief: combines another summary (ex. a partial result computed by another thread) into this one
+ *         Keys missing from a full summary are accounted with its lowest count, as both count and error
+ * @input - other: the summary to merge
+ */
+void heavyHitters::merge( const heavyHitters &other )
+{
+    std::vector <heavyHitter> combined;
+    uint64_t ownMinimum = minimumCount(), otherMinimum = other.minimumCount();
+
+    // Keys monitored by this summary, with the count of the other summary (or its bound)
+    for (const auto &entry: slots)
+    {
+        heavyHitter merged = entry;
+        auto it = other.keyIndex.find( entry.key );
+        if ( it != other.keyIndex.end() )
+        {
+            const heavyHitter &otherEntry = other.slots[it->second];
+            merged.count += otherEntry.count;
+            merged.error += otherEntry.error;
+            merged.firstSeen = std::min( merged.firstSeen, otherEntry.firstSeen );
+        }
+        else
+        {
+            merged.count += otherMinimum;
+            merged.error += otherMinimum;
+        }
+        combined.push_back( std::move( merged ) );
+    }
+
+    // Keys only monitored by the other summary
+    for (const auto &otherEntry: other.slots)
+    {
+        if ( keyIndex.find( otherEntry.key ) == keyIndex.end() )
+        {
+            heavyHitter merged = otherEntry;
+            merged.count += ownMinimum;
+            merged.error += ownMinimum;
+            combined.push_back( std::move( merged ) );
+        }
+    }
+
+    // Keep the capacity highest counts
+    if ( combined.size() > capacity )
+    {
+        std::nth_element( combined.begin(), combined.begin() + capacity, combined.end(), []( const heavyHitter &lhs, const heavyHitter &rhs )
+        {
+            return lhs.count > rhs.count;
+        } );
+        combined.resize( capacity );
+    }
+
+    slots.clear();
+    heap.clear();
+    heapPosition.clear();
+    keyIndex.clear();
+    for (const auto &entry: combined)
+    {
+        insert( entry.key, entry.count, entry.error, entry.firstSeen );
+    }
+}
+
+/*
+ * @method: save
+ * @brief: serializes the monitored keys with their counts and errors (see webServerAnalyser::saveState)
+ * @output - writer: the state being written
+ */
+void heavyHitters::save( stateWriter &writer ) const
+{
+    writer.number( slots.size() );
+    for (const auto &entry: slots)
+    {
+        writer.text( entry.key );
+        writer.number( entry.count );
+        writer.number( entry.error );
+        writer.number( entry.firstSeen );
+    }
+}
+
+/*
+ * @method: load
+ * @brief: restores the monitored keys serialized by save into an empty summary of the same capacity
+ * @input - reader: the state being read
+ * @return: returns false if the serialized keys are malformed or do not fit the summary
+ */
+bool heavyHitters::load( stateReader &reader )
+{
+    uint64_t savedKeys = reader.number();
+
+    if ( !slots.empty() || savedKeys > capacity )
+    {
+        return false;
+    }
+    for (uint64_t saved = 0; saved < savedKeys && !reader.failed(); saved++)
+    {
+        std::string_view key = reader.text();
+        uint64_t count = reader.number(), error = reader.number(), firstSeen = reader.number();
+        if ( !reader.failed() && keyIndex.find( key ) == keyIndex.end() )
+        {
+            insert( key, count, error, firstSeen );
+        }
+    }
+    return !reader.failed();
+}
+
+/*
+ * @method: rankedResult
+ * @brief: sorts the monitored keys based on the estimated # of accesses, most # of accesses at the top
+ * @input - limit: maximum number of entries to output, 0 outputs every monitored key
+ * @return: returns the keys, their estimated counts and error bounds in ranked order (resultKind::boundedCounts)
+ */
+queryResult heavyHitters::rankedResult( size_t limit ) const
+{
+    std::vector <const heavyHitter *> order;
+    queryResult result( resultKind::boundedCounts );
+    size_t keySize = 0;
+
+    for (const auto &entry: slots)
+    {
+        order.push_back( &entry );
+    }
+
+    auto ranksBefore = []( const heavyHitter *lhs, const heavyHitter *rhs )
+    {
+        if ( lhs->count != rhs->count )
+        {
+            return lhs->count > rhs->count;
+        }
+        return lhs->firstSeen < rhs->firstSeen;
+    };
+    if ( limit > 0 && limit < order.size() )
+    {
+        std::partial_sort( order.begin(), order.begin() + limit, order.end(), ranksBefore );
+        order.resize( limit );
+    }
+    else
+    {
+        std::sort( order.begin(), order.end(), ranksBefore );
+    }
+
+    for (const heavyHitter *entry: order)
+    {
+        keySize += entry->key.size();
+    }
+    result.reserve( order.size(), keySize );
+    for (const heavyHitter *entry: order)
+    {
+        resultRow row;
+        row.count = entry->count;
+        row.error = entry->error;
+        result.add( entry->key, row );
+    }
+
+    return result;
+}
+
+/*
+ * @method: minimumCount
+ * @return: returns the lowest monitored count once every counter is in use (bound of any unmonitored key), 0 otherwise
+ */
+uint64_t heavyHitters::minimumCount() const
+{
+    return slots.size() < capacity || heap.empty() ? 0 : slots[heap[0]].count;
+}
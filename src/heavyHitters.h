@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "stateFile.h"
+#include "queryResult.h"
+
+#define HEAVY_HITTERS_FACTOR 8 // counters kept per requested top key
+#define HEAVY_HITTERS_MIN_CAPACITY 1024
+
+/*
+ * @struct: heavyHitter
+ * @brief: one monitored key of a heavyHitters summary
+ * @member - key: the monitored key
+ * @member - count: estimated number of accesses, never lower than the true count
+ * @member - error: maximum overestimation of count, the true count is within [count - error, count]
+ * @member - firstSeen: position at which the key started being monitored, used to order keys with the same count
+ */
+typedef struct heavyHitter
+{
+    std::string key;
+    uint64_t count = 0;
+    uint64_t error = 0;
+    uint64_t firstSeen = 0;
+} heavyHitter;
+
+/*
+ * @class: heavyHitters
+ * @brief: Space-Saving summary of the most accessed keys, using a fixed number of counters
+ *         When every counter is in use, an unseen key replaces the key with the lowest count and inherits its count as error
+ *         Any key accessed more than total / capacity times is guaranteed to be monitored
+ */
+class heavyHitters
+{
+    private:
+        size_t capacity;
+        std::vector <heavyHitter> slots; // monitored keys, a slot never moves so keyIndex can view its key
+        std::vector <uint32_t> heap; // slot numbers, min-heap on count
+        std::vector <uint32_t> heapPosition; // position of each slot within heap
+        std::unordered_map <std::string_view, uint32_t> keyIndex; // key -> slot number
+
+        void siftDown( size_t position );
+        void siftUp( size_t position );
+        void insert( std::string_view key, uint64_t count, uint64_t error, uint64_t firstSeen );
+
+    public:
+       /*
+        * @method: heavyHitters
+        * @input - topKeys: number of top keys that will be requested, capacity is scaled from it
+        */
+        explicit heavyHitters( size_t topKeys );
+
+        // keyIndex views the keys held by slots: a copy would view the keys of the original, moves keep the slots in place
+        heavyHitters( const heavyHitters & ) = delete;
+        heavyHitters &operator=( const heavyHitters & ) = delete;
+        heavyHitters( heavyHitters && ) = default;
+        heavyHitters &operator=( heavyHitters && ) = default;
+
+       /*
+        * @method: increment
+        * @brief: counts one access for the provided key
+        * @input - key: the key being accessed
+        * @input - position: position of the access in the input (ex. byte offset of the line)
+        */
+        void increment( std::string_view key, uint64_t position ) { add( key, 1, position ); }
+
+       /*
+        * @method: add
+        * @brief: counts several accesses for the provided key (ex. exact counts computed elsewhere)
+        *         When every counter is in use, the key with the lowest count is replaced and its count inherited as error
+        * @input - key: the key being accessed
+        * @input - count: the number of accesses
+        * @input - position: position of the first access in the input, the earliest position of a key is kept
+        */
+        void add( std::string_view key, uint64_t count, uint64_t position );
+
+       /*
+        * @method: merge
+        * @brief: combines another summary (ex. a partial result computed by another thread) into this one
+        *         Keys missing from a full summary are accounted with its lowest count, as both count and error
+        * @input - other: the summary to merge
+        */
+        void merge( const heavyHitters &other );
+
+       /*
+        * @method: save
+        * @brief: serializes the monitored keys with their counts and errors (see webServerAnalyser::saveState)
+        * @output - writer: the state being written
+        */
+        void save( stateWriter &writer ) const;
+
+       /*
+        * @method: load
+        * @brief: restores the monitored keys serialized by save into an empty summary of the same capacity
+        * @input - reader: the state being read
+        * @return: returns false if the serialized keys are malformed or do not fit the summary
+        */
+        bool load( stateReader &reader );
+
+       /*
+        * @method: rankedResult
+        * @brief: sorts the monitored keys based on the estimated # of accesses, most # of accesses at the top
+        * @input - limit: maximum number of entries to output, 0 outputs every monitored key
+        * @return: returns the keys, their estimated counts and error bounds in ranked order (resultKind::boundedCounts)
+        */
+        queryResult rankedResult( size_t limit = 0 ) const;
+
+       /*
+        * @method: rankedOutput
+        * @brief: sorts the monitored keys based on the estimated # of accesses, most # of accesses at the top
+        * @input - limit: maximum number of entries to output, 0 outputs every monitored key
+        * @return: returns the "key count" entries in ranked order, followed by "(error <= e)" for estimated counts
+        */
+        std::vector <std::string> rankedOutput( size_t limit = 0 ) const { return rankedResult( limit ).text(); }
+
+       /*
+        * @method: minimumCount
+        * @return: returns the lowest monitored count once every counter is in use (bound of any unmonitored key), 0 otherwise
+        */
+        uint64_t minimumCount() const;
+
+       /*
+        * @method: size
+        * @return: returns the number of monitored keys
+        */
+        size_t size() const { return slots.size(); }
+
+       /*
+        * @method: loadFactor
+        * @return: returns the fraction of the counters in use
+        */
+        double loadFactor() const { return static_cast <double>( slots.size() ) / capacity; }
+};
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <numeric>
+
+#include "keyCounter.h"
+
+/*
+ * @method: findSlot
+ * @brief: probes the table for the provided key
+ * @return: returns the slot holding the key, or the empty slot where it would be inserted
+ */
+size_t keyCounter::findSlot( std::string_view key, uint64_t hash ) const
+{
+    size_t mask = table.size() - 1;
+
+    for (size_t slot = hash & mask; ; slot = ( slot + 1 ) & mask)
+    {
+        uint32_t entry = table[slot];
+        if ( entry == 0 || ( hashes[entry - 1] == hash && keys[entry - 1] == key ) )
+        {
+            return slot;
+        }
+    }
+}
+
+/*
+ * @method: insertKey
+ * @brief: interns a new key into the arena and assigns its ID
+ * @input - slot: the empty slot returned by findSlot for the key
+ * @return: returns the ID of the new key
+ */
+size_t keyCounter::insertKey( size_t slot, std::string_view key, uint64_t hash, const keyCount &count )
+{
+    // Copy the key at the end of the arena, keys larger than a block get a block of their own (an empty first key too)
+    if ( arenaBlocks.empty() || arenaUsed + key.size() > arenaBlockSize )
+    {
+        arenaBlockSize = std::min <size_t>( std::max <size_t>( arenaBlockSize * 2, KEY_ARENA_MIN_BLOCK_SIZE ), KEY_ARENA_MAX_BLOCK_SIZE );
+        arenaBlockSize = std::max( arenaBlockSize, key.size() );
+        arenaBlocks.emplace_back( new char[arenaBlockSize] );
+        arenaBytes += arenaBlockSize;
+        arenaUsed = 0;
+    }
+    char *storage = arenaBlocks.back().get() + arenaUsed;
+    std::copy( key.begin(), key.end(), storage );
+    arenaUsed += key.size();
+
+    size_t id = keys.size();
+    keys.emplace_back( storage, key.size() );
+    hashes.push_back( hash );
+    counts.push_back( count );
+    table[slot] = static_cast <uint32_t>( id + 1 );
+
+    // Keep the load factor at or below 1/2 so that probe sequences stay short
+    if ( keys.size() * 2 > table.size() )
+    {
+        std::vector <uint32_t> grownTable( table.size() * 2, 0 );
+        size_t mask = grownTable.size() - 1;
+        for (size_t grownId = 0; grownId < keys.size(); grownId++)
+        {
+            size_t grownSlot = hashes[grownId] & mask;
+            while ( grownTable[grownSlot] != 0 )
+            {
+                grownSlot = ( grownSlot + 1 ) & mask;
+            }
+            grownTable[grownSlot] = static_cast <uint32_t>( grownId + 1 );
+        }
+        table.swap( grownTable );
+    }
+
+    return id;
+}
+
+/*
+ * @method: increment
+ * @brief: counts one access for the provided key
+ * @input - key: the key being accessed, only copied if it has never been seen before
+ * @input - position: position of the access in the input (ex. byte offset of the line)
+ * @return: returns the ID of the key, IDs are dense and assigned in order of first appearance
+ */
+size_t keyCounter::increment( std::string_view key, uint64_t position )
+{
+    if ( table.empty() )
+    {
+        table.assign( KEY_TABLE_MIN_SIZE, 0 );
+    }
+
+    uint64_t hash = std::hash <std::string_view>()( key );
+    size_t slot = findSlot( key, hash );
+    if ( table[slot] == 0 )
+    {
+        // First time the key is seen: intern it
+        return insertKey( slot, key, hash, { 1, position } );
+    }
+
+    // Workers do not always visit the input in order: keep the earliest position of the key
+    keyCount &entry = counts[table[slot] - 1];
+    entry.count++;
+    entry.firstSeen = std::min( entry.firstSeen, position );
+    return table[slot] - 1;
+}
+
+/*
+ * @method: add
+ * @brief: adds an aggregated count to the provided key
+ * @input - key: the key being counted, only copied if it has never been seen before
+ * @input - count: the count to add, the earliest first seen position is kept
+ * @return: returns the ID of the key
+ */
+size_t keyCounter::add( std::string_view key, const keyCount &count )
+{
+    return addHashed( key, std::hash <std::string_view>()( key ), count );
+}
+
+/*
+ * @method: addHashed
+ * @brief: adds an aggregated count to the provided key, whose hash is already known
+ * @return: returns the ID of the key
+ */
+size_t keyCounter::addHashed( std::string_view key, uint64_t hash, const keyCount &count )
+{
+    if ( table.empty() )
+    {
+        table.assign( KEY_TABLE_MIN_SIZE, 0 );
+    }
+
+    size_t slot = findSlot( key, hash );
+    if ( table[slot] == 0 )
+    {
+        return insertKey( slot, key, hash, count );
+    }
+
+    keyCount &current = counts[table[slot] - 1];
+    current.count += count.count;
+    current.firstSeen = std::min( current.firstSeen, count.firstSeen );
+    return table[slot] - 1;
+}
+
+/*
+ * @method: merge
+ * @brief: adds the counts of another keyCounter (ex. a partial result computed by another thread)
+ * @input - other: the keyCounter to merge, counts are summed and the earliest first seen position is kept
+ */
+void keyCounter::merge( const keyCounter &other )
+{
+    for (size_t otherId = 0; otherId < other.counts.size(); otherId++)
+    {
+        addHashed( other.keys[otherId], other.hashes[otherId], other.counts[otherId] );
+    }
+}
+
+/*
+ * @method: save
+ * @brief: serializes the keys (a dictionary in ID order) and their counts (see webServerAnalyser::saveState)
+ * @output - writer: the state being written
+ */
+void keyCounter::save( stateWriter &writer ) const
+{
+    writer.number( keys.size() );
+    for (size_t id = 0; id < keys.size(); id++)
+    {
+        writer.text( keys[id] );
+        writer.number( counts[id].count );
+        writer.number( counts[id].firstSeen );
+    }
+}
+
+/*
+ * @method: load
+ * @brief: adds the keys and counts serialized by save, like merge
+ * @input - reader: the state being read
+ * @return: returns false if the serialized keys are malformed
+ */
+bool keyCounter::load( stateReader &reader )
+{
+    uint64_t savedKeys = reader.number();
+
+    for (uint64_t saved = 0; saved < savedKeys && !reader.failed(); saved++)
+    {
+        std::string_view key = reader.text();
+        keyCount count;
+        count.count = reader.number();
+        count.firstSeen = reader.number();
+        if ( !reader.failed() )
+        {
+            add( key, count );
+        }
+    }
+    return !reader.failed();
+}
+
+/*
+ * @method: rankedKeys
+ * @brief: sorts the keys based on the # of accesses, most # of accesses at the top
+ * @input - limit: maximum number of keys to return, 0 returns every key
+ * @return: returns the key IDs in ranked order
+ */
+std::vector <size_t> keyCounter::rankedKeys( size_t limit ) const
+{
+    std::vector <size_t> order( counts.size() );
+
+    // Sort key IDs by count, ties are broken by the position the key was first seen at
+    auto ranksBefore = [this]( size_t lhs, size_t rhs )
+    {
+        if ( counts[lhs].count != counts[rhs].count )
+        {
+            return counts[lhs].count > counts[rhs].count;
+        }
+        return counts[lhs].firstSeen < counts[rhs].firstSeen;
+    };
+    std::iota( order.begin(), order.end(), 0 );
+    if ( limit > 0 && limit < order.size() )
+    {
+        // Only the top entries are requested: partial selection instead of a full sort
+        std::partial_sort( order.begin(), order.begin() + limit, order.end(), ranksBefore );
+        order.resize( limit );
+    }
+    else
+    {
+        std::sort( order.begin(), order.end(), ranksBefore );
+    }
+
+    return order;
+}
+
+/*
+ * @method: rankedResult
+ * @brief: sorts the keys based on the # of accesses, most # of accesses at the top
+ * @input - limit: maximum number of entries to output, 0 outputs every key
+ * @return: returns the keys and their counts in ranked order (resultKind::counts)
+ */
+queryResult keyCounter::rankedResult( size_t limit ) const
+{
+    std::vector <size_t> order = rankedKeys( limit );
+    queryResult result( resultKind::counts );
+    size_t keySize = 0;
+
+    for (size_t id: order)
+    {
+        keySize += keys[id].size();
+    }
+    result.reserve( order.size(), keySize );
+    for (size_t id: order)
+    {
+        resultRow row;
+        row.count = counts[id].count;
+        result.add( keys[id], row );
+    }
+
+    return result;
+}
+
+/*
+ * @method: memoryUsage
+ * @return: returns the approximate number of bytes held by the keyCounter
+ */
+size_t keyCounter::memoryUsage() const
+{
+    return arenaBytes + keys.capacity() * sizeof( std::string_view ) +
+           hashes.capacity() * sizeof( uint64_t ) + counts.capacity() * sizeof( keyCount ) + table.capacity() * sizeof( uint32_t );
+}
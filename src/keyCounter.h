@@ -0,0 +1,163 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "stateFile.h"
+#include "queryResult.h"
+
+#define KEY_ARENA_MIN_BLOCK_SIZE ( 4 << 10 ) // arena blocks double in size from KEY_ARENA_MIN_BLOCK_SIZE
+#define KEY_ARENA_MAX_BLOCK_SIZE ( 1 << 20 ) // up to KEY_ARENA_MAX_BLOCK_SIZE
+#define KEY_TABLE_MIN_SIZE 64 // initial number of slots of the open addressing table
+
+/*
+ * @struct: keyCount
+ * @brief: aggregated statistics of a single key (host or resource)
+ * @member - count: number of accesses counted for the key
+ * @member - firstSeen: position of the first counted access, used to order keys with the same count
+ */
+typedef struct keyCount
+{
+    uint64_t count = 0;
+    uint64_t firstSeen = 0;
+} keyCount;
+
+/*
+ * @class: keyCounter
+ * @brief: counts accesses per key, copying a key only the first time it is seen
+ *         Each distinct key is interned once into a contiguous arena and given a dense ID, counts live in a flat array
+ *         indexed by ID and keys are looked up through an open addressing table of IDs (linear probing)
+ *         Keys are ranked by count (highest first), ties are ranked by first appearance in the input
+ */
+class keyCounter
+{
+    private:
+        std::vector <std::unique_ptr <char []>> arenaBlocks; // key storage, a block never moves so keys can view it
+        size_t arenaBlockSize = 0; // size of the last arena block
+        size_t arenaUsed = 0; // bytes used in the last arena block
+        size_t arenaBytes = 0; // total size of the arena blocks
+        std::vector <std::string_view> keys; // indexed by key ID, views into the arena
+        std::vector <uint64_t> hashes; // indexed by key ID, kept to grow the table without hashing again
+        std::vector <keyCount> counts; // indexed by key ID
+        std::vector <uint32_t> table; // open addressing table: key ID + 1, 0 for an empty slot
+
+       /*
+        * @method: findSlot
+        * @brief: probes the table for the provided key
+        * @return: returns the slot holding the key, or the empty slot where it would be inserted
+        */
+        size_t findSlot( std::string_view key, uint64_t hash ) const;
+
+       /*
+        * @method: insertKey
+        * @brief: interns a new key into the arena and assigns its ID
+        * @input - slot: the empty slot returned by findSlot for the key
+        * @return: returns the ID of the new key
+        */
+        size_t insertKey( size_t slot, std::string_view key, uint64_t hash, const keyCount &count );
+
+       /*
+        * @method: addHashed
+        * @brief: adds an aggregated count to the provided key, whose hash is already known
+        * @return: returns the ID of the key
+        */
+        size_t addHashed( std::string_view key, uint64_t hash, const keyCount &count );
+
+    public:
+       /*
+        * @method: increment
+        * @brief: counts one access for the provided key
+        * @input - key: the key being accessed, only copied if it has never been seen before
+        * @input - position: position of the access in the input (ex. byte offset of the line)
+        * @return: returns the ID of the key, IDs are dense and assigned in order of first appearance
+        */
+        size_t increment( std::string_view key, uint64_t position );
+
+       /*
+        * @method: add
+        * @brief: adds an aggregated count to the provided key
+        * @input - key: the key being counted, only copied if it has never been seen before
+        * @input - count: the count to add, the earliest first seen position is kept
+        * @return: returns the ID of the key
+        */
+        size_t add( std::string_view key, const keyCount &count );
+
+       /*
+        * @method: merge
+        * @brief: adds the counts of another keyCounter (ex. a partial result computed by another thread)
+        * @input - other: the keyCounter to merge, counts are summed and the earliest first seen position is kept
+        */
+        void merge( const keyCounter &other );
+
+       /*
+        * @method: save
+        * @brief: serializes the keys (a dictionary in ID order) and their counts (see webServerAnalyser::saveState)
+        * @output - writer: the state being written
+        */
+        void save( stateWriter &writer ) const;
+
+       /*
+        * @method: load
+        * @brief: adds the keys and counts serialized by save, like merge
+        * @input - reader: the state being read
+        * @return: returns false if the serialized keys are malformed
+        */
+        bool load( stateReader &reader );
+
+       /*
+        * @method: rankedKeys
+        * @brief: sorts the keys based on the # of accesses, most # of accesses at the top
+        * @input - limit: maximum number of keys to return, 0 returns every key
+        * @return: returns the key IDs in ranked order
+        */
+        std::vector <size_t> rankedKeys( size_t limit = 0 ) const;
+
+       /*
+        * @method: rankedResult
+        * @brief: sorts the keys based on the # of accesses, most # of accesses at the top
+        * @input - limit: maximum number of entries to output, 0 outputs every key
+        * @return: returns the keys and their counts in ranked order (resultKind::counts)
+        */
+        queryResult rankedResult( size_t limit = 0 ) const;
+
+       /*
+        * @method: rankedOutput
+        * @brief: sorts the keys based on the # of accesses, most # of accesses at the top
+        * @input - limit: maximum number of entries to output, 0 outputs every key
+        * @return: returns the "key count" entries in ranked order
+        */
+        std::vector <std::string> rankedOutput( size_t limit = 0 ) const { return rankedResult( limit ).text(); }
+
+       /*
+        * @method: size
+        * @return: returns the number of distinct keys counted
+        */
+        size_t size() const { return counts.size(); }
+
+       /*
+        * @method: key
+        * @return: returns the key with the provided ID, valid for the lifetime of the keyCounter
+        */
+        std::string_view key( size_t id ) const { return keys[id]; }
+
+       /*
+        * @method: count
+        * @return: returns the count of the key with the provided ID
+        */
+        const keyCount &count( size_t id ) const { return counts[id]; }
+
+       /*
+        * @method: loadFactor
+        * @return: returns the fraction of the open addressing table slots in use
+        */
+        double loadFactor() const { return table.empty() ? 0 : static_cast <double>( counts.size() ) / table.size(); }
+
+       /*
+        * @method: memoryUsage
+        * @return: returns the approximate number of bytes held by the keyCounter
+        */
+        size_t memoryUsage() const;
+};
@@ -0,0 +1,502 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "keySketch.h"
+
+/*
+ * @method: mixHash
+ * @brief: finalizes a hash (splitmix64) so that every bit of it is usable by the registers, whatever the hash function
+ */
+static uint64_t mixHash( uint64_t hash )
+{
+    hash = ( hash ^ ( hash >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+    hash = ( hash ^ ( hash >> 27 ) ) * 0x94D049BB133111EBull;
+    return hash ^ ( hash >> 31 );
+}
+
+/*
+ * @method: setRegister
+ * @brief: raises a register to the provided rank
+ */
+void distinctSketch::setRegister( uint32_t index, uint8_t rank )
+{
+    if ( !registers.empty() )
+    {
+        registers[index] = std::max( registers[index], rank );
+        return;
+    }
+
+    auto entry = std::lower_bound( sparse.begin(), sparse.end(), index << 8 );
+    if ( entry != sparse.end() && ( *entry >> 8 ) == index )
+    {
+        *entry = std::max( *entry, ( index << 8 ) | rank );
+        return;
+    }
+    sparse.insert( entry, ( index << 8 ) | rank );
+
+    // Past DISTINCT_SPARSE_LIMIT registers, the dense array is smaller
+    if ( sparse.size() > DISTINCT_SPARSE_LIMIT )
+    {
+        registers.assign( DISTINCT_REGISTERS, 0 );
+        for (uint32_t sparseEntry: sparse)
+        {
+            registers[sparseEntry >> 8] = static_cast <uint8_t>( sparseEntry & 0xFF );
+        }
+        std::vector <uint32_t>().swap( sparse );
+    }
+}
+
+/*
+ * @method: add
+ * @brief: counts a value
+ * @input - hash: 64-bit hash of the value (ex. std::hash of the host), mixed again before use
+ */
+void distinctSketch::add( uint64_t hash )
+{
+    // The first DISTINCT_PRECISION bits select the register, the rank is the position of the first 1 in the others
+    uint64_t mixed = mixHash( hash );
+    uint64_t remaining = mixed << DISTINCT_PRECISION;
+    uint8_t rank = remaining == 0 ? 64 - DISTINCT_PRECISION + 1 : static_cast <uint8_t>( __builtin_clzll( remaining ) + 1 );
+
+    setRegister( static_cast <uint32_t>( mixed >> ( 64 - DISTINCT_PRECISION ) ), rank );
+}
+
+/*
+ * @method: merge
+ * @brief: adds the values of another distinctSketch, the result is the same in any merge order
+ */
+void distinctSketch::merge( const distinctSketch &other )
+{
+    for (uint32_t entry: other.sparse)
+    {
+        setRegister( entry >> 8, static_cast <uint8_t>( entry & 0xFF ) );
+    }
+    for (uint32_t index = 0; index < other.registers.size(); index++)
+    {
+        if ( other.registers[index] > 0 )
+        {
+            setRegister( index, other.registers[index] );
+        }
+    }
+}
+
+/*
+ * @method: estimate
+ * @return: returns the estimated number of distinct values (linear counting while few registers are in use)
+ */
+uint64_t distinctSketch::estimate() const
+{
+    const double registerCount = DISTINCT_REGISTERS;
+    double inverseSum = 0;
+    size_t zeros = 0;
+
+    if ( registers.empty() )
+    {
+        zeros = DISTINCT_REGISTERS - sparse.size();
+        inverseSum = static_cast <double>( zeros );
+        for (uint32_t entry: sparse)
+        {
+            inverseSum += std::ldexp( 1.0, -static_cast <int>( entry & 0xFF ) );
+        }
+    }
+    else
+    {
+        for (uint8_t rank: registers)
+        {
+            zeros += rank == 0 ? 1 : 0;
+            inverseSum += std::ldexp( 1.0, -static_cast <int>( rank ) );
+        }
+    }
+
+    double estimate = 0.7213 / ( 1 + 1.079 / registerCount ) * registerCount * registerCount / inverseSum;
+    if ( estimate <= 2.5 * registerCount && zeros > 0 )
+    {
+        estimate = registerCount * std::log( registerCount / zeros );
+    }
+    return static_cast <uint64_t>( std::llround( estimate ) );
+}
+
+/*
+ * @method: save
+ * @brief: serializes the registers in use
+ * @output - writer: the state being written
+ */
+void distinctSketch::save( stateWriter &writer ) const
+{
+    writer.number( registers.empty() ? 0 : 1 );
+    if ( registers.empty() )
+    {
+        writer.number( sparse.size() );
+        for (uint32_t entry: sparse)
+        {
+            writer.number( entry );
+        }
+        return;
+    }
+    writer.text( std::string_view( reinterpret_cast <const char *>( registers.data() ), registers.size() ) );
+}
+
+/*
+ * @method: load
+ * @brief: adds the registers serialized by save, like merge
+ * @input - reader: the state being read
+ * @return: returns false if the serialized registers are malformed
+ */
+bool distinctSketch::load( stateReader &reader )
+{
+    if ( reader.number() == 0 )
+    {
+        uint64_t entries = reader.number();
+        for (uint64_t entry = 0; entry < entries && !reader.failed(); entry++)
+        {
+            uint64_t value = reader.number();
+            if ( ( value >> 8 ) >= DISTINCT_REGISTERS )
+            {
+                return false;
+            }
+            setRegister( static_cast <uint32_t>( value >> 8 ), static_cast <uint8_t>( value & 0xFF ) );
+        }
+        return !reader.failed();
+    }
+
+    std::string_view dense = reader.text();
+    if ( reader.failed() || dense.size() != DISTINCT_REGISTERS )
+    {
+        return false;
+    }
+    for (uint32_t index = 0; index < DISTINCT_REGISTERS; index++)
+    {
+        if ( dense[index] != 0 )
+        {
+            setRegister( index, static_cast <uint8_t>( dense[index] ) );
+        }
+    }
+    return true;
+}
+
+/*
+ * @method: bucketIndex
+ * @return: returns the bucket of a value
+ */
+uint16_t quantileSketch::bucketIndex( uint64_t value )
+{
+    if ( value < ( 1u << QUANTILE_SUB_BITS ) )
+    {
+        return static_cast <uint16_t>( value );
+    }
+
+    // Power of two of the value, then its next QUANTILE_SUB_BITS bits
+    int exponent = 63 - __builtin_clzll( value );
+    uint64_t subBucket = ( value >> ( exponent - QUANTILE_SUB_BITS ) ) & ( ( 1u << QUANTILE_SUB_BITS ) - 1 );
+    return static_cast <uint16_t>( ( ( exponent - QUANTILE_SUB_BITS + 1 ) << QUANTILE_SUB_BITS ) | subBucket );
+}
+
+/*
+ * @method: bucketValue
+ * @return: returns the value reported for a bucket, the middle of its range
+ */
+uint64_t quantileSketch::bucketValue( uint16_t bucket )
+{
+    if ( bucket < ( 1u << QUANTILE_SUB_BITS ) )
+    {
+        return bucket;
+    }
+
+    int shift = ( bucket >> QUANTILE_SUB_BITS ) - 1;
+    uint64_t lowest = ( ( 1ull << QUANTILE_SUB_BITS ) + ( bucket & ( ( 1u << QUANTILE_SUB_BITS ) - 1 ) ) ) << shift;
+    return lowest + ( ( 1ull << shift ) - 1 ) / 2;
+}
+
+/*
+ * @method: addBucket
+ * @brief: counts values in a bucket
+ */
+void quantileSketch::addBucket( uint16_t bucket, uint64_t count )
+{
+    auto position = std::lower_bound( buckets.begin(), buckets.end(), bucket );
+    size_t slot = position - buckets.begin();
+
+    total += count;
+    if ( position != buckets.end() && *position == bucket )
+    {
+        counts[slot] += count;
+        return;
+    }
+    buckets.insert( position, bucket );
+    counts.insert( counts.begin() + slot, count );
+}
+
+/*
+ * @method: add
+ * @brief: counts a value
+ */
+void quantileSketch::add( uint64_t value )
+{
+    addBucket( bucketIndex( value ), 1 );
+}
+
+/*
+ * @method: merge
+ * @brief: adds the values of another quantileSketch, the result is the same in any merge order
+ */
+void quantileSketch::merge( const quantileSketch &other )
+{
+    for (size_t slot = 0; slot < other.buckets.size(); slot++)
+    {
+        addBucket( other.buckets[slot], other.counts[slot] );
+    }
+}
+
+/*
+ * @method: quantile
+ * @input - fraction: the percentile requested, from 0 to 1 (ex. 0.95)
+ * @return: returns the value at the provided percentile (nearest rank), 0 if no value was counted
+ */
+uint64_t quantileSketch::quantile( double fraction ) const
+{
+    uint64_t rank = std::max <uint64_t>( static_cast <uint64_t>( std::ceil( fraction * total ) ), 1 );
+    uint64_t counted = 0;
+
+    for (size_t slot = 0; slot < buckets.size(); slot++)
+    {
+        counted += counts[slot];
+        if ( counted >= rank )
+        {
+            return bucketValue( buckets[slot] );
+        }
+    }
+    return 0;
+}
+
+/*
+ * @method: save
+ * @brief: serializes the buckets in use
+ * @output - writer: the state being written
+ */
+void quantileSketch::save( stateWriter &writer ) const
+{
+    writer.number( buckets.size() );
+    for (size_t slot = 0; slot < buckets.size(); slot++)
+    {
+        writer.number( buckets[slot] );
+        writer.number( counts[slot] );
+    }
+}
+
+/*
+ * @method: load
+ * @brief: adds the buckets serialized by save, like merge
+ * @input - reader: the state being read
+ * @return: returns false if the serialized buckets are malformed
+ */
+bool quantileSketch::load( stateReader &reader )
+{
+    uint64_t savedBuckets = reader.number();
+
+    for (uint64_t saved = 0; saved < savedBuckets && !reader.failed(); saved++)
+    {
+        uint64_t bucket = reader.number();
+        uint64_t count = reader.number();
+        if ( bucket >= QUANTILE_BUCKETS )
+        {
+            return false;
+        }
+        addBucket( static_cast <uint16_t>( bucket ), count );
+    }
+    return !reader.failed();
+}
+
+/*
+ * @method: add
+ * @brief: counts one access for the provided key and adds its value to the sketch of the key
+ * @input - key: the key being accessed, only copied if it has never been seen before
+ * @input - value: hash of the host for distinct hosts, reply size for size percentiles
+ * @input - position: position of the access in the input, used to order keys with the same rank
+ */
+void sketchCounter::add( std::string_view key, uint64_t value, uint64_t position )
+{
+    size_t id = keys.increment( key, position );
+
+    if ( metric == queryMetric::distinctHosts )
+    {
+        if ( id == distinct.size() )
+        {
+            distinct.emplace_back();
+        }
+        distinct[id].add( value );
+        return;
+    }
+    if ( id == quantiles.size() )
+    {
+        quantiles.emplace_back();
+    }
+    quantiles[id].add( value );
+}
+
+/*
+ * @method: merge
+ * @brief: adds the keys and sketches of another sketchCounter of the same metric (ex. computed by another thread)
+ */
+void sketchCounter::merge( const sketchCounter &other )
+{
+    for (size_t otherId = 0; otherId < other.keys.size(); otherId++)
+    {
+        size_t id = keys.add( other.keys.key( otherId ), other.keys.count( otherId ) );
+        if ( metric == queryMetric::distinctHosts )
+        {
+            distinct.resize( keys.size() );
+            distinct[id].merge( other.distinct[otherId] );
+        }
+        else
+        {
+            quantiles.resize( keys.size() );
+            quantiles[id].merge( other.quantiles[otherId] );
+        }
+    }
+}
+
+/*
+ * @method: save
+ * @brief: serializes the keys with their counts, first positions and sketches (see webServerAnalyser::saveState)
+ * @output - writer: the state being written
+ */
+void sketchCounter::save( stateWriter &writer ) const
+{
+    writer.number( keys.size() );
+    for (size_t id = 0; id < keys.size(); id++)
+    {
+        writer.text( keys.key( id ) );
+        writer.number( keys.count( id ).count );
+        writer.number( keys.count( id ).firstSeen );
+        if ( metric == queryMetric::distinctHosts )
+        {
+            distinct[id].save( writer );
+        }
+        else
+        {
+            quantiles[id].save( writer );
+        }
+    }
+}
+
+/*
+ * @method: load
+ * @brief: adds the keys and sketches serialized by save, like merge
+ * @input - reader: the state being read
+ * @return: returns false if the serialized keys are malformed
+ */
+bool sketchCounter::load( stateReader &reader )
+{
+    uint64_t savedKeys = reader.number();
+
+    for (uint64_t saved = 0; saved < savedKeys && !reader.failed(); saved++)
+    {
+        std::string_view key = reader.text();
+        keyCount count;
+        count.count = reader.number();
+        count.firstSeen = reader.number();
+        if ( reader.failed() )
+        {
+            break;
+        }
+
+        size_t id = keys.add( key, count );
+        bool loaded;
+        if ( metric == queryMetric::distinctHosts )
+        {
+            distinct.resize( keys.size() );
+            loaded = distinct[id].load( reader );
+        }
+        else
+        {
+            quantiles.resize( keys.size() );
+            loaded = quantiles[id].load( reader );
+        }
+        if ( !loaded )
+        {
+            return false;
+        }
+    }
+    return !reader.failed();
+}
+
+/*
+ * @method: rankedResult
+ * @brief: estimates the sketch of each key
+ *         distinct hosts per key (resultKind::distinctHosts), most distinct hosts at the top
+ *         requests and p50, p95, p99 reply sizes per key (resultKind::sizeQuantiles), most requests at the top
+ *         Ties are ranked by the position the key was first seen at
+ * @input - limit: maximum number of entries to output, 0 outputs every key
+ * @return: returns the keys and their estimates in ranked order
+ */
+queryResult sketchCounter::rankedResult( size_t limit ) const
+{
+    std::vector <size_t> order( keys.size() );
+    std::vector <uint64_t> ranks( keys.size() );
+    queryResult result( metric == queryMetric::distinctHosts ? resultKind::distinctHosts : resultKind::sizeQuantiles );
+    size_t keySize = 0;
+
+    // Distinct hosts are estimated once per key, then sorted like keyCounter::rankedOutput
+    for (size_t id = 0; id < keys.size(); id++)
+    {
+        ranks[id] = metric == queryMetric::distinctHosts ? distinct[id].estimate() : keys.count( id ).count;
+    }
+    auto ranksBefore = [&]( size_t lhs, size_t rhs )
+    {
+        if ( ranks[lhs] != ranks[rhs] )
+        {
+            return ranks[lhs] > ranks[rhs];
+        }
+        return keys.count( lhs ).firstSeen < keys.count( rhs ).firstSeen;
+    };
+    std::iota( order.begin(), order.end(), 0 );
+    if ( limit > 0 && limit < order.size() )
+    {
+        std::partial_sort( order.begin(), order.begin() + limit, order.end(), ranksBefore );
+        order.resize( limit );
+    }
+    else
+    {
+        std::sort( order.begin(), order.end(), ranksBefore );
+    }
+
+    for (size_t id: order)
+    {
+        keySize += keys.key( id ).size();
+    }
+    result.reserve( order.size(), keySize );
+    for (size_t id: order)
+    {
+        resultRow row;
+        row.count = ranks[id];
+        if ( metric == queryMetric::sizeQuantiles )
+        {
+            row.quantiles[0] = quantiles[id].quantile( 0.5 );
+            row.quantiles[1] = quantiles[id].quantile( 0.95 );
+            row.quantiles[2] = quantiles[id].quantile( 0.99 );
+        }
+        result.add( keys.key( id ), row );
+    }
+
+    return result;
+}
+
+/*
+ * @method: memoryUsage
+ * @return: returns the approximate number of bytes held by the keys and their sketches
+ */
+size_t sketchCounter::memoryUsage() const
+{
+    size_t bytes = keys.memoryUsage() + distinct.capacity() * sizeof( distinctSketch ) + quantiles.capacity() * sizeof( quantileSketch );
+
+    for (const auto &sketch: distinct)
+    {
+        bytes += sketch.memoryUsage();
+    }
+    for (const auto &sketch: quantiles)
+    {
+        bytes += sketch.memoryUsage();
+    }
+    return bytes;
+}
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "keyCounter.h"
+#include "stateFile.h"
+#include "queryResult.h"
+
+#define DISTINCT_PRECISION 12 // HyperLogLog registers: 1 << DISTINCT_PRECISION, standard error 1.04 / sqrt( registers ) = 1.6%
+#define DISTINCT_REGISTERS ( 1 << DISTINCT_PRECISION )
+#define DISTINCT_SPARSE_LIMIT ( DISTINCT_REGISTERS / 4 ) // sparse registers kept before switching to the dense array
+#define QUANTILE_SUB_BITS 6 // sub-buckets per power of two: 1 << QUANTILE_SUB_BITS, relative error 1 / 128
+#define QUANTILE_BUCKETS ( ( 64 - QUANTILE_SUB_BITS + 1 ) << QUANTILE_SUB_BITS ) // buckets covering every uint64_t value
+
+/*
+ * @enum: queryMetric
+ * @brief: what a query aggregates for each of its keys
+ */
+enum class queryMetric
+{
+    accesses,      // number of accesses (see keyCounter)
+    distinctHosts, // number of distinct hosts (see distinctSketch)
+    sizeQuantiles  // percentiles of the reply sizes (see quantileSketch)
+};
+
+/*
+ * @class: distinctSketch
+ * @brief: HyperLogLog estimate of the number of distinct values (ex. hosts of a resource), mergeable and order independent
+ *         Registers are kept sparse, as (register << 8) | rank entries sorted by register, until DISTINCT_SPARSE_LIMIT
+ *         registers are in use: a key seen from a few hosts costs a few bytes, any key at most DISTINCT_REGISTERS bytes
+ */
+class distinctSketch
+{
+    private:
+        std::vector <uint32_t> sparse;
+        std::vector <uint8_t> registers; // dense registers, empty while sparse
+
+       /*
+        * @method: setRegister
+        * @brief: raises a register to the provided rank
+        */
+        void setRegister( uint32_t index, uint8_t rank );
+
+    public:
+       /*
+        * @method: add
+        * @brief: counts a value
+        * @input - hash: 64-bit hash of the value (ex. std::hash of the host), mixed again before use
+        */
+        void add( uint64_t hash );
+
+       /*
+        * @method: merge
+        * @brief: adds the values of another distinctSketch, the result is the same in any merge order
+        */
+        void merge( const distinctSketch &other );
+
+       /*
+        * @method: estimate
+        * @return: returns the estimated number of distinct values (linear counting while few registers are in use)
+        */
+        uint64_t estimate() const;
+
+       /*
+        * @method: save
+        * @brief: serializes the registers in use
+        * @output - writer: the state being written
+        */
+        void save( stateWriter &writer ) const;
+
+       /*
+        * @method: load
+        * @brief: adds the registers serialized by save, like merge
+        * @input - reader: the state being read
+        * @return: returns false if the serialized registers are malformed
+        */
+        bool load( stateReader &reader );
+
+       /*
+        * @method: memoryUsage
+        * @return: returns the approximate number of bytes held by the registers
+        */
+        size_t memoryUsage() const { return sparse.capacity() * sizeof( uint32_t ) + registers.capacity(); }
+};
+
+/*
+ * @class: quantileSketch
+ * @brief: log-linear histogram of values (ex. reply sizes) answering percentiles within a relative error of 1 / 128
+ *         Values below 1 << QUANTILE_SUB_BITS have their own bucket, larger values share 1 << QUANTILE_SUB_BITS buckets
+ *         per power of two. Bucket counts are exact, so that the sketch is mergeable and order independent
+ *         No bucket is ever collapsed: only the buckets in use are kept, at most QUANTILE_BUCKETS for values spanning
+ *         the whole uint64_t range, so that every percentile stays within the error bound
+ */
+class quantileSketch
+{
+    private:
+        std::vector <uint16_t> buckets; // bucket indexes in use, sorted
+        std::vector <uint64_t> counts; // indexed like buckets
+        uint64_t total = 0;
+
+       /*
+        * @method: addBucket
+        * @brief: counts values in a bucket
+        */
+        void addBucket( uint16_t bucket, uint64_t count );
+
+    public:
+       /*
+        * @method: add
+        * @brief: counts a value
+        */
+        void add( uint64_t value );
+
+       /*
+        * @method: merge
+        * @brief: adds the values of another quantileSketch, the result is the same in any merge order
+        */
+        void merge( const quantileSketch &other );
+
+       /*
+        * @method: quantile
+        * @input - fraction: the percentile requested, from 0 to 1 (ex. 0.95)
+        * @return: returns the value at the provided percentile (nearest rank), 0 if no value was counted
+        */
+        uint64_t quantile( double fraction ) const;
+
+       /*
+        * @method: bucketIndex
+        * @return: returns the bucket of a value
+        */
+        static uint16_t bucketIndex( uint64_t value );
+
+       /*
+        * @method: bucketValue
+        * @return: returns the value reported for a bucket, the middle of its range
+        */
+        static uint64_t bucketValue( uint16_t bucket );
+
+       /*
+        * @method: save
+        * @brief: serializes the buckets in use
+        * @output - writer: the state being written
+        */
+        void save( stateWriter &writer ) const;
+
+       /*
+        * @method: load
+        * @brief: adds the buckets serialized by save, like merge
+        * @input - reader: the state being read
+        * @return: returns false if the serialized buckets are malformed
+        */
+        bool load( stateReader &reader );
+
+       /*
+        * @method: memoryUsage
+        * @return: returns the approximate number of bytes held by the buckets
+        */
+        size_t memoryUsage() const { return buckets.capacity() * sizeof( uint16_t ) + counts.capacity() * sizeof( uint64_t ); }
+};
+
+/*
+ * @class: sketchCounter
+ * @brief: one sketch per key of a query (ex. distinct hosts per resource), next to its number of accesses
+ *         Keys are interned once by a keyCounter, whose key IDs index the sketches
+ */
+class sketchCounter
+{
+    private:
+        queryMetric metric;
+        keyCounter keys;
+        std::vector <distinctSketch> distinct; // indexed by key ID, queryMetric::distinctHosts only
+        std::vector <quantileSketch> quantiles; // indexed by key ID, queryMetric::sizeQuantiles only
+
+    public:
+       /*
+        * @method: sketchCounter
+        * @input - metric: the sketch kept per key, queryMetric::distinctHosts or queryMetric::sizeQuantiles
+        */
+        explicit sketchCounter( queryMetric metric = queryMetric::distinctHosts ) : metric( metric ) {}
+
+       /*
+        * @method: add
+        * @brief: counts one access for the provided key and adds its value to the sketch of the key
+        * @input - key: the key being accessed, only copied if it has never been seen before
+        * @input - value: hash of the host for distinct hosts, reply size for size percentiles
+        * @input - position: position of the access in the input, used to order keys with the same rank
+        */
+        void add( std::string_view key, uint64_t value, uint64_t position );
+
+       /*
+        * @method: merge
+        * @brief: adds the keys and sketches of another sketchCounter of the same metric (ex. computed by another thread)
+        */
+        void merge( const sketchCounter &other );
+
+       /*
+        * @method: save
+        * @brief: serializes the keys with their counts, first positions and sketches (see webServerAnalyser::saveState)
+        * @output - writer: the state being written
+        */
+        void save( stateWriter &writer ) const;
+
+       /*
+        * @method: load
+        * @brief: adds the keys and sketches serialized by save, like merge
+        * @input - reader: the state being read
+        * @return: returns false if the serialized keys are malformed
+        */
+        bool load( stateReader &reader );
+
+       /*
+        * @method: rankedResult
+        * @brief: estimates the sketch of each key
+        *         distinct hosts per key (resultKind::distinctHosts), most distinct hosts at the top
+        *         requests and p50, p95, p99 reply sizes per key (resultKind::sizeQuantiles), most requests at the top
+        *         Ties are ranked by the position the key was first seen at
+        * @input - limit: maximum number of entries to output, 0 outputs every key
+        * @return: returns the keys and their estimates in ranked order
+        */
+        queryResult rankedResult( size_t limit = 0 ) const;
+
+       /*
+        * @method: size
+        * @return: returns the number of distinct keys
+        */
+        size_t size() const { return keys.size(); }
+
+       /*
+        * @method: loadFactor
+        * @return: returns the fill ratio of the key table
+        */
+        double loadFactor() const { return keys.loadFactor(); }
+
+       /*
+        * @method: memoryUsage
+        * @return: returns the approximate number of bytes held by the keys and their sketches
+        */
+        size_t memoryUsage() const;
+};
@@ -0,0 +1,501 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <queue>
+
+#include <unistd.h>
+
+#include "keySpill.h"
+#include "mappedFile.h"
+
+/*
+ * @method: partitionKeys
+ * @brief: splits the keys of a keyCounter into the hash partitions of a run, each partition sorted by key
+ * @return: returns the key IDs of each partition
+ */
+static std::vector <std::vector <uint32_t>> partitionKeys( const keyCounter &counts )
+{
+    std::vector <std::vector <uint32_t>> partitions( SPILL_PARTITIONS );
+
+    for (size_t id = 0; id < counts.size(); id++)
+    {
+        partitions[std::hash <std::string_view>()( counts.key( id ) ) % SPILL_PARTITIONS].push_back( static_cast <uint32_t>( id ) );
+    }
+    for (auto &partition: partitions)
+    {
+        std::sort( partition.begin(), partition.end(), [&counts]( uint32_t lhs, uint32_t rhs )
+        {
+            return counts.key( lhs ) < counts.key( rhs );
+        } );
+    }
+    return partitions;
+}
+
+/*
+ * @method: ~keySpill
+ * @brief: removes the spill file
+ */
+keySpill::~keySpill()
+{
+    if ( !spillPath.empty() )
+    {
+        spillFile.close();
+        std::remove( spillPath.c_str() );
+    }
+}
+
+/*
+ * @method: spill
+ * @brief: appends the keys and counts of a keyCounter to the spill file as a sorted, hash partitioned run
+ * @input - counts: the keyCounter to spill, the caller empties it once spilled
+ * @return: returns false if the run could not be written (the keys must then be kept in memory)
+ */
+bool keySpill::spill( const keyCounter &counts )
+{
+    std::lock_guard <std::mutex> guard( lock );
+
+    if ( failed )
+    {
+        return false;
+    }
+    if ( spillPath.empty() )
+    {
+        spillPath = createFile();
+        if ( spillPath.empty() )
+        {
+            failed = true;
+            return false;
+        }
+        spillFile.open( spillPath, std::ios::binary | std::ios::trunc );
+    }
+
+    // One sorted partition after the other, records encoded like keyCounter::save
+    std::array <uint64_t, SPILL_PARTITIONS + 1> offsets;
+    std::vector <std::vector <uint32_t>> partitions = partitionKeys( counts );
+    for (int partition = 0; partition < SPILL_PARTITIONS; partition++)
+    {
+        stateWriter records;
+        for (uint32_t id: partitions[partition])
+        {
+            records.text( counts.key( id ) );
+            records.number( counts.count( id ).count );
+            records.number( counts.count( id ).firstSeen );
+        }
+        offsets[partition] = bytes;
+        spillFile.write( records.data().data(), records.data().size() );
+        bytes += records.data().size();
+    }
+    offsets[SPILL_PARTITIONS] = bytes;
+    spillFile.flush();
+
+    // A run that could not be written entirely is never read back
+    failed = !spillFile;
+    if ( !failed )
+    {
+        runs.push_back( offsets );
+    }
+    return !failed;
+}
+
+/*
+ * @method: createFile
+ * @brief: creates an empty temporary file in the spill directory
+ * @return: returns the path of the file, empty if it could not be created
+ */
+std::string keySpill::createFile() const
+{
+    std::error_code error;
+    std::string fileTemplate = ( directory.empty() ? std::filesystem::temp_directory_path( error ).string() : directory ) + "/logParser.spill.XXXXXX";
+    int descriptor = mkstemp( fileTemplate.data() );
+
+    if ( descriptor < 0 )
+    {
+        return "";
+    }
+    close( descriptor );
+    return fileTemplate;
+}
+
+/*
+ * @method: forEachKey
+ * @brief: merges the runs and the provided keys, partition by partition
+ *         The pages of each partition are released once it is merged (see mappedFile::release)
+ * @input - mapping: the memory-mapped spill file
+ * @input - remaining: keys still in memory, merged with the runs
+ * @input - keyHandler: called once per distinct key with its total count and earliest first position, in partition order
+ *          then key order; the key is a view into the contents or into remaining
+ * @return: returns false if the spill file could not be read back
+ */
+template <typename KeyHandler>
+bool keySpill::forEachKey( const mappedFile &mapping, const keyCounter &remaining, KeyHandler &&keyHandler ) const
+{
+    std::string_view contents = mapping.data();
+    // A cursor walks one sorted partition: a partition of a run, or the keys still in memory
+    typedef struct mergeCursor
+    {
+        stateReader records;
+        const std::vector <uint32_t> *ids = nullptr;
+        size_t next = 0;
+        std::string_view key;
+        keyCount count;
+    } mergeCursor;
+    std::vector <std::vector <uint32_t>> remainingPartitions = partitionKeys( remaining );
+    bool malformed = !runs.empty() && contents.size() < runs.back()[SPILL_PARTITIONS];
+
+    for (int partition = 0; partition < SPILL_PARTITIONS && !malformed; partition++)
+    {
+        std::vector <mergeCursor> cursors( runs.size() + 1 );
+        for (size_t run = 0; run < runs.size(); run++)
+        {
+            cursors[run].records = stateReader( contents.substr( runs[run][partition], runs[run][partition + 1] - runs[run][partition] ) );
+        }
+        cursors.back().ids = &remainingPartitions[partition];
+
+        auto advance = [&]( mergeCursor &cursor )
+        {
+            if ( cursor.ids != nullptr )
+            {
+                if ( cursor.next == cursor.ids->size() )
+                {
+                    return false;
+                }
+                uint32_t id = ( *cursor.ids )[cursor.next++];
+                cursor.key = remaining.key( id );
+                cursor.count = remaining.count( id );
+                return true;
+            }
+            if ( cursor.records.atEnd() )
+            {
+                return false;
+            }
+            cursor.key = cursor.records.text();
+            cursor.count.count = cursor.records.number();
+            cursor.count.firstSeen = cursor.records.number();
+            malformed = malformed || cursor.records.failed();
+            return !cursor.records.failed();
+        };
+
+        // K-way merge on the smallest key of each cursor
+        auto after = [&cursors]( size_t lhs, size_t rhs )
+        {
+            return cursors[lhs].key > cursors[rhs].key;
+        };
+        std::priority_queue <size_t, std::vector <size_t>, decltype( after )> heap( after );
+        for (size_t cursor = 0; cursor < cursors.size(); cursor++)
+        {
+            if ( advance( cursors[cursor] ) )
+            {
+                heap.push( cursor );
+            }
+        }
+        while ( !heap.empty() )
+        {
+            size_t cursor = heap.top();
+            std::string_view key = cursors[cursor].key;
+            keyCount total = cursors[cursor].count;
+            heap.pop();
+            if ( advance( cursors[cursor] ) )
+            {
+                heap.push( cursor );
+            }
+            while ( !heap.empty() && cursors[heap.top()].key == key )
+            {
+                size_t duplicate = heap.top();
+                heap.pop();
+                total.count += cursors[duplicate].count.count;
+                total.firstSeen = std::min( total.firstSeen, cursors[duplicate].count.firstSeen );
+                if ( advance( cursors[duplicate] ) )
+                {
+                    heap.push( duplicate );
+                }
+            }
+            keyHandler( key, total );
+        }
+        for (const auto &run: runs)
+        {
+            mapping.release( run[partition], run[partition + 1] - run[partition] );
+        }
+    }
+
+    return !malformed;
+}
+
+/*
+ * @method: rankedResult
+ * @brief: merges the runs with the keys still in memory and ranks them like keyCounter::rankedResult
+ * @input - remaining: keys still in memory
+ * @input - limit: maximum number of entries to output, 0 outputs every key
+ * @return: returns the keys and their counts in ranked order (resultKind::counts), spilled to a file (see
+ *         queryResult::isSpilled) if they do not fit the budget; the keys of a ranked run that cannot be written are
+ *         kept in memory and merged with the runs already written
+ */
+queryResult keySpill::rankedResult( const keyCounter &remaining, size_t limit ) const
+{
+    // A merged key, its text is copied into rankedKeys: the pages of the spill file are released once merged
+    typedef struct rankedKey
+    {
+        size_t keyStart;
+        size_t keySize;
+        keyCount count;
+    } rankedKey;
+    std::vector <rankedKey> ranked;
+    std::string rankedKeys;
+    std::string runsPath;
+    std::ofstream runsFile;
+    std::vector <uint64_t> runEnds; // end of each ranked run in the runs file
+    bool runsFailed = false;
+    queryResult result( resultKind::counts );
+    mappedFile mapping( spillPath );
+
+    // Same order as keyCounter::rankedResult: by count, ties broken by the position the key was first seen at
+    auto ranksBefore = []( const keyCount &lhs, const keyCount &rhs )
+    {
+        if ( lhs.count != rhs.count )
+        {
+            return lhs.count > rhs.count;
+        }
+        return lhs.firstSeen < rhs.firstSeen;
+    };
+    auto keyBefore = [&ranksBefore]( const rankedKey &lhs, const rankedKey &rhs )
+    {
+        return ranksBefore( lhs.count, rhs.count );
+    };
+    auto sortRanked = [&]()
+    {
+        if ( limit > 0 && limit < ranked.size() )
+        {
+            std::partial_sort( ranked.begin(), ranked.begin() + limit, ranked.end(), keyBefore );
+            ranked.resize( limit );
+        }
+        else
+        {
+            std::sort( ranked.begin(), ranked.end(), keyBefore );
+        }
+    };
+
+    // Ranked runs: the merged keys sorted by rank, written whenever they outgrow the budget
+    // A run that cannot be written is kept in memory, with every key merged after it, and the runs already written are kept
+    auto writeRun = [&]()
+    {
+        if ( runsPath.empty() )
+        {
+            runsPath = createFile();
+            runsFile.open( runsPath, std::ios::binary | std::ios::trunc );
+        }
+        if ( runsPath.empty() || !runsFile )
+        {
+            std::cerr << "Failed to create a ranked keys file in " << ( directory.empty() ? "the temporary directory" : directory ) <<
+                         ", the keys left are ranked in memory" << std::endl;
+            runsFailed = true;
+            return;
+        }
+        sortRanked();
+        stateWriter records;
+        uint64_t runEnd = runEnds.empty() ? 0 : runEnds.back();
+        for (size_t entry = 0; entry <= ranked.size(); entry++)
+        {
+            if ( entry == ranked.size() || records.data().size() >= RESULT_RELEASE_SIZE )
+            {
+                runsFile.write( records.data().data(), records.data().size() );
+                runEnd += records.data().size();
+                records = stateWriter();
+            }
+            if ( entry < ranked.size() )
+            {
+                records.text( std::string_view( rankedKeys ).substr( ranked[entry].keyStart, ranked[entry].keySize ) );
+                records.number( ranked[entry].count.count );
+                records.number( ranked[entry].count.firstSeen );
+            }
+        }
+        runsFile.flush();
+        if ( !runsFile )
+        {
+            std::cerr << "Failed to write the ranked keys to " << runsPath << ", the keys left are ranked in memory" << std::endl;
+            runsFailed = true;
+            return;
+        }
+        runEnds.push_back( runEnd );
+        ranked.clear();
+        rankedKeys.clear();
+    };
+
+    bool readBack = forEachKey( mapping, remaining, [&]( std::string_view key, const keyCount &count )
+    {
+        ranked.push_back( { rankedKeys.size(), key.size(), count } );
+        rankedKeys.append( key );
+
+        // Only the top entries are requested: the others are dropped as the partitions are merged
+        if ( limit > 0 && ranked.size() >= 2 * limit )
+        {
+            std::nth_element( ranked.begin(), ranked.begin() + limit, ranked.end(), keyBefore );
+            ranked.resize( limit );
+            std::string keptKeys;
+            for (rankedKey &entry: ranked)
+            {
+                keptKeys.append( rankedKeys, entry.keyStart, entry.keySize );
+                entry.keyStart = keptKeys.size() - entry.keySize;
+            }
+            rankedKeys.swap( keptKeys );
+        }
+        if ( budget > 0 && !runsFailed && ranked.size() * sizeof( rankedKey ) + rankedKeys.size() > budget )
+        {
+            writeRun();
+        }
+    } );
+    if ( !readBack )
+    {
+        std::cerr << "Failed to read back the spilled keys from " << spillPath << std::endl;
+    }
+
+    // Everything fit the budget, or no run could be written: ranked in memory
+    if ( runEnds.empty() )
+    {
+        sortRanked();
+        result.reserve( ranked.size(), rankedKeys.size() );
+        for (const rankedKey &entry: ranked)
+        {
+            resultRow row;
+            row.count = entry.count.count;
+            result.add( std::string_view( rankedKeys ).substr( entry.keyStart, entry.keySize ), row );
+        }
+        if ( !runsPath.empty() )
+        {
+            std::remove( runsPath.c_str() );
+        }
+        return result;
+    }
+
+    // Otherwise, merge the ranked runs into the rows of the result, on the highest ranked key of each run
+    // The keys that could not be written, if any, are one more run read from memory
+    if ( !ranked.empty() && !runsFailed )
+    {
+        writeRun();
+    }
+    sortRanked();
+    runsFile.close();
+    mappedFile runs( runsPath );
+    std::string_view contents = runs.data();
+    typedef struct rankCursor
+    {
+        stateReader records;
+        size_t released;
+        bool inMemory = false;
+        size_t next = 0;
+        std::string_view key;
+        keyCount count;
+    } rankCursor;
+    std::vector <rankCursor> cursors( runEnds.size() + 1 );
+    bool malformed = contents.size() < runEnds.back();
+    auto advance = [&]( rankCursor &cursor )
+    {
+        if ( cursor.inMemory )
+        {
+            if ( cursor.next == ranked.size() )
+            {
+                return false;
+            }
+            cursor.key = std::string_view( rankedKeys ).substr( ranked[cursor.next].keyStart, ranked[cursor.next].keySize );
+            cursor.count = ranked[cursor.next++].count;
+            return true;
+        }
+        if ( cursor.records.atEnd() )
+        {
+            return false;
+        }
+        cursor.key = cursor.records.text();
+        cursor.count.count = cursor.records.number();
+        cursor.count.firstSeen = cursor.records.number();
+        malformed = malformed || cursor.records.failed();
+        return !cursor.records.failed();
+    };
+    auto after = [&]( size_t lhs, size_t rhs )
+    {
+        return ranksBefore( cursors[rhs].count, cursors[lhs].count );
+    };
+    std::priority_queue <size_t, std::vector <size_t>, decltype( after )> heap( after );
+    for (size_t run = 0; run < runEnds.size() && !malformed; run++)
+    {
+        cursors[run].released = run > 0 ? runEnds[run - 1] : 0;
+        cursors[run].records = stateReader( contents.substr( cursors[run].released, runEnds[run] - cursors[run].released ) );
+        if ( advance( cursors[run] ) )
+        {
+            heap.push( run );
+        }
+    }
+    cursors.back().inMemory = true;
+    if ( !malformed && advance( cursors.back() ) )
+    {
+        heap.push( cursors.size() - 1 );
+    }
+
+    std::string rowsPath = createFile();
+    std::ofstream rowsFile( rowsPath, std::ios::binary | std::ios::trunc );
+    std::string records;
+    size_t rows = 0;
+    while ( !heap.empty() && !malformed && ( limit == 0 || rows < limit ) )
+    {
+        rankCursor &cursor = cursors[heap.top()];
+        resultRow row;
+        row.count = cursor.count.count;
+        result.appendRecord( cursor.key, row, records );
+        rows++;
+        if ( records.size() >= RESULT_RELEASE_SIZE )
+        {
+            rowsFile.write( records.data(), records.size() );
+            records.clear();
+        }
+
+        // The pages of the run merged so far are not needed anymore
+        size_t position = cursor.inMemory ? 0 : static_cast <size_t>( cursor.key.data() - contents.data() );
+        if ( !cursor.inMemory && position - cursor.released >= RESULT_RELEASE_SIZE )
+        {
+            runs.release( cursor.released, position - cursor.released );
+            cursor.released = position;
+        }
+
+        size_t run = heap.top();
+        heap.pop();
+        if ( advance( cursor ) )
+        {
+            heap.push( run );
+        }
+    }
+    rowsFile.write( records.data(), records.size() );
+    rowsFile.close();
+    std::remove( runsPath.c_str() );
+    if ( malformed || rowsPath.empty() || !rowsFile )
+    {
+        std::cerr << "Failed to merge the ranked keys of " << spillPath << std::endl;
+        std::remove( rowsPath.c_str() );
+        return result;
+    }
+
+    return queryResult( resultKind::counts, rowsPath, rows );
+}
+
+/*
+ * @method: save
+ * @brief: serializes the merged runs and keys still in memory, in the format of keyCounter::save
+ * @input - remaining: keys still in memory
+ * @output - writer: the state being written
+ * @return: returns false if the spill file could not be read back
+ */
+bool keySpill::save( const keyCounter &remaining, stateWriter &writer ) const
+{
+    mappedFile mapping( spillPath );
+    uint64_t mergedKeys = 0;
+
+    // The number of distinct keys comes first: merge once to count them, once to write them
+    if ( !forEachKey( mapping, remaining, [&]( std::string_view, const keyCount & ) { mergedKeys++; } ) )
+    {
+        return false;
+    }
+    writer.number( mergedKeys );
+    return forEachKey( mapping, remaining, [&]( std::string_view key, const keyCount &count )
+    {
+        writer.text( key );
+        writer.number( count.count );
+        writer.number( count.firstSeen );
+    } );
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "keyCounter.h"
+#include "stateFile.h"
+
+#define SPILL_PARTITIONS 16 // hash partitions of a spilled run, merged one at a time
+
+/*
+ * @class: keySpill
+ * @brief: exact key counts of a query that do not fit the memory limit (see analyserConfig.memoryLimit)
+ *         A keyCounter over its budget is written to a temporary file as a run: its keys are split into SPILL_PARTITIONS hash
+ *         partitions, each sorted by key, and the keyCounter starts over empty. At the end the runs are merged one partition
+ *         at a time (a key only ever appears in one partition), together with the keys still in memory, straight from the
+ *         memory-mapped file: counts are summed and the earliest first position is kept, exactly like keyCounter::merge
+ *         Ranking is bounded by the same budget: merged keys are sorted by rank into runs of another temporary file whenever
+ *         they outgrow it, then the ranked runs are merged into the rows of the result, read back as they are written
+ *         Runs are appended by several workers, spill is thread safe
+ */
+class keySpill
+{
+    private:
+        std::string directory;
+        size_t budget;
+        std::string spillPath; // created by the first spill
+        std::ofstream spillFile;
+        std::vector <std::array <uint64_t, SPILL_PARTITIONS + 1>> runs; // offset of each partition of each run, then the run end
+        uint64_t bytes = 0;
+        bool failed = false;
+        std::mutex lock;
+
+       /*
+        * @method: forEachKey
+        * @brief: merges the runs and the provided keys, partition by partition
+        * @input - mapping: the memory-mapped spill file
+        * @input - remaining: keys still in memory, merged with the runs
+        * @input - keyHandler: called once per distinct key with its total count and earliest first position, in partition
+        *          order then key order; the key is a view into the contents or into remaining
+        * @return: returns false if the spill file could not be read back
+        */
+        template <typename KeyHandler>
+        bool forEachKey( const mappedFile &mapping, const keyCounter &remaining, KeyHandler &&keyHandler ) const;
+
+       /*
+        * @method: createFile
+        * @brief: creates an empty temporary file in the spill directory
+        * @return: returns the path of the file, empty if it could not be created
+        */
+        std::string createFile() const;
+
+    public:
+       /*
+        * @method: keySpill
+        * @input - directory: directory of the temporary files, the system temporary directory if empty
+        * @input - budget: bytes the merged keys may hold in memory while they are ranked, 0 for no limit
+        */
+        explicit keySpill( const std::string &directory, size_t budget = 0 ) : directory( directory ), budget( budget ) {}
+        ~keySpill();
+
+        keySpill( const keySpill & ) = delete;
+        keySpill &operator=( const keySpill & ) = delete;
+
+       /*
+        * @method: spill
+        * @brief: appends the keys and counts of a keyCounter to the spill file as a sorted, hash partitioned run
+        * @input - counts: the keyCounter to spill, the caller empties it once spilled
+        * @return: returns false if the run could not be written (the keys must then be kept in memory)
+        */
+        bool spill( const keyCounter &counts );
+
+       /*
+        * @method: rankedResult
+        * @brief: merges the runs with the keys still in memory and ranks them like keyCounter::rankedResult
+        * @input - remaining: keys still in memory
+        * @input - limit: maximum number of entries to output, 0 outputs every key
+        * @return: returns the keys and their counts in ranked order (resultKind::counts), spilled to a file (see
+        *         queryResult::isSpilled) if they do not fit the budget; the keys of a ranked run that cannot be written are
+        *         kept in memory and merged with the runs already written
+        */
+        queryResult rankedResult( const keyCounter &remaining, size_t limit ) const;
+
+       /*
+        * @method: save
+        * @brief: serializes the merged runs and keys still in memory, in the format of keyCounter::save
+        * @input - remaining: keys still in memory
+        * @output - writer: the state being written
+        * @return: returns false if the spill file could not be read back
+        */
+        bool save( const keyCounter &remaining, stateWriter &writer ) const;
+
+       /*
+        * @method: empty
+        * @return: returns true if nothing was spilled
+        */
+        bool empty() const { return runs.empty(); }
+
+       /*
+        * @method: spilledBytes
+        * @return: returns the size of the spill file
+        */
+        uint64_t spilledBytes() const { return bytes; }
+};
@@ -0,0 +1,453 @@
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "logFilter.h"
+#include "webServerAnalyser.h"
+
+/*
+ * @method: parseNumber
+ * @brief: converts a decimal number of a filter expression
+ * @return: returns false if the text is not a number
+ */
+static bool parseNumber( std::string_view text, uint64_t &number )
+{
+    number = 0;
+    for (char digit: text)
+    {
+        if ( digit < '0' || digit > '9' )
+        {
+            return false;
+        }
+        number = number * 10 + ( digit - '0' );
+    }
+    return !text.empty();
+}
+
+/*
+ * @method: parseIPv4
+ * @brief: converts a dotted IPv4 address ("a.b.c.d")
+ * @return: returns false if the text is not an IPv4 address (ex. a host name)
+ */
+static bool parseIPv4( std::string_view text, uint32_t &address )
+{
+    size_t start = 0;
+
+    address = 0;
+    for (int octet = 0; octet < 4; octet++)
+    {
+        size_t end = octet < 3 ? text.find( '.', start ) : text.size();
+        uint64_t value;
+        if ( end == std::string_view::npos || end - start > 3 || !parseNumber( text.substr( start, end - start ), value ) || value > 255 )
+        {
+            return false;
+        }
+        address = ( address << 8 ) | static_cast <uint32_t>( value );
+        start = end + 1;
+    }
+    return true;
+}
+
+/*
+ * @method: rank
+ * @return: returns the evaluation rank of a predicate, lower ranks are evaluated first
+ */
+unsigned int logFilter::rank( const filterPredicate &predicate )
+{
+    // Within a column: exact matches reject the most lines, exclusions the fewest
+    unsigned int selectivity = 2;
+    if ( predicate.op == filterOp::match || predicate.op == filterOp::equal )
+    {
+        selectivity = std::all_of( predicate.patterns.begin(), predicate.patterns.end(), []( const filterPattern &pattern )
+        {
+            return pattern.kind == patternKind::exact;
+        } ) ? 0 : 1;
+    }
+    else if ( predicate.op == filterOp::noMatch || predicate.op == filterOp::notEqual )
+    {
+        selectivity = 3;
+    }
+
+    return static_cast <unsigned int>( predicate.field ) * 4 + selectivity;
+}
+
+/*
+ * @method: compile
+ * @brief: parses a filter expression: predicates "field op value" joined by "and" (or "&&")
+ *         fields: method, status, host, uri, size, time
+ *         op: = or != followed by comma separated alternatives (prefix*, *suffix, a.b.c.d/n for hosts, Nxx for
+ *         status classes), or <, <=, >, >= followed by a number (size, status) or a [DD:HH:MM:SS] date time (time)
+ * @input - expression: the filter expression, empty for a filter that passes every line
+ * @output - filter: the compiled filter, in evaluation order
+ * @output - error: description of the first syntax error
+ * @return: returns true if the expression was compiled, false if it is malformed
+ */
+bool logFilter::compile( const std::string &expression, logFilter &filter, std::string &error )
+{
+    static const char *opNames[] = { "!=", "<=", ">=", "=", "<", ">" };
+    static const filterOp opCodes[] = { filterOp::noMatch, filterOp::lessEqual, filterOp::greaterEqual, filterOp::match, filterOp::less, filterOp::greater };
+    std::string_view input( expression );
+    size_t linePos = 0;
+
+    filter = logFilter();
+    auto skipSpaces = [&]()
+    {
+        while ( linePos < input.size() && isspace( static_cast <unsigned char>( input[linePos] ) ) )
+        {
+            linePos++;
+        }
+    };
+
+    skipSpaces();
+    while ( linePos < input.size() )
+    {
+        filterPredicate predicate;
+
+        // Step 1: field name
+        size_t fieldStart = linePos;
+        while ( linePos < input.size() && isalpha( static_cast <unsigned char>( input[linePos] ) ) )
+        {
+            linePos++;
+        }
+        std::string_view field = input.substr( fieldStart, linePos - fieldStart );
+        if ( field == "method" )
+        {
+            predicate.field = filterField::method;
+        }
+        else if ( field == "status" )
+        {
+            predicate.field = filterField::status;
+        }
+        else if ( field == "host" )
+        {
+            predicate.field = filterField::host;
+        }
+        else if ( field == "uri" || field == "resource" )
+        {
+            predicate.field = filterField::resource;
+        }
+        else if ( field == "size" )
+        {
+            predicate.field = filterField::size;
+        }
+        else if ( field == "time" || field == "date" )
+        {
+            predicate.field = filterField::date;
+        }
+        else
+        {
+            error = "unknown field \"" + std::string( field ) + "\" at offset " + std::to_string( fieldStart );
+            return false;
+        }
+
+        // Step 2: operator
+        skipSpaces();
+        size_t op = 0;
+        while ( op < 6 && input.substr( linePos, strlen( opNames[op] ) ) != opNames[op] )
+        {
+            op++;
+        }
+        if ( op == 6 )
+        {
+            error = "expected an operator after \"" + std::string( field ) + "\" at offset " + std::to_string( linePos );
+            return false;
+        }
+        predicate.op = opCodes[op];
+        linePos += strlen( opNames[op] );
+
+        // Step 3: value, up to the next space
+        skipSpaces();
+        size_t valueStart = linePos;
+        while ( linePos < input.size() && !isspace( static_cast <unsigned char>( input[linePos] ) ) )
+        {
+            linePos++;
+        }
+        std::string_view value = input.substr( valueStart, linePos - valueStart );
+        if ( value.empty() )
+        {
+            error = "expected a value for \"" + std::string( field ) + "\" at offset " + std::to_string( valueStart );
+            return false;
+        }
+
+        bool numeric = predicate.field == filterField::size || predicate.field == filterField::date ||
+                       ( predicate.field == filterField::status && predicate.op != filterOp::match && predicate.op != filterOp::noMatch );
+        if ( numeric )
+        {
+            // Sizes, date times and ordered status comparisons compare numbers
+            predicate.op = predicate.op == filterOp::match ? filterOp::equal : predicate.op == filterOp::noMatch ? filterOp::notEqual : predicate.op;
+            if ( predicate.field == filterField::date )
+            {
+                uint32_t date = webServerAnalyser::parseDate( value.front() == '[' ? std::string( value ) : "[" + std::string( value ) + "]" );
+                predicate.number = date;
+                if ( date == INVALID_DATE )
+                {
+                    error = "expected a [DD:HH:MM:SS] date time at offset " + std::to_string( valueStart );
+                    return false;
+                }
+            }
+            else if ( !parseNumber( value, predicate.number ) )
+            {
+                error = "expected a number at offset " + std::to_string( valueStart );
+                return false;
+            }
+        }
+        else if ( predicate.op != filterOp::match && predicate.op != filterOp::noMatch )
+        {
+            error = "\"" + std::string( field ) + "\" only supports = and != at offset " + std::to_string( valueStart );
+            return false;
+        }
+        else
+        {
+            // Comma separated alternatives
+            for (size_t start = 0; start <= value.size(); )
+            {
+                size_t end = std::min( value.find( ',', start ), value.size() );
+                std::string_view alternative = value.substr( start, end - start );
+                filterPattern pattern;
+                size_t slash = alternative.find( '/' );
+                uint64_t prefixLength;
+
+                if ( predicate.field == filterField::host && slash != std::string_view::npos )
+                {
+                    if ( !parseIPv4( alternative.substr( 0, slash ), pattern.network ) ||
+                         !parseNumber( alternative.substr( slash + 1 ), prefixLength ) || prefixLength > 32 )
+                    {
+                        error = "expected a.b.c.d/n at offset " + std::to_string( valueStart + start );
+                        return false;
+                    }
+                    pattern.kind = patternKind::cidr;
+                    pattern.mask = prefixLength == 0 ? 0 : UINT32_MAX << ( 32 - prefixLength );
+                    pattern.network &= pattern.mask;
+                }
+                else if ( predicate.field == filterField::status && alternative.size() == 3 && alternative.substr( 1 ) == "xx" )
+                {
+                    pattern.kind = patternKind::statusClass;
+                    pattern.text = alternative.substr( 0, 1 );
+                }
+                else if ( !alternative.empty() && alternative.back() == '*' )
+                {
+                    pattern.kind = patternKind::prefix;
+                    pattern.text = alternative.substr( 0, alternative.size() - 1 );
+                }
+                else if ( !alternative.empty() && alternative.front() == '*' )
+                {
+                    pattern.kind = patternKind::suffix;
+                    pattern.text = alternative.substr( 1 );
+                }
+                else
+                {
+                    pattern.text = alternative;
+                }
+                predicate.patterns.push_back( pattern );
+                start = end + 1;
+            }
+        }
+        filter.add( predicate );
+
+        // Step 4: conjunction or end of the expression
+        skipSpaces();
+        if ( linePos < input.size() )
+        {
+            if ( input.substr( linePos, 3 ) == "and" || input.substr( linePos, 2 ) == "&&" )
+            {
+                linePos += input[linePos] == '&' ? 2 : 3;
+                skipSpaces();
+                if ( linePos < input.size() )
+                {
+                    continue;
+                }
+            }
+            error = "expected \"and\" at offset " + std::to_string( linePos );
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * @method: add
+ * @brief: adds a predicate to the filter, keeping the evaluation order
+ */
+void logFilter::add( const filterPredicate &predicate )
+{
+    auto position = std::upper_bound( predicates.begin(), predicates.end(), predicate, []( const filterPredicate &lhs, const filterPredicate &rhs )
+    {
+        return rank( lhs ) < rank( rhs );
+    } );
+    predicates.insert( position, predicate );
+}
+
+/*
+ * @method: requireEqual
+ * @brief: adds an exact match predicate (ex. the HTTP method of a query)
+ */
+void logFilter::requireEqual( filterField field, std::string_view value )
+{
+    filterPredicate predicate;
+    predicate.field = field;
+    predicate.op = filterOp::match;
+    predicate.patterns.emplace_back();
+    predicate.patterns.back().text = value;
+    add( predicate );
+}
+
+/*
+ * @method: matchesPatterns
+ * @brief: applies a match / noMatch predicate with several or non exact patterns, see matches
+ */
+bool logFilter::matchesPatterns( const filterPredicate &predicate, std::string_view value )
+{
+    bool matched = false;
+    uint32_t address = 0;
+    bool isAddress = false, addressParsed = false;
+
+    for (const auto &pattern: predicate.patterns)
+    {
+        switch ( pattern.kind )
+        {
+            case patternKind::exact:
+                matched = value == pattern.text;
+                break;
+            case patternKind::prefix:
+                matched = value.substr( 0, pattern.text.size() ) == pattern.text;
+                break;
+            case patternKind::suffix:
+                matched = value.size() >= pattern.text.size() && value.substr( value.size() - pattern.text.size() ) == pattern.text;
+                break;
+            case patternKind::statusClass:
+                matched = value.size() == 3 && value[0] == pattern.text[0];
+                break;
+            case patternKind::cidr:
+                if ( !addressParsed )
+                {
+                    isAddress = parseIPv4( value, address );
+                    addressParsed = true;
+                }
+                matched = isAddress && ( address & pattern.mask ) == pattern.network;
+                break;
+        }
+        if ( matched )
+        {
+            break;
+        }
+    }
+
+    return predicate.op == filterOp::noMatch ? !matched : matched;
+}
+
+/*
+ * @method: compare
+ * @brief: applies a numeric comparison predicate to the value of its column
+ */
+bool logFilter::compare( const filterPredicate &predicate, uint64_t value )
+{
+    switch ( predicate.op )
+    {
+        case filterOp::equal:
+            return value == predicate.number;
+        case filterOp::notEqual:
+            return value != predicate.number;
+        case filterOp::less:
+            return value < predicate.number;
+        case filterOp::lessEqual:
+            return value <= predicate.number;
+        case filterOp::greater:
+            return value > predicate.number;
+        case filterOp::greaterEqual:
+            return value >= predicate.number;
+        default:
+            return false;
+    }
+}
+
+/*
+ * @method: compareText
+ * @brief: applies a numeric comparison predicate to the text of its column, see test
+ */
+bool logFilter::compareText( const filterPredicate &predicate, std::string_view value )
+{
+    uint64_t number;
+
+    return compare( predicate, parseNumber( value, number ) ? number : 0 );
+}
+
+/*
+ * @method: save
+ * @brief: serializes the predicates in evaluation order (see webServerAnalyser::saveState)
+ * @output - writer: the state being written
+ */
+void logFilter::save( stateWriter &writer ) const
+{
+    writer.number( predicates.size() );
+    for (const auto &predicate: predicates)
+    {
+        writer.number( static_cast <uint64_t>( predicate.field ) );
+        writer.number( static_cast <uint64_t>( predicate.op ) );
+        writer.number( predicate.number );
+        writer.number( predicate.patterns.size() );
+        for (const auto &pattern: predicate.patterns)
+        {
+            writer.number( static_cast <uint64_t>( pattern.kind ) );
+            writer.text( pattern.text );
+            writer.number( pattern.network );
+            writer.number( pattern.mask );
+        }
+    }
+}
+
+/*
+ * @method: load
+ * @brief: restores the predicates serialized by save, replacing the predicates of the filter
+ * @input - reader: the state being read
+ * @return: returns false if the serialized predicates are malformed
+ */
+bool logFilter::load( stateReader &reader )
+{
+    uint64_t savedPredicates = reader.number();
+
+    predicates.clear();
+    for (uint64_t saved = 0; saved < savedPredicates && !reader.failed(); saved++)
+    {
+        filterPredicate predicate;
+        uint64_t field = reader.number(), op = reader.number();
+        predicate.number = reader.number();
+        if ( field > static_cast <uint64_t>( filterField::resource ) || op > static_cast <uint64_t>( filterOp::greaterEqual ) )
+        {
+            return false;
+        }
+        predicate.field = static_cast <filterField>( field );
+        predicate.op = static_cast <filterOp>( op );
+
+        uint64_t savedPatterns = reader.number();
+        for (uint64_t savedPattern = 0; savedPattern < savedPatterns && !reader.failed(); savedPattern++)
+        {
+            filterPattern pattern;
+            uint64_t kind = reader.number();
+            if ( kind > static_cast <uint64_t>( patternKind::statusClass ) )
+            {
+                return false;
+            }
+            pattern.kind = static_cast <patternKind>( kind );
+            pattern.text = reader.text();
+            pattern.network = static_cast <uint32_t>( reader.number() );
+            pattern.mask = static_cast <uint32_t>( reader.number() );
+            predicate.patterns.push_back( pattern );
+        }
+        predicates.push_back( predicate ); // already in evaluation order
+    }
+
+    return !reader.failed();
+}
+
+/*
+ * @method: needs
+ * @return: returns true if a predicate tests the provided column
+ */
+bool logFilter::needs( filterField field ) const
+{
+    return std::any_of( predicates.begin(), predicates.end(), [field]( const filterPredicate &predicate )
+    {
+        return predicate.field == field;
+    } );
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "stateFile.h"
+
+/*
+ * @enum: filterField
+ * @brief: column tested by a filter predicate, listed by increasing cost of extraction from a parsed line
+ */
+enum class filterField
+{
+    status,   // HTTP response column, compared as is
+    host,     // host column, compared as is
+    size,     // reply size column, converted into a number
+    date,     // date time column, converted into a packed date (see webServerAnalyser::parseDate)
+    method,   // HTTP method, the request is split
+    resource  // URI of the request, the request is split
+};
+
+/*
+ * @enum: filterOp
+ * @brief: test applied by a filter predicate
+ */
+enum class filterOp
+{
+    match,        // the value matches one of the patterns
+    noMatch,      // the value matches none of the patterns
+    equal,        // numeric comparisons (size, date, status)
+    notEqual,
+    less,
+    lessEqual,
+    greater,
+    greaterEqual
+};
+
+/*
+ * @enum: patternKind
+ * @brief: how a pattern of a match / noMatch predicate compares to a value
+ */
+enum class patternKind
+{
+    exact,       // "GET"
+    prefix,      // "/images/*"
+    suffix,      // "*.gif"
+    cidr,        // "192.168.0.0/16", IPv4 hosts only
+    statusClass  // "4xx"
+};
+
+/*
+ * @struct: filterPattern
+ * @brief: one alternative of a match / noMatch predicate
+ * @member - kind: how the pattern compares to a value
+ * @member - text: the value, prefix or suffix to compare with (first digit of a status class)
+ * @member - network: network address of a CIDR pattern
+ * @member - mask: network mask of a CIDR pattern
+ */
+typedef struct filterPattern
+{
+    patternKind kind = patternKind::exact;
+    std::string text;
+    uint32_t network = 0;
+    uint32_t mask = 0;
+} filterPattern;
+
+/*
+ * @struct: filterPredicate
+ * @brief: one test of a filter, a line passes the filter if it passes every predicate
+ * @member - field: the column tested
+ * @member - op: the test applied to the column
+ * @member - patterns: alternatives of a match / noMatch test
+ * @member - number: operand of a numeric comparison
+ */
+typedef struct filterPredicate
+{
+    filterField field = filterField::status;
+    filterOp op = filterOp::match;
+    std::vector <filterPattern> patterns;
+    uint64_t number = 0;
+} filterPredicate;
+
+/*
+ * @class: logFilter
+ * @brief: conjunction of predicates over the columns of a log line, compiled from an expression such as
+ *         "status=4xx,5xx and uri=/api/prefix and size>100000 and host=10.0.0.0/8"
+ *         Predicates are kept in evaluation order: columns that are cheap to extract first (a status is compared as is,
+ *         a request has to be split), then the tests that reject the most lines first (exact matches before ranges and
+ *         exclusions), so that most lines are rejected before the costly columns are extracted
+ */
+class logFilter
+{
+    private:
+        std::vector <filterPredicate> predicates; // in evaluation order
+
+       /*
+        * @method: rank
+        * @return: returns the evaluation rank of a predicate, lower ranks are evaluated first
+        */
+        static unsigned int rank( const filterPredicate &predicate );
+
+       /*
+        * @method: matchesPatterns
+        * @brief: applies a match / noMatch predicate with several or non exact patterns, see matches
+        */
+        static bool matchesPatterns( const filterPredicate &predicate, std::string_view value );
+
+       /*
+        * @method: compareText
+        * @brief: applies a numeric comparison predicate to the text of its column, see test
+        */
+        static bool compareText( const filterPredicate &predicate, std::string_view value );
+
+    public:
+       /*
+        * @method: compile
+        * @brief: parses a filter expression: predicates "field op value" joined by "and" (or "&&")
+        *         fields: method, status, host, uri, size, time
+        *         op: = or != followed by comma separated alternatives (prefix*, *suffix, a.b.c.d/n for hosts, Nxx for
+        *         status classes), or <, <=, >, >= followed by a number (size, status) or a [DD:HH:MM:SS] date time (time)
+        * @input - expression: the filter expression, empty for a filter that passes every line
+        * @output - filter: the compiled filter, in evaluation order
+        * @output - error: description of the first syntax error
+        * @return: returns true if the expression was compiled, false if it is malformed
+        */
+        static bool compile( const std::string &expression, logFilter &filter, std::string &error );
+
+       /*
+        * @method: add
+        * @brief: adds a predicate to the filter, keeping the evaluation order
+        */
+        void add( const filterPredicate &predicate );
+
+       /*
+        * @method: requireEqual
+        * @brief: adds an exact match predicate (ex. the HTTP method of a query)
+        */
+        void requireEqual( filterField field, std::string_view value );
+
+       /*
+        * @method: matches
+        * @brief: applies a match / noMatch predicate to the value of its column
+        *         A single exact value (ex. the HTTP method of a query) is compared inline, as it is tested on every line
+        */
+        static bool matches( const filterPredicate &predicate, std::string_view value )
+        {
+            if ( predicate.patterns.size() == 1 && predicate.patterns[0].kind == patternKind::exact )
+            {
+                return ( value == predicate.patterns[0].text ) != ( predicate.op == filterOp::noMatch );
+            }
+            return matchesPatterns( predicate, value );
+        }
+
+       /*
+        * @method: compare
+        * @brief: applies a numeric comparison predicate to the value of its column
+        */
+        static bool compare( const filterPredicate &predicate, uint64_t value );
+
+       /*
+        * @method: test
+        * @brief: applies a predicate to the text of its column, numeric comparisons convert the text first (a size of "-" is 0)
+        *         Date time predicates compare packed dates, see compare
+        */
+        static bool test( const filterPredicate &predicate, std::string_view value )
+        {
+            if ( predicate.op == filterOp::match || predicate.op == filterOp::noMatch )
+            {
+                return matches( predicate, value );
+            }
+            return compareText( predicate, value );
+        }
+
+       /*
+        * @method: save
+        * @brief: serializes the predicates in evaluation order (see webServerAnalyser::saveState)
+        * @output - writer: the state being written
+        */
+        void save( stateWriter &writer ) const;
+
+       /*
+        * @method: load
+        * @brief: restores the predicates serialized by save, replacing the predicates of the filter
+        * @input - reader: the state being read
+        * @return: returns false if the serialized predicates are malformed
+        */
+        bool load( stateReader &reader );
+
+       /*
+        * @method: needs
+        * @return: returns true if a predicate tests the provided column
+        */
+        bool needs( filterField field ) const;
+
+        const std::vector <filterPredicate> &chain() const { return predicates; }
+        bool empty() const { return predicates.empty(); }
+};
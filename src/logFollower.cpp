@@ -0,0 +1,133 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "logFollower.h"
+
+/*
+ * @method: logFollower
+ * @input - filePath: the log file to follow, it does not need to exist yet
+ * @input - fromStart: read the existing contents of the log first instead of only the lines appended from now on
+ */
+logFollower::logFollower( const std::string &filePath, bool fromStart ) : filePath( filePath ), skipExisting( !fromStart )
+{
+    openFile();
+}
+
+logFollower::~logFollower()
+{
+    if ( fd >= 0 )
+    {
+        close( fd );
+    }
+}
+
+/*
+ * @method: openFile
+ * @brief: opens the file behind filePath, from its end for the first file unless the existing contents are read
+ * @return: returns true if the file was opened, false otherwise
+ */
+bool logFollower::openFile()
+{
+    struct stat fileInfo;
+    int newFd = open( filePath.c_str(), O_RDONLY | O_CLOEXEC );
+
+    if ( newFd < 0 )
+    {
+        return false;
+    }
+    if ( fstat( newFd, &fileInfo ) != 0 )
+    {
+        close( newFd );
+        return false;
+    }
+
+    if ( fd >= 0 )
+    {
+        close( fd );
+    }
+    fd = newFd;
+    device = fileInfo.st_dev;
+    inode = fileInfo.st_ino;
+    offset = skipExisting ? fileInfo.st_size : 0;
+    skipExisting = false; // files created after the start of the follow (rotations) are read entirely
+    lseek( fd, offset, SEEK_SET );
+
+    return true;
+}
+
+/*
+ * @method: readAvailable
+ * @brief: appends the bytes of the open file up to its current end to pending, at most FOLLOW_POLL_SIZE bytes per poll
+ * @return: returns true if the end of the file was reached, false if bytes are left for the next poll
+ */
+bool logFollower::readAvailable()
+{
+    char buffer[FOLLOW_READ_SIZE];
+    ssize_t bytesRead = 0;
+
+    while ( pending.size() < FOLLOW_POLL_SIZE && ( bytesRead = read( fd, buffer, sizeof( buffer ) ) ) > 0 )
+    {
+        pending.append( buffer, bytesRead );
+        offset += bytesRead;
+    }
+
+    return bytesRead <= 0;
+}
+
+/*
+ * @method: poll
+ * @brief: reads the lines appended since the last poll, following rotations and truncations
+ * @output - lines: the complete lines read, each one ending with a newline (empty if nothing was appended)
+ * @output - linesPosition: position of the first line since the start of the follow (see logFollower::position)
+ * @return: returns false if the log is not open (ex. missing file), true otherwise
+ */
+bool logFollower::poll( std::string &lines, uint64_t &linesPosition )
+{
+    struct stat pathInfo;
+
+    lines.clear();
+    linesPosition = position;
+    if ( fd < 0 && !openFile() )
+    {
+        return false;
+    }
+
+    // Step 1: read what was appended to the open file
+    bool caughtUp = readAvailable();
+
+    // Step 2: a different file behind the path is a rotation: the rotated file was read up to its end, follow the new one
+    // A file shorter than what was read was truncated in place: follow it again from its start
+    if ( caughtUp && stat( filePath.c_str(), &pathInfo ) == 0 )
+    {
+        if ( pathInfo.st_dev != device || pathInfo.st_ino != inode )
+        {
+            if ( !pending.empty() && pending.back() != '\n' )
+            {
+                pending += '\n'; // the last line of the rotated file will never be completed
+            }
+            if ( openFile() )
+            {
+                readAvailable();
+            }
+        }
+        else if ( static_cast <uint64_t>( pathInfo.st_size ) < offset )
+        {
+            pending.clear();
+            offset = 0;
+            lseek( fd, 0, SEEK_SET );
+            readAvailable();
+        }
+    }
+
+    // Step 3: hand out the complete lines, keep the line being written
+    size_t lastNewline = pending.rfind( '\n' );
+    if ( lastNewline != std::string::npos )
+    {
+        lines.assign( pending, 0, lastNewline + 1 );
+        pending.erase( 0, lastNewline + 1 );
+        position += lines.size();
+    }
+
+    return true;
+}
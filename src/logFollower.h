@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <sys/types.h>
+
+#define FOLLOW_READ_SIZE ( 64 << 10 ) // bytes read from the followed log per read call
+#define FOLLOW_POLL_SIZE ( 16 << 20 ) // bytes read per poll at most, a large backlog is handed out over several polls
+
+/*
+ * @class: logFollower
+ * @brief: keeps a growing log file open and reads only the bytes appended since the last poll (like tail -F)
+ *         Rotations are detected by comparing the file behind the path with the open file: the rest of the rotated file is
+ *         read first, then the new file is followed from its start. A file truncated in place is followed from its start
+ *         Only complete lines are handed out, a line being written is kept until its newline arrives
+ */
+class logFollower
+{
+    private:
+        std::string filePath;
+        int fd = -1;
+        dev_t device = 0; // identity of the open file, compared with the file behind filePath
+        ino_t inode = 0;
+        uint64_t offset = 0; // bytes read from the open file
+        uint64_t position = 0; // bytes handed out since the start of the follow, across rotations
+        std::string pending; // bytes read after the last complete line
+        bool skipExisting; // the first file is followed from its end
+
+       /*
+        * @method: openFile
+        * @brief: opens the file behind filePath, from its end for the first file unless the existing contents are read
+        * @return: returns true if the file was opened, false otherwise
+        */
+        bool openFile();
+
+       /*
+        * @method: readAvailable
+        * @brief: appends the bytes of the open file up to its current end to pending, at most FOLLOW_POLL_SIZE bytes per poll
+        * @return: returns true if the end of the file was reached, false if bytes are left for the next poll
+        */
+        bool readAvailable();
+
+    public:
+       /*
+        * @method: logFollower
+        * @input - filePath: the log file to follow, it does not need to exist yet
+        * @input - fromStart: read the existing contents of the log first instead of only the lines appended from now on
+        */
+        logFollower( const std::string &filePath, bool fromStart );
+        ~logFollower();
+
+        logFollower( const logFollower & ) = delete;
+        logFollower &operator=( const logFollower & ) = delete;
+
+       /*
+        * @method: poll
+        * @brief: reads the lines appended since the last poll, following rotations and truncations
+        * @output - lines: the complete lines read, each one ending with a newline (empty if nothing was appended)
+        * @output - linesPosition: position of the first line since the start of the follow (see logFollower::position)
+        * @return: returns false if the log is not open (ex. missing file), true otherwise
+        */
+        bool poll( std::string &lines, uint64_t &linesPosition );
+};
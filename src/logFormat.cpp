@@ -0,0 +1,179 @@
+#include <cctype>
+
+#include "logFormat.h"
+#include "logTokenizer.h"
+
+/*
+ * @method: logFormat
+ * @brief: builds the format of this tool's logs (LOG_FORMAT_DEFAULT)
+ */
+logFormat::logFormat()
+{
+    std::string error;
+    compile( LOG_FORMAT_DEFAULT, *this, error );
+}
+
+/*
+ * @method: compile
+ * @brief: parses a log format descriptor: $variables separated by literal text
+ *         Known variables fill the webServerLog (see logColumn), any other variable is a field that is skipped
+ *         A variable must be followed by a space, a quote closing a quoted variable, a bracket closing a bracketed
+ *         variable (kept with its brackets, ex. "[10/Oct/2000:13:55:36 -0700]") or the end of the line
+ * @input - descriptor: the descriptor, or the name of a predefined format: default, common or combined
+ * @output - format: the compiled format, restricted to every column it holds
+ * @output - error: description of the first error
+ * @return: returns true if the descriptor was compiled, false if it is malformed
+ */
+bool logFormat::compile( const std::string &descriptor, logFormat &format, std::string &error )
+{
+    static const char *variableNames[] = { "remote_addr", "time_local", "request", "status", "body_bytes_sent", "bytes_sent" };
+    static const unsigned int variableColumns[] = { 0, 1, 2, 3, 4, 4 }; // bit index of the logColumn of each variable
+    std::string layout = descriptor == "default" ? LOG_FORMAT_DEFAULT :
+                         descriptor == "common" ? LOG_FORMAT_COMMON :
+                         descriptor == "combined" ? LOG_FORMAT_COMBINED : descriptor;
+    std::vector <std::string> literals( 1 ), names; // literals[i] precedes names[i], literals.back() follows the last variable
+    std::vector <size_t> offsets;
+
+    // Step 1: split the descriptor into variables and the literal text around them
+    for (size_t linePos = 0; linePos < layout.size(); )
+    {
+        auto isNameChar = [&]( size_t position )
+        {
+            return position < layout.size() && ( islower( static_cast <unsigned char>( layout[position] ) ) ||
+                                                 isdigit( static_cast <unsigned char>( layout[position] ) ) || layout[position] == '_' );
+        };
+        if ( layout[linePos] != '$' || !isNameChar( linePos + 1 ) )
+        {
+            literals.back() += layout[linePos++];
+            continue;
+        }
+        size_t nameEnd = linePos + 1;
+        while ( isNameChar( nameEnd ) )
+        {
+            nameEnd++;
+        }
+        names.push_back( layout.substr( linePos + 1, nameEnd - linePos - 1 ) );
+        offsets.push_back( linePos );
+        literals.emplace_back();
+        linePos = nameEnd;
+    }
+    if ( names.empty() )
+    {
+        error = "the log format has no $variable";
+        return false;
+    }
+
+    // Step 2: one field per variable, ended by the character following it
+    std::vector <formatField> fields;
+    unsigned int available = 0;
+    bool previousBracketed = false;
+    for (size_t variable = 0; variable < names.size(); variable++)
+    {
+        const std::string &lead = literals[variable], &trail = literals[variable + 1];
+        bool last = variable + 1 == names.size();
+        bool bracketed = !lead.empty() && lead.back() == '[' && !trail.empty() && trail.front() == ']';
+        bool quoted = !lead.empty() && lead.back() == '"' && !trail.empty() && trail.front() == '"';
+        std::string separator = bracketed ? trail.substr( 1 ) : trail; // a bracketed field keeps its closing bracket
+        formatField field;
+
+        // The brackets of a bracketed field belong to the field, not to the literals around it
+        field.skip = static_cast <uint32_t>( lead.size() - ( previousBracketed ? 1 : 0 ) - ( bracketed ? 1 : 0 ) );
+        if ( quoted )
+        {
+            // Quotes may appear inside a quoted field: only a quote followed by the next literal character ends it
+            field.classes = TOKEN_QUOTE | TOKEN_NEWLINE;
+            field.after = separator.size() > 1 ? separator[1] : last ? '\n' : 0;
+        }
+        else if ( ( separator.empty() && last ) || ( !separator.empty() && separator.front() == ' ' ) )
+        {
+            // A bracketed field may hold spaces (ex. a time zone): only a space following its closing bracket ends it
+            field.classes = TOKEN_SPACE | TOKEN_NEWLINE;
+            field.before = bracketed ? ']' : 0;
+        }
+        else
+        {
+            error = "$" + names[variable] + " at offset " + std::to_string( offsets[variable] ) +
+                    " must be followed by a space, a closing quote or bracket, or the end of the line";
+            return false;
+        }
+
+        for (size_t known = 0; known < sizeof( variableNames ) / sizeof( variableNames[0] ); known++)
+        {
+            if ( names[variable] == variableNames[known] )
+            {
+                field.column = variableColumns[known];
+            }
+        }
+        if ( field.column != FIELD_SKIPPED && ( available & ( 1u << field.column ) ) )
+        {
+            error = "$" + names[variable] + " at offset " + std::to_string( offsets[variable] ) + " repeats a column of the format";
+            return false;
+        }
+        available |= field.column != FIELD_SKIPPED ? 1u << field.column : 0;
+        fields.push_back( field );
+        previousBracketed = bracketed;
+    }
+
+    format.formatFields.swap( fields );
+    format.available = available;
+    format.calendar = layout != LOG_FORMAT_DEFAULT;
+    format = format.restrict( COLUMN_ALL );
+
+    return true;
+}
+
+/*
+ * @method: fingerprint
+ * @brief: hashes the layout of the format (64-bit FNV-1a of its fields), ex. to tell whether an index was built with it
+ * @return: returns the same value for formats compiled from the same layout (restricted formats hash differently)
+ */
+uint64_t logFormat::fingerprint() const
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    auto hashValue = [&hash]( uint64_t value )
+    {
+        for (int byte = 0; byte < 8; byte++)
+        {
+            hash = ( hash ^ ( ( value >> ( 8 * byte ) ) & 0xFF ) ) * 0x100000001B3ull;
+        }
+    };
+
+    hashValue( calendar ? 1 : 0 );
+    for (const auto &field: formatFields)
+    {
+        hashValue( field.column );
+        hashValue( field.skip );
+        hashValue( field.classes );
+        hashValue( static_cast <unsigned char>( field.before ) );
+        hashValue( static_cast <unsigned char>( field.after ) );
+    }
+
+    return hash;
+}
+
+/*
+ * @method: restrict
+ * @brief: provides a copy of the format that only materializes the requested columns and stops after the last one
+ * @input - columns: combination of logColumn flags
+ * @return: returns the restricted format
+ */
+logFormat logFormat::restrict( unsigned int columns ) const
+{
+    logFormat restricted = *this;
+
+    restricted.parsed = 0;
+    for (size_t field = 0; field < restricted.formatFields.size(); field++)
+    {
+        formatField &restrictedField = restricted.formatFields[field];
+        if ( restrictedField.column != FIELD_SKIPPED && !( columns & ( 1u << restrictedField.column ) ) )
+        {
+            restrictedField.column = FIELD_SKIPPED;
+        }
+        if ( restrictedField.column != FIELD_SKIPPED )
+        {
+            restricted.parsed = field + 1;
+        }
+    }
+
+    return restricted;
+}
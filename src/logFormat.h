@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define LOG_FORMAT_DEFAULT "$remote_addr [$time_local] \"$request\" $status $body_bytes_sent"
+#define LOG_FORMAT_COMMON "$remote_addr $remote_ident $remote_user [$time_local] \"$request\" $status $body_bytes_sent"
+#define LOG_FORMAT_COMBINED LOG_FORMAT_COMMON " \"$http_referer\" \"$http_user_agent\""
+
+#define LOG_COLUMNS 5 // number of logColumn flags, see webServerLog
+#define FIELD_SKIPPED LOG_COLUMNS // formatField.column of a field that no column is filled from
+
+/*
+ * @enum: logColumn
+ * @brief: columns of the webServerLog filled by a log format, combined as flags when restricting a format
+ */
+enum logColumn : unsigned int
+{
+    COLUMN_HOST = 1 << 0,     // $remote_addr
+    COLUMN_DATE = 1 << 1,     // $time_local
+    COLUMN_REQUEST = 1 << 2,  // $request
+    COLUMN_RESPONSE = 1 << 3, // $status
+    COLUMN_SIZE = 1 << 4,     // $body_bytes_sent, $bytes_sent
+    COLUMN_ALL = ( 1 << LOG_COLUMNS ) - 1
+};
+
+/*
+ * @struct: formatField
+ * @brief: one field of a compiled log format: where it starts and which structural character ends it
+ * @member - column: bit index of the logColumn filled from the field, FIELD_SKIPPED if the field is not materialized
+ * @member - skip: literal bytes between the end of the previous field and the field (ex. " \"" before a quoted request)
+ * @member - classes: tokenClass flags of the character ending the field, TOKEN_NEWLINE included
+ * @member - before: byte that must precede the ending character (']' ending a bracketed date time), 0 for any byte
+ * @member - after: byte that must follow the ending character (' ' after the quote ending a quoted field, '\n' at the end
+ *           of the line), 0 for any byte
+ */
+typedef struct formatField
+{
+    unsigned int column = FIELD_SKIPPED;
+    uint32_t skip = 0;
+    unsigned int classes = 0;
+    char before = 0;
+    char after = 0;
+} formatField;
+
+/*
+ * @class: logFormat
+ * @brief: layout of the log lines, compiled once from an nginx log_format like descriptor such as
+ *         "$remote_addr - $remote_user [$time_local] \"$request\" $status $body_bytes_sent \"$http_referer\""
+ *         Each variable becomes a field ended by the structural character that follows it, found with the tokenizer
+ *         A format restricted to the columns of a run stops at the last field it needs: trailing fields (ex. the referer and
+ *         user agent of the Combined Log Format) are never scanned, the other unused fields are skipped without being stored
+ */
+class logFormat
+{
+    private:
+        std::vector <formatField> formatFields; // in line order
+        size_t parsed = 0; // fields scanned per line, up to the last field holding a requested column
+        unsigned int available = 0; // logColumn flags of the columns present in the format
+        bool calendar = false; // date times are calendar dates, see calendarDates
+
+    public:
+       /*
+        * @method: logFormat
+        * @brief: builds the format of this tool's logs (LOG_FORMAT_DEFAULT)
+        */
+        logFormat();
+
+       /*
+        * @method: compile
+        * @brief: parses a log format descriptor: $variables separated by literal text
+        *         Known variables fill the webServerLog (see logColumn), any other variable is a field that is skipped
+        *         A variable must be followed by a space, a quote closing a quoted variable, a bracket closing a bracketed
+        *         variable (kept with its brackets, ex. "[10/Oct/2000:13:55:36 -0700]") or the end of the line
+        * @input - descriptor: the descriptor, or the name of a predefined format: default, common or combined
+        * @output - format: the compiled format, restricted to every column it holds
+        * @output - error: description of the first error
+        * @return: returns true if the descriptor was compiled, false if it is malformed
+        */
+        static bool compile( const std::string &descriptor, logFormat &format, std::string &error );
+
+       /*
+        * @method: restrict
+        * @brief: provides a copy of the format that only materializes the requested columns and stops after the last one
+        * @input - columns: combination of logColumn flags
+        * @return: returns the restricted format
+        */
+        logFormat restrict( unsigned int columns ) const;
+
+        const formatField *fields() const { return formatFields.data(); }
+        size_t parsedFields() const { return parsed; }
+        unsigned int columns() const { return available; }
+
+       /*
+        * @method: fingerprint
+        * @brief: hashes the layout of the format (64-bit FNV-1a of its fields), ex. to tell whether an index was built with it
+        * @return: returns the same value for formats compiled from the same layout (restricted formats hash differently)
+        */
+        uint64_t fingerprint() const;
+
+       /*
+        * @method: calendarDates
+        * @brief: tells how the date times of the format read: this tool's format (LOG_FORMAT_DEFAULT) counts days from day 0
+        *         ([DD:HH:MM:SS]), every other format holds calendar dates ([DD/Mon/YYYY:HH:MM:SS +ZZZZ]) whose packed date
+        *         times are seconds since the Unix epoch and are printed back as calendar dates (see queryResult::appendDate)
+        * @return: returns true if the date times of the format are calendar dates
+        */
+        bool calendarDates() const { return calendar; }
+};
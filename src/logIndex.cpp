@@ -0,0 +1,248 @@
+#include <cstring>
+#include <fstream>
+
+#include <sys/stat.h>
+
+#include "logIndex.h"
+
+#define INDEX_ALIGNMENT 8 // columns start on 8 byte boundaries so they can be used in place from the mapping
+
+/*
+ * @method: appendRow
+ * @brief: adds one parsed log line to the index
+ * @input - keys: value of each indexDictionary column (host, resource, method, response)
+ * @input - date: packed date time of the line
+ * @input - size: number of bytes in the reply
+ */
+void logIndexWriter::appendRow( const std::string_view ( &keys )[INDEX_DICTIONARIES], uint32_t date, uint64_t size )
+{
+    uint64_t row = dateColumn.size();
+
+    for (int dictionary = 0; dictionary < INDEX_DICTIONARIES; dictionary++)
+    {
+        keyColumns[dictionary].push_back( static_cast <uint32_t>( dictionaries[dictionary].increment( keys[dictionary], row ) ) );
+    }
+
+    timeOrdered = timeOrdered && ( dateColumn.empty() || dateColumn.back() <= date );
+    dateColumn.push_back( date );
+    sizeColumn.push_back( size );
+}
+
+/*
+ * @method: write
+ * @brief: writes the index file for the provided log
+ * @input - indexPath: path of the index file to write
+ * @input - sourcePath: path of the indexed log, its size and modification time are recorded to detect stale indexes
+ * @input - formatFingerprint: logFormat::fingerprint of the format the log was parsed with
+ * @return: returns true if the index was written successfully, false otherwise
+ */
+bool logIndexWriter::write( const std::string &indexPath, const std::string &sourcePath, uint64_t formatFingerprint ) const
+{
+    indexHeader header = {};
+    std::string temporaryPath = indexPath + ".tmp";
+    std::ofstream indexFile( temporaryPath, std::ios::binary | std::ios::trunc );
+    static const char padding[INDEX_ALIGNMENT] = {};
+
+    if ( !indexFile || !logIndex::sourceStatus( sourcePath, header.sourceSize, header.sourceModified ) )
+    {
+        return false;
+    }
+
+    memcpy( header.magic, INDEX_MAGIC, sizeof( header.magic ) );
+    header.version = INDEX_VERSION;
+    header.flags = timeOrdered ? INDEX_FLAG_TIME_ORDERED : 0;
+    header.formatFingerprint = formatFingerprint;
+    header.rows = dateColumn.size();
+    for (int dictionary = 0; dictionary < INDEX_DICTIONARIES; dictionary++)
+    {
+        header.dictionarySizes[dictionary] = static_cast <uint32_t>( dictionaries[dictionary].size() );
+    }
+    indexFile.write( reinterpret_cast <const char *>( &header ), sizeof( header ) );
+
+    // Dictionaries: length prefixed values, in ID order
+    for (int dictionary = 0; dictionary < INDEX_DICTIONARIES; dictionary++)
+    {
+        for (size_t id = 0; id < dictionaries[dictionary].size(); id++)
+        {
+            std::string_view key = dictionaries[dictionary].key( id );
+            uint32_t length = static_cast <uint32_t>( key.size() );
+            indexFile.write( reinterpret_cast <const char *>( &length ), sizeof( length ) );
+            indexFile.write( key.data(), key.size() );
+        }
+    }
+
+    // Columns: one array per column, each aligned on INDEX_ALIGNMENT
+    auto writeColumn = [&]( const void *column, size_t bytes )
+    {
+        indexFile.write( padding, ( INDEX_ALIGNMENT - indexFile.tellp() % INDEX_ALIGNMENT ) % INDEX_ALIGNMENT );
+        indexFile.write( static_cast <const char *>( column ), bytes );
+    };
+    for (int dictionary = 0; dictionary < INDEX_DICTIONARIES; dictionary++)
+    {
+        writeColumn( keyColumns[dictionary].data(), keyColumns[dictionary].size() * sizeof( uint32_t ) );
+    }
+    writeColumn( dateColumn.data(), dateColumn.size() * sizeof( uint32_t ) );
+    writeColumn( sizeColumn.data(), sizeColumn.size() * sizeof( uint64_t ) );
+
+    // Publish the index atomically so that readers never see a partially written file
+    indexFile.close();
+    return indexFile && rename( temporaryPath.c_str(), indexPath.c_str() ) == 0;
+}
+
+/*
+ * @method: load
+ * @brief: maps an index file and validates its layout
+ * @input - indexPath: path of the index file to load
+ * @return: returns true if the index was loaded successfully, false if it is missing or malformed
+ */
+bool logIndex::load( const std::string &indexPath )
+{
+    mapping = std::make_unique <mappedFile>( indexPath );
+    std::string_view contents = mapping->data();
+    size_t position = sizeof( indexHeader );
+
+    if ( contents.size() < sizeof( indexHeader ) )
+    {
+        return false;
+    }
+    memcpy( &header, contents.data(), sizeof( header ) );
+    if ( memcmp( header.magic, INDEX_MAGIC, sizeof( header.magic ) ) != 0 || header.version != INDEX_VERSION )
+    {
+        return false;
+    }
+
+    for (int dictionary = 0; dictionary < INDEX_DICTIONARIES; dictionary++)
+    {
+        dictionaries[dictionary].clear();
+        dictionaries[dictionary].reserve( header.dictionarySizes[dictionary] );
+        for (uint32_t id = 0; id < header.dictionarySizes[dictionary]; id++)
+        {
+            uint32_t length;
+            if ( position + sizeof( length ) > contents.size() )
+            {
+                return false;
+            }
+            memcpy( &length, contents.data() + position, sizeof( length ) );
+            position += sizeof( length );
+            if ( length > contents.size() - position )
+            {
+                return false;
+            }
+            dictionaries[dictionary].push_back( contents.substr( position, length ) );
+            position += length;
+        }
+    }
+
+    auto mapColumn = [&]( size_t elementSize ) -> const void *
+    {
+        position += ( INDEX_ALIGNMENT - position % INDEX_ALIGNMENT ) % INDEX_ALIGNMENT;
+        if ( position > contents.size() || ( contents.size() - position ) / elementSize < header.rows )
+        {
+            return nullptr;
+        }
+        const void *column = contents.data() + position;
+        position += header.rows * elementSize;
+        return column;
+    };
+    for (int dictionary = 0; dictionary < INDEX_DICTIONARIES; dictionary++)
+    {
+        keyColumns[dictionary] = static_cast <const uint32_t *>( mapColumn( sizeof( uint32_t ) ) );
+        if ( keyColumns[dictionary] == nullptr )
+        {
+            return false;
+        }
+    }
+    dateColumn = static_cast <const uint32_t *>( mapColumn( sizeof( uint32_t ) ) );
+    sizeColumn = static_cast <const uint64_t *>( mapColumn( sizeof( uint64_t ) ) );
+
+    return dateColumn != nullptr && sizeColumn != nullptr;
+}
+
+/*
+ * @method: isFresh
+ * @brief: verifies that the index was built from the current contents of the provided log, parsed with the same format
+ * @input - sourcePath: path of the indexed log
+ * @input - formatFingerprint: logFormat::fingerprint of the format the log is read with
+ * @return: returns true if the log size, modification time and format match the ones recorded in the index
+ */
+bool logIndex::isFresh( const std::string &sourcePath, uint64_t formatFingerprint ) const
+{
+    uint64_t size;
+    int64_t modified;
+
+    return sourceStatus( sourcePath, size, modified ) && size == header.sourceSize && modified == header.sourceModified &&
+           formatFingerprint == header.formatFingerprint;
+}
+
+/*
+ * @method: attach
+ * @brief: views the columns of a writer in memory instead of an index file (ex. a resident log, see loadResident)
+ *         Rows appended to the writer afterwards are only seen once attach is called again: the columns may have moved
+ *         Dictionary values are never moved by the writer, only the entries added since the last attach are looked up
+ * @input - writer: the columns to view, must outlive the logIndex and not be modified while the logIndex is read
+ */
+void logIndex::attach( const logIndexWriter &writer )
+{
+    if ( mapping != nullptr )
+    {
+        mapping.reset();
+        for (auto &dictionary: dictionaries)
+        {
+            dictionary.clear();
+        }
+    }
+
+    header.flags = writer.timeOrdered ? INDEX_FLAG_TIME_ORDERED : 0;
+    header.rows = writer.dateColumn.size();
+    for (int dictionary = 0; dictionary < INDEX_DICTIONARIES; dictionary++)
+    {
+        for (size_t id = dictionaries[dictionary].size(); id < writer.dictionaries[dictionary].size(); id++)
+        {
+            dictionaries[dictionary].push_back( writer.dictionaries[dictionary].key( id ) );
+        }
+        header.dictionarySizes[dictionary] = static_cast <uint32_t>( dictionaries[dictionary].size() );
+        keyColumns[dictionary] = writer.keyColumns[dictionary].data();
+    }
+    dateColumn = writer.dateColumn.data();
+    sizeColumn = writer.sizeColumn.data();
+}
+
+/*
+ * @method: findKey
+ * @brief: looks up the ID of a value in a dictionary (linear search, meant for the small method / response dictionaries)
+ * @input - dictionary: the dictionary to search
+ * @input - key: the value to look for
+ * @return: returns the ID of the value, UINT32_MAX if the value never appears in the log
+ */
+uint32_t logIndex::findKey( indexDictionary dictionary, std::string_view key ) const
+{
+    for (size_t id = 0; id < dictionaries[dictionary].size(); id++)
+    {
+        if ( dictionaries[dictionary][id] == key )
+        {
+            return static_cast <uint32_t>( id );
+        }
+    }
+    return UINT32_MAX;
+}
+
+/*
+ * @method: sourceStatus
+ * @brief: reads the size and modification time of a log file
+ * @input - sourcePath: path of the log file
+ * @output - size: size of the file in bytes
+ * @output - modified: modification time of the file in ns
+ * @return: returns true if the file exists, false otherwise
+ */
+bool logIndex::sourceStatus( const std::string &sourcePath, uint64_t &size, int64_t &modified )
+{
+    struct stat fileInfo;
+
+    if ( stat( sourcePath.c_str(), &fileInfo ) != 0 )
+    {
+        return false;
+    }
+    size = fileInfo.st_size;
+    modified = static_cast <int64_t>( fileInfo.st_mtim.tv_sec ) * 1000000000 + fileInfo.st_mtim.tv_nsec;
+    return true;
+}
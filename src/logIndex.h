@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "keyCounter.h"
+#include "mappedFile.h"
+
+#define INDEX_EXTENSION ".idx" // sidecar index of "access.log" is "access.log.idx"
+#define INDEX_MAGIC "WSLINDEX"
+#define INDEX_VERSION 2
+#define INDEX_FLAG_TIME_ORDERED 0x1 // rows are sorted by date time
+
+/*
+ * @enum: indexDictionary
+ * @brief: dictionary-encoded columns of a logIndex, each value is stored once and referenced by ID
+ */
+enum indexDictionary
+{
+    INDEX_HOST,
+    INDEX_RESOURCE,
+    INDEX_METHOD,
+    INDEX_RESPONSE,
+    INDEX_DICTIONARIES // number of dictionaries
+};
+
+/*
+ * @struct: indexHeader
+ * @brief: fixed size header at the start of an index file
+ * @member - magic: INDEX_MAGIC, identifies index files
+ * @member - version: INDEX_VERSION of the writer
+ * @member - flags: INDEX_FLAG_* properties of the indexed rows
+ * @member - sourceSize: size in bytes of the indexed log when the index was built
+ * @member - sourceModified: modification time (ns) of the indexed log when the index was built
+ * @member - formatFingerprint: logFormat::fingerprint of the format the log was parsed with
+ * @member - rows: number of indexed log lines
+ * @member - dictionarySizes: number of entries in each indexDictionary
+ */
+typedef struct indexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t sourceSize;
+    int64_t sourceModified;
+    uint64_t formatFingerprint;
+    uint64_t rows;
+    uint32_t dictionarySizes[INDEX_DICTIONARIES];
+} indexHeader;
+
+/*
+ * @class: logIndexWriter
+ * @brief: accumulates parsed log lines into dictionary-encoded columns and writes them as an index file
+ */
+class logIndexWriter
+{
+    friend class logIndex; // logIndex::attach reads the columns in place
+
+    private:
+        keyCounter dictionaries[INDEX_DICTIONARIES];
+        std::vector <uint32_t> keyColumns[INDEX_DICTIONARIES];
+        std::vector <uint32_t> dateColumn;
+        std::vector <uint64_t> sizeColumn;
+        bool timeOrdered = true;
+
+    public:
+       /*
+        * @method: appendRow
+        * @brief: adds one parsed log line to the index
+        * @input - keys: value of each indexDictionary column (host, resource, method, response)
+        * @input - date: packed date time of the line
+        * @input - size: number of bytes in the reply
+        */
+        void appendRow( const std::string_view ( &keys )[INDEX_DICTIONARIES], uint32_t date, uint64_t size );
+
+       /*
+        * @method: write
+        * @brief: writes the index file for the provided log
+        * @input - indexPath: path of the index file to write
+        * @input - sourcePath: path of the indexed log, its size and modification time are recorded to detect stale indexes
+        * @input - formatFingerprint: logFormat::fingerprint of the format the log was parsed with
+        * @return: returns true if the index was written successfully, false otherwise
+        */
+        bool write( const std::string &indexPath, const std::string &sourcePath, uint64_t formatFingerprint ) const;
+};
+
+/*
+ * @class: logIndex
+ * @brief: read-only view of an index file, columns point straight into the memory-mapped file
+ *         or into the columns of a logIndexWriter kept in memory (see attach)
+ */
+class logIndex
+{
+    private:
+        std::unique_ptr <mappedFile> mapping;
+        indexHeader header = {};
+        std::vector <std::string_view> dictionaries[INDEX_DICTIONARIES];
+        const uint32_t *keyColumns[INDEX_DICTIONARIES] = {};
+        const uint32_t *dateColumn = nullptr;
+        const uint64_t *sizeColumn = nullptr;
+
+    public:
+       /*
+        * @method: load
+        * @brief: maps an index file and validates its layout
+        * @input - indexPath: path of the index file to load
+        * @return: returns true if the index was loaded successfully, false if it is missing or malformed
+        */
+        bool load( const std::string &indexPath );
+
+       /*
+        * @method: isFresh
+        * @brief: verifies that the index was built from the current contents of the provided log, parsed with the same format
+        * @input - sourcePath: path of the indexed log
+        * @input - formatFingerprint: logFormat::fingerprint of the format the log is read with
+        * @return: returns true if the log size, modification time and format match the ones recorded in the index
+        */
+        bool isFresh( const std::string &sourcePath, uint64_t formatFingerprint ) const;
+
+       /*
+        * @method: attach
+        * @brief: views the columns of a writer in memory instead of an index file (ex. a resident log, see loadResident)
+        *         Rows appended to the writer afterwards are only seen once attach is called again: the columns may have moved
+        *         Dictionary values are never moved by the writer, only the entries added since the last attach are looked up
+        * @input - writer: the columns to view, must outlive the logIndex and not be modified while the logIndex is read
+        */
+        void attach( const logIndexWriter &writer );
+
+       /*
+        * @method: findKey
+        * @brief: looks up the ID of a value in a dictionary (linear search, meant for the small method / response dictionaries)
+        * @input - dictionary: the dictionary to search
+        * @input - key: the value to look for
+        * @return: returns the ID of the value, UINT32_MAX if the value never appears in the log
+        */
+        uint32_t findKey( indexDictionary dictionary, std::string_view key ) const;
+
+        uint64_t rows() const { return header.rows; }
+        uint32_t dictionarySize( indexDictionary dictionary ) const { return static_cast <uint32_t>( dictionaries[dictionary].size() ); }
+        bool timeOrdered() const { return header.flags & INDEX_FLAG_TIME_ORDERED; }
+        std::string_view key( indexDictionary dictionary, uint32_t id ) const { return dictionaries[dictionary][id]; }
+        const uint32_t *keyColumn( indexDictionary dictionary ) const { return keyColumns[dictionary]; }
+        const uint32_t *dates() const { return dateColumn; }
+        const uint64_t *sizes() const { return sizeColumn; }
+
+       /*
+        * @method: sourceStatus
+        * @brief: reads the size and modification time of a log file
+        * @input - sourcePath: path of the log file
+        * @output - size: size of the file in bytes
+        * @output - modified: modification time of the file in ns
+        * @return: returns true if the file exists, false otherwise
+        */
+        static bool sourceStatus( const std::string &sourcePath, uint64_t &size, int64_t &modified );
+};
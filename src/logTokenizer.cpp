@@ -0,0 +1,182 @@
+#include <cstring>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <immintrin.h>
+#define TOKENIZER_X86
+#endif
+
+#include "logTokenizer.h"
+
+/*
+ * @method: classifyScalar
+ * @brief: portable fallback, classifies one byte at a time
+ */
+static structuralMasks classifyScalar( const char *bytes )
+{
+    structuralMasks block = {};
+
+    for (int i = 0; i < TOKENIZER_BLOCK_SIZE; i++)
+    {
+        switch ( bytes[i] )
+        {
+            case '\n':
+                block.masks[0] |= 1ULL << i;
+                break;
+            case ' ':
+                block.masks[1] |= 1ULL << i;
+                break;
+            case '"':
+                block.masks[2] |= 1ULL << i;
+                break;
+            case '[':
+            case ']':
+            case ':':
+                block.masks[3] |= 1ULL << i;
+                break;
+        }
+    }
+
+    return block;
+}
+
+#ifdef TOKENIZER_X86
+/*
+ * @method: classifySSE2
+ * @brief: classifies 16 bytes per instruction
+ */
+__attribute__(( target( "sse2" ) ))
+static structuralMasks classifySSE2( const char *bytes )
+{
+    const __m128i newline = _mm_set1_epi8( '\n' ), space = _mm_set1_epi8( ' ' ), quote = _mm_set1_epi8( '"' );
+    const __m128i open = _mm_set1_epi8( '[' ), close = _mm_set1_epi8( ']' ), colon = _mm_set1_epi8( ':' );
+    structuralMasks block = {};
+
+    for (int i = 0; i < TOKENIZER_BLOCK_SIZE; i += 16)
+    {
+        __m128i chunk = _mm_loadu_si128( reinterpret_cast <const __m128i *>( bytes + i ) );
+        __m128i date = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( chunk, open ), _mm_cmpeq_epi8( chunk, close ) ),
+                                     _mm_cmpeq_epi8( chunk, colon ) );
+        block.masks[0] |= static_cast <uint64_t>( static_cast <uint16_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, newline ) ) ) ) << i;
+        block.masks[1] |= static_cast <uint64_t>( static_cast <uint16_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, space ) ) ) ) << i;
+        block.masks[2] |= static_cast <uint64_t>( static_cast <uint16_t>( _mm_movemask_epi8( _mm_cmpeq_epi8( chunk, quote ) ) ) ) << i;
+        block.masks[3] |= static_cast <uint64_t>( static_cast <uint16_t>( _mm_movemask_epi8( date ) ) ) << i;
+    }
+
+    return block;
+}
+
+/*
+ * @method: classifyAVX2
+ * @brief: classifies 32 bytes per instruction
+ */
+__attribute__(( target( "avx2" ) ))
+static structuralMasks classifyAVX2( const char *bytes )
+{
+    const __m256i newline = _mm256_set1_epi8( '\n' ), space = _mm256_set1_epi8( ' ' ), quote = _mm256_set1_epi8( '"' );
+    const __m256i open = _mm256_set1_epi8( '[' ), close = _mm256_set1_epi8( ']' ), colon = _mm256_set1_epi8( ':' );
+    structuralMasks block = {};
+
+    for (int i = 0; i < TOKENIZER_BLOCK_SIZE; i += 32)
+    {
+        __m256i chunk = _mm256_loadu_si256( reinterpret_cast <const __m256i *>( bytes + i ) );
+        __m256i date = _mm256_or_si256( _mm256_or_si256( _mm256_cmpeq_epi8( chunk, open ), _mm256_cmpeq_epi8( chunk, close ) ),
+                                        _mm256_cmpeq_epi8( chunk, colon ) );
+        block.masks[0] |= static_cast <uint64_t>( static_cast <uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( chunk, newline ) ) ) ) << i;
+        block.masks[1] |= static_cast <uint64_t>( static_cast <uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( chunk, space ) ) ) ) << i;
+        block.masks[2] |= static_cast <uint64_t>( static_cast <uint32_t>( _mm256_movemask_epi8( _mm256_cmpeq_epi8( chunk, quote ) ) ) ) << i;
+        block.masks[3] |= static_cast <uint64_t>( static_cast <uint32_t>( _mm256_movemask_epi8( date ) ) ) << i;
+    }
+
+    return block;
+}
+#endif
+
+typedef structuralMasks ( *classifyFunction )( const char * );
+
+static classifyFunction levelFunction( tokenizerLevel level )
+{
+#ifdef TOKENIZER_X86
+    // Also used by a static initializer: the CPU features must be detected before querying them
+    __builtin_cpu_init();
+#endif
+
+    switch ( level )
+    {
+#ifdef TOKENIZER_X86
+        case tokenizerLevel::avx2:
+            return __builtin_cpu_supports( "avx2" ) ? classifyAVX2 : nullptr;
+        case tokenizerLevel::sse2:
+            return __builtin_cpu_supports( "sse2" ) ? classifySSE2 : nullptr;
+#endif
+        case tokenizerLevel::scalar:
+            return classifyScalar;
+        default:
+            return nullptr;
+    }
+}
+
+static classifyFunction selectedClassify = levelFunction( logTokenizer::bestLevel() );
+
+/*
+ * @method: classify
+ * @brief: classifies TOKENIZER_BLOCK_SIZE bytes with the selected instruction set
+ * @input - bytes: the bytes to classify, TOKENIZER_BLOCK_SIZE bytes must be readable
+ * @return: returns the masks of structural characters of each tokenClass
+ */
+structuralMasks logTokenizer::classify( const char *bytes )
+{
+    return selectedClassify( bytes );
+}
+
+/*
+ * @method: selectLevel
+ * @brief: overrides the instruction set selected at startup (ex. to compare implementations)
+ * @input - level: the instruction set to use
+ * @return: returns true if the CPU supports the instruction set and it is now in use, false otherwise
+ */
+bool logTokenizer::selectLevel( tokenizerLevel level )
+{
+    classifyFunction function = levelFunction( level );
+    if ( function != nullptr )
+    {
+        selectedClassify = function;
+    }
+    return function != nullptr;
+}
+
+/*
+ * @method: bestLevel
+ * @return: returns the fastest instruction set supported by the CPU
+ */
+tokenizerLevel logTokenizer::bestLevel()
+{
+    if ( levelFunction( tokenizerLevel::avx2 ) != nullptr )
+    {
+        return tokenizerLevel::avx2;
+    }
+    if ( levelFunction( tokenizerLevel::sse2 ) != nullptr )
+    {
+        return tokenizerLevel::sse2;
+    }
+    return tokenizerLevel::scalar;
+}
+
+/*
+ * @method: loadBlock
+ * @brief: classifies the block starting at the provided offset
+ *         The last block of the contents is copied into a padded buffer so that no byte past the contents is read
+ */
+void logTokenizer::loadBlock( size_t blockOffset )
+{
+    blockStart = blockOffset;
+    if ( blockOffset + TOKENIZER_BLOCK_SIZE <= size )
+    {
+        block = classify( data + blockOffset );
+    }
+    else
+    {
+        char padded[TOKENIZER_BLOCK_SIZE] = {};
+        memcpy( padded, data + blockOffset, size - blockOffset );
+        block = classify( padded );
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#define TOKENIZER_BLOCK_SIZE 64 // bytes classified per structural mask
+
+/*
+ * @enum: tokenClass
+ * @brief: classes of structural characters of the webserver logs, combined as flags when searching
+ */
+enum tokenClass : unsigned int
+{
+    TOKEN_NEWLINE = 1 << 0, // '\n'
+    TOKEN_SPACE = 1 << 1,   // ' '
+    TOKEN_QUOTE = 1 << 2,   // '"'
+    TOKEN_DATE = 1 << 3     // '[', ']' and ':'
+};
+
+constexpr size_t TOKEN_CLASSES = 4; // number of tokenClass flags, one structural mask each
+
+/*
+ * @struct: structuralMasks
+ * @brief: classification of one block of TOKENIZER_BLOCK_SIZE bytes
+ * @member - masks: one mask per tokenClass (in flag order), bit i set if byte i of the block belongs to the class
+ */
+typedef struct structuralMasks
+{
+    uint64_t masks[TOKEN_CLASSES];
+} structuralMasks;
+
+/*
+ * @enum: tokenizerLevel
+ * @brief: instruction set used to classify the structural characters of the logs
+ */
+enum class tokenizerLevel
+{
+    scalar,
+    sse2, // 16 bytes per instruction
+    avx2  // 32 bytes per instruction
+};
+
+/*
+ * @class: logTokenizer
+ * @brief: finds the structural characters of the webserver logs (newline, space, quote, brackets, colon)
+ *         Each block of TOKENIZER_BLOCK_SIZE bytes is classified at once into bit masks using SSE2/AVX2 when the
+ *         CPU supports it (selected at runtime), the parser then jumps between set bits instead of searching byte by byte
+ */
+class logTokenizer
+{
+    private:
+        const char *data;
+        size_t size;
+        size_t blockStart = SIZE_MAX; // offset of the block described by block
+        structuralMasks block = {};
+
+        void loadBlock( size_t blockOffset );
+
+    public:
+       /*
+        * @method: logTokenizer
+        * @input - contents: the webserver log contents to tokenize, must outlive the tokenizer
+        */
+        explicit logTokenizer( std::string_view contents ) : data( contents.data() ), size( contents.size() ) {}
+
+       /*
+        * @method: next
+        * @brief: finds the next structural character of the requested classes
+        * @input - position: offset at which the search starts (inclusive)
+        * @input - classes: combination of tokenClass flags to look for
+        * @return: returns the offset of the first match at or after position, size of the contents if there is none
+        */
+        size_t next( size_t position, unsigned int classes )
+        {
+            while ( position < size )
+            {
+                size_t blockOffset = position & ~static_cast <size_t>( TOKENIZER_BLOCK_SIZE - 1 );
+                if ( blockOffset != blockStart )
+                {
+                    loadBlock( blockOffset );
+                }
+
+                // Branch free so that classes only known at runtime (ex. the fields of a log format) cost no misprediction
+                uint64_t mask = 0;
+                for (size_t tokenIndex = 0; tokenIndex < TOKEN_CLASSES; tokenIndex++)
+                {
+                    mask |= block.masks[tokenIndex] & ( 0 - static_cast <uint64_t>( ( classes >> tokenIndex ) & 1 ) );
+                }
+
+                mask >>= position - blockOffset;
+                if ( mask != 0 )
+                {
+                    return position + __builtin_ctzll( mask );
+                }
+                position = blockOffset + TOKENIZER_BLOCK_SIZE;
+            }
+            return size;
+        }
+
+       /*
+        * @method: classify
+        * @brief: classifies TOKENIZER_BLOCK_SIZE bytes with the selected instruction set
+        * @input - bytes: the bytes to classify, TOKENIZER_BLOCK_SIZE bytes must be readable
+        * @return: returns the masks of structural characters of each tokenClass
+        */
+        static structuralMasks classify( const char *bytes );
+
+       /*
+        * @method: selectLevel
+        * @brief: overrides the instruction set selected at startup (ex. to compare implementations)
+        * @input - level: the instruction set to use
+        * @return: returns true if the CPU supports the instruction set and it is now in use, false otherwise
+        */
+        static bool selectLevel( tokenizerLevel level );
+
+       /*
+        * @method: bestLevel
+        * @return: returns the fastest instruction set supported by the CPU
+        */
+        static tokenizerLevel bestLevel();
+};
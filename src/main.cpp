@@ -1,53 +1,212 @@
+#include <algorithm>
+#include <cctype>
+#include <csignal>
+#include <cstdio>
 #include <iostream>
 #include <getopt.h>
+#include <unistd.h>
 
 #include "webServerAnalyser.h"
+#include "timeHistogram.h"
+#include "queryServer.h"
+#include "resultWriter.h"
+
+#define FOLLOW_DEFAULT_TOP 10 // keys reported per action by --follow without --top
 
 using namespace std;
 
+static queryServer *activeServer = nullptr; // stopped by SIGINT / SIGTERM in --serve mode
+
+static void stopServer( int )
+{
+    if ( activeServer != nullptr )
+    {
+        activeServer->stop();
+    }
+}
+
 void printUsageInstructions()
 {
     cout << endl
          << "Required arguments:" << endl
-         << "  --action=webserver OR --action=resource" << endl
+         << "  --action=webserver OR --action=resource OR --action=status OR --action=traffic OR --action=visitors OR --action=sizes" << endl
          << "    =webserver: provides number of accesses to webserver per host" << endl
          << "    =resource: provides number of successful resource accesses by URI" << endl
+         << "    =status: provides number of replies per HTTP response code" << endl
+         << "    =traffic: provides number of requests and reply bytes per time bucket, in date time order (UTC for calendar dates)" << endl
+         << "    =visitors: provides estimated number of distinct hosts per URI (HyperLogLog, about 2% error)" << endl
+         << "    =sizes: provides number of requests and p50, p95 and p99 of the reply sizes per URI (within 1%)" << endl
+         << "    NOTE: --action can be repeated, all actions are answered by a single pass over the logs" << endl
          << "  --filepath=<path_to_webserver_logs>" << endl
+         << "    NOTE: gzip (.gz) and zstd (.zst) compressed logs are detected and decompressed on the fly" << endl
+         << "    NOTE: --file can be repeated and accepts glob patterns and directories, all the logs are processed in parallel" << endl
+         << "    and counted as if they were concatenated" << endl
          << endl
          << "Optional arguments:" << endl
          << " --minimum_date=[DD:HH:MM:SS]" << endl
          << " --maximum_date=[DD:HH:MM:SS]" << endl
          << "   NOTE: minimum_date and maximum_date are used in conjunction" << endl
          << "   to filter logs between the two date times" << endl
+         << " --filter=EXPR" << endl
+         << "   only counts the lines matching every predicate of EXPR, \"field op value\" joined by \"and\":" << endl
+         << "   fields method, status, host, uri, size and time; = and != take comma separated values, prefix* and *suffix" << endl
+         << "   patterns, a.b.c.d/n networks for host and Nxx classes for status; <, <=, >, >= compare size, status and time" << endl
+         << "   ex. --filter='status=4xx,5xx and uri=/api/* and size>100000 and host!=10.0.0.0/8'" << endl
+         << " --log-format=default|common|combined|DESCRIPTOR" << endl
+         << "   layout of the log lines, predefined or an nginx log_format like descriptor (default: default)" << endl
+         << "   ex. --log-format='$remote_addr - $remote_user [$time_local] \"$request\" $status $body_bytes_sent \"$http_referer\"'" << endl
+         << " --time_ordered" << endl
+         << "   the logs are sorted by date time: only the lines between minimum_date and maximum_date are read" << endl
+         << " --build-index" << endl
+         << "   writes a sidecar index next to the log file, used by later runs while the log and its --log-format are unchanged" << endl
+         << " --top=K" << endl
+         << "   only provides the K most accessed keys, estimated with fixed memory (estimates are reported with their error bound)" << endl
+         << " --exact" << endl
+         << "   with --top, counts every key exactly instead of estimating" << endl
+         << " --bucket=second|minute|hour" << endl
+         << "   width of the time buckets of --action=traffic (default: hour)" << endl
+         << " --by=host|resource|status" << endl
+         << "   splits each time bucket of --action=traffic by host, resource or HTTP response (with --top=K: K keys per bucket)" << endl
+         << "   or keys --action=visitors and --action=sizes by host, resource or HTTP response instead of resource" << endl
+         << " --follow" << endl
+         << "   keeps the log open and reports the top keys of the last --window seconds every --interval seconds, following" << endl
+         << "   appends and rotations (only the new lines are parsed, default --top: " << FOLLOW_DEFAULT_TOP << ")" << endl
+         << " --window=SECONDS --interval=SECONDS" << endl
+         << "   with --follow, length of the sliding window in log time and time between two reports (default: "
+         << DEFAULT_FOLLOW_WINDOW << ", " << DEFAULT_FOLLOW_REFRESH / 1000 << ")" << endl
+         << " --shard=I/N --save-state=PATH" << endl
+         << "   only counts part I (from 0 to N-1) of the logs and writes the partial results to PATH instead of printing them" << endl
+         << " --merge" << endl
+         << "   the --file arguments are state files written by --save-state: prints the combined ranking of their actions" << endl
+         << " --memory-limit=SIZE[K|M|G] --spill-dir=DIR" << endl
+         << "   bounds the memory of the exact counts, the keys over it are spilled to temporary files in DIR and merged" << endl
+         << "   back when ranking (default: no limit, system temporary directory; not applied to --sample runs)" << endl
+         << " --sample=FRACTION --seed=N" << endl
+         << "   only reads a random FRACTION (from 0 to 1) of the 64 KB blocks of the logs, selected by the seed N (default: 0)," << endl
+         << "   and prints estimated counts with the margin of their 95% confidence interval (webserver, resource and status only)" << endl
+         << " --input=mmap|pread|uring --read-depth=N --direct-io" << endl
+         << "   reads the logs through the memory mapping, or ahead of the parsing threads in large buffers with pread or io_uring" << endl
+         << "   (N reads in flight per log, default: " << DEFAULT_READ_DEPTH << "), optionally bypassing the page cache (default: mmap)" << endl
+         << " --serve=SOCKET" << endl
+         << "   loads the logs into memory once and answers the queries of --connect clients on the Unix domain socket SOCKET" << endl
+         << "   until interrupted, following the lines appended to the logs (plain text logs only, no --action)" << endl
+         << " --connect=SOCKET" << endl
+         << "   sends the actions, dates, --filter, --bucket, --by and --top to the --serve process listening on SOCKET and prints" << endl
+         << "   its answer (no --file)" << endl
+         << " --output=text|csv|json|binary" << endl
+         << "   layout of the results on stdout: the text lines, CSV rows with a header, a JSON array of the actions and their" << endl
+         << "   results, or a compact binary encoding (default: text)" << endl
+         << " --limit=N" << endl
+         << "   only writes the first N rows of each action, without changing how they are counted (default: 0, every row)" << endl
+         << " --threads=N" << endl
+         << "   number of worker threads scanning the log (default: 1, 0: one per hardware thread)" << endl
+         << " --stats[=text|json]" << endl
+         << "   prints the time spent in each stage, lines read and filtered, distinct keys and peak memory to stderr" << endl
          << endl
          << "Sample usage:" << endl
          << "./logParser --action=webserver --file=../tests/hostAccessTest_small.txt" << endl
          << "  (Request number of accesses to webserver per host, using provided log file" << endl
          << "./logParser --action=resource --file=../tests/resourceAccessTest_small.txt --minimum_date=[29:23:53:27] --maximum_date=[29:23:54:18]" << endl
-         << "  (Request number of successful resource accesses by URI, ranging between provided date times, using provided log file" << endl;
+         << "  (Request number of successful resource accesses by URI, ranging between provided date times, using provided log file" << endl
+         << "./logParser --action=webserver --action=resource --file=../tests/resourceAccessTest_small.txt" << endl
+         << "  (Request both reports from a single pass over the provided log file" << endl
+         << "./logParser --action=traffic --bucket=minute --by=host --top=5 --file=../tests/hostAccessTest_small.txt" << endl
+         << "  (Request the requests and bytes of the 5 busiest hosts of every minute, using provided log file" << endl
+         << "./logParser --action=status --filter='method=POST and uri=*.php' --file=../tests/hostAccessTest_small.txt" << endl
+         << "  (Request the HTTP responses of the POST requests to PHP scripts, using provided log file" << endl
+         << "./logParser --action=visitors --action=sizes --top=20 --file=../tests/hostAccessTest_small.txt" << endl
+         << "  (Request the distinct hosts of the 20 URIs with the most visitors, and the reply size percentiles of the 20 most requested URIs" << endl
+         << "./logParser --action=resource --log-format=combined --file=/var/log/nginx/access.log" << endl
+         << "  (Request number of successful resource accesses by URI, using an nginx log in the Combined Log Format" << endl
+         << "./logParser --action=webserver --file='/var/log/httpd/access.log*' --threads=0" << endl
+         << "  (Request one report over every rotated log, using all the hardware threads" << endl
+         << "./logParser --action=webserver --file=/var/log/httpd/access.log --follow --window=300 --interval=10" << endl
+         << "  (Report the 10 most active hosts of the last 5 minutes every 10 seconds, as the log grows" << endl
+         << "./logParser --action=webserver --file=access.log --shard=0/2 --save-state=part0.state (and --shard=1/2 on another node)" << endl
+         << "./logParser --merge --file=part0.state --file=part1.state" << endl
+         << "  (Count each half of access.log separately, then rank the hosts of the whole log from the two partial results" << endl
+         << "./logParser --action=resource --file=/var/log/httpd/access.log --memory-limit=256M --spill-dir=/scratch" << endl
+         << "  (Request number of successful resource accesses by URI over millions of URIs, using at most 256 MB for the counts" << endl
+         << "./logParser --action=webserver --top=10 --file=/var/log/httpd/access.log --sample=0.05" << endl
+         << "  (Estimate the 10 most active hosts from 5% of the log, with the error margin of each count" << endl
+         << "./logParser --action=webserver --file=/data/access.log --threads=0 --input=uring --read-depth=32 --direct-io" << endl
+         << "  (Request number of accesses per host from a log larger than memory, keeping 32 reads in flight on the device" << endl
+         << "./logParser --serve=/run/logParser.sock --file='/var/log/httpd/access.log*' &" << endl
+         << "./logParser --connect=/run/logParser.sock --action=resource --top=10 --minimum_date=[29:23:53:27] --maximum_date=[29:23:54:18]" << endl
+         << "  (Hold the rotated logs in memory, then request the 10 most accessed resources of a time window from them" << endl
+         << "./logParser --action=traffic --bucket=minute --file=/var/log/httpd/access.log --output=csv > traffic.csv" << endl
+         << "  (Export the requests and bytes of every minute as CSV rows" << endl;
 }
 
 int main( int argc, char **argv )
 {
     int opt;
-    string filePath, action, minDate, maxDate;
-    vector <string> output;
+    string minDate, maxDate;
+    vector <string> filePaths;
+    vector <string> actions;
+    vector <queryResult> output;
+    analyserConfig config;
+    bool buildIndex = false;
+    string statsFormat;
+    timeBucket bucket = timeBucket::hour;
+    string splitBy;
+    bool follow = false;
+    followConfig followOptions;
+    logFilter filter;
+    string filterText;
+    string filterError;
+    string formatError;
+    string statePath;
+    bool merge = false;
+    string bucketName;
+    string servePath;
+    string connectPath;
+    outputFormat format = outputFormat::text;
+    size_t limit = 0;
 
     // Parse user provided arguments / options using getopt with long options
     option long_opts[] = { { "action", required_argument, nullptr, 'a' },
                            { "file", required_argument, nullptr, 'f' },
                            { "minimum_date", optional_argument, nullptr, 'm' },
-                           { "maximum_date", optional_argument, nullptr, 'x' } };
+                           { "maximum_date", optional_argument, nullptr, 'x' },
+                           { "threads", required_argument, nullptr, 't' },
+                           { "time_ordered", no_argument, nullptr, 'o' },
+                           { "build-index", no_argument, nullptr, 'i' },
+                           { "top", required_argument, nullptr, 'k' },
+                           { "exact", no_argument, nullptr, 'e' },
+                           { "stats", optional_argument, nullptr, 's' },
+                           { "bucket", required_argument, nullptr, 'b' },
+                           { "by", required_argument, nullptr, 'y' },
+                           { "follow", no_argument, nullptr, 'F' },
+                           { "window", required_argument, nullptr, 'w' },
+                           { "interval", required_argument, nullptr, 'n' },
+                           { "filter", required_argument, nullptr, 'q' },
+                           { "log-format", required_argument, nullptr, 'l' },
+                           { "shard", required_argument, nullptr, 'H' },
+                           { "save-state", required_argument, nullptr, 'S' },
+                           { "merge", no_argument, nullptr, 'M' },
+                           { "memory-limit", required_argument, nullptr, 'L' },
+                           { "spill-dir", required_argument, nullptr, 'D' },
+                           { "sample", required_argument, nullptr, 'P' },
+                           { "seed", required_argument, nullptr, 'R' },
+                           { "input", required_argument, nullptr, 'I' },
+                           { "read-depth", required_argument, nullptr, 'Q' },
+                           { "direct-io", no_argument, nullptr, 'O' },
+                           { "serve", required_argument, nullptr, 'V' },
+                           { "connect", required_argument, nullptr, 'C' },
+                           { "output", required_argument, nullptr, 'u' },
+                           { "limit", required_argument, nullptr, 'N' },
+                           { nullptr, 0, nullptr, 0 } };
 
-    while ( ( opt = getopt_long( argc, argv, "a:f:mx", long_opts, nullptr ) ) != -1 )
+    while ( ( opt = getopt_long( argc, argv, "a:f:mxt:oik:es::b:y:Fw:n:q:l:H:S:ML:D:P:R:I:Q:OV:C:u:N:", long_opts, nullptr ) ) != -1 )
     {
         switch ( opt )
         {
             case 'a':
-                action = optarg;
+                actions.push_back( optarg );
                 break;
             case 'f':
-                filePath = optarg;
+                filePaths.push_back( optarg );
                 break;
             case 'm':
                 minDate = optarg;
@@ -55,32 +214,400 @@ int main( int argc, char **argv )
             case 'x':
                 maxDate = optarg;
                 break;
+            case 't':
+                config.threads = strtoul( optarg, nullptr, 10 );
+                break;
+            case 'o':
+                config.timeOrdered = true;
+                break;
+            case 'i':
+                buildIndex = true;
+                break;
+            case 'k':
+                config.topKeys = strtoul( optarg, nullptr, 10 );
+                break;
+            case 'e':
+                config.exactTop = true;
+                break;
+            case 's':
+                statsFormat = optarg != nullptr ? optarg : "text";
+                if ( statsFormat != "text" && statsFormat != "json" )
+                {
+                    printUsageInstructions();
+                    return -1;
+                }
+                config.collectStats = true;
+                break;
+            case 'b':
+                bucketName = optarg;
+                if ( string( optarg ) == "second" )
+                {
+                    bucket = timeBucket::second;
+                }
+                else if ( string( optarg ) == "minute" )
+                {
+                    bucket = timeBucket::minute;
+                }
+                else if ( string( optarg ) == "hour" )
+                {
+                    bucket = timeBucket::hour;
+                }
+                else
+                {
+                    printUsageInstructions();
+                    return -1;
+                }
+                break;
+            case 'y':
+                splitBy = optarg;
+                if ( splitBy != "host" && splitBy != "resource" && splitBy != "status" )
+                {
+                    printUsageInstructions();
+                    return -1;
+                }
+                break;
+            case 'F':
+                follow = true;
+                break;
+            case 'w':
+                followOptions.windowSeconds = strtoul( optarg, nullptr, 10 );
+                break;
+            case 'n':
+                followOptions.refreshMilliseconds = static_cast <unsigned int>( strtod( optarg, nullptr ) * 1000 );
+                break;
+            case 'q':
+                if ( !logFilter::compile( optarg, filter, filterError ) )
+                {
+                    cerr << "Invalid --filter: " << filterError << endl;
+                    printUsageInstructions();
+                    return -1;
+                }
+                filterText = optarg;
+                break;
+            case 'l':
+                if ( !logFormat::compile( optarg, config.format, formatError ) )
+                {
+                    cerr << "Invalid --log-format: " << formatError << endl;
+                    printUsageInstructions();
+                    return -1;
+                }
+                break;
+            case 'H':
+                if ( sscanf( optarg, "%u/%u", &config.shard, &config.shards ) != 2 || config.shard >= config.shards )
+                {
+                    printUsageInstructions();
+                    return -1;
+                }
+                break;
+            case 'S':
+                statePath = optarg;
+                break;
+            case 'M':
+                merge = true;
+                break;
+            case 'L':
+            {
+                char *unit = nullptr;
+                config.memoryLimit = strtoull( optarg, &unit, 10 );
+                switch ( toupper( *unit ) )
+                {
+                    case 'G':
+                        config.memoryLimit <<= 10;
+                        [[fallthrough]];
+                    case 'M':
+                        config.memoryLimit <<= 10;
+                        [[fallthrough]];
+                    case 'K':
+                        config.memoryLimit <<= 10;
+                        break;
+                    case '\0':
+                        break;
+                    default:
+                        printUsageInstructions();
+                        return -1;
+                }
+                break;
+            }
+            case 'D':
+                config.spillDirectory = optarg;
+                break;
+            case 'P':
+                config.sampleFraction = strtod( optarg, nullptr );
+                if ( !( config.sampleFraction > 0 && config.sampleFraction <= 1 ) )
+                {
+                    printUsageInstructions();
+                    return -1;
+                }
+                break;
+            case 'R':
+                config.sampleSeed = strtoull( optarg, nullptr, 10 );
+                break;
+            case 'I':
+                if ( string( optarg ) == "mmap" )
+                {
+                    config.input = inputBackend::mmap;
+                }
+                else if ( string( optarg ) == "pread" )
+                {
+                    config.input = inputBackend::pread;
+                }
+                else if ( string( optarg ) == "uring" )
+                {
+                    config.input = inputBackend::uring;
+                }
+                else
+                {
+                    printUsageInstructions();
+                    return -1;
+                }
+                break;
+            case 'Q':
+                config.readDepth = max( 1u, static_cast <unsigned int>( strtoul( optarg, nullptr, 10 ) ) );
+                break;
+            case 'O':
+                config.directIO = true;
+                break;
+            case 'V':
+                servePath = optarg;
+                break;
+            case 'C':
+                connectPath = optarg;
+                break;
+            case 'u':
+                if ( !resultWriter::parseFormat( optarg, format ) )
+                {
+                    printUsageInstructions();
+                    return -1;
+                }
+                break;
+            case 'N':
+                limit = strtoul( optarg, nullptr, 10 );
+                break;
             default:
                 printUsageInstructions();
                 return -1;
         }
     }
 
-    // Perform actions depending on user provided arguments / options
-    webServerAnalyser takeHomeAssignment;
-    if ( action == "webserver" )
+    // Follow, server and client modes print the text lines as they come
+    bool structuredOutput = format != outputFormat::text || limit > 0;
+    if ( structuredOutput && ( follow || !servePath.empty() || !connectPath.empty() ) )
     {
-        output = takeHomeAssignment.hostAccesses( filePath, minDate, maxDate );
+        printUsageInstructions();
+        return -1;
     }
-    else if ( action == "resource" )
+
+    if ( follow && config.topKeys == 0 )
     {
-        output = takeHomeAssignment.resourceAccesses( filePath, minDate, maxDate );
+        config.topKeys = FOLLOW_DEFAULT_TOP;
     }
-    else
+
+    // Register one query per requested action, all of them are evaluated during the same pass
+    webServerAnalyser takeHomeAssignment( config );
+    for (const auto &action: actions)
+    {
+        accessQuery query;
+        query.minDate = minDate;
+        query.maxDate = maxDate;
+        query.filter = filter;
+
+        if ( !webServerAnalyser::actionQuery( action, bucket, splitBy, query ) )
+        {
+            printUsageInstructions();
+            return -1;
+        }
+        string columnError;
+        if ( connectPath.empty() && !takeHomeAssignment.checkColumns( query, columnError ) )
+        {
+            cerr << "Cannot answer --action=" << action << ": " << columnError << endl;
+            return -1;
+        }
+        takeHomeAssignment.addQuery( query );
+    }
+
+    // Client mode: the server holding the logs answers the actions, printed as they would be printed by this process
+    if ( !connectPath.empty() )
+    {
+        if ( actions.empty() || !filePaths.empty() || !servePath.empty() || merge || follow || !statePath.empty() || buildIndex )
+        {
+            printUsageInstructions();
+            return -1;
+        }
+        string request, connectError;
+        vector <string> answer;
+        auto addField = [&request]( const string &name, const string &value )
+        {
+            request += ( request.empty() ? "" : "\t" ) + name + "=" + value;
+        };
+        for (const auto &action: actions)
+        {
+            addField( "action", action );
+        }
+        for (const auto &field: { make_pair( "minimum_date", minDate ), make_pair( "maximum_date", maxDate ), make_pair( "filter", filterText ),
+                                  make_pair( "bucket", bucketName ), make_pair( "by", splitBy ) })
+        {
+            if ( !field.second.empty() )
+            {
+                addField( field.first, field.second );
+            }
+        }
+        if ( config.topKeys > 0 )
+        {
+            addField( "top", to_string( config.topKeys ) );
+        }
+        if ( !queryServer::query( connectPath, request, answer, connectError ) )
+        {
+            cerr << "Query failed: " << connectError << endl;
+            return -1;
+        }
+        for (const auto &it: answer)
+        {
+            cout << it << '\n';
+        }
+        return 0;
+    }
+
+    // Index the logs first, so that the requested actions (if any) are answered from the new indexes
+    filePaths = webServerAnalyser::expandInputs( filePaths );
+    if ( buildIndex )
+    {
+        for (const auto &filePath: filePaths)
+        {
+            if ( !takeHomeAssignment.buildIndex( filePath ) )
+            {
+                cerr << "Failed to build the index of " << filePath << endl;
+                return -1;
+            }
+        }
+        if ( actions.empty() )
+        {
+            return 0;
+        }
+    }
+
+    // Server mode: the logs are parsed once into memory, then queried by --connect clients until interrupted
+    if ( !servePath.empty() )
+    {
+        if ( !actions.empty() || filePaths.empty() || merge || follow || !statePath.empty() || config.sampleFraction < 1 )
+        {
+            printUsageInstructions();
+            return -1;
+        }
+        string serveError;
+        if ( !takeHomeAssignment.loadResident( filePaths, serveError ) )
+        {
+            cerr << "Failed to load " << serveError << endl;
+            return -1;
+        }
+        queryServer server( takeHomeAssignment, servePath, config.topKeys );
+        if ( !server.listen( serveError ) )
+        {
+            cerr << "Failed to serve: " << serveError << endl;
+            return -1;
+        }
+        activeServer = &server;
+        signal( SIGINT, stopServer );
+        signal( SIGTERM, stopServer );
+        cerr << "Serving " << takeHomeAssignment.residentRows() << " lines of " << filePaths.size() << " logs on " << servePath << endl;
+        server.serve();
+        activeServer = nullptr;
+        return 0;
+    }
+
+    // Sampled runs only estimate accesses per key, and their estimates cannot be merged or followed
+    bool sampled = config.sampleFraction < 1;
+    bool sampledActions = all_of( actions.begin(), actions.end(), []( const string &action )
+    {
+        return action == "webserver" || action == "resource" || action == "status";
+    } );
+    if ( actions.empty() != merge || ( merge && ( follow || !statePath.empty() ) ) ||
+         ( sampled && ( !sampledActions || merge || follow || !statePath.empty() ) ) )
     {
         printUsageInstructions();
         return -1;
     }
+    // The estimates of a sampled run need the per-block spread of every key in memory: their counts are never spilled
+    if ( sampled && config.memoryLimit > 0 )
+    {
+        cerr << "--memory-limit is not applied to --sample runs, the counts of the sampled blocks are kept in memory" << endl;
+    }
+
+    // Follow mode: report the sliding window rankings until interrupted
+    if ( follow )
+    {
+        if ( filePaths.size() != 1 )
+        {
+            printUsageInstructions();
+            return -1;
+        }
+        bool opened = takeHomeAssignment.followLog( filePaths[0], followOptions, [&]( uint64_t windowEnd, const vector <vector <string>> &report )
+        {
+            // One flush per report, so that each report shows up at once when piped
+            cout << "# " << timeHistogram::formatDate( static_cast <uint32_t>( windowEnd ), config.format.calendarDates() ) << " last " << followOptions.windowSeconds << " s\n";
+            for (size_t i = 0; i < report.size(); i++)
+            {
+                if ( report.size() > 1 )
+                {
+                    cout << "## " << actions[i] << '\n';
+                }
+                for (const auto &it: report[i])
+                {
+                    cout << it << '\n';
+                }
+            }
+            cout << endl;
+            return true;
+        } );
+        if ( !opened )
+        {
+            cerr << "Failed to open " << filePaths[0] << endl;
+            return -1;
+        }
+        return 0;
+    }
+
+    if ( merge )
+    {
+        // Merge mode: the actions are the ones the state files were counted for
+        string mergeError;
+        if ( !takeHomeAssignment.mergeStates( filePaths, output, mergeError ) )
+        {
+            cerr << "Failed to merge: " << mergeError << endl;
+            return -1;
+        }
+        for (const auto &query: takeHomeAssignment.registeredQueries())
+        {
+            actions.push_back( webServerAnalyser::actionName( query ) );
+        }
+    }
+    else if ( !statePath.empty() )
+    {
+        if ( !takeHomeAssignment.saveState( filePaths, statePath ) )
+        {
+            cerr << "Failed to write the state file " << statePath << endl;
+            return -1;
+        }
+    }
+    else
+    {
+        output = takeHomeAssignment.runResults( filePaths );
+    }
+
+    // Write requested output, buffered into large writes (text: each action in its own section when several actions are requested)
+    if ( statePath.empty() )
+    {
+        resultWriter writer( STDOUT_FILENO, format, limit );
+        if ( !writer.write( actions, output ) || !writer.flush() )
+        {
+            cerr << "Failed to write the results" << endl;
+            return -1;
+        }
+    }
 
-    // Print requested output
-    for (auto it: output)
+    // Stats go to stderr so that the output can still be piped
+    if ( config.collectStats )
     {
-        cout << it << endl;
+        cerr << formatStats( takeHomeAssignment.lastStats(), statsFormat == "json" );
     }
 
     return 0;
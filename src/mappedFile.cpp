@@ -0,0 +1,134 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mappedFile.h"
+
+/*
+ * @method: mappedFile
+ * @brief: opens and maps the provided file
+ * @input - filePath: file containing the webserver logs to map
+ *          Note: a missing or unreadable file results in an empty mapping (isOpen() returns false)
+ */
+mappedFile::mappedFile( const std::string &filePath )
+{
+    int fd = open( filePath.c_str(), O_RDONLY | O_CLOEXEC );
+    if ( fd < 0 )
+    {
+        return;
+    }
+
+    struct stat fileInfo;
+    if ( fstat( fd, &fileInfo ) == 0 && S_ISREG( fileInfo.st_mode ) )
+    {
+        opened = true;
+        if ( fileInfo.st_size > 0 )
+        {
+            void *mapping = mmap( nullptr, fileInfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+            if ( mapping != MAP_FAILED )
+            {
+                // Logs are scanned front to back once: let the kernel read ahead aggressively
+                madvise( mapping, fileInfo.st_size, MADV_SEQUENTIAL );
+                mappedData = static_cast <const char *>( mapping );
+                mappedSize = fileInfo.st_size;
+                close( fd );
+                return;
+            }
+        }
+    }
+    close( fd );
+
+    // Fallback: non-regular file or mmap failure, read the contents into an owned buffer
+    std::ifstream inputStream( filePath, std::ios::binary );
+    if ( inputStream )
+    {
+        std::ostringstream contents;
+        contents << inputStream.rdbuf();
+        fallbackBuffer = contents.str();
+        opened = true;
+    }
+}
+
+mappedFile::~mappedFile()
+{
+    if ( mappedData != nullptr )
+    {
+        munmap( const_cast <char *>( mappedData ), mappedSize );
+    }
+}
+
+/*
+ * @method: data
+ * @brief: provides the contents of the mapped file
+ * @return: returns a view over the whole file, valid for the lifetime of the mappedFile
+ */
+std::string_view mappedFile::data() const
+{
+    if ( mappedData != nullptr )
+    {
+        return std::string_view( mappedData, mappedSize );
+    }
+    return std::string_view( fallbackBuffer );
+}
+
+/*
+ * @method: adviseRandom
+ * @brief: stops the kernel from reading ahead of the pages touched, only parts of the file will be read
+ *         (ex. sampled blocks, see analyserConfig.sampleFraction)
+ */
+void mappedFile::adviseRandom()
+{
+    if ( mappedData != nullptr )
+    {
+        madvise( const_cast <char *>( mappedData ), mappedSize, MADV_RANDOM );
+    }
+}
+
+/*
+ * @method: prefetch
+ * @brief: starts reading a range of the file in the background, before it is parsed
+ * @input - offset: start of the range
+ * @input - length: number of bytes of the range, clamped to the end of the file
+ */
+void mappedFile::prefetch( size_t offset, size_t length ) const
+{
+    if ( mappedData == nullptr || offset >= mappedSize )
+    {
+        return;
+    }
+
+    // madvise works on whole pages: round the start of the range down to its page
+    size_t pageSize = static_cast <size_t>( sysconf( _SC_PAGESIZE ) );
+    size_t start = offset - offset % pageSize;
+    size_t end = std::min( offset + length, mappedSize );
+    madvise( const_cast <char *>( mappedData ) + start, end - start, MADV_WILLNEED );
+}
+
+/*
+ * @method: release
+ * @brief: drops the pages of a range already read from the resident memory of the process, they are read again from
+ *         the page cache if touched later (ex. a spill file merged from front to back, see keySpill)
+ * @input - offset: start of the range
+ * @input - length: number of bytes of the range, clamped to the end of the file
+ */
+void mappedFile::release( size_t offset, size_t length ) const
+{
+    if ( mappedData == nullptr || offset >= mappedSize )
+    {
+        return;
+    }
+
+    // Only the pages entirely within the range: the pages at its edges may still be in use
+    size_t pageSize = static_cast <size_t>( sysconf( _SC_PAGESIZE ) );
+    size_t start = ( offset + pageSize - 1 ) / pageSize * pageSize;
+    size_t end = std::min( offset + length, mappedSize ) / pageSize * pageSize;
+    if ( start < end )
+    {
+        madvise( const_cast <char *>( mappedData ) + start, end - start, MADV_DONTNEED );
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/*
+ * @class: mappedFile
+ * @brief: read-only view of a whole webserver log file
+ *         The file is memory-mapped when possible so that parsed records can point straight into the mapping
+ *         Files that cannot be mapped (pipes, special files) are read into an owned buffer instead
+ */
+class mappedFile
+{
+    private:
+        const char *mappedData = nullptr;
+        size_t mappedSize = 0;
+        std::string fallbackBuffer; // only used when the file could not be memory-mapped
+        bool opened = false;
+
+    public:
+       /*
+        * @method: mappedFile
+        * @brief: opens and maps the provided file
+        * @input - filePath: file containing the webserver logs to map
+        *          Note: a missing or unreadable file results in an empty mapping (isOpen() returns false)
+        */
+        explicit mappedFile( const std::string &filePath );
+        ~mappedFile();
+
+        mappedFile( const mappedFile & ) = delete;
+        mappedFile &operator=( const mappedFile & ) = delete;
+
+       /*
+        * @method: data
+        * @brief: provides the contents of the mapped file
+        * @return: returns a view over the whole file, valid for the lifetime of the mappedFile
+        */
+        std::string_view data() const;
+
+       /*
+        * @method: adviseRandom
+        * @brief: stops the kernel from reading ahead of the pages touched, only parts of the file will be read
+        *         (ex. sampled blocks, see analyserConfig.sampleFraction)
+        */
+        void adviseRandom();
+
+       /*
+        * @method: prefetch
+        * @brief: starts reading a range of the file in the background, before it is parsed
+        * @input - offset: start of the range
+        * @input - length: number of bytes of the range, clamped to the end of the file
+        */
+        void prefetch( size_t offset, size_t length ) const;
+
+       /*
+        * @method: release
+        * @brief: drops the pages of a range already read from the resident memory of the process, they are read again from
+        *         the page cache if touched later (ex. a spill file merged from front to back, see keySpill)
+        * @input - offset: start of the range
+        * @input - length: number of bytes of the range, clamped to the end of the file
+        */
+        void release( size_t offset, size_t length ) const;
+
+       /*
+        * @method: isMapped
+        * @return: returns true if the file is memory-mapped, false if it was read into an owned buffer (ex. a pipe)
+        */
+        bool isMapped() const { return mappedData != nullptr; }
+
+       /*
+        * @method: isOpen
+        * @return: returns true if the file was opened successfully, false otherwise
+        */
+        bool isOpen() const { return opened; }
+};
@@ -0,0 +1,263 @@
+#include <charconv>
+#include <cstdio>
+
+#include "queryResult.h"
+
+/*
+ * @method: ~spilledRows
+ * @brief: removes the file of the rows
+ */
+spilledRows::~spilledRows()
+{
+    std::remove( path.c_str() );
+}
+
+/*
+ * @method: queryResult
+ * @brief: a result whose rows are read back from a file
+ * @input - kind: the kind of the rows
+ * @input - rowsPath: the rows, encoded with appendRecord in order, the file is removed with the result
+ * @input - rowCount: number of rows of the file
+ */
+queryResult::queryResult( resultKind kind, const std::string &rowsPath, size_t rowCount ) : resultType( kind )
+{
+    auto file = std::make_shared <spilledRows>();
+    file->path = rowsPath;
+    file->rowCount = rowCount;
+    spilled = file;
+}
+
+/*
+ * @method: reserve
+ * @brief: preallocates the rows and their keys
+ * @input - rowCount: number of rows
+ * @input - keySize: total number of bytes of their keys
+ */
+void queryResult::reserve( size_t rowCount, size_t keySize )
+{
+    rows.reserve( rowCount );
+    keyEnds.reserve( rowCount );
+    keyBytes.reserve( keySize );
+}
+
+/*
+ * @method: add
+ * @brief: appends a row, after the rows added before it
+ * @input - key: the key of the row (empty for unkeyed traffic), copied into the result
+ * @input - row: the numbers of the row
+ */
+void queryResult::add( std::string_view key, const resultRow &row )
+{
+    rows.push_back( row );
+    keyBytes.append( key );
+    keyEnds.push_back( keyBytes.size() );
+}
+
+/*
+ * @method: appendText
+ * @brief: formats a row of the kind of this result as a line of text, without its newline
+ * @input - key: the key of the row
+ * @input - row: the numbers of the row
+ * @output - line: receives the formatted row, appended to its contents
+ */
+void queryResult::appendText( std::string_view key, const resultRow &entry, std::string &line ) const
+{
+    if ( resultType == resultKind::traffic || resultType == resultKind::keyedTraffic )
+    {
+        appendDate( entry.bucket, calendar, line );
+        line += ' ';
+    }
+    if ( resultType != resultKind::traffic )
+    {
+        line.append( key );
+        line += ' ';
+    }
+    appendNumber( entry.count, line );
+
+    switch ( resultType )
+    {
+        case resultKind::boundedCounts:
+            if ( entry.error > 0 )
+            {
+                line += " (error <= ";
+                appendNumber( entry.error, line );
+                line += ')';
+            }
+            break;
+        case resultKind::sampledCounts:
+            line += " (error +/- ";
+            appendNumber( entry.error, line );
+            line += ')';
+            break;
+        case resultKind::traffic:
+        case resultKind::keyedTraffic:
+            line += ' ';
+            appendNumber( entry.bytes, line );
+            break;
+        case resultKind::sizeQuantiles:
+            for (uint64_t quantile: entry.quantiles)
+            {
+                line += ' ';
+                appendNumber( quantile, line );
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * @method: text
+ * @brief: formats every row (see appendText)
+ * @return: returns one line per row, ex. "key count"
+ */
+std::vector <std::string> queryResult::text() const
+{
+    std::vector <std::string> output;
+
+    output.reserve( size() );
+    forEachRow( [&]( std::string_view key, const resultRow &row )
+    {
+        output.emplace_back();
+        appendText( key, row, output.back() );
+        return true;
+    } );
+
+    return output;
+}
+
+/*
+ * @method: appendRecord
+ * @brief: encodes a row of the kind of this result: key, count, then error (bounded and sampled counts), bucket and
+ *         bytes (traffic), or p50, p95 and p99 (size quantiles), as varints and a length prefixed key
+ * @input - key: the key of the row
+ * @input - row: the numbers of the row
+ * @output - output: receives the record, appended to its contents
+ */
+void queryResult::appendRecord( std::string_view key, const resultRow &row, std::string &output ) const
+{
+    appendVarint( key.size(), output );
+    output.append( key );
+    appendVarint( row.count, output );
+    if ( resultType == resultKind::boundedCounts || resultType == resultKind::sampledCounts )
+    {
+        appendVarint( row.error, output );
+    }
+    if ( resultType == resultKind::traffic || resultType == resultKind::keyedTraffic )
+    {
+        appendVarint( row.bucket, output );
+        appendVarint( row.bytes, output );
+    }
+    if ( resultType == resultKind::sizeQuantiles )
+    {
+        for (uint64_t quantile: row.quantiles)
+        {
+            appendVarint( quantile, output );
+        }
+    }
+}
+
+/*
+ * @method: readRecord
+ * @brief: decodes a row encoded by appendRecord
+ * @input - records: the encoded rows, positioned on the row
+ * @output - row: the numbers of the row
+ * @return: returns the key of the row, a view valid for the lifetime of the records
+ */
+std::string_view queryResult::readRecord( stateReader &records, resultRow &row ) const
+{
+    std::string_view key = records.text();
+
+    row.count = records.number();
+    if ( resultType == resultKind::boundedCounts || resultType == resultKind::sampledCounts )
+    {
+        row.error = records.number();
+    }
+    if ( resultType == resultKind::traffic || resultType == resultKind::keyedTraffic )
+    {
+        row.bucket = static_cast <uint32_t>( records.number() );
+        row.bytes = records.number();
+    }
+    if ( resultType == resultKind::sizeQuantiles )
+    {
+        for (uint64_t &quantile: row.quantiles)
+        {
+            quantile = records.number();
+        }
+    }
+    return key;
+}
+
+/*
+ * @method: appendNumber
+ * @brief: appends the decimal form of a number to a buffer
+ */
+void queryResult::appendNumber( uint64_t number, std::string &output )
+{
+    char digits[20];
+
+    output.append( digits, std::to_chars( digits, digits + sizeof( digits ), number ).ptr );
+}
+
+/*
+ * @method: appendVarint
+ * @brief: appends an unsigned number to a buffer, encoded like stateWriter::number
+ */
+void queryResult::appendVarint( uint64_t value, std::string &output )
+{
+    while ( value >= 0x80 )
+    {
+        output += static_cast <char>( ( value & 0x7F ) | 0x80 );
+        value >>= 7;
+    }
+    output += static_cast <char>( value );
+}
+
+/*
+ * @method: appendDate
+ * @brief: appends the [DD:HH:MM:SS] form of a packed date time to a buffer, or its [DD/Mon/YYYY:HH:MM:SS +0000] form
+ *         for the seconds since the Unix epoch of a calendar log format (see logFormat::calendarDates)
+ */
+void queryResult::appendDate( uint32_t date, bool calendar, std::string &output )
+{
+    static const char monthNames[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    uint32_t fields[4] = { date / 86400, date / 3600 % 24, date / 60 % 60, date % 60 };
+    auto appendField = [&]( uint32_t field )
+    {
+        if ( field < 10 )
+        {
+            output += '0';
+        }
+        appendNumber( field, output );
+    };
+
+    output += '[';
+    if ( calendar )
+    {
+        // Civil date of the days since 1970-01-01, years starting in March like webServerAnalyser::parseDate
+        uint32_t days = fields[0] + 719468;
+        uint32_t dayOfEra = days % 146097;
+        uint32_t yearOfEra = ( dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096 ) / 365;
+        uint32_t dayOfYear = dayOfEra - ( 365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100 );
+        uint32_t marchMonth = ( 5 * dayOfYear + 2 ) / 153;
+        uint32_t month = marchMonth < 10 ? marchMonth + 2 : marchMonth - 10;
+
+        appendField( dayOfYear - ( 153 * marchMonth + 2 ) / 5 + 1 );
+        output += '/';
+        output.append( monthNames + 3 * month, 3 );
+        output += '/';
+        appendNumber( days / 146097 * 400 + yearOfEra + ( month < 2 ), output );
+        output += ':';
+    }
+    else
+    {
+        appendField( fields[0] );
+        output += ':';
+    }
+    appendField( fields[1] );
+    output += ':';
+    appendField( fields[2] );
+    output += ':';
+    appendField( fields[3] );
+    output += calendar ? " +0000]" : "]";
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mappedFile.h"
+#include "stateFile.h"
+
+#define RESULT_RELEASE_SIZE ( 1 << 20 ) // bytes of a spilled result read before their pages are released
+
+/*
+ * @enum: resultKind
+ * @brief: which fields of its rows a queryResult fills, and how they read as text (see queryResult::appendText)
+ */
+enum class resultKind
+{
+    counts,        // "key count": exact accesses per key
+    boundedCounts, // "key count (error <= error)": heavy hitters estimates, the error is only printed when not 0
+    sampledCounts, // "key count (error +/- error)": accesses scaled up from a sample, with the margin of their 95% interval
+    traffic,       // "[DD:HH:MM:SS] count bytes": requests and reply bytes per time bucket
+    keyedTraffic,  // "[DD:HH:MM:SS] key count bytes": requests and reply bytes per key within each time bucket
+    distinctHosts, // "key count": estimated distinct hosts per key
+    sizeQuantiles  // "key count p50 p95 p99": requests and reply size percentiles per key
+};
+
+/*
+ * @struct: resultRow
+ * @brief: the numbers of an entry of the ranked results of a query, the fields its resultKind does not use are 0
+ * @member - count: accesses, requests or distinct hosts of the entry (estimated for bounded, sampled and distinct counts)
+ * @member - error: error bound of a bounded count, margin of a sampled count
+ * @member - bytes: reply bytes of a traffic entry
+ * @member - bucket: packed date time of the start of the time bucket of a traffic entry (see webServerAnalyser::parseDate)
+ * @member - quantiles: p50, p95 and p99 reply sizes of a size quantiles entry
+ */
+typedef struct resultRow
+{
+    uint64_t count = 0;
+    uint64_t error = 0;
+    uint64_t bytes = 0;
+    uint32_t bucket = 0;
+    uint64_t quantiles[3] = {};
+} resultRow;
+
+/*
+ * @class: spilledRows
+ * @brief: a temporary file holding the rows of a queryResult too large for the memory limit, removed with the last
+ *         queryResult sharing it
+ */
+class spilledRows
+{
+    public:
+        std::string path;
+        size_t rowCount = 0;
+
+        ~spilledRows();
+};
+
+/*
+ * @class: queryResult
+ * @brief: the ranked results of a query as typed rows, in ranked order (date time order for traffic)
+ *         The keys of every row are packed in one buffer: building a result allocates nothing per row
+ *         Rows ranked under a memory limit may instead be read back one at a time from a file (see keySpill::rankedResult):
+ *         such results are visited with forEachRow, row and key only address the rows held in memory
+ */
+class queryResult
+{
+    private:
+        resultKind resultType;
+        std::vector <resultRow> rows;
+        std::vector <size_t> keyEnds; // end of the key of each row in keyBytes, a key starts where the previous one ends
+        std::string keyBytes;
+        std::shared_ptr <const spilledRows> spilled; // rows kept in a file, encoded with appendRecord
+        bool calendar = false; // the buckets are seconds since the Unix epoch, printed as calendar date times (see appendDate)
+
+    public:
+        explicit queryResult( resultKind kind = resultKind::counts ) : resultType( kind ) {}
+
+       /*
+        * @method: queryResult
+        * @brief: a result whose rows are read back from a file
+        * @input - kind: the kind of the rows
+        * @input - rowsPath: the rows, encoded with appendRecord in order, the file is removed with the result
+        * @input - rowCount: number of rows of the file
+        */
+        queryResult( resultKind kind, const std::string &rowsPath, size_t rowCount );
+
+       /*
+        * @method: reserve
+        * @brief: preallocates the rows and their keys
+        * @input - rowCount: number of rows
+        * @input - keySize: total number of bytes of their keys
+        */
+        void reserve( size_t rowCount, size_t keySize );
+
+       /*
+        * @method: add
+        * @brief: appends a row, after the rows added before it
+        * @input - key: the key of the row (empty for unkeyed traffic), copied into the result
+        * @input - row: the numbers of the row
+        */
+        void add( std::string_view key, const resultRow &row );
+
+        resultKind kind() const { return resultType; }
+        bool calendarDates() const { return calendar; }
+        void setCalendarDates( bool calendarDates ) { calendar = calendarDates; }
+        size_t size() const { return spilled != nullptr ? spilled->rowCount : rows.size(); }
+        bool isSpilled() const { return spilled != nullptr; }
+        const resultRow &row( size_t index ) const { return rows[index]; }
+        std::string_view key( size_t index ) const
+        {
+            size_t keyStart = index > 0 ? keyEnds[index - 1] : 0;
+            return std::string_view( keyBytes ).substr( keyStart, keyEnds[index] - keyStart );
+        }
+
+       /*
+        * @method: appendText
+        * @brief: formats a row as a line of text, as logParser prints it (see resultKind), without its newline
+        * @input - index: the row
+        * @output - line: receives the formatted row, appended to its contents
+        */
+        void appendText( size_t index, std::string &line ) const { appendText( key( index ), rows[index], line ); }
+
+       /*
+        * @method: appendText
+        * @brief: formats a row of the kind of this result as a line of text, without its newline
+        * @input - key: the key of the row
+        * @input - row: the numbers of the row
+        * @output - line: receives the formatted row, appended to its contents
+        */
+        void appendText( std::string_view key, const resultRow &row, std::string &line ) const;
+
+       /*
+        * @method: forEachRow
+        * @brief: visits the rows in order, from memory or read back from the file of a spilled result
+        * @input - rowHandler: called with the key and the numbers of each row, returns false to stop visiting
+        * @return: returns false if the file of a spilled result could not be read back
+        */
+        template <typename RowHandler>
+        bool forEachRow( RowHandler &&rowHandler ) const;
+
+       /*
+        * @method: appendRecord
+        * @brief: encodes a row of the kind of this result: key, count, then error (bounded and sampled counts), bucket and
+        *         bytes (traffic), or p50, p95 and p99 (size quantiles), as varints and a length prefixed key
+        * @input - key: the key of the row
+        * @input - row: the numbers of the row
+        * @output - output: receives the record, appended to its contents
+        */
+        void appendRecord( std::string_view key, const resultRow &row, std::string &output ) const;
+
+       /*
+        * @method: readRecord
+        * @brief: decodes a row encoded by appendRecord
+        * @input - records: the encoded rows, positioned on the row
+        * @output - row: the numbers of the row
+        * @return: returns the key of the row, a view valid for the lifetime of the records
+        */
+        std::string_view readRecord( stateReader &records, resultRow &row ) const;
+
+       /*
+        * @method: text
+        * @brief: formats every row (see appendText)
+        * @return: returns one line per row, ex. "key count"
+        */
+        std::vector <std::string> text() const;
+
+       /*
+        * @method: appendNumber
+        * @brief: appends the decimal form of a number to a buffer
+        */
+        static void appendNumber( uint64_t number, std::string &output );
+
+       /*
+        * @method: appendDate
+        * @brief: appends the [DD:HH:MM:SS] form of a packed date time to a buffer, or its [DD/Mon/YYYY:HH:MM:SS +0000] form
+        *         for the seconds since the Unix epoch of a calendar log format (see logFormat::calendarDates)
+        */
+        static void appendDate( uint32_t date, bool calendar, std::string &output );
+
+       /*
+        * @method: appendVarint
+        * @brief: appends an unsigned number to a buffer, encoded like stateWriter::number
+        */
+        static void appendVarint( uint64_t value, std::string &output );
+};
+
+/*
+ * @method: forEachRow
+ * @brief: visits the rows in order, from memory or read back from the file of a spilled result
+ * @input - rowHandler: called with the key and the numbers of each row, returns false to stop visiting
+ * @return: returns false if the file of a spilled result could not be read back
+ */
+template <typename RowHandler>
+bool queryResult::forEachRow( RowHandler &&rowHandler ) const
+{
+    if ( spilled == nullptr )
+    {
+        for (size_t index = 0; index < rows.size(); index++)
+        {
+            if ( !rowHandler( key( index ), rows[index] ) )
+            {
+                break;
+            }
+        }
+        return true;
+    }
+
+    // The pages of the rows already visited are released as the file is read, only about RESULT_RELEASE_SIZE stay resident
+    mappedFile mapping( spilled->path );
+    std::string_view contents = mapping.data();
+    stateReader records( contents );
+    size_t released = 0;
+    for (size_t index = 0; index < spilled->rowCount && mapping.isOpen(); index++)
+    {
+        resultRow row;
+        std::string_view rowKey = readRecord( records, row );
+        if ( records.failed() || !rowHandler( rowKey, row ) )
+        {
+            break;
+        }
+        size_t position = static_cast <size_t>( rowKey.data() + rowKey.size() - contents.data() );
+        if ( position - released >= RESULT_RELEASE_SIZE )
+        {
+            mapping.release( released, position - released );
+            released = position;
+        }
+    }
+    return mapping.isOpen() && !records.failed();
+}
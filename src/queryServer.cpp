@@ -0,0 +1,440 @@
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "queryServer.h"
+#include "boundedQueue.h"
+
+/*
+ * @method: socketAddress
+ * @brief: builds the address of a Unix domain socket
+ * @input - socketPath: path of the socket
+ * @output - address: the address
+ * @return: returns false if the path is too long for a socket address, true otherwise
+ */
+static bool socketAddress( const std::string &socketPath, sockaddr_un &address )
+{
+    address = {};
+    address.sun_family = AF_UNIX;
+    if ( socketPath.empty() || socketPath.size() >= sizeof( address.sun_path ) )
+    {
+        return false;
+    }
+    memcpy( address.sun_path, socketPath.c_str(), socketPath.size() + 1 );
+    return true;
+}
+
+/*
+ * @method: sendAll
+ * @brief: writes a whole buffer to a connection (a closed connection does not raise SIGPIPE)
+ * @return: returns false if the connection failed, true otherwise
+ */
+static bool sendAll( int fd, std::string_view data )
+{
+    while ( !data.empty() )
+    {
+        ssize_t sent = send( fd, data.data(), data.size(), MSG_NOSIGNAL );
+        if ( sent < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        if ( sent <= 0 )
+        {
+            return false;
+        }
+        data.remove_prefix( sent );
+    }
+    return true;
+}
+
+/*
+ * @method: receiveLine
+ * @brief: reads the next line of a connection, through a buffer holding the bytes received after it
+ * @output - buffer: bytes received and not handed out yet
+ * @output - line: the line, without its newline
+ * @return: returns false if the connection was closed before a complete line, true otherwise
+ */
+static bool receiveLine( int fd, std::string &buffer, std::string &line )
+{
+    char block[4096];
+    size_t lineEnd;
+
+    while ( ( lineEnd = buffer.find( '\n' ) ) == std::string::npos )
+    {
+        ssize_t received = recv( fd, block, sizeof( block ), 0 );
+        if ( received < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        if ( received <= 0 )
+        {
+            return false;
+        }
+        buffer.append( block, received );
+    }
+    line = buffer.substr( 0, lineEnd );
+    buffer.erase( 0, lineEnd + 1 );
+    return true;
+}
+
+/*
+ * @method: queryServer
+ * @input - analyser: the analyser holding the resident logs, must outlive the server
+ * @input - socketPath: path of the Unix domain socket to listen on
+ * @input - defaultTop: number of keys of the answers of requests without a top field, 0 answers every key
+ * @input - handlers: number of connections served at once
+ */
+queryServer::queryServer( webServerAnalyser &analyser, const std::string &socketPath, size_t defaultTop, unsigned int handlers )
+    : analyser( analyser ), socketPath( socketPath ), defaultTop( defaultTop ), handlers( handlers > 0 ? handlers : 1 )
+{
+}
+
+queryServer::~queryServer()
+{
+    if ( listenFd >= 0 )
+    {
+        close( listenFd );
+        unlink( socketPath.c_str() );
+    }
+}
+
+/*
+ * @method: listen
+ * @brief: creates the socket, replacing a stale socket file left by a server that is not running anymore
+ * @output - error: why the socket could not be created
+ * @return: returns true if the server is listening, false otherwise
+ */
+bool queryServer::listen( std::string &error )
+{
+    sockaddr_un address;
+    struct stat fileInfo;
+
+    if ( !socketAddress( socketPath, address ) )
+    {
+        error = "invalid socket path " + socketPath;
+        return false;
+    }
+
+    // An existing socket is only replaced if no server answers on it, any other file is left alone
+    if ( lstat( socketPath.c_str(), &fileInfo ) == 0 )
+    {
+        int probeFd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+        bool running = probeFd >= 0 && connect( probeFd, reinterpret_cast <sockaddr *>( &address ), sizeof( address ) ) == 0;
+        if ( probeFd >= 0 )
+        {
+            close( probeFd );
+        }
+        if ( !S_ISSOCK( fileInfo.st_mode ) || running )
+        {
+            error = socketPath + ( running ? " is used by a running server" : " exists and is not a socket" );
+            return false;
+        }
+        unlink( socketPath.c_str() );
+    }
+
+    listenFd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if ( listenFd < 0 || bind( listenFd, reinterpret_cast <sockaddr *>( &address ), sizeof( address ) ) != 0 || ::listen( listenFd, SOMAXCONN ) != 0 )
+    {
+        error = "cannot listen on " + socketPath + ": " + strerror( errno );
+        if ( listenFd >= 0 )
+        {
+            close( listenFd );
+            listenFd = -1;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * @method: serve
+ * @brief: accepts connections and refreshes the resident logs every FOLLOW_POLL_INTERVAL milliseconds until stop is
+ *         called, then waits for the connections being served and removes the socket file
+ */
+void queryServer::serve()
+{
+    typedef std::chrono::steady_clock clock;
+    boundedQueue <int> connections( SERVER_QUEUED_CONNECTIONS );
+    std::vector <std::thread> workers;
+    clock::time_point nextRefresh = clock::now() + std::chrono::milliseconds( FOLLOW_POLL_INTERVAL );
+
+    // Each handler serves one connection at a time: handlers connections are answered at once
+    for (unsigned int handler = 0; handler < handlers; handler++)
+    {
+        workers.emplace_back( [&]()
+        {
+            int clientFd;
+            while ( connections.pop( clientFd ) )
+            {
+                serveClient( clientFd );
+            }
+        } );
+    }
+
+    while ( !stopping && listenFd >= 0 )
+    {
+        pollfd listener = { listenFd, POLLIN, 0 };
+        if ( poll( &listener, 1, FOLLOW_POLL_INTERVAL ) > 0 )
+        {
+            // Connections no handler can take are turned away rather than blocking the listener (and the refreshes)
+            int clientFd = accept4( listenFd, nullptr, nullptr, SOCK_CLOEXEC );
+            if ( clientFd >= 0 && !connections.tryPush( clientFd ) )
+            {
+                static const std::string_view busy = "error server busy\n";
+                send( clientFd, busy.data(), busy.size(), MSG_NOSIGNAL | MSG_DONTWAIT );
+                close( clientFd );
+            }
+        }
+
+        // Appended lines are parsed by this thread only, queries wait for each append (see refreshResident)
+        if ( clock::now() >= nextRefresh )
+        {
+            analyser.refreshResident();
+            nextRefresh = clock::now() + std::chrono::milliseconds( FOLLOW_POLL_INTERVAL );
+        }
+    }
+
+    connections.close();
+    for (auto &worker: workers)
+    {
+        worker.join();
+    }
+    if ( listenFd >= 0 )
+    {
+        close( listenFd );
+        unlink( socketPath.c_str() );
+        listenFd = -1;
+    }
+}
+
+/*
+ * @method: serveClient
+ * @brief: answers the requests of a connection until the client closes it, goes idle or the server stops
+ * @input - clientFd: the accepted connection, closed on return
+ */
+void queryServer::serveClient( int clientFd )
+{
+    typedef std::chrono::steady_clock clock;
+    std::string buffer;
+    char block[4096];
+    clock::time_point lastRequest = clock::now();
+
+    while ( !stopping )
+    {
+        // Answer every complete request received so far, in order
+        size_t lineEnd;
+        bool connected = true;
+        while ( connected && ( lineEnd = buffer.find( '\n' ) ) != std::string::npos )
+        {
+            connected = sendAll( clientFd, answer( std::string_view( buffer ).substr( 0, lineEnd ) ) );
+            buffer.erase( 0, lineEnd + 1 );
+        }
+        if ( !connected )
+        {
+            break;
+        }
+        if ( buffer.size() > SERVER_REQUEST_SIZE )
+        {
+            sendAll( clientFd, "error request too long\n" );
+            break;
+        }
+
+        // Wait for more requests, checking for a stop every FOLLOW_POLL_INTERVAL milliseconds
+        pollfd client = { clientFd, POLLIN, 0 };
+        int ready = poll( &client, 1, FOLLOW_POLL_INTERVAL );
+        if ( ready == 0 && clock::now() - lastRequest > std::chrono::seconds( SERVER_CLIENT_TIMEOUT ) )
+        {
+            break;
+        }
+        if ( ready <= 0 )
+        {
+            continue;
+        }
+        ssize_t received = recv( clientFd, block, sizeof( block ), 0 );
+        if ( received < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        if ( received <= 0 )
+        {
+            break;
+        }
+        buffer.append( block, received );
+        lastRequest = clock::now();
+    }
+
+    close( clientFd );
+}
+
+/*
+ * @method: answer
+ * @brief: evaluates a request over the resident logs
+ * @input - request: the request line, without its newline
+ * @return: returns the response, each line ending with a newline
+ */
+std::string queryServer::answer( std::string_view request )
+{
+    std::vector <std::string> actions;
+    std::string minDate, maxDate, splitBy, filterError;
+    logFilter filter;
+    timeBucket bucket = timeBucket::hour;
+    size_t top = defaultTop;
+
+    // Step 1: read the fields of the request
+    while ( !request.empty() )
+    {
+        size_t fieldEnd = request.find( '\t' );
+        std::string_view field = request.substr( 0, fieldEnd );
+        request = fieldEnd == std::string_view::npos ? std::string_view() : request.substr( fieldEnd + 1 );
+        if ( field.empty() )
+        {
+            continue;
+        }
+
+        size_t separator = field.find( '=' );
+        std::string name( field.substr( 0, separator ) );
+        std::string value( separator == std::string_view::npos ? std::string_view() : field.substr( separator + 1 ) );
+        if ( name == "action" )
+        {
+            actions.push_back( value );
+        }
+        else if ( name == "minimum_date" )
+        {
+            minDate = value;
+        }
+        else if ( name == "maximum_date" )
+        {
+            maxDate = value;
+        }
+        else if ( name == "filter" )
+        {
+            if ( !logFilter::compile( value, filter, filterError ) )
+            {
+                return "error invalid filter: " + filterError + "\n";
+            }
+        }
+        else if ( name == "bucket" && ( value == "second" || value == "minute" || value == "hour" ) )
+        {
+            bucket = value == "second" ? timeBucket::second : value == "minute" ? timeBucket::minute : timeBucket::hour;
+        }
+        else if ( name == "by" && ( value == "host" || value == "resource" || value == "status" ) )
+        {
+            splitBy = value;
+        }
+        else if ( name == "top" && !value.empty() && value.find_first_not_of( "0123456789" ) == std::string::npos )
+        {
+            top = strtoull( value.c_str(), nullptr, 10 );
+        }
+        else
+        {
+            return "error invalid field " + std::string( field ) + "\n";
+        }
+    }
+    if ( actions.empty() )
+    {
+        return "error no action requested\n";
+    }
+
+    // Step 2: build one query per action, all of them are counted over the columns together
+    std::vector <accessQuery> batch;
+    for (const auto &action: actions)
+    {
+        accessQuery query;
+        query.minDate = minDate;
+        query.maxDate = maxDate;
+        query.filter = filter;
+        if ( !webServerAnalyser::actionQuery( action, bucket, splitBy, query ) )
+        {
+            return "error unknown action " + action + "\n";
+        }
+        std::string columnError;
+        if ( !analyser.checkColumns( query, columnError ) )
+        {
+            return "error cannot answer " + action + ": " + columnError + "\n";
+        }
+        batch.push_back( query );
+    }
+    std::vector <queryResult> output = analyser.queryResident( batch, top );
+
+    // Step 3: lay the results out like logParser, each action in its own section when several actions are requested
+    std::string lines;
+    size_t lineCount = 0;
+    for (size_t query = 0; query < output.size(); query++)
+    {
+        if ( output.size() > 1 )
+        {
+            lines += ( query > 0 ? "\n# " : "# " ) + actions[query] + "\n";
+            lineCount += query > 0 ? 2 : 1;
+        }
+        for (size_t row = 0; row < output[query].size(); row++)
+        {
+            output[query].appendText( row, lines );
+            lines += '\n';
+        }
+        lineCount += output[query].size();
+    }
+
+    return "ok " + std::to_string( lineCount ) + "\n" + lines;
+}
+
+/*
+ * @method: query
+ * @brief: client side: sends a request to a server and reads its response
+ * @input - socketPath: path of the socket the server listens on
+ * @input - request: the request line, without its newline
+ * @output - lines: the lines of the answer
+ * @output - error: the error of the server, or why it could not be reached
+ * @return: returns true if the request was answered, false otherwise
+ */
+bool queryServer::query( const std::string &socketPath, const std::string &request, std::vector <std::string> &lines, std::string &error )
+{
+    sockaddr_un address;
+    std::string buffer, status;
+
+    lines.clear();
+    if ( !socketAddress( socketPath, address ) )
+    {
+        error = "invalid socket path " + socketPath;
+        return false;
+    }
+    int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if ( fd < 0 || connect( fd, reinterpret_cast <sockaddr *>( &address ), sizeof( address ) ) != 0 )
+    {
+        error = "cannot connect to " + socketPath + ": " + strerror( errno );
+        if ( fd >= 0 )
+        {
+            close( fd );
+        }
+        return false;
+    }
+
+    // The status line tells how many lines follow, a busy server answers it before reading the request
+    sendAll( fd, request + "\n" );
+    bool answered = receiveLine( fd, buffer, status );
+    if ( answered && status.compare( 0, 3, "ok " ) == 0 )
+    {
+        size_t lineCount = strtoull( status.c_str() + 3, nullptr, 10 );
+        lines.resize( lineCount );
+        for (size_t line = 0; answered && line < lineCount; line++)
+        {
+            answered = receiveLine( fd, buffer, lines[line] );
+        }
+        error = answered ? "" : "connection closed by the server";
+    }
+    else
+    {
+        error = !answered ? "connection closed by the server" : status.compare( 0, 6, "error " ) == 0 ? status.substr( 6 ) : "invalid response " + status;
+        answered = false;
+    }
+    close( fd );
+
+    return answered;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "webServerAnalyser.h"
+
+#define DEFAULT_SERVER_HANDLERS 4 // connections served at once by a queryServer
+#define SERVER_REQUEST_SIZE ( 64 << 10 ) // longest request line accepted
+#define SERVER_CLIENT_TIMEOUT 30 // seconds a connection may stay idle before it is closed
+#define SERVER_QUEUED_CONNECTIONS 16 // accepted connections waiting for a handler, the next ones are turned away
+
+/*
+ * @class: queryServer
+ * @brief: answers queries over the resident logs of an analyser (see loadResident) on a Unix domain socket, and keeps the
+ *         logs refreshed with the lines appended to them
+ *         Protocol: one request per line, a client may send several requests on the same connection
+ *           request:  "name=value" fields separated by tabs, named like the logParser options:
+ *                     action (repeated for several actions), minimum_date, maximum_date, filter, bucket, by and top
+ *                     ex. "action=webserver\taction=resource\ttop=10\tfilter=status=4xx\n"
+ *           response: "ok N\n" followed by the N lines logParser prints for the same options ("# action" sections
+ *                     for several actions), or "error MESSAGE\n" if the request is invalid
+ *         A connection arriving while every handler is busy and SERVER_QUEUED_CONNECTIONS others wait for one is answered
+ *         "error server busy\n" and closed: the listener never waits for a handler
+ */
+class queryServer
+{
+    private:
+        webServerAnalyser &analyser;
+        std::string socketPath;
+        size_t defaultTop;
+        unsigned int handlers;
+        int listenFd = -1;
+        std::atomic <bool> stopping{ false };
+
+       /*
+        * @method: serveClient
+        * @brief: answers the requests of a connection until the client closes it, goes idle or the server stops
+        * @input - clientFd: the accepted connection, closed on return
+        */
+        void serveClient( int clientFd );
+
+    public:
+       /*
+        * @method: queryServer
+        * @input - analyser: the analyser holding the resident logs, must outlive the server
+        * @input - socketPath: path of the Unix domain socket to listen on
+        * @input - defaultTop: number of keys of the answers of requests without a top field, 0 answers every key
+        * @input - handlers: number of connections served at once
+        */
+        queryServer( webServerAnalyser &analyser, const std::string &socketPath, size_t defaultTop = 0,
+                     unsigned int handlers = DEFAULT_SERVER_HANDLERS );
+        ~queryServer();
+
+        queryServer( const queryServer & ) = delete;
+        queryServer &operator=( const queryServer & ) = delete;
+
+       /*
+        * @method: listen
+        * @brief: creates the socket, replacing a stale socket file left by a server that is not running anymore
+        * @output - error: why the socket could not be created
+        * @return: returns true if the server is listening, false otherwise
+        */
+        bool listen( std::string &error );
+
+       /*
+        * @method: serve
+        * @brief: accepts connections and refreshes the resident logs every FOLLOW_POLL_INTERVAL milliseconds until stop is
+        *         called, then waits for the connections being served and removes the socket file
+        */
+        void serve();
+
+       /*
+        * @method: stop
+        * @brief: asks serve to return (can be called from another thread or a signal handler)
+        */
+        void stop() { stopping = true; }
+
+       /*
+        * @method: answer
+        * @brief: evaluates a request over the resident logs
+        * @input - request: the request line, without its newline
+        * @return: returns the response, each line ending with a newline
+        */
+        std::string answer( std::string_view request );
+
+       /*
+        * @method: query
+        * @brief: client side: sends a request to a server and reads its response
+        * @input - socketPath: path of the socket the server listens on
+        * @input - request: the request line, without its newline
+        * @output - lines: the lines of the answer
+        * @output - error: the error of the server, or why it could not be reached
+        * @return: returns true if the request was answered, false otherwise
+        */
+        static bool query( const std::string &socketPath, const std::string &request, std::vector <std::string> &lines, std::string &error );
+};
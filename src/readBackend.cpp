@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "readBackend.h"
+
+/*
+ * @method: readFully
+ * @brief: reads with pread until length bytes are read or the end of the file is reached
+ * @return: returns the number of bytes read, or a negative errno if nothing could be read
+ */
+static ssize_t readFully( int fd, char *buffer, size_t length, uint64_t offset )
+{
+    size_t done = 0;
+    while ( done < length )
+    {
+        ssize_t bytes = pread( fd, buffer + done, length - done, offset + done );
+        if ( bytes < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        if ( bytes < 0 && done == 0 )
+        {
+            return -errno;
+        }
+        if ( bytes <= 0 )
+        {
+            break;
+        }
+        done += bytes;
+    }
+    return static_cast <ssize_t>( done );
+}
+
+/*
+ * @method: create
+ * @brief: builds the backend of the provided kind
+ * @input - backend: inputBackend::pread or inputBackend::uring (pread if io_uring is not available)
+ * @input - depth: maximum number of reads in flight
+ * @return: returns the backend, never nullptr
+ */
+std::unique_ptr <readBackend> readBackend::create( inputBackend backend, unsigned int depth )
+{
+    if ( backend == inputBackend::uring )
+    {
+        // io_uring can be missing (old kernels) or forbidden (seccomp filters of containers): fall back to pread
+        auto ring = std::make_unique <uringBackend>( depth );
+        if ( ring->isOpen() )
+        {
+            return ring;
+        }
+    }
+    return std::make_unique <preadBackend>();
+}
+
+/*
+ * @method: submit
+ * @brief: performs the read right away, its result is handed out by the next wait
+ */
+bool preadBackend::submit( uint64_t tag, int fd, char *buffer, size_t length, uint64_t offset )
+{
+    completed.emplace_back( tag, readFully( fd, buffer, length, offset ) );
+    return true;
+}
+
+/*
+ * @method: wait
+ * @brief: hands out the result of the oldest read
+ */
+bool preadBackend::wait( uint64_t &tag, ssize_t &result )
+{
+    if ( completed.empty() )
+    {
+        return false;
+    }
+    std::tie( tag, result ) = completed.front();
+    completed.pop_front();
+    return true;
+}
+
+/*
+ * @method: uringBackend
+ * @brief: sets up a ring of depth entries and maps its submission and completion rings
+ * @input - depth: maximum number of reads in flight
+ */
+uringBackend::uringBackend( unsigned int depth )
+{
+    io_uring_params params = {};
+    int fd = static_cast <int>( syscall( __NR_io_uring_setup, std::max( depth, 1u ), &params ) );
+    if ( fd < 0 )
+    {
+        return;
+    }
+    ringFd = fd; // released by the destructor, with the rings mapped so far, if the ring cannot be used
+
+    submissionSize = params.sq_off.array + params.sq_entries * sizeof( unsigned int );
+    completionSize = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+    entriesSize = params.sq_entries * sizeof( io_uring_sqe );
+    // Recent kernels map both rings at once
+    if ( params.features & IORING_FEAT_SINGLE_MMAP )
+    {
+        submissionSize = completionSize = std::max( submissionSize, completionSize );
+    }
+    submissionRing = mmap( nullptr, submissionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+    completionRing = submissionRing;
+    if ( submissionRing != MAP_FAILED && !( params.features & IORING_FEAT_SINGLE_MMAP ) )
+    {
+        completionRing = mmap( nullptr, completionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+    }
+    entries = mmap( nullptr, entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES );
+    if ( submissionRing == MAP_FAILED || completionRing == MAP_FAILED || entries == MAP_FAILED )
+    {
+        return;
+    }
+    ready = true;
+
+    char *submission = static_cast <char *>( submissionRing ), *completion = static_cast <char *>( completionRing );
+    submissionHead = reinterpret_cast <unsigned int *>( submission + params.sq_off.head );
+    submissionTail = reinterpret_cast <unsigned int *>( submission + params.sq_off.tail );
+    submissionMask = reinterpret_cast <unsigned int *>( submission + params.sq_off.ring_mask );
+    submissionArray = reinterpret_cast <unsigned int *>( submission + params.sq_off.array );
+    completionHead = reinterpret_cast <unsigned int *>( completion + params.cq_off.head );
+    completionTail = reinterpret_cast <unsigned int *>( completion + params.cq_off.tail );
+    completionMask = reinterpret_cast <unsigned int *>( completion + params.cq_off.ring_mask );
+    completions = completion + params.cq_off.cqes;
+}
+
+uringBackend::~uringBackend()
+{
+    if ( ringFd < 0 )
+    {
+        return;
+    }
+    if ( entries != nullptr && entries != MAP_FAILED )
+    {
+        munmap( entries, entriesSize );
+    }
+    if ( completionRing != nullptr && completionRing != MAP_FAILED && completionRing != submissionRing )
+    {
+        munmap( completionRing, completionSize );
+    }
+    if ( submissionRing != nullptr && submissionRing != MAP_FAILED )
+    {
+        munmap( submissionRing, submissionSize );
+    }
+    close( ringFd );
+}
+
+/*
+ * @method: submit
+ * @brief: queues a read in the submission ring, it is handed to the kernel by the next wait
+ */
+bool uringBackend::submit( uint64_t tag, int fd, char *buffer, size_t length, uint64_t offset )
+{
+    unsigned int tail = *submissionTail;
+    if ( tail - __atomic_load_n( submissionHead, __ATOMIC_ACQUIRE ) > *submissionMask )
+    {
+        return false; // more reads than entries
+    }
+
+    unsigned int index = tail & *submissionMask;
+    io_uring_sqe &entry = static_cast <io_uring_sqe *>( entries )[index];
+    memset( &entry, 0, sizeof( entry ) );
+    entry.opcode = IORING_OP_READ;
+    entry.fd = fd;
+    entry.addr = reinterpret_cast <uint64_t>( buffer );
+    entry.len = static_cast <uint32_t>( length );
+    entry.off = offset;
+    entry.user_data = tag;
+    submissionArray[index] = index;
+    __atomic_store_n( submissionTail, tail + 1, __ATOMIC_RELEASE );
+    unsubmitted++;
+    inFlight++;
+    return true;
+}
+
+/*
+ * @method: wait
+ * @brief: hands the queued reads to the kernel, then waits for a completion if none is available yet
+ */
+bool uringBackend::wait( uint64_t &tag, ssize_t &result )
+{
+    if ( inFlight == 0 )
+    {
+        return false;
+    }
+
+    unsigned int head = *completionHead;
+    while ( unsubmitted > 0 || head == __atomic_load_n( completionTail, __ATOMIC_ACQUIRE ) )
+    {
+        bool empty = head == __atomic_load_n( completionTail, __ATOMIC_ACQUIRE );
+        long submitted = syscall( __NR_io_uring_enter, ringFd, unsubmitted, empty ? 1 : 0, empty ? IORING_ENTER_GETEVENTS : 0, nullptr, 0 );
+        if ( submitted < 0 )
+        {
+            if ( errno == EINTR || errno == EAGAIN || errno == EBUSY )
+            {
+                continue;
+            }
+            return false;
+        }
+        unsubmitted -= static_cast <unsigned int>( submitted );
+    }
+
+    const io_uring_cqe &completion = static_cast <const io_uring_cqe *>( completions )[head & *completionMask];
+    tag = completion.user_data;
+    result = completion.res;
+    __atomic_store_n( completionHead, head + 1, __ATOMIC_RELEASE );
+    inFlight--;
+    return true;
+}
+
+/*
+ * @method: readStream
+ * @brief: starts reading in the background
+ * @input - filePath: the plain text log
+ * @input - start: offset of the first byte to hand out, the start of a line
+ * @input - end: offset after the last byte to hand out, the end of a line or of the file
+ * @input - backend: inputBackend::pread or inputBackend::uring
+ * @input - depth: number of reads in flight
+ * @input - directIO: open the log with O_DIRECT when the file system supports it
+ * @input - chunkSize: approximate size of the chunks
+ * @input - queueDepth: maximum number of chunks waiting to be parsed
+ */
+readStream::readStream( const std::string &filePath, uint64_t start, uint64_t end, inputBackend backend, unsigned int depth, bool directIO,
+                        size_t chunkSize, size_t queueDepth )
+    : filePath( filePath ), start( start ), end( std::max( start, end ) ), backend( backend ), depth( std::max( depth, 1u ) ),
+      directIO( directIO ), chunkSize( chunkSize > 0 ? chunkSize : DECOMPRESSED_CHUNK_SIZE ), chunks( queueDepth ), error( false )
+{
+    producer = std::thread( &readStream::produce, this );
+}
+
+readStream::~readStream()
+{
+    // Unblocks the producer if the consumers stopped early
+    chunks.close();
+    producer.join();
+}
+
+/*
+ * @method: produce
+ * @brief: reader thread: reads the whole range in order and pushes the chunks, closes the queue at the end
+ */
+void readStream::produce()
+{
+    decompressedChunk pending; // read data not handed out yet, offsets are relative to start
+    bool open = true;
+
+    // Hands out everything up to the last complete line once enough data is pending, the partial line is carried over
+    auto flush = [&]( bool last )
+    {
+        if ( !open || pending.data.empty() || ( !last && pending.data.size() < chunkSize ) )
+        {
+            return;
+        }
+        size_t cut = last ? pending.data.size() : pending.data.rfind( '\n' ) + 1;
+        if ( cut == 0 )
+        {
+            return; // a single line longer than the chunk size: keep accumulating
+        }
+
+        decompressedChunk next;
+        next.offset = pending.offset + cut;
+        next.data.reserve( chunkSize + READ_BUFFER_SIZE );
+        next.data.assign( pending.data, cut, std::string::npos );
+        pending.data.resize( cut );
+        open = chunks.push( std::move( pending ) );
+        pending = std::move( next );
+    };
+
+    // O_DIRECT is refused by some file systems (ex. tmpfs): the log is read through the page cache instead
+    int fd = directIO ? ::open( filePath.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT ) : -1;
+    if ( fd < 0 )
+    {
+        fd = ::open( filePath.c_str(), O_RDONLY | O_CLOEXEC );
+        if ( fd >= 0 )
+        {
+            posix_fadvise( fd, start, end - start, POSIX_FADV_SEQUENTIAL );
+        }
+    }
+    if ( fd < 0 )
+    {
+        error = true;
+        chunks.close();
+        return;
+    }
+
+    // Reads are aligned on READ_ALIGNMENT: the first one starts before start, its leading bytes are skipped
+    // Each of the depth buffers holds one read, the read depth blocks ahead is submitted as soon as a buffer is handed out
+    std::unique_ptr <readBackend> reader = readBackend::create( backend, depth );
+    std::unique_ptr <char, decltype( &std::free )> buffers( static_cast <char *>( std::aligned_alloc( READ_ALIGNMENT, static_cast <size_t>( depth ) * READ_BUFFER_SIZE ) ),
+                                                            &std::free );
+    uint64_t readStart = start - start % READ_ALIGNMENT;
+    uint64_t blocks = ( end - readStart + READ_BUFFER_SIZE - 1 ) / READ_BUFFER_SIZE;
+    std::vector <ssize_t> results( depth, 0 );
+    std::vector <bool> completed( depth, false );
+    uint64_t submitted = 0, reaped = 0;
+    auto submit = [&]( uint64_t block )
+    {
+        size_t slot = block % depth;
+        completed[slot] = false;
+        if ( !reader->submit( block, fd, buffers.get() + slot * READ_BUFFER_SIZE, READ_BUFFER_SIZE, readStart + block * READ_BUFFER_SIZE ) )
+        {
+            return false;
+        }
+        submitted++;
+        return true;
+    };
+
+    error = buffers == nullptr;
+    while ( !error && submitted < std::min <uint64_t>( blocks, depth ) )
+    {
+        error = !submit( submitted );
+    }
+    for (uint64_t block = 0; !error && open && block < blocks; block++)
+    {
+        size_t slot = block % depth;
+        while ( !completed[slot] )
+        {
+            uint64_t tag = 0;
+            ssize_t result = 0;
+            if ( !reader->wait( tag, result ) )
+            {
+                error = true;
+                break;
+            }
+            reaped++;
+            results[tag % depth] = result;
+            completed[tag % depth] = true;
+        }
+
+        // A short read (ex. interrupted) is completed in place, only a log truncated while it is read ends before the end of the range
+        uint64_t blockOffset = readStart + block * READ_BUFFER_SIZE;
+        size_t wanted = std::min <uint64_t>( READ_BUFFER_SIZE, end - blockOffset );
+        char *buffer = buffers.get() + slot * READ_BUFFER_SIZE;
+        if ( !error && results[slot] > 0 && results[slot] < static_cast <ssize_t>( wanted ) )
+        {
+            ssize_t rest = readFully( fd, buffer + results[slot], wanted - results[slot], blockOffset + results[slot] );
+            results[slot] += std::max <ssize_t>( rest, 0 );
+        }
+        if ( error || results[slot] < static_cast <ssize_t>( wanted ) )
+        {
+            error = true;
+            break;
+        }
+        size_t skip = block == 0 ? start - readStart : 0;
+        pending.data.append( buffer + skip, wanted - skip );
+        flush( false );
+
+        if ( submitted < blocks )
+        {
+            error = !submit( submitted );
+        }
+    }
+
+    // The reads still in flight (ex. the consumers stopped early) must complete before their buffers are released
+    uint64_t tag = 0;
+    ssize_t result = 0;
+    while ( reaped < submitted && reader->wait( tag, result ) )
+    {
+        reaped++;
+    }
+    close( fd );
+
+    flush( true );
+    chunks.close();
+}
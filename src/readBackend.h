@@ -0,0 +1,188 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <sys/types.h>
+
+#include "boundedQueue.h"
+#include "compressedInput.h"
+
+#define READ_BUFFER_SIZE ( 1 << 20 ) // bytes of each read in flight
+#define READ_ALIGNMENT 4096 // alignment of the read buffers, offsets and lengths (required by O_DIRECT)
+#define DEFAULT_READ_DEPTH 8 // reads kept in flight by a readStream
+
+/*
+ * @enum: inputBackend
+ * @brief: how the contents of plain text logs reach the parsing threads
+ */
+enum class inputBackend
+{
+    mmap,  // the parsing threads read the memory-mapped file, pages are faulted in as they are parsed (see mappedFile)
+    pread, // a reader thread reads large buffers ahead of the parsing threads with pread (see preadBackend)
+    uring  // a reader thread keeps several reads in flight through io_uring, falls back to pread if unavailable (see uringBackend)
+};
+
+/*
+ * @class: readBackend
+ * @brief: asynchronous reads of a file into caller-owned buffers: reads are submitted, then reaped in completion order
+ */
+class readBackend
+{
+    public:
+        virtual ~readBackend() = default;
+
+       /*
+        * @method: submit
+        * @brief: queues a read, the buffer must stay valid until the read is reaped by wait
+        * @input - tag: identifies the read when it completes
+        * @input - fd: the file to read
+        * @input - buffer: receives the bytes read
+        * @input - length: number of bytes to read
+        * @input - offset: offset of the first byte to read in the file
+        * @return: returns false if the read could not be queued
+        */
+        virtual bool submit( uint64_t tag, int fd, char *buffer, size_t length, uint64_t offset ) = 0;
+
+       /*
+        * @method: wait
+        * @brief: waits for the completion of a submitted read
+        * @output - tag: the tag of the completed read
+        * @output - result: number of bytes read, or a negative errno
+        * @return: returns false if no read is in flight or waiting failed
+        */
+        virtual bool wait( uint64_t &tag, ssize_t &result ) = 0;
+
+       /*
+        * @method: create
+        * @brief: builds the backend of the provided kind
+        * @input - backend: inputBackend::pread or inputBackend::uring (pread if io_uring is not available)
+        * @input - depth: maximum number of reads in flight
+        * @return: returns the backend, never nullptr
+        */
+        static std::unique_ptr <readBackend> create( inputBackend backend, unsigned int depth );
+};
+
+/*
+ * @class: preadBackend
+ * @brief: portable backend: each read is performed with pread when it is submitted, wait hands out the results in order
+ */
+class preadBackend : public readBackend
+{
+    private:
+        std::deque <std::pair <uint64_t, ssize_t>> completed;
+
+    public:
+        bool submit( uint64_t tag, int fd, char *buffer, size_t length, uint64_t offset ) override;
+        bool wait( uint64_t &tag, ssize_t &result ) override;
+};
+
+/*
+ * @class: uringBackend
+ * @brief: io_uring backend, driven through the raw system calls: submitted reads are queued in the submission ring and
+ *         handed to the kernel together by the next wait, so that the device sees every read in flight at once
+ */
+class uringBackend : public readBackend
+{
+    private:
+        int ringFd = -1;
+        bool ready = false;
+        void *submissionRing = nullptr;
+        void *completionRing = nullptr;
+        void *entries = nullptr; // struct io_uring_sqe array
+        size_t submissionSize = 0;
+        size_t completionSize = 0;
+        size_t entriesSize = 0;
+        unsigned int *submissionHead = nullptr, *submissionTail = nullptr, *submissionMask = nullptr, *submissionArray = nullptr;
+        unsigned int *completionHead = nullptr, *completionTail = nullptr, *completionMask = nullptr;
+        void *completions = nullptr; // struct io_uring_cqe array
+        unsigned int unsubmitted = 0; // queued in the submission ring, not handed to the kernel yet
+        unsigned int inFlight = 0; // submitted, not reaped yet
+
+    public:
+       /*
+        * @method: uringBackend
+        * @brief: sets up a ring of depth entries
+        * @input - depth: maximum number of reads in flight
+        */
+        explicit uringBackend( unsigned int depth );
+        ~uringBackend() override;
+
+        uringBackend( const uringBackend & ) = delete;
+        uringBackend &operator=( const uringBackend & ) = delete;
+
+       /*
+        * @method: isOpen
+        * @return: returns true if the ring was set up (io_uring is supported and allowed)
+        */
+        bool isOpen() const { return ready; }
+
+        bool submit( uint64_t tag, int fd, char *buffer, size_t length, uint64_t offset ) override;
+        bool wait( uint64_t &tag, ssize_t &result ) override;
+};
+
+/*
+ * @class: readStream
+ * @brief: reads a range of a plain text log on its own thread, keeping depth reads of READ_BUFFER_SIZE bytes in flight, and
+ *         hands newline aligned chunks to the parsing threads through a bounded queue, like a decompressionStream
+ *         Buffers are aligned so that the log can be opened with O_DIRECT, bypassing the page cache for logs larger than memory
+ */
+class readStream : public chunkStream
+{
+    private:
+        std::string filePath;
+        uint64_t start;
+        uint64_t end;
+        inputBackend backend;
+        unsigned int depth;
+        bool directIO;
+        size_t chunkSize;
+        boundedQueue <decompressedChunk> chunks;
+        std::atomic <bool> error;
+        std::thread producer;
+
+       /*
+        * @method: produce
+        * @brief: reader thread: reads the whole range in order and pushes the chunks, closes the queue at the end
+        */
+        void produce();
+
+    public:
+       /*
+        * @method: readStream
+        * @brief: starts reading in the background
+        * @input - filePath: the plain text log
+        * @input - start: offset of the first byte to hand out, the start of a line
+        * @input - end: offset after the last byte to hand out, the end of a line or of the file
+        * @input - backend: inputBackend::pread or inputBackend::uring
+        * @input - depth: number of reads in flight
+        * @input - directIO: open the log with O_DIRECT when the file system supports it
+        * @input - chunkSize: approximate size of the chunks
+        * @input - queueDepth: maximum number of chunks waiting to be parsed
+        */
+        readStream( const std::string &filePath, uint64_t start, uint64_t end, inputBackend backend, unsigned int depth, bool directIO,
+                    size_t chunkSize, size_t queueDepth );
+        ~readStream() override;
+
+        readStream( const readStream & ) = delete;
+        readStream &operator=( const readStream & ) = delete;
+
+       /*
+        * @method: next
+        * @brief: waits for the next chunk (can be called concurrently by several parsing threads)
+        * @output - chunk: the next chunk, in file order, its offset is relative to start
+        * @return: returns false once the whole range has been handed out, true otherwise
+        */
+        bool next( decompressedChunk &chunk ) override { return chunks.pop( chunk ); }
+
+       /*
+        * @method: failed
+        * @return: returns true if the log could not be opened or read entirely
+        */
+        bool failed() const override { return error; }
+};
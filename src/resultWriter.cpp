@@ -0,0 +1,359 @@
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+#include "resultWriter.h"
+#include "stateFile.h"
+
+/*
+ * @method: resultWriter
+ * @input - fd: file descriptor the results are written to, left open
+ * @input - format: layout of the results
+ * @input - limit: maximum number of rows written per result, 0 writes every row
+ */
+resultWriter::resultWriter( int fd, outputFormat format, size_t limit ) : fd( fd ), format( format ), limit( limit )
+{
+    buffer.reserve( RESULT_BUFFER_SIZE + ( 4 << 10 ) );
+}
+
+resultWriter::~resultWriter()
+{
+    flush();
+}
+
+/*
+ * @method: write
+ * @brief: formats the results of a run (one document for json and binary), writing them out as the buffer fills up
+ * @input - actions: the action of each result, names its section
+ * @input - results: the ranked results of each action
+ * @return: returns true if everything written so far reached the file descriptor, false otherwise
+ */
+bool resultWriter::write( const std::vector <std::string> &actions, const std::vector <queryResult> &results )
+{
+    // Step 1: the header of the document
+    if ( format == outputFormat::csv && !csvHeader )
+    {
+        buffer += "action,bucket,key,count,error,bytes,p50,p95,p99\n";
+        csvHeader = true;
+    }
+    else if ( format == outputFormat::json )
+    {
+        buffer += '[';
+    }
+    else if ( format == outputFormat::binary )
+    {
+        buffer.append( RESULT_MAGIC, strlen( RESULT_MAGIC ) );
+        queryResult::appendVarint( RESULT_VERSION, buffer );
+        queryResult::appendVarint( results.size(), buffer );
+    }
+
+    // Step 2: one section per action, flushed whenever the buffer is full
+    for (size_t section = 0; section < results.size(); section++)
+    {
+        const queryResult &result = results[section];
+        size_t rows = limit > 0 && limit < result.size() ? limit : result.size();
+
+        switch ( format )
+        {
+            case outputFormat::text:
+                if ( results.size() > 1 )
+                {
+                    buffer += section > 0 ? "\n# " : "# ";
+                    buffer += actions[section];
+                    buffer += '\n';
+                }
+                break;
+            case outputFormat::json:
+                buffer += section > 0 ? ",{\"action\":" : "{\"action\":";
+                appendQuoted( actions[section] );
+                buffer += ",\"results\":[";
+                break;
+            case outputFormat::binary:
+                queryResult::appendVarint( actions[section].size(), buffer );
+                buffer += actions[section];
+                queryResult::appendVarint( static_cast <uint64_t>( result.kind() ), buffer );
+                queryResult::appendVarint( result.calendarDates() ? 1 : 0, buffer );
+                queryResult::appendVarint( rows, buffer );
+                break;
+            default:
+                break;
+        }
+
+        // Spilled results are read back from their file while they are written
+        size_t written = 0;
+        bool readBack = result.forEachRow( [&]( std::string_view key, const resultRow &row )
+        {
+            if ( written == rows )
+            {
+                return false;
+            }
+            if ( format == outputFormat::json && written > 0 )
+            {
+                buffer += ',';
+            }
+            appendRow( actions[section], result, key, row );
+            written++;
+            if ( buffer.size() >= RESULT_BUFFER_SIZE )
+            {
+                flush();
+            }
+            return true;
+        } );
+        writeFailed = writeFailed || !readBack || written < rows;
+
+        if ( format == outputFormat::json )
+        {
+            buffer += "]}";
+        }
+    }
+
+    if ( format == outputFormat::json )
+    {
+        buffer += "]\n";
+    }
+
+    return !writeFailed;
+}
+
+/*
+ * @method: appendRow
+ * @brief: formats a row of a result into the buffer, in the format of the writer
+ * @input - action: the action of the result
+ * @input - result: the result
+ * @input - key: the key of the row
+ * @input - row: the numbers of the row
+ */
+void resultWriter::appendRow( std::string_view action, const queryResult &result, std::string_view key, const resultRow &row )
+{
+    resultKind kind = result.kind();
+    bool traffic = kind == resultKind::traffic || kind == resultKind::keyedTraffic;
+    bool bounded = kind == resultKind::boundedCounts || kind == resultKind::sampledCounts;
+
+    switch ( format )
+    {
+        case outputFormat::text:
+            result.appendText( key, row, buffer );
+            buffer += '\n';
+            break;
+
+        case outputFormat::csv:
+            appendQuoted( action );
+            buffer += ',';
+            if ( traffic )
+            {
+                queryResult::appendDate( row.bucket, result.calendarDates(), buffer );
+            }
+            buffer += ',';
+            appendQuoted( key );
+            buffer += ',';
+            queryResult::appendNumber( row.count, buffer );
+            buffer += ',';
+            if ( bounded )
+            {
+                queryResult::appendNumber( row.error, buffer );
+            }
+            buffer += ',';
+            if ( traffic )
+            {
+                queryResult::appendNumber( row.bytes, buffer );
+            }
+            for (uint64_t quantile: row.quantiles)
+            {
+                buffer += ',';
+                if ( kind == resultKind::sizeQuantiles )
+                {
+                    queryResult::appendNumber( quantile, buffer );
+                }
+            }
+            buffer += '\n';
+            break;
+
+        case outputFormat::json:
+            buffer += '{';
+            if ( traffic )
+            {
+                buffer += "\"bucket\":\"";
+                queryResult::appendDate( row.bucket, result.calendarDates(), buffer );
+                buffer += "\",";
+            }
+            if ( kind != resultKind::traffic )
+            {
+                buffer += "\"key\":";
+                appendQuoted( key );
+                buffer += ',';
+            }
+            buffer += "\"count\":";
+            queryResult::appendNumber( row.count, buffer );
+            if ( bounded )
+            {
+                buffer += ",\"error\":";
+                queryResult::appendNumber( row.error, buffer );
+            }
+            if ( traffic )
+            {
+                buffer += ",\"bytes\":";
+                queryResult::appendNumber( row.bytes, buffer );
+            }
+            if ( kind == resultKind::sizeQuantiles )
+            {
+                buffer += ",\"p50\":";
+                queryResult::appendNumber( row.quantiles[0], buffer );
+                buffer += ",\"p95\":";
+                queryResult::appendNumber( row.quantiles[1], buffer );
+                buffer += ",\"p99\":";
+                queryResult::appendNumber( row.quantiles[2], buffer );
+            }
+            buffer += '}';
+            break;
+
+        case outputFormat::binary:
+            result.appendRecord( key, row, buffer );
+            break;
+    }
+}
+
+/*
+ * @method: appendQuoted
+ * @brief: appends a text to the buffer, as a CSV field (quoted when needed) or a JSON string
+ */
+void resultWriter::appendQuoted( std::string_view value )
+{
+    if ( format == outputFormat::csv )
+    {
+        if ( value.find_first_of( ",\"\r\n" ) == std::string_view::npos )
+        {
+            buffer += value;
+            return;
+        }
+        buffer += '"';
+        for (char byte: value)
+        {
+            buffer += byte;
+            if ( byte == '"' )
+            {
+                buffer += '"';
+            }
+        }
+        buffer += '"';
+        return;
+    }
+
+    buffer += '"';
+    for (char byte: value)
+    {
+        unsigned char code = static_cast <unsigned char>( byte );
+        if ( byte == '"' || byte == '\\' )
+        {
+            buffer += '\\';
+            buffer += byte;
+        }
+        else if ( code < 0x20 )
+        {
+            static const char hexDigits[] = "0123456789abcdef";
+            buffer += "\\u00";
+            buffer += hexDigits[code >> 4];
+            buffer += hexDigits[code & 0xF];
+        }
+        else
+        {
+            buffer += byte;
+        }
+    }
+    buffer += '"';
+}
+
+/*
+ * @method: flush
+ * @brief: writes the buffered bytes out
+ * @return: returns true if everything written so far reached the file descriptor, false otherwise
+ */
+bool resultWriter::flush()
+{
+    size_t written = 0;
+
+    while ( written < buffer.size() && !writeFailed )
+    {
+        ssize_t count = ::write( fd, buffer.data() + written, buffer.size() - written );
+        if ( count < 0 && errno == EINTR )
+        {
+            continue;
+        }
+        writeFailed = count <= 0;
+        written += count > 0 ? static_cast <size_t>( count ) : 0;
+    }
+    buffer.clear();
+
+    return !writeFailed;
+}
+
+/*
+ * @method: parseFormat
+ * @brief: parses the name of an output format ("text", "csv", "json" or "binary")
+ * @output - format: the parsed format
+ * @return: returns true if the name is a format, false otherwise
+ */
+bool resultWriter::parseFormat( std::string_view name, outputFormat &format )
+{
+    static const std::pair <const char *, outputFormat> formats[] = { { "text", outputFormat::text }, { "csv", outputFormat::csv },
+                                                                      { "json", outputFormat::json }, { "binary", outputFormat::binary } };
+
+    for (const auto &entry: formats)
+    {
+        if ( name == entry.first )
+        {
+            format = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * @method: readBinary
+ * @brief: reads back results written in the binary format
+ * @input - data: the written bytes
+ * @output - actions: the action of each result
+ * @output - results: the results, in the order they were written
+ * @return: returns true if data is a complete binary document, false otherwise
+ */
+bool resultWriter::readBinary( std::string_view data, std::vector <std::string> &actions, std::vector <queryResult> &results )
+{
+    size_t magicSize = strlen( RESULT_MAGIC );
+
+    actions.clear();
+    results.clear();
+    if ( data.substr( 0, magicSize ) != RESULT_MAGIC )
+    {
+        return false;
+    }
+
+    // The sections are read like a state file payload: a malformed or truncated document fails the reader
+    stateReader reader( data.substr( magicSize ) );
+    if ( reader.number() != RESULT_VERSION )
+    {
+        return false;
+    }
+    uint64_t sections = reader.number();
+    for (uint64_t section = 0; section < sections && !reader.failed(); section++)
+    {
+        actions.emplace_back( reader.text() );
+        uint64_t kindValue = reader.number();
+        if ( kindValue > static_cast <uint64_t>( resultKind::sizeQuantiles ) )
+        {
+            return false;
+        }
+        resultKind kind = static_cast <resultKind>( kindValue );
+        queryResult result( kind );
+        result.setCalendarDates( reader.number() != 0 );
+        uint64_t rows = reader.number();
+        for (uint64_t index = 0; index < rows && !reader.failed(); index++)
+        {
+            resultRow row;
+            std::string_view key = result.readRecord( reader, row );
+            result.add( key, row );
+        }
+        results.push_back( std::move( result ) );
+    }
+
+    return !reader.failed() && reader.atEnd();
+}
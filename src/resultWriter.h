@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "queryResult.h"
+
+#define RESULT_BUFFER_SIZE ( 1 << 20 ) // bytes buffered by a resultWriter before they are written out
+#define RESULT_MAGIC "WSLRESLT"
+#define RESULT_VERSION 2
+
+/*
+ * @enum: outputFormat
+ * @brief: how a resultWriter lays the results out
+ */
+enum class outputFormat
+{
+    text,  // the lines logParser prints, "# action" sections for several actions (see queryResult::appendText)
+    csv,   // "action,bucket,key,count,error,bytes,p50,p95,p99" rows (RFC 4180), the fields a result does not use are empty
+    json,  // [{"action":"webserver","results":[{"key":"host","count":5},...]},...], only the fields a result uses
+    binary // RESULT_MAGIC, then varints and length prefixed texts like a state file payload (see readBinary)
+};
+
+/*
+ * @class: resultWriter
+ * @brief: writes the ranked results of queries to a file descriptor, formatting the rows straight into a large buffer
+ *         that is written out every RESULT_BUFFER_SIZE bytes instead of once per line
+ *         Binary layout: RESULT_MAGIC, version, number of sections, then per section: action, resultKind, 1 if the buckets
+ *         are calendar date times (see queryResult::calendarDates) or 0, number of rows,
+ *         and per row the record of queryResult::appendRecord
+ */
+class resultWriter
+{
+    private:
+        int fd;
+        outputFormat format;
+        size_t limit;
+        std::string buffer;
+        bool writeFailed = false;
+        bool csvHeader = false;
+
+       /*
+        * @method: appendRow
+        * @brief: formats a row of a result into the buffer, in the format of the writer
+        * @input - action: the action of the result
+        * @input - result: the result
+        * @input - key: the key of the row
+        * @input - row: the numbers of the row
+        */
+        void appendRow( std::string_view action, const queryResult &result, std::string_view key, const resultRow &row );
+
+       /*
+        * @method: appendQuoted
+        * @brief: appends a text to the buffer, as a CSV field (quoted when needed) or a JSON string
+        */
+        void appendQuoted( std::string_view value );
+
+    public:
+       /*
+        * @method: resultWriter
+        * @input - fd: file descriptor the results are written to, left open
+        * @input - format: layout of the results
+        * @input - limit: maximum number of rows written per result, 0 writes every row
+        */
+        resultWriter( int fd, outputFormat format, size_t limit = 0 );
+        ~resultWriter();
+
+        resultWriter( const resultWriter & ) = delete;
+        resultWriter &operator=( const resultWriter & ) = delete;
+
+       /*
+        * @method: write
+        * @brief: formats the results of a run (one document for json and binary), writing them out as the buffer fills up
+        * @input - actions: the action of each result, names its section
+        * @input - results: the ranked results of each action
+        * @return: returns true if everything written so far reached the file descriptor, false otherwise
+        */
+        bool write( const std::vector <std::string> &actions, const std::vector <queryResult> &results );
+
+       /*
+        * @method: flush
+        * @brief: writes the buffered bytes out
+        * @return: returns true if everything written so far reached the file descriptor, false otherwise
+        */
+        bool flush();
+
+       /*
+        * @method: parseFormat
+        * @brief: parses the name of an output format ("text", "csv", "json" or "binary")
+        * @output - format: the parsed format
+        * @return: returns true if the name is a format, false otherwise
+        */
+        static bool parseFormat( std::string_view name, outputFormat &format );
+
+       /*
+        * @method: readBinary
+        * @brief: reads back results written in the binary format
+        * @input - data: the written bytes
+        * @output - actions: the action of each result
+        * @output - results: the results, in the order they were written
+        * @return: returns true if data is a complete binary document, false otherwise
+        */
+        static bool readBinary( std::string_view data, std::vector <std::string> &actions, std::vector <queryResult> &results );
+};
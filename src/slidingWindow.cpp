@@ -0,0 +1,186 @@
+#include <algorithm>
+
+#include "slidingWindow.h"
+
+/*
+ * @method: slidingWindow
+ * @input - windowSeconds: length of the window in seconds of log time
+ * @input - buckets: number of buckets the window is sliced into, the window moves one bucket at a time
+ */
+slidingWindow::slidingWindow( uint32_t windowSeconds, uint32_t buckets )
+{
+    buckets = std::max <uint32_t>( 1, std::min( buckets, std::max <uint32_t>( windowSeconds, 1 ) ) );
+    bucketSeconds = ( std::max <uint32_t>( windowSeconds, 1 ) + buckets - 1 ) / buckets;
+    ring.resize( buckets );
+}
+
+/*
+ * @method: expire
+ * @brief: subtracts a bucket from the window totals and empties it
+ */
+void slidingWindow::expire( windowBucket &bucket )
+{
+    for (size_t entry = 0; entry < bucket.ids.size(); entry++)
+    {
+        uint64_t &total = totals[bucket.ids[entry]];
+        total -= bucket.counts[entry];
+        liveKeys -= total == 0;
+    }
+    bucket.ids.clear();
+    bucket.counts.clear();
+}
+
+/*
+ * @method: compact
+ * @brief: drops the keys that left the window, renumbering the live keys
+ */
+void slidingWindow::compact()
+{
+    keyCounter liveKeyCounter;
+    std::vector <uint32_t> renumbered( totals.size(), UINT32_MAX );
+    std::vector <uint64_t> liveTotals, liveNewestSlot;
+
+    for (size_t id = 0; id < totals.size(); id++)
+    {
+        if ( totals[id] > 0 )
+        {
+            renumbered[id] = static_cast <uint32_t>( liveKeyCounter.add( keys.key( id ), keys.count( id ) ) );
+            liveTotals.push_back( totals[id] );
+            liveNewestSlot.push_back( newestSlot[id] );
+        }
+    }
+
+    // Every entry of the ring belongs to a key within the window
+    for (auto &bucket: ring)
+    {
+        for (auto &id: bucket.ids)
+        {
+            id = renumbered[id];
+        }
+    }
+    keys = std::move( liveKeyCounter );
+    totals.swap( liveTotals );
+    newestSlot.swap( liveNewestSlot );
+}
+
+/*
+ * @method: advance
+ * @brief: moves the end of the window to the provided date time (never backwards), expiring the buckets left behind
+ * @input - date: packed date time (see webServerAnalyser::parseDate)
+ */
+void slidingWindow::advance( uint64_t date )
+{
+    uint64_t bucket = date / bucketSeconds;
+
+    if ( !started || bucket <= newestBucket )
+    {
+        return;
+    }
+
+    // The buckets between the old and the new end of the window are recycled, at most the whole ring
+    uint64_t expired = std::min <uint64_t>( bucket - newestBucket, ring.size() );
+    for (uint64_t step = 1; step <= expired; step++)
+    {
+        expire( ring[( newestBucket + step ) % ring.size()] );
+    }
+    newestBucket = bucket;
+
+    if ( keys.size() > KEY_TABLE_MIN_SIZE && keys.size() > 2 * liveKeys )
+    {
+        compact();
+    }
+}
+
+/*
+ * @method: add
+ * @brief: counts one access for the provided key at the provided date time
+ *         A later date time moves the window forward, an access older than the window is ignored
+ * @input - key: the key being accessed, only copied if it is not already in the window
+ * @input - date: packed date time of the access
+ * @input - position: position of the access in the input, used to order keys with the same count
+ */
+void slidingWindow::add( std::string_view key, uint64_t date, uint64_t position )
+{
+    uint64_t bucket = date / bucketSeconds;
+
+    if ( !started )
+    {
+        started = true;
+        newestBucket = bucket;
+    }
+    advance( date );
+    if ( bucket + ring.size() <= newestBucket )
+    {
+        return;
+    }
+
+    size_t id = keys.increment( key, position );
+    if ( id >= totals.size() )
+    {
+        totals.resize( id + 1, 0 );
+        newestSlot.resize( id + 1, 0 );
+    }
+    liveKeys += totals[id]++ == 0;
+
+    // Accesses to the newest bucket (nearly all of them) update the entry of their key, late accesses get an entry of their own
+    windowBucket &entries = ring[bucket % ring.size()];
+    uint64_t newestTag = ( newestBucket + 1 ) << 32;
+    if ( bucket == newestBucket && ( newestSlot[id] & ~uint64_t( UINT32_MAX ) ) == newestTag )
+    {
+        entries.counts[newestSlot[id] & UINT32_MAX]++;
+        return;
+    }
+    if ( bucket == newestBucket )
+    {
+        newestSlot[id] = newestTag | entries.ids.size();
+    }
+    entries.ids.push_back( static_cast <uint32_t>( id ) );
+    entries.counts.push_back( 1 );
+}
+
+/*
+ * @method: rankedOutput
+ * @brief: sorts the keys of the window based on the # of accesses, most # of accesses at the top
+ * @input - limit: maximum number of entries to output, 0 outputs every key
+ * @return: returns the "key count" entries in ranked order
+ */
+std::vector <std::string> slidingWindow::rankedOutput( size_t limit ) const
+{
+    std::vector <size_t> order;
+    std::vector <std::string> output;
+
+    for (size_t id = 0; id < totals.size(); id++)
+    {
+        if ( totals[id] > 0 )
+        {
+            order.push_back( id );
+        }
+    }
+
+    // Same ranking as keyCounter: by count, ties broken by the position the key was first seen at
+    auto ranksBefore = [this]( size_t lhs, size_t rhs )
+    {
+        if ( totals[lhs] != totals[rhs] )
+        {
+            return totals[lhs] > totals[rhs];
+        }
+        return keys.count( lhs ).firstSeen < keys.count( rhs ).firstSeen;
+    };
+    if ( limit > 0 && limit < order.size() )
+    {
+        std::partial_sort( order.begin(), order.begin() + limit, order.end(), ranksBefore );
+        order.resize( limit );
+    }
+    else
+    {
+        std::sort( order.begin(), order.end(), ranksBefore );
+    }
+
+    output.reserve( order.size() );
+    for (size_t id: order)
+    {
+        output.push_back( std::string( keys.key( id ) ) + " " + std::to_string( totals[id] ) );
+    }
+
+    return output;
+}
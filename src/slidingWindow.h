@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "keyCounter.h"
+
+/*
+ * @class: slidingWindow
+ * @brief: counts accesses per key over the last windowSeconds of log time, updated incrementally
+ *         The window is a ring of buckets, each holding the accesses of a slice of the window as (key ID, count) pairs:
+ *         moving the window forward subtracts the expiring buckets from the window totals instead of counting again
+ *         Keys are interned once (see keyCounter), the keys that left the window are dropped once they outnumber the live keys
+ */
+class slidingWindow
+{
+    private:
+        // Accesses of a slice of the window, a key may appear more than once (ex. lines arriving late)
+        typedef struct windowBucket
+        {
+            std::vector <uint32_t> ids;
+            std::vector <uint32_t> counts;
+        } windowBucket;
+
+        uint32_t bucketSeconds;
+        std::vector <windowBucket> ring; // indexed by bucket number % ring.size()
+        uint64_t newestBucket = 0; // bucket number (date / bucketSeconds) of the newest bucket of the window
+        bool started = false;
+        keyCounter keys; // interned keys, firstSeen orders keys with the same count
+        std::vector <uint64_t> totals; // indexed by key ID: accesses within the window
+        std::vector <uint64_t> newestSlot; // indexed by key ID: ((newestBucket + 1) << 32) | slot of the key in the newest bucket
+        size_t liveKeys = 0; // keys with a non-zero total
+
+       /*
+        * @method: expire
+        * @brief: subtracts a bucket from the window totals and empties it
+        */
+        void expire( windowBucket &bucket );
+
+       /*
+        * @method: compact
+        * @brief: drops the keys that left the window, renumbering the live keys
+        */
+        void compact();
+
+    public:
+       /*
+        * @method: slidingWindow
+        * @input - windowSeconds: length of the window in seconds of log time
+        * @input - buckets: number of buckets the window is sliced into, the window moves one bucket at a time
+        */
+        slidingWindow( uint32_t windowSeconds, uint32_t buckets );
+
+       /*
+        * @method: advance
+        * @brief: moves the end of the window to the provided date time (never backwards), expiring the buckets left behind
+        * @input - date: packed date time (see webServerAnalyser::parseDate)
+        */
+        void advance( uint64_t date );
+
+       /*
+        * @method: add
+        * @brief: counts one access for the provided key at the provided date time
+        *         A later date time moves the window forward, an access older than the window is ignored
+        * @input - key: the key being accessed, only copied if it is not already in the window
+        * @input - date: packed date time of the access
+        * @input - position: position of the access in the input, used to order keys with the same count
+        */
+        void add( std::string_view key, uint64_t date, uint64_t position );
+
+       /*
+        * @method: rankedOutput
+        * @brief: sorts the keys of the window based on the # of accesses, most # of accesses at the top
+        * @input - limit: maximum number of entries to output, 0 outputs every key
+        * @return: returns the "key count" entries in ranked order
+        */
+        std::vector <std::string> rankedOutput( size_t limit = 0 ) const;
+
+       /*
+        * @method: windowEnd
+        * @return: returns the packed date time at which the window ends (exclusive), 0 before the first access
+        */
+        uint64_t windowEnd() const { return started ? ( newestBucket + 1 ) * bucketSeconds : 0; }
+
+       /*
+        * @method: size
+        * @return: returns the number of distinct keys within the window
+        */
+        size_t size() const { return liveKeys; }
+};
@@ -0,0 +1,159 @@
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "stateFile.h"
+
+/*
+ * @method: payloadChecksum
+ * @brief: hashes a payload (64-bit FNV-1a)
+ */
+static uint64_t payloadChecksum( std::string_view payload )
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+
+    for (char byte: payload)
+    {
+        hash = ( hash ^ static_cast <unsigned char>( byte ) ) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+/*
+ * @method: number
+ * @brief: appends an unsigned number (varint)
+ */
+void stateWriter::number( uint64_t value )
+{
+    // 7 bits per byte, low bits first, the high bit marks that more bytes follow
+    while ( value >= 0x80 )
+    {
+        payload += static_cast <char>( ( value & 0x7F ) | 0x80 );
+        value >>= 7;
+    }
+    payload += static_cast <char>( value );
+}
+
+/*
+ * @method: text
+ * @brief: appends a length prefixed text (ex. a key of a dictionary)
+ */
+void stateWriter::text( std::string_view value )
+{
+    number( value.size() );
+    payload.append( value.data(), value.size() );
+}
+
+/*
+ * @method: write
+ * @brief: writes the header and the payload to a state file
+ * @input - statePath: path of the state file to write, replaced atomically
+ * @return: returns true if the state file was written successfully, false otherwise
+ */
+bool stateWriter::write( const std::string &statePath ) const
+{
+    stateHeader header = {};
+    std::string temporaryPath = statePath + ".tmp";
+    std::ofstream stateFile( temporaryPath, std::ios::binary | std::ios::trunc );
+
+    if ( !stateFile )
+    {
+        return false;
+    }
+
+    memcpy( header.magic, STATE_MAGIC, sizeof( header.magic ) );
+    header.version = STATE_VERSION;
+    header.payloadSize = payload.size();
+    header.checksum = payloadChecksum( payload );
+    stateFile.write( reinterpret_cast <const char *>( &header ), sizeof( header ) );
+    stateFile.write( payload.data(), payload.size() );
+
+    // Publish the state atomically so that a merge never reads a partially written file
+    stateFile.close();
+    return stateFile && rename( temporaryPath.c_str(), statePath.c_str() ) == 0;
+}
+
+/*
+ * @method: load
+ * @brief: maps a state file and validates its header and checksum
+ * @input - statePath: path of the state file to read
+ * @output - error: description of the problem when the file cannot be read
+ * @return: returns true if the payload can be read, false if the file is missing, of another version or corrupted
+ */
+bool stateReader::load( const std::string &statePath, std::string &error )
+{
+    stateHeader header;
+
+    mapping = std::make_unique <mappedFile>( statePath );
+    std::string_view contents = mapping->data();
+    position = 0;
+    malformed = false;
+    if ( !mapping->isOpen() )
+    {
+        error = "cannot open " + statePath;
+        return false;
+    }
+    if ( contents.size() < sizeof( header ) || memcmp( contents.data(), STATE_MAGIC, sizeof( header.magic ) ) != 0 )
+    {
+        error = statePath + " is not a state file";
+        return false;
+    }
+    memcpy( &header, contents.data(), sizeof( header ) );
+    if ( header.version != STATE_VERSION )
+    {
+        error = statePath + " has version " + std::to_string( header.version ) + ", expected " + std::to_string( STATE_VERSION );
+        return false;
+    }
+    payload = contents.substr( sizeof( header ) );
+    if ( payload.size() != header.payloadSize || payloadChecksum( payload ) != header.checksum )
+    {
+        error = statePath + " is truncated or corrupted";
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * @method: number
+ * @return: returns the next unsigned number (varint)
+ */
+uint64_t stateReader::number()
+{
+    uint64_t value = 0;
+
+    for (unsigned int shift = 0; shift < 64; shift += 7)
+    {
+        if ( position >= payload.size() )
+        {
+            break;
+        }
+        uint8_t byte = static_cast <uint8_t>( payload[position++] );
+        value |= static_cast <uint64_t>( byte & 0x7F ) << shift;
+        if ( ( byte & 0x80 ) == 0 )
+        {
+            return value;
+        }
+    }
+
+    malformed = true;
+    return 0;
+}
+
+/*
+ * @method: text
+ * @return: returns the next length prefixed text, a view valid for the lifetime of the reader
+ */
+std::string_view stateReader::text()
+{
+    uint64_t length = number();
+
+    if ( malformed || length > payload.size() - position )
+    {
+        malformed = true;
+        return std::string_view();
+    }
+    std::string_view value = payload.substr( position, length );
+    position += length;
+    return value;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "mappedFile.h"
+
+#define STATE_MAGIC "WSLSTATE"
+#define STATE_VERSION 3
+
+/*
+ * @struct: stateHeader
+ * @brief: fixed size header at the start of a state file
+ * @member - magic: STATE_MAGIC, identifies state files
+ * @member - version: STATE_VERSION of the writer, a reader only accepts its own version
+ * @member - flags: reserved, 0
+ * @member - payloadSize: number of bytes following the header
+ * @member - checksum: FNV-1a hash of the payload, detects truncated or corrupted copies between nodes
+ */
+typedef struct stateHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t payloadSize;
+    uint64_t checksum;
+} stateHeader;
+
+/*
+ * @class: stateWriter
+ * @brief: serializes partial results (see webServerAnalyser::saveState) into a compact payload
+ *         Numbers are written as LEB128 varints and texts are length prefixed, so that small counts and the key
+ *         dictionaries take as few bytes as possible
+ */
+class stateWriter
+{
+    private:
+        std::string payload;
+
+    public:
+       /*
+        * @method: number
+        * @brief: appends an unsigned number (varint)
+        */
+        void number( uint64_t value );
+
+       /*
+        * @method: text
+        * @brief: appends a length prefixed text (ex. a key of a dictionary)
+        */
+        void text( std::string_view value );
+
+       /*
+        * @method: data
+        * @return: returns the payload written so far (ex. a section nested into another payload with text)
+        */
+        const std::string &data() const { return payload; }
+
+       /*
+        * @method: write
+        * @brief: writes the header and the payload to a state file
+        * @input - statePath: path of the state file to write, replaced atomically
+        * @return: returns true if the state file was written successfully, false otherwise
+        */
+        bool write( const std::string &statePath ) const;
+};
+
+/*
+ * @class: stateReader
+ * @brief: reads back the payload of a state file written by stateWriter, in the order it was written
+ *         Reading past the end of the payload or a malformed value marks the reader as failed and returns zeros: callers
+ *         check failed() once a section is read instead of after every value
+ */
+class stateReader
+{
+    private:
+        std::unique_ptr <mappedFile> mapping;
+        std::string_view payload;
+        size_t position = 0;
+        bool malformed = false;
+
+    public:
+        stateReader() = default;
+
+       /*
+        * @method: stateReader
+        * @brief: reads a section nested into another payload (see stateWriter::data)
+        * @input - section: the nested payload, must outlive the reader
+        */
+        explicit stateReader( std::string_view section ) : payload( section ) {}
+
+       /*
+        * @method: load
+        * @brief: maps a state file and validates its header and checksum
+        * @input - statePath: path of the state file to read
+        * @output - error: description of the problem when the file cannot be read
+        * @return: returns true if the payload can be read, false if the file is missing, of another version or corrupted
+        */
+        bool load( const std::string &statePath, std::string &error );
+
+       /*
+        * @method: number
+        * @return: returns the next unsigned number (varint)
+        */
+        uint64_t number();
+
+       /*
+        * @method: text
+        * @return: returns the next length prefixed text, a view valid for the lifetime of the reader
+        */
+        std::string_view text();
+
+       /*
+        * @method: failed
+        * @return: returns true if a read went past the end of the payload or met a malformed value
+        */
+        bool failed() const { return malformed; }
+
+       /*
+        * @method: atEnd
+        * @return: returns true once the whole payload has been read
+        */
+        bool atEnd() const { return position == payload.size(); }
+};
@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <numeric>
+
+#include "timeHistogram.h"
+
+/*
+ * @method: cellHash
+ * @brief: spreads a packed (bucket, key ID) cell over the table (Fibonacci hashing)
+ */
+static uint64_t cellHash( uint64_t cell )
+{
+    return ( cell * 0x9E3779B97F4A7C15ull ) >> 32;
+}
+
+/*
+ * @method: timeHistogram
+ * @input - bucketSeconds: width of a time bucket in seconds (ex. 60 for one bucket per minute)
+ */
+timeHistogram::timeHistogram( uint32_t bucketSeconds ) : bucketSeconds( std::max <uint32_t>( bucketSeconds, 1 ) )
+{
+}
+
+/*
+ * @method: bucketCount
+ * @return: returns the counters of the provided bucket, allocating its page if needed
+ */
+trafficCount &timeHistogram::bucketCount( uint32_t bucket )
+{
+    size_t page = bucket >> HISTOGRAM_PAGE_BITS;
+
+    if ( page >= pages.size() )
+    {
+        pages.resize( page + 1 );
+    }
+    if ( pages[page] == nullptr )
+    {
+        pages[page].reset( new trafficCount[1 << HISTOGRAM_PAGE_BITS]() );
+    }
+    firstBucket = std::min( firstBucket, bucket );
+    lastBucket = std::max( lastBucket, bucket );
+
+    return pages[page][bucket & ( ( 1 << HISTOGRAM_PAGE_BITS ) - 1 )];
+}
+
+/*
+ * @method: cellCount
+ * @return: returns the counters of the provided key within the provided bucket, inserting the cell if needed
+ */
+trafficCount &timeHistogram::cellCount( uint32_t bucket, uint32_t keyId )
+{
+    uint64_t cell = ( static_cast <uint64_t>( bucket ) << 32 ) | keyId;
+
+    if ( cellTable.empty() )
+    {
+        cellTable.assign( HISTOGRAM_TABLE_MIN_SIZE, 0 );
+    }
+
+    size_t mask = cellTable.size() - 1;
+    size_t slot = cellHash( cell ) & mask;
+    while ( cellTable[slot] != 0 && cells[cellTable[slot] - 1] != cell )
+    {
+        slot = ( slot + 1 ) & mask;
+    }
+    if ( cellTable[slot] != 0 )
+    {
+        return cellCounts[cellTable[slot] - 1];
+    }
+
+    // First request of the key within the bucket: keep the load factor at or below 1/2 like keyCounter
+    cells.push_back( cell );
+    cellCounts.emplace_back();
+    cellTable[slot] = static_cast <uint32_t>( cells.size() );
+    if ( cells.size() * 2 > cellTable.size() )
+    {
+        std::vector <uint32_t> grownTable( cellTable.size() * 2, 0 );
+        size_t grownMask = grownTable.size() - 1;
+        for (size_t id = 0; id < cells.size(); id++)
+        {
+            size_t grownSlot = cellHash( cells[id] ) & grownMask;
+            while ( grownTable[grownSlot] != 0 )
+            {
+                grownSlot = ( grownSlot + 1 ) & grownMask;
+            }
+            grownTable[grownSlot] = static_cast <uint32_t>( id + 1 );
+        }
+        cellTable.swap( grownTable );
+    }
+
+    return cellCounts.back();
+}
+
+/*
+ * @method: add
+ * @brief: counts one request in the bucket of the provided date time
+ * @input - date: packed date time of the request, INVALID_DATE requests are not counted
+ * @input - bytes: reply size of the request
+ */
+void timeHistogram::add( uint32_t date, uint64_t bytes )
+{
+    if ( date == UINT32_MAX ) // INVALID_DATE: the request has no bucket
+    {
+        return;
+    }
+
+    trafficCount &count = bucketCount( date / bucketSeconds );
+    usedBuckets += count.requests == 0;
+    count.requests++;
+    count.bytes += bytes;
+}
+
+/*
+ * @method: add
+ * @brief: counts one request in the bucket of the provided date time, for the provided key
+ * @input - date: packed date time of the request, INVALID_DATE requests are not counted
+ * @input - bytes: reply size of the request
+ * @input - key: the key the bucket is split by, only copied if it has never been seen before
+ * @input - position: position of the request in the input, used to order keys with the same count
+ */
+void timeHistogram::add( uint32_t date, uint64_t bytes, std::string_view key, uint64_t position )
+{
+    if ( date == UINT32_MAX )
+    {
+        return;
+    }
+
+    add( date, bytes );
+    trafficCount &count = cellCount( date / bucketSeconds, static_cast <uint32_t>( keys.increment( key, position ) ) );
+    count.requests++;
+    count.bytes += bytes;
+}
+
+/*
+ * @method: merge
+ * @brief: adds the counts of another timeHistogram with the same bucket width (ex. computed by another thread)
+ */
+void timeHistogram::merge( const timeHistogram &other )
+{
+    for (size_t page = 0; page < other.pages.size(); page++)
+    {
+        if ( other.pages[page] == nullptr )
+        {
+            continue;
+        }
+        for (uint32_t offset = 0; offset < ( 1 << HISTOGRAM_PAGE_BITS ); offset++)
+        {
+            const trafficCount &otherCount = other.pages[page][offset];
+            if ( otherCount.requests > 0 )
+            {
+                trafficCount &count = bucketCount( static_cast <uint32_t>( ( page << HISTOGRAM_PAGE_BITS ) + offset ) );
+                usedBuckets += count.requests == 0;
+                count.requests += otherCount.requests;
+                count.bytes += otherCount.bytes;
+            }
+        }
+    }
+
+    // Key IDs are local to each histogram: translate the IDs of the other histogram once, then merge its cells
+    std::vector <uint32_t> keyIds( other.keys.size() );
+    for (size_t otherId = 0; otherId < other.keys.size(); otherId++)
+    {
+        keyIds[otherId] = static_cast <uint32_t>( keys.add( other.keys.key( otherId ), other.keys.count( otherId ) ) );
+    }
+    for (size_t otherCell = 0; otherCell < other.cells.size(); otherCell++)
+    {
+        trafficCount &count = cellCount( static_cast <uint32_t>( other.cells[otherCell] >> 32 ), keyIds[other.cells[otherCell] & UINT32_MAX] );
+        count.requests += other.cellCounts[otherCell].requests;
+        count.bytes += other.cellCounts[otherCell].bytes;
+    }
+}
+
+/*
+ * @method: save
+ * @brief: serializes the bucket width, the bucket totals and the split counts (see webServerAnalyser::saveState)
+ * @output - writer: the state being written
+ */
+void timeHistogram::save( stateWriter &writer ) const
+{
+    // Bucket totals in bucket order, each bucket as the distance from the previous one
+    writer.number( bucketSeconds );
+    writer.number( usedBuckets );
+    for (uint64_t bucket = firstBucket, previous = 0; usedBuckets > 0 && bucket <= lastBucket; bucket++)
+    {
+        const std::unique_ptr <trafficCount []> &page = pages[bucket >> HISTOGRAM_PAGE_BITS];
+        if ( page != nullptr && page[bucket & ( ( 1 << HISTOGRAM_PAGE_BITS ) - 1 )].requests > 0 )
+        {
+            const trafficCount &count = page[bucket & ( ( 1 << HISTOGRAM_PAGE_BITS ) - 1 )];
+            writer.number( bucket - previous );
+            writer.number( count.requests );
+            writer.number( count.bytes );
+            previous = bucket;
+        }
+    }
+
+    // Split counts: the key dictionary, then the cells referencing it by key ID
+    keys.save( writer );
+    writer.number( cells.size() );
+    for (size_t cell = 0; cell < cells.size(); cell++)
+    {
+        writer.number( cells[cell] >> 32 );
+        writer.number( cells[cell] & UINT32_MAX );
+        writer.number( cellCounts[cell].requests );
+        writer.number( cellCounts[cell].bytes );
+    }
+}
+
+/*
+ * @method: load
+ * @brief: adds the counts serialized by save, like merge
+ * @input - reader: the state being read
+ * @return: returns false if the serialized counts are malformed or use another bucket width
+ */
+bool timeHistogram::load( stateReader &reader )
+{
+    if ( reader.number() != bucketSeconds )
+    {
+        return false;
+    }
+
+    uint64_t savedBuckets = reader.number();
+    for (uint64_t saved = 0, bucket = 0; saved < savedBuckets && !reader.failed(); saved++)
+    {
+        bucket += reader.number();
+        uint64_t requests = reader.number(), bytes = reader.number();
+        if ( bucket > UINT32_MAX / bucketSeconds || requests == 0 )
+        {
+            return false;
+        }
+        trafficCount &count = bucketCount( static_cast <uint32_t>( bucket ) );
+        usedBuckets += count.requests == 0;
+        count.requests += requests;
+        count.bytes += bytes;
+    }
+
+    // Key IDs are local to the saved histogram: translate them like merge
+    keyCounter savedKeys;
+    if ( !savedKeys.load( reader ) )
+    {
+        return false;
+    }
+    std::vector <uint32_t> keyIds( savedKeys.size() );
+    for (size_t savedId = 0; savedId < savedKeys.size(); savedId++)
+    {
+        keyIds[savedId] = static_cast <uint32_t>( keys.add( savedKeys.key( savedId ), savedKeys.count( savedId ) ) );
+    }
+    uint64_t savedCells = reader.number();
+    for (uint64_t saved = 0; saved < savedCells && !reader.failed(); saved++)
+    {
+        uint64_t bucket = reader.number(), keyId = reader.number(), requests = reader.number(), bytes = reader.number();
+        if ( bucket > UINT32_MAX / bucketSeconds || keyId >= keyIds.size() )
+        {
+            return false;
+        }
+        trafficCount &count = cellCount( static_cast <uint32_t>( bucket ), keyIds[keyId] );
+        count.requests += requests;
+        count.bytes += bytes;
+    }
+
+    return !reader.failed();
+}
+
+/*
+ * @method: result
+ * @brief: lists the histogram in date time order
+ *         requests and bytes per bucket (resultKind::traffic), empty buckets between the first and the last bucket included
+ *         requests and bytes per key of each bucket for a split histogram (resultKind::keyedTraffic), most requests first
+ * @input - limit: maximum number of keys per bucket of a split histogram, 0 outputs every key
+ * @return: returns the entries, the date time of each entry is the start of its bucket
+ */
+queryResult timeHistogram::result( size_t limit ) const
+{
+    queryResult result( keys.size() == 0 ? resultKind::traffic : resultKind::keyedTraffic );
+
+    if ( usedBuckets == 0 )
+    {
+        return result;
+    }
+
+    if ( keys.size() == 0 )
+    {
+        result.reserve( lastBucket - firstBucket + 1, 0 );
+        for (uint64_t bucket = firstBucket; bucket <= lastBucket; bucket++)
+        {
+            const std::unique_ptr <trafficCount []> &page = pages[bucket >> HISTOGRAM_PAGE_BITS];
+            trafficCount count = page != nullptr ? page[bucket & ( ( 1 << HISTOGRAM_PAGE_BITS ) - 1 )] : trafficCount();
+            resultRow row;
+            row.bucket = static_cast <uint32_t>( bucket * bucketSeconds );
+            row.count = count.requests;
+            row.bytes = count.bytes;
+            result.add( std::string_view(), row );
+        }
+        return result;
+    }
+
+    // Sort the cells by bucket, then like keyCounter: most requests first, ties broken by the first appearance of the key
+    std::vector <size_t> order( cells.size() );
+    std::iota( order.begin(), order.end(), 0 );
+    std::sort( order.begin(), order.end(), [this]( size_t lhs, size_t rhs )
+    {
+        if ( cells[lhs] >> 32 != cells[rhs] >> 32 )
+        {
+            return cells[lhs] >> 32 < cells[rhs] >> 32;
+        }
+        if ( cellCounts[lhs].requests != cellCounts[rhs].requests )
+        {
+            return cellCounts[lhs].requests > cellCounts[rhs].requests;
+        }
+        return keys.count( cells[lhs] & UINT32_MAX ).firstSeen < keys.count( cells[rhs] & UINT32_MAX ).firstSeen;
+    } );
+
+    size_t bucketKeys = 0;
+    for (size_t rank = 0; rank < order.size(); rank++)
+    {
+        uint64_t cell = cells[order[rank]];
+        bucketKeys = rank > 0 && cells[order[rank - 1]] >> 32 == cell >> 32 ? bucketKeys + 1 : 0;
+        if ( limit > 0 && bucketKeys >= limit )
+        {
+            continue;
+        }
+        resultRow row;
+        row.bucket = static_cast <uint32_t>( ( cell >> 32 ) * bucketSeconds );
+        row.count = cellCounts[order[rank]].requests;
+        row.bytes = cellCounts[order[rank]].bytes;
+        result.add( keys.key( cell & UINT32_MAX ), row );
+    }
+
+    return result;
+}
+
+/*
+ * @method: formatDate
+ * @brief: converts a packed date time back into its [DD:HH:MM:SS] form, or its calendar form (see queryResult::appendDate)
+ * @input - date: the packed date time
+ * @input - calendar: the date time is in seconds since the Unix epoch (see logFormat::calendarDates)
+ */
+std::string timeHistogram::formatDate( uint32_t date, bool calendar )
+{
+    std::string formatted;
+
+    queryResult::appendDate( date, calendar, formatted );
+
+    return formatted;
+}
+
+/*
+ * @method: memoryUsage
+ * @return: returns the approximate number of bytes held by the timeHistogram
+ */
+size_t timeHistogram::memoryUsage() const
+{
+    size_t allocatedPages = std::count_if( pages.begin(), pages.end(), []( const std::unique_ptr <trafficCount []> &page )
+    {
+        return page != nullptr;
+    } );
+
+    return pages.capacity() * sizeof( pages[0] ) + allocatedPages * ( sizeof( trafficCount ) << HISTOGRAM_PAGE_BITS ) + keys.memoryUsage() +
+           cells.capacity() * sizeof( uint64_t ) + cellCounts.capacity() * sizeof( trafficCount ) + cellTable.capacity() * sizeof( uint32_t );
+}
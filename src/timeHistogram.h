@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "keyCounter.h"
+#include "queryResult.h"
+
+#define HISTOGRAM_PAGE_BITS 10 // time buckets per page of counters: 1 << HISTOGRAM_PAGE_BITS
+#define HISTOGRAM_TABLE_MIN_SIZE 64 // initial number of slots of the open addressing table of (time bucket, key) cells
+
+/*
+ * @struct: trafficCount
+ * @brief: traffic of a time bucket (or of a key within a time bucket)
+ * @member - requests: number of requests counted
+ * @member - bytes: sum of the reply sizes of the requests
+ */
+typedef struct trafficCount
+{
+    uint64_t requests = 0;
+    uint64_t bytes = 0;
+} trafficCount;
+
+/*
+ * @class: timeHistogram
+ * @brief: counts requests and reply bytes per time bucket, optionally split by key (host, resource or response)
+ *         Bucket totals live in fixed-size pages of counters indexed directly by the packed date time of the line (see
+ *         webServerAnalyser::parseDate), a page is only allocated once a line falls in its range
+ *         Split counts intern each key once (see keyCounter) and live in an open addressing table keyed by the packed
+ *         (time bucket, key ID) pair, no string is hashed twice for the same line
+ */
+class timeHistogram
+{
+    private:
+        uint32_t bucketSeconds;
+        std::vector <std::unique_ptr <trafficCount []>> pages; // indexed by bucket >> HISTOGRAM_PAGE_BITS, nullptr until used
+        uint32_t firstBucket = UINT32_MAX; // range of the buckets holding a count
+        uint32_t lastBucket = 0;
+        size_t usedBuckets = 0;
+        keyCounter keys; // split histogram: requests per key, ties within a bucket are ranked by first appearance
+        std::vector <uint64_t> cells; // indexed by cell ID: (bucket << 32) | key ID
+        std::vector <trafficCount> cellCounts; // indexed by cell ID
+        std::vector <uint32_t> cellTable; // open addressing table: cell ID + 1, 0 for an empty slot
+
+       /*
+        * @method: bucketCount
+        * @return: returns the counters of the provided bucket, allocating its page if needed
+        */
+        trafficCount &bucketCount( uint32_t bucket );
+
+       /*
+        * @method: cellCount
+        * @return: returns the counters of the provided key within the provided bucket, inserting the cell if needed
+        */
+        trafficCount &cellCount( uint32_t bucket, uint32_t keyId );
+
+    public:
+       /*
+        * @method: timeHistogram
+        * @input - bucketSeconds: width of a time bucket in seconds (ex. 60 for one bucket per minute)
+        */
+        explicit timeHistogram( uint32_t bucketSeconds );
+
+       /*
+        * @method: add
+        * @brief: counts one request in the bucket of the provided date time
+        * @input - date: packed date time of the request, INVALID_DATE requests are not counted
+        * @input - bytes: reply size of the request
+        */
+        void add( uint32_t date, uint64_t bytes );
+
+       /*
+        * @method: add
+        * @brief: counts one request in the bucket of the provided date time, for the provided key
+        * @input - date: packed date time of the request, INVALID_DATE requests are not counted
+        * @input - bytes: reply size of the request
+        * @input - key: the key the bucket is split by, only copied if it has never been seen before
+        * @input - position: position of the request in the input, used to order keys with the same count
+        */
+        void add( uint32_t date, uint64_t bytes, std::string_view key, uint64_t position );
+
+       /*
+        * @method: merge
+        * @brief: adds the counts of another timeHistogram with the same bucket width (ex. computed by another thread)
+        */
+        void merge( const timeHistogram &other );
+
+       /*
+        * @method: save
+        * @brief: serializes the bucket width, the bucket totals and the split counts (see webServerAnalyser::saveState)
+        * @output - writer: the state being written
+        */
+        void save( stateWriter &writer ) const;
+
+       /*
+        * @method: load
+        * @brief: adds the counts serialized by save, like merge
+        * @input - reader: the state being read
+        * @return: returns false if the serialized counts are malformed or use another bucket width
+        */
+        bool load( stateReader &reader );
+
+       /*
+        * @method: result
+        * @brief: lists the histogram in date time order
+        *         requests and bytes per bucket (resultKind::traffic), empty buckets between the first and the last bucket included
+        *         requests and bytes per key of each bucket for a split histogram (resultKind::keyedTraffic), most requests first
+        * @input - limit: maximum number of keys per bucket of a split histogram, 0 outputs every key
+        * @return: returns the entries, the date time of each entry is the start of its bucket
+        */
+        queryResult result( size_t limit = 0 ) const;
+
+       /*
+        * @method: formatDate
+        * @brief: converts a packed date time back into its [DD:HH:MM:SS] form, or its calendar form (see queryResult::appendDate)
+        * @input - date: the packed date time
+        * @input - calendar: the date time is in seconds since the Unix epoch (see logFormat::calendarDates)
+        */
+        static std::string formatDate( uint32_t date, bool calendar );
+
+       /*
+        * @method: size
+        * @return: returns the number of counters in use: (bucket, key) cells of a split histogram, buckets otherwise
+        */
+        size_t size() const { return keys.size() > 0 ? cells.size() : usedBuckets; }
+
+       /*
+        * @method: loadFactor
+        * @return: returns the fraction of the cell table slots in use, 0 for a histogram that is not split
+        */
+        double loadFactor() const { return cellTable.empty() ? 0 : static_cast <double>( cells.size() ) / cellTable.size(); }
+
+       /*
+        * @method: memoryUsage
+        * @return: returns the approximate number of bytes held by the timeHistogram
+        */
+        size_t memoryUsage() const;
+};
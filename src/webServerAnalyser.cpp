@@ -1,282 +1,2620 @@
 #include <iostream>
-#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
 
-#include <map>
-#include <unordered_map>
 #include <vector>
 #include <string>
 
+#include <glob.h>
+
 #include "webServerAnalyser.h"
+#include "mappedFile.h"
+#include "keyCounter.h"
+#include "heavyHitters.h"
+#include "logTokenizer.h"
+#include "compressedInput.h"
+#include "logFollower.h"
+#include "slidingWindow.h"
+
+// Rejection category of the predicates on each filterField (see queryFilter)
+static const queryFilter FIELD_FILTERS[] = { FILTER_RESPONSE, FILTER_HOST, FILTER_SIZE, FILTER_DATE, FILTER_METHOD, FILTER_RESOURCE };
+// logColumn read by the predicates on each filterField (see logFormat)
+static const unsigned int FIELD_COLUMNS[] = { COLUMN_RESPONSE, COLUMN_HOST, COLUMN_SIZE, COLUMN_DATE, COLUMN_REQUEST, COLUMN_REQUEST };
+// Index dictionary of each filterField, sizes and date times are plain columns (see logIndex)
+static const int FIELD_DICTIONARIES[] = { INDEX_RESPONSE, INDEX_HOST, -1, -1, INDEX_METHOD, INDEX_RESOURCE };
 
 /*
- * @method: parseDate
- * @brief: converts a date time into a vector format
- *         ex. "[29:23:54:18] -> [29] [23] [54] [18]
- * @input - date: the date time to be converted
- * @return: returns the vector form of the date time, split using the ":" delimiter
+ * @method: forEachRecord
+ * @brief: splits the provided log contents into lines and parses them, without copying them
+ * @input - format: the log format to parse the lines with
+ * @input - contents: the webserver log contents (ex. a memory-mapped file)
+ * @input - recordHandler: called with each parsed non-empty line and the byte offset of the line in contents
  */
-std::vector <int> webServerAnalyser::parseDate( std::string date )
+template <typename RecordHandler>
+void webServerAnalyser::forEachRecord( const logFormat &format, std::string_view contents, RecordHandler &&recordHandler )
 {
-    std::vector <int> outputDate;
-    size_t linePos = 1, endPos = 0; // Start at linePos = 1 to ignore the first "["
-    std::string dateEntry;
+    logTokenizer tokens( contents );
+    webServerLog parsedLine;
+    size_t linePos = 0;
 
-    for (int dateIndex = 1; dateIndex <= DATE_ENTRIES; dateIndex++)
+    while ( linePos < contents.size() )
     {
-        // Look for : or the ] delimiter (indicating last entry of date time)
-        endPos = date.find_first_of( ":]", linePos );
-        dateEntry = date.substr( linePos, endPos - linePos );
-        linePos = endPos + 1;
+        if ( contents[linePos] == '\n' )
+        {
+            linePos++;
+            continue;
+        }
+
+        size_t lineEnd = parseRecord( format, contents, tokens, linePos, parsedLine );
+        recordHandler( parsedLine, static_cast <uint64_t>( linePos ) );
+        linePos = lineEnd + 1;
+    }
+}
+
+/*
+ * @method: chunkBoundaries
+ * @brief: cuts the log contents every chunkSize bytes, moving each cut forward to the start of the next line
+ * @input - contents: the webserver log contents
+ * @input - chunkSize: approximate number of bytes per chunk
+ * @return: returns the start of each chunk followed by contents.size()
+ */
+std::vector <size_t> webServerAnalyser::chunkBoundaries( std::string_view contents, size_t chunkSize )
+{
+    std::vector <size_t> chunkStarts = { 0 };
 
-        outputDate.push_back( std::stoi( dateEntry ) );
+    chunkSize = std::max <size_t>( chunkSize, 1 );
+    for (size_t cut = chunkSize; cut < contents.size(); cut = chunkStarts.back() + chunkSize)
+    {
+        size_t lineEnd = contents.find( '\n', cut - 1 );
+        if ( lineEnd == std::string_view::npos || lineEnd + 1 >= contents.size() )
+        {
+            break;
+        }
+        chunkStarts.push_back( lineEnd + 1 );
     }
+    chunkStarts.push_back( contents.size() );
 
-    return outputDate;
+    return chunkStarts;
 }
 
 /*
- * @method: parseHTTPRequest
- * @brief: converts an HTTP request at column #3 into a vector format
- *         ex. "GET /Software.html HTTP/1.0" -> ["GET"] ["/Software.html"] ["HTTP/1.0"]
- * @input - request: the HTTP request to be converted
- * @return: returns the vector form of the HTTP request, split using the " " delimiter
+ * @method: shardBoundaries
+ * @brief: cuts the log contents into equal parts, moving each cut forward to the start of the next line
+ * @input - contents: the webserver log contents
+ * @input - shards: number of parts
+ * @return: returns the start of each part followed by contents.size() (shards + 1 offsets, parts may be empty)
  */
-std::vector <std::string> webServerAnalyser::parseHTTPRequest( std::string request )
+std::vector <size_t> webServerAnalyser::shardBoundaries( std::string_view contents, unsigned int shards )
 {
-    std::vector <std::string> outputRequest;
-    size_t linePos = 0, endPos = 0; // No quotes in request, start at linePos = 0
-    std::string requestEntry;
+    std::vector <size_t> shardStarts = { 0 };
 
-    for (int requestIndex = 1; requestIndex <= REQUEST_ENTRIES; requestIndex++)
+    for (unsigned int shard = 1; shard < shards; shard++)
     {
-        endPos = request.find( " ", linePos );
-        requestEntry = request.substr( linePos, endPos - linePos );
-        linePos = endPos + 1;
+        size_t cut = std::max( contents.size() * shard / shards, shardStarts.back() );
+        size_t lineEnd = cut == 0 ? std::string_view::npos : contents.find( '\n', cut - 1 );
+        shardStarts.push_back( cut == 0 ? 0 : lineEnd == std::string_view::npos ? contents.size() : lineEnd + 1 );
+    }
+    shardStarts.push_back( contents.size() );
+
+    return shardStarts;
+}
+
+/*
+ * @method: sampledBlock
+ * @brief: draws whether a block of a log is read by a sampled run, from a hash of the seed, the file and the block
+ * @input - file: number of the log file
+ * @input - block: number of the block in the whole file (offset >> SAMPLE_BLOCK_BITS)
+ * @return: returns true with probability config.sampleFraction, always the same answer for the same block
+ */
+bool webServerAnalyser::sampledBlock( size_t file, uint64_t block ) const
+{
+    // splitmix64 of the seeded block position, whose top 53 bits are a uniform draw in [0, 1)
+    uint64_t hash = config.sampleSeed + ( ( static_cast <uint64_t>( file ) << FILE_POSITION_BITS ) + block + 1 ) * 0x9E3779B97F4A7C15ull;
+    hash = ( hash ^ ( hash >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+    hash = ( hash ^ ( hash >> 27 ) ) * 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+    return static_cast <double>( hash >> 11 ) * 0x1p-53 < config.sampleFraction;
+}
+
+/*
+ * @method: sampleBoundaries
+ * @brief: finds the lines of the contents that belong to a sampled block, a line belongs to the block it starts in
+ * @input - contents: the webserver log contents
+ * @input - contentsStart: offset of the contents in the whole file, blocks are aligned on the whole file
+ * @input - file: number of the log file
+ * @return: returns the start and end of the lines of each sampled block, flattened ({ start, end, start, end, ... })
+ */
+std::vector <size_t> webServerAnalyser::sampleBoundaries( std::string_view contents, uint64_t contentsStart, size_t file ) const
+{
+    std::vector <size_t> sampleRanges;
+    if ( contents.empty() )
+    {
+        return sampleRanges;
+    }
 
-        outputRequest.push_back( requestEntry );
+    // Start of the first line starting at or after an offset of the whole file, like the cuts of chunkBoundaries
+    auto lineStart = [&]( uint64_t offset ) -> size_t
+    {
+        if ( offset <= contentsStart )
+        {
+            return 0;
+        }
+        size_t lineEnd = contents.find( '\n', std::min <uint64_t>( offset - contentsStart, contents.size() ) - 1 );
+        return lineEnd == std::string_view::npos ? contents.size() : lineEnd + 1;
+    };
+    uint64_t lastBlock = ( contentsStart + contents.size() - 1 ) >> SAMPLE_BLOCK_BITS;
+    for (uint64_t block = contentsStart >> SAMPLE_BLOCK_BITS; block <= lastBlock; block++)
+    {
+        if ( !sampledBlock( file, block ) )
+        {
+            continue;
+        }
+        size_t start = lineStart( block << SAMPLE_BLOCK_BITS ), end = lineStart( ( block + 1 ) << SAMPLE_BLOCK_BITS );
+        if ( start < end )
+        {
+            sampleRanges.push_back( start );
+            sampleRanges.push_back( end );
+        }
     }
 
-    return outputRequest;
+    return sampleRanges;
+}
+
+/*
+ * @method: scanContents
+ * @brief: splits the log contents into newline aligned chunks and parses them on the worker pool
+ * @input - format: the log format to parse the lines with
+ * @input - contents: the webserver log contents (ex. a memory-mapped file)
+ * @input - recordHandler: called with each parsed non-empty line, the byte offset of the line and the index of the worker
+ *          Note: recordHandler is called concurrently by different workers, state must be kept per worker
+ */
+template <typename RecordHandler>
+void webServerAnalyser::scanContents( const logFormat &format, std::string_view contents, RecordHandler &&recordHandler )
+{
+    // Single worker: no need to split the contents
+    std::vector <size_t> chunkStarts = pool.size() > 1 ? chunkBoundaries( contents, config.chunkSize ) :
+                                                         std::vector <size_t>{ 0, contents.size() };
 
+    pool.run( chunkStarts.size() - 1, [&]( size_t chunk, unsigned int worker )
+    {
+        std::string_view chunkContents = contents.substr( chunkStarts[chunk], chunkStarts[chunk + 1] - chunkStarts[chunk] );
+        forEachRecord( format, chunkContents, [&]( const webServerLog &parsedLine, uint64_t lineOffset )
+        {
+            recordHandler( parsedLine, chunkStarts[chunk] + lineOffset, worker );
+        } );
+    } );
 }
 
 /*
- * @method: verifyDateTimeRange
- * @brief: verifies that the provided inputDate ranges between the minDate and the maxDate
- * @input - inputDate: the date time to be compared
- * @input - minDate: the date time located at the minimum range of comparison
- * @input - maxDate: the date time located at the maximum range of comparison
- * @return: returns true if the provided input date time is between the minimum and maximum input ranges, false otherwise
- *          returns true if minDate or maxDate are not populated (not used to filter the input date time)
+ * @method: scanFiles
+ * @brief: parses the contents of several log files on the worker pool
+ *         Plain text logs are split into newline aligned chunks, compressed logs are decompressed on the fly by one stream per
+ *         log shared by its consumer tasks; the tasks of every file are handed out from a single queue so that small and
+ *         large files balance out between the workers
+ *         Plain text logs read through a read ahead backend are streamed like compressed logs (see readStream)
+ *         Sampled runs only parse the lines of the sampled blocks (see sampleBoundaries)
+ * @input - format: the log format to parse the lines with
+ * @input - contents: the contents of each log file (ex. memory-mapped files), empty for files that must not be parsed
+ * @input - fileStarts: offset of the contents of each file in the whole file (ex. the start of a shard)
+ * @input - streamPaths: path of the plain text files read through config.input instead of their contents, empty for the others
+ * @input - recordHandler: called with each parsed non-empty line, the number of its file, the byte offset of the line
+ *          (in the decompressed contents) and the index of the worker
+ * @return: returns the numbers of the streamed files that could not be decompressed or read entirely
  */
-bool webServerAnalyser::verifyDateTimeRange( std::string inputDate, std::string minDate, std::string maxDate)
+template <typename RecordHandler>
+std::vector <size_t> webServerAnalyser::scanFiles( const logFormat &format, const std::vector <std::string_view> &contents, const std::vector <size_t> &fileStarts,
+                                                   const std::vector <std::string> &streamPaths, RecordHandler &&recordHandler )
 {
-    bool ret = true;
+    // A task parses a newline aligned range of a plain text file, or consumes the chunks of a streamed file
+    typedef struct scanTask
+    {
+        size_t file;
+        size_t start;
+        size_t end;
+    } scanTask;
+    std::vector <scanTask> tasks;
+    std::vector <compressionFormat> formats( contents.size() );
+    std::vector <bool> streamed( contents.size(), false );
+    std::vector <size_t> streamedFiles, failedFiles;
 
-    // If minDate or maxDate are not provided, filtering is not used: returns true
-    if ( !minDate.empty() && !maxDate.empty() )
+    for (size_t file = 0; file < contents.size(); file++)
+    {
+        formats[file] = decompressionStream::detect( contents[file] );
+        streamed[file] = formats[file] != compressionFormat::none || ( !streamPaths[file].empty() && !contents[file].empty() );
+        if ( streamed[file] )
+        {
+            streamedFiles.push_back( file );
+        }
+    }
+
+    // Streamed files (decompressed, or read ahead) cannot be split: they are handed out first, largest first, so that they
+    // do not finish last; each one is shared by enough consumers to keep every worker busy
+    std::sort( streamedFiles.begin(), streamedFiles.end(), [&]( size_t lhs, size_t rhs )
+    {
+        return contents[lhs].size() > contents[rhs].size();
+    } );
+    size_t consumers = std::max <size_t>( 1, pool.size() / std::max <size_t>( 1, streamedFiles.size() ) );
+    for (size_t file: streamedFiles)
+    {
+        for (size_t consumer = 0; consumer < consumers; consumer++)
+        {
+            tasks.push_back( { file, 0, 0 } );
+        }
+    }
+    for (size_t file = 0; file < contents.size(); file++)
+    {
+        if ( streamed[file] || contents[file].empty() )
+        {
+            continue;
+        }
+        // Sampled runs: one task per sampled block, the other blocks are never read
+        if ( config.sampleFraction < 1 )
+        {
+            std::vector <size_t> sampleRanges = sampleBoundaries( contents[file], fileStarts[file], file );
+            for (size_t range = 0; range < sampleRanges.size(); range += 2)
+            {
+                tasks.push_back( { file, sampleRanges[range], sampleRanges[range + 1] } );
+            }
+            continue;
+        }
+        std::vector <size_t> chunkStarts = pool.size() > 1 ? chunkBoundaries( contents[file], config.chunkSize ) :
+                                                             std::vector <size_t>{ 0, contents[file].size() };
+        for (size_t chunk = 0; chunk + 1 < chunkStarts.size(); chunk++)
+        {
+            tasks.push_back( { file, chunkStarts[chunk], chunkStarts[chunk + 1] } );
+        }
+    }
+
+    // The stream of a file starts with its first consumer, so that only the files being parsed hold buffers
+    std::vector <std::unique_ptr <chunkStream>> streams( contents.size() );
+    std::vector <std::once_flag> streamStarted( contents.size() );
+    pool.run( tasks.size(), [&]( size_t taskIndex, unsigned int worker )
     {
-        std::vector <int> formattedDate = parseDate( inputDate );
-        std::vector <int> formattedMin = parseDate( minDate );
-        std::vector <int> formattedMax = parseDate( maxDate );
+        const scanTask &task = tasks[taskIndex];
 
-        // Compares the days, hours, minutes and seconds of the date time until violation occurs
-        // If no violation occurs, then input date time is within the valid range
-        for (int i = 0; i < DATE_ENTRIES; i++)
+        if ( !streamed[task.file] )
         {
-            if ( formattedMin[i] > formattedDate[i] && formattedMax[i] < formattedDate[i] )
+            forEachRecord( format, contents[task.file].substr( task.start, task.end - task.start ), [&]( const webServerLog &parsedLine, uint64_t lineOffset )
             {
-                // inputDate is outside of minimum/maximum boundaries, exit early
-                ret = false;
-                break;
+                recordHandler( parsedLine, task.file, task.start + lineOffset, worker );
+            } );
+            return;
+        }
+
+        std::call_once( streamStarted[task.file], [&]()
+        {
+            if ( formats[task.file] != compressionFormat::none )
+            {
+                streams[task.file] = std::make_unique <decompressionStream>( contents[task.file], formats[task.file], config.chunkSize, 2 * consumers );
+                return;
+            }
+            uint64_t start = fileStarts[task.file];
+            streams[task.file] = std::make_unique <readStream>( streamPaths[task.file], start, start + contents[task.file].size(), config.input,
+                                                                config.readDepth, config.directIO, config.chunkSize, 2 * consumers );
+        } );
+        decompressedChunk chunk;
+        while ( streams[task.file]->next( chunk ) )
+        {
+            // Compressed logs must be decompressed entirely, but only the lines of their sampled blocks are parsed
+            std::string_view chunkData = chunk.data;
+            std::vector <size_t> chunkRanges = config.sampleFraction < 1 ? sampleBoundaries( chunkData, fileStarts[task.file] + chunk.offset, task.file ) :
+                                                                           std::vector <size_t>{ 0, chunkData.size() };
+            for (size_t range = 0; range < chunkRanges.size(); range += 2)
+            {
+                size_t rangeStart = chunkRanges[range];
+                forEachRecord( format, chunkData.substr( rangeStart, chunkRanges[range + 1] - rangeStart ), [&]( const webServerLog &parsedLine, uint64_t lineOffset )
+                {
+                    recordHandler( parsedLine, task.file, chunk.offset + rangeStart + lineOffset, worker );
+                } );
             }
         }
+    } );
+
+    for (size_t file: streamedFiles)
+    {
+        if ( streams[file]->failed() )
+        {
+            failedFiles.push_back( file );
+        }
+    }
+    return failedFiles;
+}
+
+/*
+ * @method: scanInput
+ * @brief: parses the contents of a log file on the worker pool, decompressing it on the fly if it is compressed
+ *         Compressed logs are decompressed by a dedicated thread while the workers parse the decompressed chunks
+ * @input - format: the log format to parse the lines with
+ * @input - contents: the contents of the log file (ex. a memory-mapped file), plain text or compressed
+ * @input - inOrder: the records must be handed out in file order (a single worker parses every chunk)
+ * @input - recordHandler: called with each parsed non-empty line, the byte offset of the line (in the decompressed log)
+ *          and the index of the worker
+ * @return: returns false if the log is compressed and could not be decompressed entirely, true otherwise
+ */
+template <typename RecordHandler>
+bool webServerAnalyser::scanInput( const logFormat &format, std::string_view contents, bool inOrder, RecordHandler &&recordHandler )
+{
+    compressionFormat compression = decompressionStream::detect( contents );
+
+    if ( compression == compressionFormat::none )
+    {
+        if ( inOrder )
+        {
+            forEachRecord( format, contents, [&]( const webServerLog &parsedLine, uint64_t lineOffset )
+            {
+                recordHandler( parsedLine, lineOffset, 0 );
+            } );
+        }
+        else
+        {
+            scanContents( format, contents, recordHandler );
+        }
+        return true;
     }
 
-    return ret;
+    // Each worker keeps taking the next decompressed chunk until the stream ends
+    unsigned int consumers = inOrder ? 1 : pool.size();
+    decompressionStream stream( contents, compression, config.chunkSize, 2 * consumers );
+    pool.run( consumers, [&]( size_t, unsigned int worker )
+    {
+        decompressedChunk chunk;
+        while ( stream.next( chunk ) )
+        {
+            forEachRecord( format, chunk.data, [&]( const webServerLog &parsedLine, uint64_t lineOffset )
+            {
+                recordHandler( parsedLine, chunk.offset + lineOffset, worker );
+            } );
+        }
+    } );
+
+    return !stream.failed();
 }
 
 /*
- * @method: verifyHTTPRequest
- * @brief: verifies the request member of the webServerLog with the filtered inputs and extracts the requested resource
- * @input - inputEntry: the webServerLog struct that contains the request to be verified
- * @input - filteredHTTPMethod: the HTTP method to compare against in the request
- * @input - filteredHTTPResponse: the HTTP response to compare against in the request
- * @output - resource: the resource that is being accessed in the URI
- * @return: returns true if the request member has been verified with the expected filtered inputs, false otherwise
+ * @method: parseCalendarDate
+ * @brief: converts a Common Log Format date time ("[10/Oct/2000:13:55:36 -0700]") into seconds since the Unix epoch (UTC)
+ *         The time zone is optional, a date time without one is taken as UTC
+ * @return: returns the packed date time, INVALID_DATE if the date time is malformed or before 1970
  */
-bool webServerAnalyser::verifyHTTPRequest( webServerLog inputEntry, std::string filteredHTTPMethod, std::string filteredHTTPResponse, std::string &resource )
+static uint32_t parseCalendarDate( std::string_view date )
 {
-    bool ret = false;
+    static const char monthNames[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    uint32_t day, month = 0, year, hour, minute, second, zoneHours = 0, zoneMinutes = 0;
+    size_t dateEnd = 21;
+
+    auto digits = [&]( size_t position, size_t count, uint32_t &value )
+    {
+        value = 0;
+        for (size_t digit = position; digit < position + count; digit++)
+        {
+            if ( digit >= date.size() || date[digit] < '0' || date[digit] > '9' )
+            {
+                return false;
+            }
+            value = value * 10 + ( date[digit] - '0' );
+        }
+        return true;
+    };
 
-    // Parse the HTTP request into vector format for easier handling:
-    // ex. "GET /Software.html HTTP/1.0" -> ["GET"] ["/Software.html"] ["HTTP/1.0"]
-    std::vector <std::string> formattedRequest = parseHTTPRequest( inputEntry.request );
+    // [DD/Mon/YYYY:HH:MM:SS +ZZZZ]
+    if ( date.size() < 22 || !digits( 1, 2, day ) || date[3] != '/' || date[7] != '/' || !digits( 8, 4, year ) || date[12] != ':' ||
+         !digits( 13, 2, hour ) || date[15] != ':' || !digits( 16, 2, minute ) || date[18] != ':' || !digits( 19, 2, second ) )
+    {
+        return INVALID_DATE;
+    }
+    while ( month < 12 && date.substr( 4, 3 ) != std::string_view( monthNames + 3 * month, 3 ) )
+    {
+        month++;
+    }
+    if ( date.size() >= 28 && date[21] == ' ' && ( date[22] == '+' || date[22] == '-' ) )
+    {
+        if ( !digits( 23, 2, zoneHours ) || !digits( 25, 2, zoneMinutes ) )
+        {
+            return INVALID_DATE;
+        }
+        dateEnd = 27;
+    }
+    if ( month == 12 || day < 1 || day > 31 || year < 1970 || hour > 23 || minute > 59 || second > 60 || date[dateEnd] != ']' )
+    {
+        return INVALID_DATE;
+    }
 
-    // Verify that HTTP request method and HTTP response match the filtered values and populate the resource output if true
-    if ( formattedRequest[0] == filteredHTTPMethod && inputEntry.httpResponse == filteredHTTPResponse )
+    // Days since 1970-01-01 of the civil date, years starting in March so that the leap day is the last day of the year
+    uint32_t marchYear = year - ( month < 2 );
+    uint32_t yearOfEra = marchYear % 400;
+    uint32_t dayOfYear = ( 153 * ( month < 2 ? month + 10 : month - 2 ) + 2 ) / 5 + day - 1;
+    uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    int64_t days = static_cast <int64_t>( marchYear / 400 ) * 146097 + dayOfEra - 719468;
+    int64_t packedDate = days * 86400 + hour * 3600 + minute * 60 + second;
+    if ( dateEnd == 27 )
     {
-        resource = formattedRequest[1];
-        ret = true;
+        packedDate -= ( date[22] == '-' ? -1 : 1 ) * static_cast <int64_t>( zoneHours * 3600 + zoneMinutes * 60 );
     }
 
-    return ret;
+    return packedDate >= 0 && packedDate < INVALID_DATE ? static_cast <uint32_t>( packedDate ) : INVALID_DATE;
 }
 
 /*
- * @method: parseLine
- * @brief: converts a line of the webserver logs into a webServerLog structure format
- * @input - line: the webserver log line to be converted
- * @return: returns the corresponding webServerLog structure from the line input
+ * @method: parseDate
+ * @brief: converts a date time into a packed integer format: number of seconds since day 0
+ *         ex. "[29:23:54:18]" -> ((29 * 24 + 23) * 60 + 54) * 60 + 18
+ *         Common Log Format date times are converted into seconds since the Unix epoch (UTC, see parseCalendarDate)
+ *         ex. "[10/Oct/2000:13:55:36 -0700]" -> 971211336
+ *         Packed dates compare in the same order as the date times they were converted from
+ * @input - date: the date time to be converted
+ * @return: returns the packed form of the date time, INVALID_DATE if the date time is malformed
  */
-webServerLog webServerAnalyser::parseLine( std::string line )
+uint32_t webServerAnalyser::parseDate( std::string_view date )
 {
-    webServerLog outputLine;
-    size_t linePos = 0, endPos = 0;
-    std::string column;
+    static const uint32_t fieldScale[DATE_ENTRIES] = { 1, 24, 60, 60 }; // days, hours, minutes, seconds
+    uint64_t packedDate = 0;
+    size_t linePos = 1; // Start at linePos = 1 to ignore the first "["
+
+    if ( date.empty() || date[0] != '[' )
+    {
+        return INVALID_DATE;
+    }
+    if ( date.size() > 3 && date[3] == '/' )
+    {
+        return parseCalendarDate( date );
+    }
 
-    // Go through the line, extracting all MAX_COLUMNS # of columns into individual members of the webServerLog struct
-    for (int columnIndex = 1; columnIndex <= MAX_COLUMNS; columnIndex++)
+    for (int dateIndex = 0; dateIndex < DATE_ENTRIES; dateIndex++)
     {
-        if ( columnIndex == REQUEST_INDEX )
+        // Decode the digits up to the : or the ] delimiter (indicating last entry of date time)
+        uint32_t field = 0;
+        size_t fieldStart = linePos;
+        while ( linePos < date.size() && date[linePos] >= '0' && date[linePos] <= '9' && linePos - fieldStart < 4 )
         {
-            // Request field in webserver log needs to be handled differently since spaces are not valid delimiters
-            endPos = line.find( "\" ", linePos );
-            column = line.substr( linePos + 1, endPos - linePos - 1 );
-            linePos = endPos + 2;
+            field = field * 10 + ( date[linePos] - '0' );
+            linePos++;
         }
-        else
+        if ( linePos == fieldStart || linePos >= date.size() || date[linePos] != ( dateIndex == DATE_ENTRIES - 1 ? ']' : ':' ) )
         {
-            endPos = line.find_first_of( " \n", linePos );
-            column = line.substr( linePos, endPos - linePos );
-            linePos = endPos + 1;
+            return INVALID_DATE;
         }
+        linePos++;
+
+        packedDate = packedDate * fieldScale[dateIndex] + field;
+    }
+
+    return packedDate < INVALID_DATE ? static_cast <uint32_t>( packedDate ) : INVALID_DATE;
+}
+
+/*
+ * @method: parseSize
+ * @brief: converts the number of bytes in the reply into an integer
+ * @input - retSize: the reply size column, "-" when no body was sent
+ * @return: returns the number of bytes in the reply, 0 if the column is not a number
+ */
+uint64_t webServerAnalyser::parseSize( std::string_view retSize )
+{
+    uint64_t size = 0;
 
-        // Assign each member of the webServerLog struct to the extracted entry
-        switch (columnIndex)
+    for (char digit: retSize)
+    {
+        if ( digit < '0' || digit > '9' )
         {
-            case 1:
-                outputLine.host = column;
-                break;
-            case 2:
-                outputLine.date = column;
-                break;
-            case REQUEST_INDEX:
-                outputLine.request = column;
-                break;
-            case 4:
-                outputLine.httpResponse = column;
-                break;
-            case 5:
-                outputLine.retSize = column;
-                break;
-            default:
-                std::cout << "MAX_COLUMNS exceeded # of case statements, webServerLog will stop being populated" << std::endl;
+            return 0;
         }
+        size = size * 10 + ( digit - '0' );
     }
 
-#if 0
-    std::cout << "host: " << outputLine.host << std::endl
-              << "date: " << outputLine.date << std::endl
-              << "request: " << outputLine.request << std::endl
-              << "httpResponse: " << outputLine.httpResponse << std::endl
-              << "retSize: " << outputLine.retSize << std::endl << std::endl;
-#endif
+    return size;
+}
+
+/*
+ * @method: compileDateTimeRange
+ * @brief: converts the minDate and maxDate of a query into a packed dateRange, once per scan
+ * @input - minDate: the date time located at the minimum range of comparison
+ * @input - maxDate: the date time located at the maximum range of comparison
+ * @return: returns the packed range, not filtered if minDate or maxDate are not populated or malformed
+ */
+dateRange webServerAnalyser::compileDateTimeRange( const std::string &minDate, const std::string &maxDate )
+{
+    dateRange range;
 
-    return outputLine;
+    // If minDate or maxDate are not provided, filtering is not used
+    if ( !minDate.empty() && !maxDate.empty() )
+    {
+        uint32_t packedMin = parseDate( minDate );
+        uint32_t packedMax = parseDate( maxDate );
+        if ( packedMin != INVALID_DATE && packedMax != INVALID_DATE )
+        {
+            range.filtered = true;
+            range.minDate = packedMin;
+            range.maxDate = packedMax;
+        }
+    }
+
+    return range;
 }
 
 /*
- * @method: hostAccesses
- * @brief: provides number of accesses to a webserver per host
- * @input - filepath: file containing the webserver logs to process
- * @input - minDate: minimum date time used to filter the webserver logs
- * @input - maxDate: maximum date time used to filter the webserver logs
- *          Note: both minDate and maxDate are optional: can be blank to indicate no filtering
- *          Note: both minDate and maxDate are used in conjunction, cannot use one without the other
- * @return: returns the number of successful accesses to a webserver per host in vector format
+ * @method: findDateOffset
+ * @brief: binary searches time ordered log contents for the first line dated at or after the provided date
+ * @input - format: the log format to parse the lines with
+ * @input - contents: the webserver log contents, lines must be sorted by date time
+ * @input - date: the packed date time to look for
+ * @return: returns the byte offset of the first line with a date time >= date, contents.size() if there is none
  */
-std::vector <std::string> webServerAnalyser::hostAccesses( std::string filePath, std::string minDate, std::string maxDate )
+size_t webServerAnalyser::findDateOffset( const logFormat &format, std::string_view contents, uint32_t date )
 {
-    std::unordered_map <std::string, int> accessCount;
-    std::multimap <int, std::string> sortedAccessCount;
-    std::vector <std::string> output;
-    std::string currentLine;
+    // Invariant: every line starting before lo is dated before date, the searched line starts in [lo, hi]
+    size_t lo = 0, hi = contents.size();
 
-    // Step 1: read file
-    std::ifstream inputStream( filePath );
+    auto lineDate = [&]( size_t lineStart, size_t &lineEnd )
+    {
+        lineEnd = std::min( contents.find( '\n', lineStart ), contents.size() );
+        return parseDate( parseLine( format, contents.substr( lineStart, lineEnd - lineStart ) ).date );
+    };
 
-    // Step 2: parse file line by line
-    while( std::getline( inputStream, currentLine ) )
+    while ( hi - lo > DATE_SEARCH_LINEAR_SIZE )
     {
-        // Step 3: parse the single line into a webServerLog structure
-        webServerLog parsedLine = parseLine( currentLine );
+        // Probe the first line starting at or after the middle of the range
+        size_t mid = lo + ( hi - lo ) / 2;
+        size_t lineStart = contents.find( '\n', mid - 1 );
+        size_t lineEnd;
+        if ( lineStart == std::string_view::npos || lineStart + 1 >= hi )
+        {
+            break;
+        }
+        lineStart++;
 
-        // Step 4: verify that entry is within a valid time range (if specified)
-        if ( verifyDateTimeRange( parsedLine.date, minDate, maxDate ) )
+        // Malformed dates are treated as earlier than date so that the search keeps moving forward
+        uint32_t probeDate = lineDate( lineStart, lineEnd );
+        if ( probeDate < date || probeDate == INVALID_DATE )
+        {
+            lo = lineEnd + 1;
+        }
+        else
         {
-            // Step 5: once verified, increment number of accesses for the host
-            accessCount[parsedLine.host]++;
+            hi = lineStart;
         }
     }
 
-    // Step 6: sort entries based on the # of accesses, most # of entries at the top
-    for (auto it: accessCount)
+    // Finish with a linear scan over the few remaining lines
+    while ( lo < hi )
     {
-        sortedAccessCount.insert( { it.second, it.first } );
+        size_t lineEnd;
+        uint32_t probeDate = lineDate( lo, lineEnd );
+        if ( probeDate >= date && probeDate != INVALID_DATE )
+        {
+            break;
+        }
+        lo = lineEnd + 1;
     }
-    for (auto rit = sortedAccessCount.rbegin(); rit != sortedAccessCount.rend(); rit++)
+
+    return std::min( lo, contents.size() );
+}
+
+/*
+ * @method: parseHTTPRequest
+ * @brief: converts an HTTP request at column #3 into a vector format
+ *         ex. "GET /Software.html HTTP/1.0" -> ["GET"] ["/Software.html"] ["HTTP/1.0"]
+ * @input - request: the HTTP request to be converted
+ * @return: returns the array form of the HTTP request, split using the " " delimiter
+ */
+std::array <std::string_view, REQUEST_ENTRIES> webServerAnalyser::parseHTTPRequest( std::string_view request )
+{
+    std::array <std::string_view, REQUEST_ENTRIES> outputRequest;
+    size_t linePos = 0, endPos = 0; // No quotes in request, start at linePos = 0
+
+    for (int requestIndex = 0; requestIndex < REQUEST_ENTRIES && linePos <= request.size(); requestIndex++)
     {
-        output.push_back( std::string( rit->second + " " + std::to_string( rit->first ) ) );
+        endPos = std::min( request.find( ' ', linePos ), request.size() );
+        outputRequest[requestIndex] = request.substr( linePos, endPos - linePos );
+        linePos = endPos + 1;
     }
 
-    return output;
+    return outputRequest;
 }
 
 /*
- * @method: resourceAccesses
- * @brief: provides number of accesses to a resource for requests with HTTP "GET" and HTTP_OK (200) response
- * @input - filepath: file containing the webserver logs to process
- * @input - minDate: minimum date time used to filter the webserver logs
- * @input - maxDate: maximum date time used to filter the webserver logs
- *          Note: both minDate and maxDate are optional: can be blank to indicate no filtering
- *          Note: both minDate and maxDate are used in conjunction, cannot use one without the other
- * @return: returns the number of successful accesses to a resource per host in vector format
+ * @method: parseRecord
+ * @brief: converts the line starting at lineStart into a webServerLog structure format, using the structural characters
+ *         found by the tokenizer instead of searching the delimiters byte by byte
+ * @input - format: the log format to parse the lines with
+ * @input - contents: the webserver log contents the tokenizer was built on
+ * @input - tokens: the tokenizer of the contents
+ * @input - lineStart: offset of the first character of the line
+ * @output - outputLine: the corresponding webServerLog structure, members point into the contents
+ * @return: returns the offset of the newline ending the line, contents.size() for the last line without a newline
  */
-std::vector <std::string> webServerAnalyser::resourceAccesses( std::string filePath, std::string minDate, std::string maxDate )
+size_t webServerAnalyser::parseRecord( const logFormat &format, std::string_view contents, logTokenizer &tokens, size_t lineStart, webServerLog &outputLine )
 {
-    std::unordered_map <std::string, int> accessCount;
-    std::multimap <int, std::string> sortedAccessCount;
-    std::vector <std::string> output;
-    std::string currentLine, resource;
+    static std::string_view webServerLog::*const columns[LOG_COLUMNS] = { &webServerLog::host, &webServerLog::date, &webServerLog::request,
+                                                                          &webServerLog::httpResponse, &webServerLog::retSize };
+    size_t linePos = lineStart, endPos = 0, lineEnd = std::string_view::npos;
+    const formatField *field = format.fields(), *lastField = field + format.parsedFields();
 
-    // Step 1: create filestream
-    std::ifstream inputStream( filePath );
+    outputLine = webServerLog();
 
-    // Step 2: parse file line by line
-    while( std::getline( inputStream, currentLine ) )
+    // Go through the fields of the format up to the last one a query needs, skipped fields are not stored
+    // Missing fields (truncated line) are left empty
+    for (; field < lastField && lineEnd == std::string_view::npos; field++)
     {
-        // Step 3: parse the single line into a webServerLog structure
-        webServerLog parsedLine = parseLine( currentLine );
+        linePos = std::min( linePos + field->skip, contents.size() );
 
-        // Step 4: verify that only HTTP "GET" and HTTP_OK (200) entries are counted, within a valid time range (if specified)
-        if ( verifyDateTimeRange( parsedLine.date, minDate, maxDate ) &&
-             verifyHTTPRequest( parsedLine, "GET", HTTP_OK, resource ) )
+        // A structural character only ends the field when surrounded by the expected bytes: a quoted request ends at the first
+        // quote followed by a space, a bracketed date time with a time zone at the first space following a closing bracket
+        endPos = tokens.next( linePos, field->classes );
+        while ( endPos < contents.size() && contents[endPos] != '\n' &&
+                ( ( field->before != 0 && ( endPos == linePos || contents[endPos - 1] != field->before ) ) ||
+                  ( field->after != 0 && endPos + 1 < contents.size() && contents[endPos + 1] != field->after ) ) )
+        {
+            endPos = tokens.next( endPos + 1, field->classes );
+        }
+        if ( endPos >= contents.size() || contents[endPos] == '\n' )
         {
-            // Step 5: once verified, resource populated with verifyHTTPRequest, increment number of accesses
-            accessCount[resource]++;
+            lineEnd = endPos;
         }
+        if ( field->column != FIELD_SKIPPED )
+        {
+            outputLine.*columns[field->column] = contents.substr( linePos, endPos - linePos );
+        }
+        linePos = endPos;
+    }
+
+    // Fields after the last needed one are not scanned
+    if ( lineEnd == std::string_view::npos )
+    {
+        lineEnd = linePos >= contents.size() ? contents.size() : tokens.next( linePos, TOKEN_NEWLINE );
+    }
+
+    return std::min( lineEnd, contents.size() );
+}
+
+/*
+ * @method: parseLine
+ * @brief: converts a line of the webserver logs into a webServerLog structure format
+ * @input - format: the log format to parse the lines with
+ * @input - line: the webserver log line to be converted
+ * @return: returns the corresponding webServerLog structure from the line input, members point into the line
+ */
+webServerLog webServerAnalyser::parseLine( const logFormat &format, std::string_view line )
+{
+    webServerLog outputLine;
+    logTokenizer tokens( line );
+
+    parseRecord( format, line, tokens, 0, outputLine );
+
+    return outputLine;
+}
+
+/*
+ * @method: compileQueryFilter
+ * @brief: combines the HTTP method and response of a query with its filter expression into a single predicate chain
+ * @input - query: the query to compile
+ * @return: returns the predicates of the query, in evaluation order
+ */
+logFilter webServerAnalyser::compileQueryFilter( const accessQuery &query )
+{
+    logFilter filter = query.filter;
+
+    if ( !query.httpResponse.empty() )
+    {
+        filter.requireEqual( filterField::status, query.httpResponse );
+    }
+    if ( !query.httpMethod.empty() )
+    {
+        filter.requireEqual( filterField::method, query.httpMethod );
     }
 
-    // Step 6: sort entries based on the # of accesses, most # of entries at the top
-    for (auto it: accessCount)
+    return filter;
+}
+
+/*
+ * @method: queryColumns
+ * @brief: lists the columns of the log lines that a query reads: its key, its filters, the date time and size of histograms,
+ *         the host or size of sketches
+ * @input - query: the query
+ * @input - filter: the compiled predicates of the query (see compileQueryFilter)
+ * @input - range: the packed date time range of the query
+ * @return: returns the combination of logColumn flags read by the query
+ */
+unsigned int webServerAnalyser::queryColumns( const accessQuery &query, const logFilter &filter, const dateRange &range )
+{
+    unsigned int columns = 0;
+
+    // A histogram that is not split by key only reads the date time and size of the lines
+    if ( query.bucket == timeBucket::none || query.splitByKey )
+    {
+        columns |= query.key == queryKey::host ? COLUMN_HOST : query.key == queryKey::resource ? COLUMN_REQUEST : COLUMN_RESPONSE;
+    }
+    if ( query.bucket != timeBucket::none )
+    {
+        columns |= COLUMN_DATE | COLUMN_SIZE;
+    }
+    if ( query.bucket == timeBucket::none && query.metric == queryMetric::distinctHosts )
+    {
+        columns |= COLUMN_HOST;
+    }
+    else if ( query.bucket == timeBucket::none && query.metric == queryMetric::sizeQuantiles )
     {
-        sortedAccessCount.insert( { it.second, it.first } );
+        columns |= COLUMN_SIZE;
     }
-    for (auto rit = sortedAccessCount.rbegin(); rit != sortedAccessCount.rend(); rit++)
+    if ( range.filtered )
     {
-        output.push_back( std::string( rit->second + " " + std::to_string( rit->first ) ) );
+        columns |= COLUMN_DATE;
+    }
+    for (const auto &predicate: filter.chain())
+    {
+        columns |= FIELD_COLUMNS[static_cast <size_t>( predicate.field )];
     }
 
-    return output;
+    return columns;
+}
+
+/*
+ * @method: selectQueryKey
+ * @brief: applies the filters of a query to a webServerLog and extracts the key to count
+ *         The columns tested by the filter are only extracted (request split, size converted) when a predicate needs them
+ * @input - query: the query to evaluate
+ * @input - filter: the compiled predicates of the query (see compileQueryFilter)
+ * @input - range: the packed date time range of the query (see compileDateTimeRange)
+ * @input - inputEntry: the parsed webserver log line
+ * @input - inputDate: the packed date time of the inputEntry (only parsed if a query filters on date times)
+ * @output - key: the value of the query key column (view into the inputEntry)
+ * @return: returns FILTER_PASSED if the entry passes the query filters and must be counted,
+ *          the first predicate rejecting the entry otherwise (see queryFilter)
+ */
+queryFilter webServerAnalyser::selectQueryKey( const accessQuery &query, const logFilter &filter, const dateRange &range, const webServerLog &inputEntry,
+                                               uint32_t inputDate, std::string_view &key )
+{
+    std::array <std::string_view, REQUEST_ENTRIES> request;
+    bool requestSplit = false;
+
+    if ( !verifyDateTimeRange( inputDate, range ) )
+    {
+        return FILTER_DATE;
+    }
+
+    // Predicates are ordered by the cost of their column: the HTTP request is only split when a predicate or the key needs a part of it
+    for (const auto &predicate: filter.chain())
+    {
+        bool passed = false;
+        switch ( predicate.field )
+        {
+            case filterField::status:
+                passed = logFilter::test( predicate, inputEntry.httpResponse );
+                break;
+            case filterField::host:
+                passed = logFilter::matches( predicate, inputEntry.host );
+                break;
+            case filterField::size:
+                passed = logFilter::test( predicate, inputEntry.retSize );
+                break;
+            case filterField::date:
+                passed = inputDate != INVALID_DATE && logFilter::compare( predicate, inputDate );
+                break;
+            case filterField::method:
+            case filterField::resource:
+                if ( !requestSplit )
+                {
+                    request = parseHTTPRequest( inputEntry.request );
+                    requestSplit = true;
+                }
+                passed = logFilter::matches( predicate, request[predicate.field == filterField::method ? 0 : 1] );
+                break;
+        }
+        if ( !passed )
+        {
+            return FIELD_FILTERS[static_cast <size_t>( predicate.field )];
+        }
+    }
+
+    switch ( query.key )
+    {
+        case queryKey::host:
+            key = inputEntry.host;
+            break;
+        case queryKey::resource:
+            key = requestSplit ? request[1] : parseHTTPRequest( inputEntry.request )[1];
+            break;
+        case queryKey::httpResponse:
+            key = inputEntry.httpResponse;
+            break;
+    }
+
+    return FILTER_PASSED;
+}
+
+/*
+ * @method: prepareBatch
+ * @brief: compiles a batch of queries and builds the empty partial results of every worker
+ * @input - batch: the queries to evaluate
+ * @input - sampled: only sampled blocks of the logs will be counted (see analyserConfig.sampleFraction)
+ * @output - state: the compiled queries and their partial results
+ */
+void webServerAnalyser::prepareBatch( const std::vector <accessQuery> &batch, bool sampled, batchState &state )
+{
+    state = batchState();
+    state.batch = batch;
+
+    // One partial result per worker thread and per query: accessCount[worker][query]
+    // Top keys requested without exact counts: fixed size heavy hitters summaries (topCount) replace the exact counters
+    // Sampled runs count exactly: the error margins are derived from the spread of the exact counts (spreads)
+    state.topKeys = config.topKeys;
+    state.approximateTop = config.topKeys > 0 && !config.exactTop && !sampled;
+    state.sampled = sampled;
+    state.accessCount.resize( pool.size() );
+    state.spreads.resize( sampled ? pool.size() : 0, std::vector <std::vector <blockSpread>>( batch.size() ) );
+    state.topCount.resize( state.approximateTop ? pool.size() : 0 );
+    state.histograms.resize( pool.size() );
+    for (auto &workerCount: state.accessCount)
+    {
+        workerCount.resize( batch.size() ); // keyCounter owns its key arena: built in place rather than copied
+    }
+    // With a memory limit, the exact counters share it evenly and each spills to its query's file once over its share
+    // Sampled runs never spill: the spread of each key is indexed by its key ID in memory (see sampledResult)
+    auto exactQuery = [&state]( const accessQuery &query )
+    {
+        return query.bucket == timeBucket::none && query.metric == queryMetric::accesses && !state.approximateTop;
+    };
+    size_t exactQueries = std::count_if( batch.begin(), batch.end(), exactQuery );
+    state.spills.resize( batch.size() );
+    if ( config.memoryLimit > 0 && exactQueries > 0 && !sampled )
+    {
+        state.spillBudget = std::max <size_t>( config.memoryLimit / ( pool.size() * exactQueries ), 1 );
+        for (size_t query = 0; query < batch.size(); query++)
+        {
+            if ( exactQuery( batch[query] ) )
+            {
+                state.spills[query] = std::make_unique <keySpill>( config.spillDirectory, state.spillBudget );
+            }
+        }
+    }
+    for (auto &workerTop: state.topCount)
+    {
+        for (size_t query = 0; query < batch.size(); query++)
+        {
+            workerTop.emplace_back( state.topKeys ); // heavyHitters views its own keys: built in place rather than copied
+        }
+    }
+    // Traffic histogram queries: one timeHistogram per worker and per query (left empty for the other queries)
+    for (auto &workerHistograms: state.histograms)
+    {
+        for (const auto &query: batch)
+        {
+            workerHistograms.emplace_back( bucketSeconds( query.bucket ) );
+            state.anyHistogram = state.anyHistogram || query.bucket != timeBucket::none;
+        }
+    }
+    // Sketch queries: one sketchCounter per worker and per query, of the query metric
+    state.sketches.resize( pool.size() );
+    for (auto &workerSketches: state.sketches)
+    {
+        for (const auto &query: batch)
+        {
+            workerSketches.emplace_back( query.metric );
+        }
+    }
+
+    // Instrumentation counters are kept per worker as well (padded so that workers do not share cache lines)
+    state.workerCounters.resize( config.collectStats ? pool.size() : 0 );
+    for (auto &counters: state.workerCounters)
+    {
+        counters.queries.resize( batch.size() );
+    }
+
+    // Compile the date time ranges and the predicates of the queries, once per scan
+    // The lines are parsed up to the last column a query reads, the other columns are skipped
+    unsigned int columns = 0;
+    for (const auto &query: batch)
+    {
+        state.ranges.push_back( compileDateTimeRange( query.minDate, query.maxDate ) );
+        state.filters.push_back( compileQueryFilter( query ) );
+        state.anyDateFilter = state.anyDateFilter || state.ranges.back().filtered || state.filters.back().needs( filterField::date );
+        columns |= queryColumns( query, state.filters.back(), state.ranges.back() );
+    }
+    state.format = config.format.restrict( columns );
+    state.calendarDates = config.format.calendarDates();
+    state.scannedRange.filtered = !state.ranges.empty();
+    state.scannedRange.minDate = INVALID_DATE - 1;
+    state.scannedRange.maxDate = 0;
+    for (const auto &range: state.ranges)
+    {
+        state.scannedRange.filtered = state.scannedRange.filtered && range.filtered;
+        state.scannedRange.minDate = std::min( state.scannedRange.minDate, range.minDate );
+        state.scannedRange.maxDate = std::max( state.scannedRange.maxDate, range.maxDate );
+    }
+}
+
+/*
+ * @method: countRecord
+ * @brief: evaluates every query of a batch against a parsed line and counts it in the partial results of the worker
+ *         Instantiated with and without instrumentation, a run without stats pays nothing for it
+ * @input - parsedLine: the parsed webserver log line
+ * @input - position: position of the line in the input (see FILE_POSITION_BITS), orders keys with the same count
+ * @input - worker: index of the worker counting the line
+ * @output - state: the partial results of the worker
+ */
+template <bool collectStats>
+void webServerAnalyser::countRecord( const webServerLog &parsedLine, uint64_t position, unsigned int worker, batchState &state )
+{
+    std::string_view key;
+    uint32_t lineDate = state.anyDateFilter || state.anyHistogram ? parseDate( parsedLine.date ) : INVALID_DATE;
+    uint64_t lineBytes = state.anyHistogram ? parseSize( parsedLine.retSize ) : 0;
+
+    if constexpr ( collectStats )
+    {
+        state.workerCounters[worker].lines++;
+    }
+    for (size_t query = 0; query < state.batch.size(); query++)
+    {
+        // Verify the entry against the query filters (date time range, HTTP method and response, filter expression)
+        queryFilter verdict = selectQueryKey( state.batch[query], state.filters[query], state.ranges[query], parsedLine, lineDate, key );
+        if constexpr ( collectStats )
+        {
+            queryStats &counters = state.workerCounters[worker].queries[query];
+            ( verdict == FILTER_PASSED ? counters.counted : counters.rejected[verdict] )++;
+        }
+        if ( verdict != FILTER_PASSED )
+        {
+            continue;
+        }
+
+        // Once verified, increment number of accesses for the key (copied only when first seen),
+        // the traffic of the time bucket of the line or the sketch of the key
+        if ( state.batch[query].bucket != timeBucket::none )
+        {
+            if ( state.batch[query].splitByKey )
+            {
+                state.histograms[worker][query].add( lineDate, lineBytes, key, position );
+            }
+            else
+            {
+                state.histograms[worker][query].add( lineDate, lineBytes );
+            }
+        }
+        else if ( state.batch[query].metric == queryMetric::distinctHosts )
+        {
+            state.sketches[worker][query].add( key, std::hash <std::string_view>()( parsedLine.host ), position );
+        }
+        else if ( state.batch[query].metric == queryMetric::sizeQuantiles )
+        {
+            state.sketches[worker][query].add( key, parseSize( parsedLine.retSize ), position );
+        }
+        else if ( state.approximateTop )
+        {
+            state.topCount[worker][query].increment( key, position );
+        }
+        else
+        {
+            keyCounter &counter = state.accessCount[worker][query];
+            size_t keys = counter.size();
+            size_t id = counter.increment( key, position );
+
+            // Sampled runs: the accesses of the key within each block it was counted in, for its error margin (see rankBatch)
+            // A worker counts the lines of a block in a row, a block change closes the count of the previous block
+            // (a block split across the decompressed chunks of two workers is counted as two blocks)
+            if ( state.sampled )
+            {
+                std::vector <blockSpread> &spreads = state.spreads[worker][query];
+                spreads.resize( counter.size() );
+                blockSpread &spread = spreads[id];
+                uint64_t block = position >> SAMPLE_BLOCK_BITS;
+                if ( spread.block != block )
+                {
+                    spread.squares += spread.blockCount * spread.blockCount;
+                    spread.block = block;
+                    spread.blockCount = 0;
+                }
+                spread.blockCount++;
+            }
+
+            // Only a new key grows the counter: spill it once over its share of the memory limit
+            if ( state.spillBudget > 0 && counter.size() > keys && counter.memoryUsage() > state.spillBudget &&
+                 state.spills[query]->spill( counter ) )
+            {
+                counter = keyCounter();
+            }
+        }
+    }
+}
+
+/*
+ * @method: mergeBatch
+ * @brief: merges the partial results of every worker into the results of worker 0, the other workers start over empty
+ *         Keys are ordered by their first position: the merge order does not matter
+ * @output - state: the partial results to merge
+ */
+void webServerAnalyser::mergeBatch( batchState &state )
+{
+    for (size_t query = 0; query < state.batch.size(); query++)
+    {
+        for (size_t worker = 1; worker < state.histograms.size(); worker++)
+        {
+            if ( state.batch[query].bucket != timeBucket::none && state.histograms[worker][query].size() > 0 )
+            {
+                state.histograms[0][query].merge( state.histograms[worker][query] );
+                state.histograms[worker][query] = timeHistogram( bucketSeconds( state.batch[query].bucket ) );
+            }
+        }
+        for (size_t worker = 1; worker < state.sketches.size(); worker++)
+        {
+            if ( state.sketches[worker][query].size() > 0 )
+            {
+                state.sketches[0][query].merge( state.sketches[worker][query] );
+                state.sketches[worker][query] = sketchCounter( state.batch[query].metric );
+            }
+        }
+        for (size_t worker = 1; worker < state.topCount.size(); worker++)
+        {
+            if ( state.topCount[worker][query].size() > 0 )
+            {
+                state.topCount[0][query].merge( state.topCount[worker][query] );
+                state.topCount[worker][query] = heavyHitters( state.topKeys );
+            }
+        }
+        for (size_t worker = 1; worker < state.spreads.size(); worker++)
+        {
+            // Sampled runs: the keys are merged one by one so that their block spread follows them to their key ID in worker 0
+            const keyCounter &workerCount = state.accessCount[worker][query];
+            std::vector <blockSpread> &spreads = state.spreads[0][query];
+            for (size_t id = 0; id < workerCount.size(); id++)
+            {
+                const blockSpread &spread = state.spreads[worker][query][id];
+                size_t mergedId = state.accessCount[0][query].add( workerCount.key( id ), workerCount.count( id ) );
+                spreads.resize( state.accessCount[0][query].size() );
+                spreads[mergedId].squares += spread.squares + spread.blockCount * spread.blockCount;
+            }
+            state.accessCount[worker][query] = keyCounter();
+            state.spreads[worker][query].clear();
+        }
+        for (size_t worker = 1; worker < state.accessCount.size(); worker++)
+        {
+            // Once a query spilled, merging the workers in memory could exceed the limit: their counts are spilled instead
+            keySpill *spill = state.spills[query].get();
+            if ( state.accessCount[worker][query].size() > 0 &&
+                 ( spill == nullptr || spill->empty() || !spill->spill( state.accessCount[worker][query] ) ) )
+            {
+                state.accessCount[0][query].merge( state.accessCount[worker][query] );
+            }
+            state.accessCount[worker][query] = keyCounter();
+        }
+    }
+}
+
+/*
+ * @method: rankBatch
+ * @brief: sorts the merged results of each query, most # of accesses at the top (see mergeBatch)
+ * @input - state: the merged results
+ * @input - summarized: the top keys are ranked from the heavy hitters summaries, not from the exact counters
+ * @return: returns the ranked results of each query (time buckets of a histogram query), in the order of the batch
+ */
+std::vector <queryResult> webServerAnalyser::rankBatch( const batchState &state, bool summarized ) const
+{
+    std::vector <queryResult> output;
+
+    for (size_t query = 0; query < state.batch.size(); query++)
+    {
+        if ( state.batch[query].bucket != timeBucket::none )
+        {
+            output.push_back( state.histograms[0][query].result( state.topKeys ) );
+            output.back().setCalendarDates( state.calendarDates );
+            continue;
+        }
+        if ( state.batch[query].metric != queryMetric::accesses )
+        {
+            output.push_back( state.sketches[0][query].rankedResult( state.topKeys ) );
+        }
+        else if ( summarized )
+        {
+            output.push_back( state.topCount[0][query].rankedResult( state.topKeys ) );
+        }
+        else if ( state.spills[query] != nullptr && !state.spills[query]->empty() )
+        {
+            output.push_back( state.spills[query]->rankedResult( state.accessCount[0][query], state.topKeys ) );
+        }
+        else if ( state.sampled )
+        {
+            output.push_back( sampledResult( state.accessCount[0][query], state.spreads[0][query], state.topKeys ) );
+        }
+        else
+        {
+            output.push_back( state.accessCount[0][query].rankedResult( state.topKeys ) );
+        }
+    }
+
+    return output;
+}
+
+/*
+ * @method: sampledResult
+ * @brief: scales the counts of a sampled run up to the whole logs, with the margin of their 95% confidence interval
+ *         The sampled blocks are the sampling units: a count c sampled with probability f is estimated as c / f, with a
+ *         variance of ( 1 - f ) / f^2 times the sum of the squared counts of the key within each sampled block
+ * @input - counter: the merged exact counts of the sampled blocks
+ * @input - spreads: the block spread of each key of counter (see blockSpread)
+ * @input - limit: maximum number of entries to output, 0 outputs every key
+ * @return: returns the keys, their estimates and margins in ranked order (resultKind::sampledCounts)
+ */
+queryResult webServerAnalyser::sampledResult( const keyCounter &counter, const std::vector <blockSpread> &spreads, size_t limit ) const
+{
+    std::vector <size_t> order = counter.rankedKeys( limit );
+    queryResult result( resultKind::sampledCounts );
+    double fraction = config.sampleFraction;
+
+    result.reserve( order.size(), 0 );
+    for (size_t id: order)
+    {
+        const blockSpread &spread = spreads[id];
+        double squares = static_cast <double>( spread.squares + spread.blockCount * spread.blockCount );
+        resultRow row;
+        row.count = static_cast <uint64_t>( std::llround( counter.count( id ).count / fraction ) );
+        row.error = static_cast <uint64_t>( std::llround( SAMPLE_CONFIDENCE_Z * std::sqrt( ( 1 - fraction ) * squares ) / fraction ) );
+        result.add( counter.key( id ), row );
+    }
+
+    return result;
+}
+
+/*
+ * @method: resultText
+ * @brief: formats the results of each query as logParser prints them (see queryResult::text)
+ * @input - results: the ranked results of each query
+ * @return: returns the lines of each query, in the order of results
+ */
+std::vector <std::vector <std::string>> webServerAnalyser::resultText( const std::vector <queryResult> &results )
+{
+    std::vector <std::vector <std::string>> output;
+
+    output.reserve( results.size() );
+    for (const auto &result: results)
+    {
+        output.push_back( result.text() );
+    }
+
+    return output;
+}
+
+/*
+ * @method: collectBatchStats
+ * @brief: sums the instrumentation counters of the workers into the stats of the run and measures the merged results
+ * @input - state: the merged results (see mergeBatch)
+ * @input - summarized: the top keys are ranked from the heavy hitters summaries, not from the exact counters
+ */
+void webServerAnalyser::collectBatchStats( const batchState &state, bool summarized )
+{
+    stats.threads = pool.size();
+    stats.queries.resize( state.batch.size() );
+    for (const auto &counters: state.workerCounters)
+    {
+        stats.lines += counters.lines;
+    }
+    for (size_t query = 0; query < state.batch.size(); query++)
+    {
+        queryStats &counters = stats.queries[query];
+        for (const auto &workerCounter: state.workerCounters)
+        {
+            counters.counted += workerCounter.queries[query].counted;
+            for (int filter = 0; filter < QUERY_FILTERS; filter++)
+            {
+                counters.rejected[filter] += workerCounter.queries[query].rejected[filter];
+            }
+        }
+
+        if ( state.batch[query].bucket != timeBucket::none )
+        {
+            counters.distinctKeys = state.histograms[0][query].size();
+            counters.tableLoad = state.histograms[0][query].loadFactor();
+            counters.keyMemory = state.histograms[0][query].memoryUsage();
+            continue;
+        }
+        if ( state.batch[query].metric != queryMetric::accesses )
+        {
+            counters.distinctKeys = state.sketches[0][query].size();
+            counters.tableLoad = state.sketches[0][query].loadFactor();
+            counters.keyMemory = state.sketches[0][query].memoryUsage();
+            continue;
+        }
+        counters.distinctKeys = summarized ? state.topCount[0][query].size() : state.accessCount[0][query].size();
+        counters.tableLoad = summarized ? state.topCount[0][query].loadFactor() : state.accessCount[0][query].loadFactor();
+        counters.keyMemory = summarized ? 0 : state.accessCount[0][query].memoryUsage();
+        counters.spilledBytes = state.spills[query] != nullptr ? state.spills[query]->spilledBytes() : 0;
+    }
+    stats.peakMemory = peakResidentMemory();
+}
+
+/*
+ * @method: countBatch
+ * @brief: evaluates all the provided queries during a single pass over the log files, up to the merged partial results
+ *         With config.shards, only the part of the logs assigned to config.shard is counted
+ * @input - filePaths: files containing the webserver logs to process, counted as if they were concatenated in this order
+ * @input - batch: the queries to evaluate
+ * @output - state: the merged results of every query (see mergeBatch)
+ * @return: returns true if the top keys are summarized (heavy hitters) rather than counted exactly
+ */
+bool webServerAnalyser::countBatch( const std::vector <std::string> &filePaths, const std::vector <accessQuery> &batch, batchState &state )
+{
+    analyserStats *runStats = config.collectStats ? &stats : nullptr;
+    if ( runStats != nullptr )
+    {
+        stats = analyserStats();
+        stats.files = filePaths.size();
+    }
+    stageTimer openTimer( runStats, STAGE_OPEN );
+
+    // Step 1: compile the queries and build the partial results of every worker (see prepareBatch)
+    prepareBatch( batch, config.sampleFraction < 1, state );
+
+    // Step 2: open every file: a fresh sidecar index answers its file from its columns, the other files are memory-mapped
+    // and parsed records point straight into the mapping
+    std::vector <std::unique_ptr <logIndex>> indexes( filePaths.size() );
+    std::vector <std::unique_ptr <mappedFile>> inputFiles( filePaths.size() );
+    std::vector <std::string_view> contents( filePaths.size() );
+    std::vector <size_t> scanStarts( filePaths.size(), 0 );
+    std::vector <std::string> streamPaths( filePaths.size() );
+    std::vector <size_t> indexedFiles, textFiles;
+    unsigned int shards = std::max( config.shards, 1u );
+    for (size_t file = 0; file < filePaths.size(); file++)
+    {
+        // Shards split the text of each log: an index, which only some nodes may have, would change what a shard counts
+        if ( config.useIndex && !state.sampled && shards == 1 )
+        {
+            auto index = std::make_unique <logIndex>();
+            if ( index->load( filePaths[file] + INDEX_EXTENSION ) && index->isFresh( filePaths[file], config.format.fingerprint() ) )
+            {
+                indexes[file] = std::move( index );
+                indexedFiles.push_back( file );
+                continue;
+            }
+        }
+
+        inputFiles[file] = std::make_unique <mappedFile>( filePaths[file] );
+        contents[file] = inputFiles[file]->data();
+        textFiles.push_back( file );
+
+        // Time ordered logs: only the lines within the union of the query ranges need to be read (plain text logs only)
+        bool compressed = decompressionStream::detect( contents[file] ) != compressionFormat::none;
+        if ( config.timeOrdered && state.scannedRange.filtered && !compressed )
+        {
+            size_t scanStart = findDateOffset( state.format, contents[file], state.scannedRange.minDate );
+            size_t scanEnd = scanStart + findDateOffset( state.format, contents[file].substr( scanStart ), state.scannedRange.maxDate + 1 );
+            contents[file] = contents[file].substr( scanStart, scanEnd - scanStart );
+            scanStarts[file] = scanStart;
+        }
+
+        // Plain text logs are split into one newline aligned range per shard, lines keep their position in the whole file
+        // Compressed logs cannot be split by lines: they are assigned whole, round robin
+        if ( shards > 1 )
+        {
+            size_t shardStart = 0, shardEnd = file % shards == config.shard ? contents[file].size() : 0;
+            if ( !compressed && config.shard < shards )
+            {
+                std::vector <size_t> shardStarts = shardBoundaries( contents[file], shards );
+                shardStart = shardStarts[config.shard];
+                shardEnd = shardStarts[config.shard + 1];
+            }
+            contents[file] = contents[file].substr( shardStart, shardEnd - shardStart );
+            scanStarts[file] += shardStart;
+        }
+
+        // Sampled runs: only the sampled blocks of plain text logs are read from disk, they are requested ahead of the scan
+        size_t scannedBytes = contents[file].size();
+        if ( state.sampled && !compressed )
+        {
+            std::vector <size_t> sampleRanges = sampleBoundaries( contents[file], scanStarts[file], file );
+            inputFiles[file]->adviseRandom();
+            scannedBytes = 0;
+            for (size_t range = 0; range < sampleRanges.size(); range += 2)
+            {
+                inputFiles[file]->prefetch( scanStarts[file] + sampleRanges[range], sampleRanges[range + 1] - sampleRanges[range] );
+                scannedBytes += sampleRanges[range + 1] - sampleRanges[range];
+            }
+        }
+        // Read ahead backends: the scanned range is read by a reader thread instead of being faulted in by the workers
+        if ( config.input != inputBackend::mmap && !state.sampled && !compressed && inputFiles[file]->isMapped() )
+        {
+            streamPaths[file] = filePaths[file];
+        }
+        if ( runStats != nullptr )
+        {
+            stats.bytes += scannedBytes;
+            stats.compressed = stats.compressed || compressed;
+        }
+    }
+    openTimer.stop();
+
+    // Step 3: count the indexed files, each one is a single task producing exact counts
+    stageTimer scanTimer( runStats, STAGE_SCAN );
+    std::vector <std::vector <keyCounter>> indexedCount( filePaths.size() );
+    std::vector <std::vector <timeHistogram>> indexedHistograms( filePaths.size() );
+    std::vector <std::vector <sketchCounter>> indexedSketches( filePaths.size() );
+    std::vector <std::vector <queryStats>> indexedCounters( runStats != nullptr ? filePaths.size() : 0, std::vector <queryStats>( batch.size() ) );
+    pool.run( indexedFiles.size(), [&]( size_t task, unsigned int )
+    {
+        size_t file = indexedFiles[task];
+        indexedCount[file] = runIndexedBatch( *indexes[file], batch, state.ranges, state.filters, state.spills, state.spillBudget,
+                                              static_cast <uint64_t>( file ) << FILE_POSITION_BITS, indexedHistograms[file], indexedSketches[file],
+                                              runStats != nullptr ? &indexedCounters[file] : nullptr );
+    } );
+
+    // Step 4: parse the other files line by line, split into tasks across the worker threads (decompressed on the fly if needed)
+    // Step 5: each line is parsed into a webServerLog structure once for all queries and counted (see countRecord)
+    auto scan = [&]( auto collectStats )
+    {
+        return scanFiles( state.format, contents, scanStarts, streamPaths, [&]( const webServerLog &parsedLine, size_t file, uint64_t lineOffset, unsigned int worker )
+        {
+            uint64_t position = ( static_cast <uint64_t>( file ) << FILE_POSITION_BITS ) + scanStarts[file] + lineOffset;
+            countRecord <decltype( collectStats )::value>( parsedLine, position, worker, state );
+        } );
+    };
+    std::vector <size_t> failedFiles = runStats != nullptr ? scan( std::true_type() ) : scan( std::false_type() );
+    scanTimer.stop();
+    for (size_t file: failedFiles)
+    {
+        std::cerr << "Failed to " << ( streamPaths[file].empty() ? "decompress " : "read " ) << filePaths[file]
+                  << " entirely, results only cover its readable part" << std::endl;
+    }
+
+    // Step 6: merge the per-worker and per-file results into one result per query, as if the files had been concatenated
+    stageTimer mergeTimer( runStats, STAGE_MERGE );
+    mergeBatch( state );
+    for (size_t query = 0; query < batch.size(); query++)
+    {
+        for (size_t file: indexedFiles)
+        {
+            if ( batch[query].bucket != timeBucket::none )
+            {
+                state.histograms[0][query].merge( indexedHistograms[file][query] );
+            }
+            else if ( batch[query].metric != queryMetric::accesses )
+            {
+                state.sketches[0][query].merge( indexedSketches[file][query] );
+            }
+            else
+            {
+                // Like the counts of the workers (see mergeBatch): spilled rather than merged once the query spilled, and the
+                // merged counts are spilled once over the budget
+                keySpill *spill = state.spills[query].get();
+                keyCounter &mergedCount = state.accessCount[0][query];
+                if ( indexedCount[file][query].size() > 0 &&
+                     ( spill == nullptr || spill->empty() || !spill->spill( indexedCount[file][query] ) ) )
+                {
+                    mergedCount.merge( indexedCount[file][query] );
+                    if ( spill != nullptr && mergedCount.memoryUsage() > state.spillBudget && spill->spill( mergedCount ) )
+                    {
+                        mergedCount = keyCounter();
+                    }
+                }
+                indexedCount[file][query] = keyCounter();
+            }
+        }
+
+        // Exact counts of the indexed files join the summary of the parsed files
+        if ( state.approximateTop && !textFiles.empty() && !indexedFiles.empty() )
+        {
+            const keyCounter &exactCount = state.accessCount[0][query];
+            for (size_t id = 0; id < exactCount.size(); id++)
+            {
+                state.topCount[0][query].add( exactCount.key( id ), exactCount.count( id ).count, exactCount.count( id ).firstSeen );
+            }
+        }
+    }
+    mergeTimer.stop();
+
+    if ( runStats != nullptr )
+    {
+        stats.indexedFiles = indexedFiles.size();
+        stats.queries.resize( batch.size() );
+        for (size_t file: indexedFiles)
+        {
+            stats.lines += indexes[file]->rows();
+            for (size_t query = 0; query < batch.size(); query++)
+            {
+                stats.queries[query].counted += indexedCounters[file][query].counted;
+                for (int filter = 0; filter < QUERY_FILTERS; filter++)
+                {
+                    stats.queries[query].rejected[filter] += indexedCounters[file][query].rejected[filter];
+                }
+            }
+        }
+    }
+
+    // The top keys are exact if every file was indexed
+    return state.approximateTop && !textFiles.empty();
+}
+
+/*
+ * @method: runBatch
+ * @brief: evaluates all the provided queries during a single pass over the log files
+ * @input - filePaths: files containing the webserver logs to process, counted as if they were concatenated in this order
+ * @input - batch: the queries to evaluate
+ * @return: returns the ranked results of each query, in the order of the batch
+ *          (the time buckets of a histogram query, see timeHistogram::result)
+ */
+std::vector <queryResult> webServerAnalyser::runBatch( const std::vector <std::string> &filePaths, const std::vector <accessQuery> &batch )
+{
+    batchState state;
+    bool summarized = countBatch( filePaths, batch, state );
+
+    // Sort entries based on the # of accesses, most # of entries at the top
+    stageTimer rankTimer( config.collectStats ? &stats : nullptr, STAGE_RANK );
+    std::vector <queryResult> output = rankBatch( state, summarized );
+    rankTimer.stop();
+
+    if ( config.collectStats )
+    {
+        collectBatchStats( state, summarized );
+    }
+
+    return output;
+}
+
+/*
+ * @method: runIndexedBatch
+ * @brief: evaluates all the provided queries over the columns of a log index instead of the log text
+ * @input - index: the loaded index of the log file
+ * @input - batch: the queries to evaluate
+ * @input - ranges: the packed date time range of each query
+ * @input - filters: the compiled predicates of each query, dictionary columns are tested once per dictionary entry
+ * @input - spills: where the exact counts of each query are spilled over spillBudget (see batchState.spills)
+ * @input - spillBudget: bytes the exact counts of a query may hold before they are spilled, 0 for no limit
+ * @input - positionBase: position of the first row of the index (see FILE_POSITION_BITS), rows are positioned by number
+ * @output - histograms: the traffic histogram of each query, only updated for histogram queries
+ * @output - sketches: the sketches per key of each query, only updated for sketch queries (see accessQuery.metric)
+ * @output - queryCounters: the rejection counters of each query, updated when not nullptr
+ * @return: returns the exact counts of each query not spilled yet, in the order of the batch (empty for histogram and
+ *         sketch queries)
+ */
+std::vector <keyCounter> webServerAnalyser::runIndexedBatch( const logIndex &index, const std::vector <accessQuery> &batch, const std::vector <dateRange> &ranges,
+                                                           const std::vector <logFilter> &filters, const std::vector <std::unique_ptr <keySpill>> &spills,
+                                                           size_t spillBudget, uint64_t positionBase, std::vector <timeHistogram> &histograms,
+                                                           std::vector <sketchCounter> &sketches, std::vector <queryStats> *queryCounters )
+{
+    std::vector <keyCounter> indexedCount( batch.size() );
+    const uint32_t *dates = index.dates();
+    const uint64_t *sizes = index.sizes();
+
+    // A predicate translated into a test of the index columns
+    typedef struct indexedPredicate
+    {
+        const filterPredicate *predicate;
+        queryFilter category; // rejection category (see FIELD_FILTERS)
+        const uint32_t *ids = nullptr; // dictionary column tested, nullptr for sizes and date times
+        std::vector <uint8_t> allowed; // indexed by dictionary ID: the value passes the predicate
+    } indexedPredicate;
+
+    for (size_t query = 0; query < batch.size(); query++)
+    {
+        indexDictionary keyDictionary = batch[query].key == queryKey::host ? INDEX_HOST :
+                                        batch[query].key == queryKey::resource ? INDEX_RESOURCE : INDEX_RESPONSE;
+        const uint32_t *keys = index.keyColumn( keyDictionary );
+        std::vector <keyCount> accessCount;
+        uint64_t firstRow = 0, lastRow = index.rows(), counted = 0;
+        bool histogram = batch[query].bucket != timeBucket::none;
+        histograms.emplace_back( bucketSeconds( batch[query].bucket ) );
+        sketches.emplace_back( batch[query].metric );
+        bool sketched = !histogram && batch[query].metric != queryMetric::accesses;
+
+        // Distinct hosts sketches hash each host of the dictionary once
+        const uint32_t *hosts = index.keyColumn( INDEX_HOST );
+        std::vector <uint64_t> hostHashes( sketched && batch[query].metric == queryMetric::distinctHosts ? index.dictionarySize( INDEX_HOST ) : 0 );
+        for (uint32_t id = 0; id < hostHashes.size(); id++)
+        {
+            hostHashes[id] = std::hash <std::string_view>()( index.key( INDEX_HOST, id ) );
+        }
+
+        // Step 1: translate the query predicates into tests of the columns: a dictionary column is tested once per dictionary
+        // entry and its rows only look up their ID, sizes and date times are compared as they are stored
+        std::vector <indexedPredicate> predicates;
+        for (const auto &predicate: filters[query].chain())
+        {
+            predicates.push_back( { &predicate, FIELD_FILTERS[static_cast <size_t>( predicate.field )], nullptr, {} } );
+            int dictionary = FIELD_DICTIONARIES[static_cast <size_t>( predicate.field )];
+            if ( dictionary >= 0 )
+            {
+                indexedPredicate &test = predicates.back();
+                test.ids = index.keyColumn( static_cast <indexDictionary>( dictionary ) );
+                test.allowed.resize( index.dictionarySize( static_cast <indexDictionary>( dictionary ) ) );
+                for (uint32_t id = 0; id < test.allowed.size(); id++)
+                {
+                    test.allowed[id] = logFilter::test( predicate, index.key( static_cast <indexDictionary>( dictionary ), id ) );
+                }
+            }
+        }
+
+        // Step 2: time ordered rows, only the rows within the date time range are visited
+        if ( ranges[query].filtered && index.timeOrdered() )
+        {
+            firstRow = std::lower_bound( dates, dates + index.rows(), ranges[query].minDate ) - dates;
+            lastRow = std::upper_bound( dates, dates + index.rows(), ranges[query].maxDate ) - dates;
+        }
+
+        // Step 3: count the accesses per key ID, the first counted row orders keys with the same count
+        for (uint64_t row = firstRow; row < lastRow; row++)
+        {
+            queryFilter verdict = verifyDateTimeRange( dates[row], ranges[query] ) ? FILTER_PASSED : FILTER_DATE;
+            for (size_t test = 0; test < predicates.size() && verdict == FILTER_PASSED; test++)
+            {
+                const indexedPredicate &predicate = predicates[test];
+                bool passed = predicate.ids != nullptr ? predicate.allowed[predicate.ids[row]] != 0 :
+                              predicate.predicate->field == filterField::size ? logFilter::compare( *predicate.predicate, sizes[row] ) :
+                              dates[row] != INVALID_DATE && logFilter::compare( *predicate.predicate, dates[row] );
+                verdict = passed ? FILTER_PASSED : predicate.category;
+            }
+            if ( verdict != FILTER_PASSED )
+            {
+                if ( queryCounters != nullptr )
+                {
+                    ( *queryCounters )[query].rejected[verdict]++;
+                }
+                continue;
+            }
+            counted++;
+
+            // Histogram queries count the traffic of the time bucket of the row instead
+            if ( histogram )
+            {
+                if ( batch[query].splitByKey )
+                {
+                    histograms[query].add( dates[row], sizes[row], index.key( keyDictionary, keys[row] ), positionBase + row );
+                }
+                else
+                {
+                    histograms[query].add( dates[row], sizes[row] );
+                }
+                continue;
+            }
+
+            // Sketch queries add the host or the reply size of the row to the sketch of its key
+            if ( sketched )
+            {
+                uint64_t value = batch[query].metric == queryMetric::sizeQuantiles ? sizes[row] : hostHashes[hosts[row]];
+                sketches[query].add( index.key( keyDictionary, keys[row] ), value, positionBase + row );
+                continue;
+            }
+
+            if ( keys[row] >= accessCount.size() )
+            {
+                accessCount.resize( keys[row] + 1 );
+            }
+            if ( accessCount[keys[row]].count++ == 0 )
+            {
+                accessCount[keys[row]].firstSeen = positionBase + row;
+            }
+        }
+
+        // Step 4: translate the key IDs back into keys (counts are exact, no summary needed), spilled once over the budget
+        for (uint32_t id = 0; id < accessCount.size(); id++)
+        {
+            if ( accessCount[id].count > 0 )
+            {
+                indexedCount[query].add( index.key( keyDictionary, id ), accessCount[id] );
+                if ( spillBudget > 0 && spills[query] != nullptr && indexedCount[query].memoryUsage() > spillBudget &&
+                     spills[query]->spill( indexedCount[query] ) )
+                {
+                    indexedCount[query] = keyCounter();
+                }
+            }
+        }
+
+        if ( queryCounters != nullptr )
+        {
+            ( *queryCounters )[query].counted += counted;
+            ( *queryCounters )[query].rejected[FILTER_DATE] += index.rows() - ( lastRow - firstRow ); // rows skipped by the binary search
+        }
+    }
+
+    return indexedCount;
+}
+
+/*
+ * @method: bucketSeconds
+ * @return: returns the width in seconds of the provided time bucket, 0 for timeBucket::none
+ */
+uint32_t webServerAnalyser::bucketSeconds( timeBucket bucket )
+{
+    switch ( bucket )
+    {
+        case timeBucket::second:
+            return 1;
+        case timeBucket::minute:
+            return 60;
+        case timeBucket::hour:
+            return 60 * 60;
+        default:
+            return 0;
+    }
+}
+
+/*
+ * @method: hostAccesses
+ * @brief: provides number of accesses to a webserver per host
+ * @input - filepath: file containing the webserver logs to process
+ * @input - minDate: minimum date time used to filter the webserver logs
+ * @input - maxDate: maximum date time used to filter the webserver logs
+ *          Note: both minDate and maxDate are optional: can be blank to indicate no filtering
+ *          Note: both minDate and maxDate are used in conjunction, cannot use one without the other
+ * @return: returns the number of successful accesses to a webserver per host in vector format
+ */
+std::vector <std::string> webServerAnalyser::hostAccesses( std::string filePath, std::string minDate, std::string maxDate )
+{
+    accessQuery query;
+    query.key = queryKey::host;
+    query.minDate = minDate;
+    query.maxDate = maxDate;
+
+    return runBatch( { filePath }, { query } )[0].text();
+}
+
+/*
+ * @method: resourceAccesses
+ * @brief: provides number of accesses to a resource for requests with HTTP "GET" and HTTP_OK (200) response
+ * @input - filepath: file containing the webserver logs to process
+ * @input - minDate: minimum date time used to filter the webserver logs
+ * @input - maxDate: maximum date time used to filter the webserver logs
+ *          Note: both minDate and maxDate are optional: can be blank to indicate no filtering
+ *          Note: both minDate and maxDate are used in conjunction, cannot use one without the other
+ * @return: returns the number of successful accesses to a resource per host in vector format
+ */
+std::vector <std::string> webServerAnalyser::resourceAccesses( std::string filePath, std::string minDate, std::string maxDate )
+{
+    accessQuery query;
+    query.key = queryKey::resource;
+    query.httpMethod = "GET";
+    query.httpResponse = HTTP_OK;
+    query.minDate = minDate;
+    query.maxDate = maxDate;
+
+    return runBatch( { filePath }, { query } )[0].text();
+}
+
+/*
+ * @method: addQuery
+ * @brief: registers a query to be evaluated by the next runQueries call
+ * @input - query: the aggregation to compute, with its own filters
+ * @return: returns the index of the query's output in the runQueries result
+ */
+size_t webServerAnalyser::addQuery( const accessQuery &query )
+{
+    queries.push_back( query );
+    return queries.size() - 1;
+}
+
+/*
+ * @method: checkColumns
+ * @brief: verifies that the log format holds every column a query reads (see queryColumns): lines missing a column
+ *         would never pass the query and it would silently output nothing
+ * @input - query: the query
+ * @output - error: names the missing columns, and whether the query itself or its filter reads them
+ * @return: returns true if the format holds every column of the query, false otherwise
+ */
+bool webServerAnalyser::checkColumns( const accessQuery &query, std::string &error ) const
+{
+    static const char *columnNames[LOG_COLUMNS] = { "$remote_addr", "$time_local", "$request", "$status", "$body_bytes_sent" };
+    accessQuery unfiltered = query;
+    unfiltered.filter = logFilter();
+    dateRange range = compileDateTimeRange( query.minDate, query.maxDate );
+    unsigned int queryMissing = queryColumns( unfiltered, compileQueryFilter( unfiltered ), range ) & ~config.format.columns();
+    unsigned int missing = queryColumns( query, compileQueryFilter( query ), range ) & ~config.format.columns();
+
+    if ( missing == 0 )
+    {
+        return true;
+    }
+    error = "the log format has no";
+    for (unsigned int column = 0; column < LOG_COLUMNS; column++)
+    {
+        if ( missing & ( 1u << column ) )
+        {
+            error += std::string( " " ) + columnNames[column];
+        }
+    }
+    error += queryMissing != 0 ? ", read by the query" : ", read by its filter";
+
+    return false;
+}
+
+/*
+ * @method: clearQueries
+ * @brief: removes all the queries registered with addQuery
+ */
+void webServerAnalyser::clearQueries()
+{
+    queries.clear();
+}
+
+/*
+ * @method: runQueries
+ * @brief: evaluates every registered query during a single pass over the log file
+ * @input - filePath: file containing the webserver logs to process
+ * @return: returns the ranked "key count" output of each query, indexed as returned by addQuery
+ */
+std::vector <std::vector <std::string>> webServerAnalyser::runQueries( std::string filePath )
+{
+    return resultText( runBatch( { filePath }, queries ) );
+}
+
+/*
+ * @method: runQueries
+ * @brief: evaluates every registered query during a single pass over several log files (ex. rotated logs)
+ *         The files are processed in parallel and their results merged, as if the files had been concatenated
+ * @input - filePaths: files containing the webserver logs to process, see expandInputs for globs and directories
+ * @return: returns the ranked "key count" output of each query, indexed as returned by addQuery
+ */
+std::vector <std::vector <std::string>> webServerAnalyser::runQueries( const std::vector <std::string> &filePaths )
+{
+    return resultText( runBatch( filePaths, queries ) );
+}
+
+/*
+ * @method: runResults
+ * @brief: evaluates every registered query like runQueries, without formatting the results as text
+ * @input - filePaths: files containing the webserver logs to process, see expandInputs for globs and directories
+ * @return: returns the ranked results of each query, indexed as returned by addQuery (see resultWriter to print them)
+ */
+std::vector <queryResult> webServerAnalyser::runResults( const std::vector <std::string> &filePaths )
+{
+    return runBatch( filePaths, queries );
+}
+
+/*
+ * @method: saveQuery
+ * @brief: serializes a query, see loadQuery
+ */
+static void saveQuery( const accessQuery &query, stateWriter &writer )
+{
+    writer.number( static_cast <uint64_t>( query.key ) );
+    writer.text( query.httpMethod );
+    writer.text( query.httpResponse );
+    writer.text( query.minDate );
+    writer.text( query.maxDate );
+    writer.number( static_cast <uint64_t>( query.bucket ) );
+    writer.number( query.splitByKey ? 1 : 0 );
+    writer.number( static_cast <uint64_t>( query.metric ) );
+    query.filter.save( writer );
+}
+
+/*
+ * @method: loadQuery
+ * @brief: restores a query serialized by saveQuery
+ * @return: returns false if the serialized query is malformed
+ */
+static bool loadQuery( stateReader &reader, accessQuery &query )
+{
+    uint64_t key = reader.number();
+    query.httpMethod = reader.text();
+    query.httpResponse = reader.text();
+    query.minDate = reader.text();
+    query.maxDate = reader.text();
+    uint64_t bucket = reader.number();
+    query.splitByKey = reader.number() != 0;
+    uint64_t metric = reader.number();
+    if ( key > static_cast <uint64_t>( queryKey::httpResponse ) || bucket > static_cast <uint64_t>( timeBucket::hour ) ||
+         metric > static_cast <uint64_t>( queryMetric::sizeQuantiles ) )
+    {
+        return false;
+    }
+    query.key = static_cast <queryKey>( key );
+    query.bucket = static_cast <timeBucket>( bucket );
+    query.metric = static_cast <queryMetric>( metric );
+
+    return query.filter.load( reader );
+}
+
+/*
+ * @method: saveState
+ * @brief: evaluates every registered query over the log files like runQueries, but writes the merged partial results
+ *         to a state file instead of ranking them: the queries, then the keys of each query (a dictionary) with their
+ *         counts and first positions, or the buckets of a histogram query (see stateWriter)
+ *         The states of several analysers (ex. one per shard of the logs, see analyserConfig.shards) are combined
+ *         with mergeStates
+ * @input - filePaths: files containing the webserver logs to process, see expandInputs for globs and directories
+ * @input - statePath: path of the state file to write
+ * @return: returns true if the state file was written successfully, false otherwise
+ */
+bool webServerAnalyser::saveState( const std::vector <std::string> &filePaths, const std::string &statePath )
+{
+    if ( config.sampleFraction < 1 )
+    {
+        return false;
+    }
+
+    batchState state;
+    bool summarized = countBatch( filePaths, queries, state );
+    stateWriter querySection, writer;
+
+    // The queries are nested as a single section: merged states must hold the very same bytes
+    querySection.number( queries.size() );
+    for (const auto &query: queries)
+    {
+        saveQuery( query, querySection );
+    }
+    writer.text( querySection.data() );
+    writer.number( state.topKeys );
+    writer.number( summarized ? 1 : 0 );
+    writer.number( state.calendarDates ? 1 : 0 );
+    for (size_t query = 0; query < queries.size(); query++)
+    {
+        if ( queries[query].bucket != timeBucket::none )
+        {
+            state.histograms[0][query].save( writer );
+        }
+        else if ( queries[query].metric != queryMetric::accesses )
+        {
+            state.sketches[0][query].save( writer );
+        }
+        else if ( summarized )
+        {
+            state.topCount[0][query].save( writer );
+        }
+        else if ( state.spills[query] != nullptr && !state.spills[query]->empty() )
+        {
+            if ( !state.spills[query]->save( state.accessCount[0][query], writer ) )
+            {
+                return false;
+            }
+        }
+        else
+        {
+            state.accessCount[0][query].save( writer );
+        }
+    }
+
+    if ( config.collectStats )
+    {
+        collectBatchStats( state, summarized );
+    }
+    return writer.write( statePath );
+}
+
+/*
+ * @method: mergeStates
+ * @brief: combines state files written by saveState into the final ranking of their queries, as if a single analyser had
+ *         counted all their logs: counts are summed and ties are ranked by the earliest first position
+ *         The queries of the state files replace the registered queries (see registeredQueries)
+ * @input - statePaths: state files, written for the same queries and top keys
+ * @output - output: the ranked "key count" output of each query of the state files
+ * @output - error: description of the first state file that could not be merged
+ * @return: returns true if every state file was merged, false otherwise
+ */
+bool webServerAnalyser::mergeStates( const std::vector <std::string> &statePaths, std::vector <std::vector <std::string>> &output, std::string &error )
+{
+    std::vector <queryResult> results;
+
+    if ( !mergeStates( statePaths, results, error ) )
+    {
+        return false;
+    }
+    output = resultText( results );
+
+    return true;
+}
+
+/*
+ * @method: mergeStates
+ * @brief: combines state files written by saveState like mergeStates above, without formatting the results as text
+ * @input - statePaths: state files, written for the same queries and top keys
+ * @output - results: the ranked results of each query of the state files
+ * @output - error: description of the first state file that could not be merged
+ * @return: returns true if every state file was merged, false otherwise
+ */
+bool webServerAnalyser::mergeStates( const std::vector <std::string> &statePaths, std::vector <queryResult> &results, std::string &error )
+{
+    analyserStats *runStats = config.collectStats ? &stats : nullptr;
+    batchState state;
+    std::string firstQueries;
+    bool summarized = false;
+
+    if ( runStats != nullptr )
+    {
+        stats = analyserStats();
+        stats.files = statePaths.size();
+    }
+    if ( statePaths.empty() )
+    {
+        error = "no state file to merge";
+        return false;
+    }
+
+    stageTimer mergeTimer( runStats, STAGE_MERGE );
+    for (size_t file = 0; file < statePaths.size(); file++)
+    {
+        const std::string &statePath = statePaths[file];
+        stateReader reader;
+        if ( !reader.load( statePath, error ) )
+        {
+            return false;
+        }
+
+        // Step 1: the first state file defines the queries, the other ones must have been counted for the same queries
+        std::string_view querySection = reader.text();
+        size_t topKeys = reader.number();
+        bool fileSummarized = reader.number() != 0;
+        bool calendarDates = reader.number() != 0;
+        if ( reader.failed() )
+        {
+            error = statePath + " is malformed";
+            return false;
+        }
+        if ( file == 0 )
+        {
+            stateReader queryReader( querySection );
+            std::vector <accessQuery> batch( queryReader.number() );
+            for (size_t query = 0; query < batch.size() && !queryReader.failed(); query++)
+            {
+                if ( !loadQuery( queryReader, batch[query] ) )
+                {
+                    break;
+                }
+            }
+            if ( queryReader.failed() || !queryReader.atEnd() )
+            {
+                error = statePath + " holds malformed queries";
+                return false;
+            }
+            firstQueries = querySection;
+
+            // A single set of partial results, built like the results of worker 0 (see prepareBatch)
+            state.batch = batch;
+            state.topKeys = topKeys;
+            state.calendarDates = calendarDates;
+            state.accessCount.resize( 1 );
+            state.accessCount[0].resize( batch.size() );
+            state.spills.resize( batch.size() );
+            state.topCount.resize( 1 );
+            state.histograms.resize( 1 );
+            state.sketches.resize( 1 );
+            for (const auto &query: batch)
+            {
+                state.topCount[0].emplace_back( topKeys );
+                state.histograms[0].emplace_back( bucketSeconds( query.bucket ) );
+                state.sketches[0].emplace_back( query.metric );
+            }
+        }
+        else if ( querySection != firstQueries || topKeys != state.topKeys || calendarDates != state.calendarDates )
+        {
+            error = statePath + " was not counted for the same queries, --top and --log-format date times as " + statePaths[0];
+            return false;
+        }
+
+        // Step 2: add the results of each query: exact counts and summaries are kept apart until every file is read
+        for (size_t query = 0; query < state.batch.size(); query++)
+        {
+            bool loaded;
+            if ( state.batch[query].bucket != timeBucket::none )
+            {
+                loaded = state.histograms[0][query].load( reader );
+            }
+            else if ( state.batch[query].metric != queryMetric::accesses )
+            {
+                loaded = state.sketches[0][query].load( reader );
+            }
+            else if ( fileSummarized )
+            {
+                heavyHitters summary( topKeys );
+                loaded = summary.load( reader );
+                state.topCount[0][query].merge( summary );
+            }
+            else
+            {
+                loaded = state.accessCount[0][query].load( reader );
+            }
+            if ( !loaded )
+            {
+                error = statePath + " holds malformed results";
+                return false;
+            }
+        }
+        if ( !reader.atEnd() )
+        {
+            error = statePath + " holds malformed results";
+            return false;
+        }
+        summarized = summarized || fileSummarized;
+    }
+
+    // Step 3: exact counts join the summaries if any state was summarized (ex. a state answered from indexes only)
+    for (size_t query = 0; summarized && query < state.batch.size(); query++)
+    {
+        const keyCounter &exactCount = state.accessCount[0][query];
+        for (size_t id = 0; id < exactCount.size(); id++)
+        {
+            state.topCount[0][query].add( exactCount.key( id ), exactCount.count( id ).count, exactCount.count( id ).firstSeen );
+        }
+    }
+    mergeTimer.stop();
+
+    // Step 4: sort entries based on the # of accesses, most # of entries at the top
+    stageTimer rankTimer( runStats, STAGE_RANK );
+    queries = state.batch;
+    results = rankBatch( state, summarized );
+    rankTimer.stop();
+
+    if ( runStats != nullptr )
+    {
+        collectBatchStats( state, summarized );
+    }
+    return true;
+}
+
+/*
+ * @method: countChunk
+ * @brief: parses complete lines of a pushed chunk in place and counts them in the stream results
+ *         Large chunks are split across the worker threads, smaller ones are counted by the calling thread
+ * @input - lines: complete lines, the last one ending with a newline
+ * @input - position: position of the first line in the stream
+ */
+template <bool collectStats>
+void webServerAnalyser::countChunk( std::string_view lines, uint64_t position )
+{
+    if ( pool.size() > 1 && lines.size() >= config.chunkSize )
+    {
+        scanContents( stream.counts.format, lines, [&]( const webServerLog &parsedLine, uint64_t lineOffset, unsigned int worker )
+        {
+            countRecord <collectStats>( parsedLine, position + lineOffset, worker, stream.counts );
+        } );
+        return;
+    }
+
+    forEachRecord( stream.counts.format, lines, [&]( const webServerLog &parsedLine, uint64_t lineOffset )
+    {
+        countRecord <collectStats>( parsedLine, position + lineOffset, 0, stream.counts );
+    } );
+}
+
+/*
+ * @method: beginStream
+ * @brief: starts a push session evaluating the registered queries (see pushChunk), discarding the previous session
+ */
+void webServerAnalyser::beginStream()
+{
+    prepareBatch( queries, false, stream.counts );
+    stream.carry.clear();
+    stream.carry.reserve( STREAM_CARRY_SIZE );
+    stream.carryPosition = 0;
+    stream.pushed = 0;
+    stream.active = true;
+}
+
+/*
+ * @method: pushChunk
+ * @brief: counts the lines of a chunk of log pushed by the caller (ex. a network buffer), starting a session if needed
+ *         Complete lines are parsed straight from the chunk, only a line split across chunks is copied (into a
+ *         preallocated carry buffer) until the chunk holding its end is pushed
+ * @input - chunk: the next bytes of the log, of any size, lines may be split across chunks
+ *          Note: the chunk only needs to stay valid during the call
+ */
+void webServerAnalyser::pushChunk( std::string_view chunk )
+{
+    if ( !stream.active )
+    {
+        beginStream();
+    }
+    auto count = [&]( std::string_view lines, uint64_t position )
+    {
+        if ( config.collectStats )
+        {
+            countChunk <true>( lines, position );
+        }
+        else
+        {
+            countChunk <false>( lines, position );
+        }
+    };
+
+    // Step 1: complete the line carried over from the previous chunks
+    size_t linesStart = 0;
+    if ( !stream.carry.empty() )
+    {
+        size_t lineEnd = chunk.find( '\n' );
+        if ( lineEnd == std::string_view::npos )
+        {
+            stream.carry.append( chunk );
+            stream.pushed += chunk.size();
+            return;
+        }
+        stream.carry.append( chunk.substr( 0, lineEnd + 1 ) );
+        count( stream.carry, stream.carryPosition );
+        stream.carry.clear();
+        linesStart = lineEnd + 1;
+    }
+
+    // Step 2: count the complete lines in place, carry the unfinished last line over to the next chunk
+    size_t linesEnd = chunk.rfind( '\n' );
+    linesEnd = linesEnd == std::string_view::npos || linesEnd < linesStart ? linesStart : linesEnd + 1;
+    if ( linesEnd > linesStart )
+    {
+        count( chunk.substr( linesStart, linesEnd - linesStart ), stream.pushed + linesStart );
+    }
+    stream.carry.append( chunk.substr( linesEnd ) );
+    stream.carryPosition = stream.pushed + linesEnd;
+    stream.pushed += chunk.size();
+}
+
+/*
+ * @method: streamResults
+ * @brief: provides the results of the lines pushed so far, the line still being carried over is not counted yet
+ * @return: returns the ranked "key count" output of each query, indexed as returned by addQuery
+ */
+std::vector <std::vector <std::string>> webServerAnalyser::streamResults()
+{
+    if ( !stream.active )
+    {
+        beginStream();
+    }
+
+    mergeBatch( stream.counts );
+    if ( config.collectStats )
+    {
+        stats = analyserStats();
+        stats.files = 1;
+        stats.bytes = stream.pushed;
+        collectBatchStats( stream.counts, stream.counts.approximateTop );
+    }
+
+    return resultText( rankBatch( stream.counts, stream.counts.approximateTop ) );
+}
+
+/*
+ * @method: endStream
+ * @brief: ends the push session, counting the last line even without its newline
+ * @return: returns the final ranked "key count" output of each query, indexed as returned by addQuery
+ */
+std::vector <std::vector <std::string>> webServerAnalyser::endStream()
+{
+    if ( stream.active && !stream.carry.empty() )
+    {
+        if ( config.collectStats )
+        {
+            countChunk <true>( stream.carry, stream.carryPosition );
+        }
+        else
+        {
+            countChunk <false>( stream.carry, stream.carryPosition );
+        }
+        stream.carry.clear();
+    }
+    std::vector <std::vector <std::string>> output = streamResults();
+    stream.active = false;
+
+    return output;
+}
+
+/*
+ * @method: followLog
+ * @brief: follows a growing log file (see logFollower) and keeps every registered query counted over a sliding window
+ *         of log time (see slidingWindow): only the appended lines are parsed and expired accesses are subtracted
+ *         The window ends at the latest date time of the log, plus the wall time elapsed since that line was read so
+ *         that the rankings of an idle log keep expiring. Histogram and sketch queries are ranked by their key like the others
+ * @input - filePath: file containing the webserver logs to follow, rotations are followed
+ * @input - follow: window and report options
+ * @input - reportHandler: called every follow.refreshMilliseconds with the packed date time the window ends at and the
+ *          ranked "key count" output of each query (config.topKeys entries at most), returns false to stop following
+ * @return: returns false if the log could not be opened, true once the reportHandler stopped the follow
+ */
+bool webServerAnalyser::followLog( const std::string &filePath, const followConfig &follow,
+                                   const std::function <bool( uint64_t windowEnd, const std::vector <std::vector <std::string>> &output )> &reportHandler )
+{
+    typedef std::chrono::steady_clock clock;
+    logFollower follower( filePath, follow.fromStart );
+    std::vector <slidingWindow> windows;
+    std::vector <dateRange> ranges;
+    std::vector <logFilter> filters;
+    unsigned int columns = COLUMN_DATE; // the window moves with the date times of the log
+    std::string lines;
+    uint64_t linesPosition = 0, latestDate = 0;
+    clock::time_point latestRead = clock::now();
+    clock::time_point nextReport = latestRead + std::chrono::milliseconds( follow.refreshMilliseconds );
+
+    // Step 1: compile the queries once, each one keeps its own window (histogram and sketch queries are counted by key as well)
+    for (const auto &query: queries)
+    {
+        accessQuery keyQuery = query;
+        keyQuery.bucket = timeBucket::none;
+        keyQuery.metric = queryMetric::accesses;
+        ranges.push_back( compileDateTimeRange( query.minDate, query.maxDate ) );
+        filters.push_back( compileQueryFilter( query ) );
+        columns |= queryColumns( keyQuery, filters.back(), ranges.back() );
+        windows.emplace_back( follow.windowSeconds, follow.windowBuckets );
+    }
+
+    logFormat followFormat = config.format.restrict( columns );
+    while ( follower.poll( lines, linesPosition ) )
+    {
+        // Step 2: parse the appended lines only, serially: a poll holds a few milliseconds of log on a live server
+        bool newerDate = false;
+        forEachRecord( followFormat, lines, [&]( const webServerLog &parsedLine, uint64_t lineOffset )
+        {
+            std::string_view key;
+            uint32_t lineDate = parseDate( parsedLine.date );
+            if ( lineDate != INVALID_DATE && lineDate > latestDate )
+            {
+                latestDate = lineDate;
+                newerDate = true;
+            }
+
+            // Step 3: count the accesses that pass the query filters in the window, at the date time of the line
+            // (lines without a valid date time are counted at the end of the window)
+            for (size_t query = 0; query < queries.size(); query++)
+            {
+                if ( selectQueryKey( queries[query], filters[query], ranges[query], parsedLine, lineDate, key ) == FILTER_PASSED )
+                {
+                    windows[query].add( key, lineDate != INVALID_DATE ? lineDate : latestDate, linesPosition + lineOffset );
+                }
+            }
+        } );
+        clock::time_point now = clock::now();
+        latestRead = newerDate ? now : latestRead;
+
+        // Step 4: at each refresh, move the windows up to the current log time and report them
+        if ( now >= nextReport )
+        {
+            uint64_t windowEnd = latestDate + std::chrono::duration_cast <std::chrono::seconds>( now - latestRead ).count();
+            std::vector <std::vector <std::string>> output;
+            for (auto &window: windows)
+            {
+                window.advance( windowEnd );
+                output.push_back( window.rankedOutput( config.topKeys ) );
+            }
+            if ( !reportHandler( windowEnd, output ) )
+            {
+                return true;
+            }
+            nextReport = std::max( nextReport + std::chrono::milliseconds( follow.refreshMilliseconds ), now );
+        }
+
+        // Step 5: wait for more lines, unless a backlog is still being read
+        if ( lines.size() < FOLLOW_POLL_SIZE / 2 )
+        {
+            std::this_thread::sleep_for( std::min <clock::duration>( std::chrono::milliseconds( FOLLOW_POLL_INTERVAL ),
+                                                                     std::max <clock::duration>( nextReport - clock::now(), clock::duration::zero() ) ) );
+        }
+    }
+
+    return false;
+}
+
+/*
+ * @method: expandInputs
+ * @brief: converts input arguments into a list of log files
+ *         ex. "logs/access.log*" -> the matching files, "logs/" -> the files of the directory (sorted by name)
+ * @input - inputs: files, glob patterns or directories
+ * @return: returns the log files in the order of the inputs, index files (INDEX_EXTENSION) are skipped
+ *          Note: an input that does not match anything is kept as is (processed as a missing file)
+ */
+std::vector <std::string> webServerAnalyser::expandInputs( const std::vector <std::string> &inputs )
+{
+    std::vector <std::string> filePaths;
+
+    auto isIndex = []( const std::string &path )
+    {
+        return path.size() > strlen( INDEX_EXTENSION ) && path.compare( path.size() - strlen( INDEX_EXTENSION ), std::string::npos, INDEX_EXTENSION ) == 0;
+    };
+
+    for (const auto &input: inputs)
+    {
+        std::error_code error;
+        std::vector <std::string> matches;
+
+        if ( std::filesystem::is_directory( input, error ) )
+        {
+            for (const auto &entry: std::filesystem::directory_iterator( input, error ))
+            {
+                if ( entry.is_regular_file( error ) )
+                {
+                    matches.push_back( entry.path().string() );
+                }
+            }
+            std::sort( matches.begin(), matches.end() );
+        }
+        else if ( input.find_first_of( "*?[" ) != std::string::npos )
+        {
+            glob_t globResult = {};
+            if ( glob( input.c_str(), 0, nullptr, &globResult ) == 0 )
+            {
+                for (size_t match = 0; match < globResult.gl_pathc; match++)
+                {
+                    matches.push_back( globResult.gl_pathv[match] ); // glob sorts its matches
+                }
+            }
+            globfree( &globResult );
+        }
+
+        if ( matches.empty() )
+        {
+            filePaths.push_back( input );
+            continue;
+        }
+        for (auto &match: matches)
+        {
+            if ( !isIndex( match ) )
+            {
+                filePaths.push_back( std::move( match ) );
+            }
+        }
+    }
+
+    return filePaths;
+}
+
+/*
+ * @method: buildIndex
+ * @brief: parses the log file once and writes its sidecar index (filePath + INDEX_EXTENSION)
+ *         The index holds dictionary-encoded hosts, resources, methods and responses, packed date times and reply sizes,
+ *         later queries on the same unmodified log are answered from the index instead of parsing the text
+ * @input - filePath: file containing the webserver logs to index
+ * @return: returns true if the index was written successfully, false otherwise
+ */
+bool webServerAnalyser::buildIndex( std::string filePath )
+{
+    logIndexWriter indexWriter;
+
+    // Step 1: memory-map the file
+    mappedFile inputFile( filePath );
+    if ( !inputFile.isOpen() )
+    {
+        return false;
+    }
+
+    // Step 2: parse file line by line, in order so that row numbers follow the log
+    // Step 3: append each line to the dictionary-encoded columns
+    bool complete = scanInput( config.format, inputFile.data(), true, [&]( const webServerLog &parsedLine, uint64_t, unsigned int )
+    {
+        appendIndexRow( parsedLine, indexWriter );
+    } );
+
+    // Step 4: write the columns next to the log file
+    return complete && indexWriter.write( filePath + INDEX_EXTENSION, filePath, config.format.fingerprint() );
+}
+
+/*
+ * @method: appendIndexRow
+ * @brief: appends a parsed line to dictionary-encoded columns (see buildIndex)
+ * @input - parsedLine: the parsed webserver log line
+ * @output - columns: the columns of the log
+ */
+void webServerAnalyser::appendIndexRow( const webServerLog &parsedLine, logIndexWriter &columns )
+{
+    std::array <std::string_view, REQUEST_ENTRIES> request = parseHTTPRequest( parsedLine.request );
+    std::string_view keys[INDEX_DICTIONARIES];
+
+    keys[INDEX_HOST] = parsedLine.host;
+    keys[INDEX_RESOURCE] = request[1];
+    keys[INDEX_METHOD] = request[0];
+    keys[INDEX_RESPONSE] = parsedLine.httpResponse;
+
+    columns.appendRow( keys, parseDate( parsedLine.date ), parseSize( parsedLine.retSize ) );
+}
+
+/*
+ * @method: appendResident
+ * @brief: parses the lines appended to a resident log since its last poll into its columns (FOLLOW_POLL_SIZE bytes at most)
+ * @output - log: the resident log, its index is attached to the extended columns
+ * @output - bytesRead: number of bytes of log read
+ * @output - error: why the log cannot be held
+ * @return: returns false if the log is missing or compressed, true otherwise
+ */
+bool webServerAnalyser::appendResident( residentLog &log, size_t &bytesRead, std::string &error )
+{
+    std::string lines;
+    uint64_t linesPosition = 0;
+
+    bytesRead = 0;
+    if ( !log.follower->poll( lines, linesPosition ) )
+    {
+        error = "cannot be opened";
+        return false;
+    }
+    // The follower hands out lines of text: a compressed log cannot be followed
+    if ( linesPosition == 0 && decompressionStream::detect( lines ) != compressionFormat::none )
+    {
+        error = "is compressed, only plain text logs can be held in memory";
+        return false;
+    }
+    bytesRead = lines.size();
+    if ( lines.empty() )
+    {
+        return true;
+    }
+
+    // Queries wait while the columns grow: they may move, and the index is attached to them again
+    std::unique_lock <std::shared_mutex> guard( residentLock );
+    forEachRecord( config.format, lines, [&]( const webServerLog &parsedLine, uint64_t )
+    {
+        appendIndexRow( parsedLine, log.columns );
+    } );
+    log.index.attach( log.columns );
+
+    return true;
+}
+
+/*
+ * @method: loadResident
+ * @brief: parses the log files once into dictionary-encoded columns held in memory (see logIndex::attach): queries
+ *         are then answered from the columns (see queryResident) without reading or parsing the logs again
+ *         The logs stay open, refreshResident appends the lines written to them since (rotations are followed)
+ * @input - filePaths: plain text logs to hold, counted as if they were concatenated in this order
+ * @output - error: description of the first log that could not be loaded
+ * @return: returns true if every log was loaded, false otherwise
+ */
+bool webServerAnalyser::loadResident( const std::vector <std::string> &filePaths, std::string &error )
+{
+    std::vector <std::unique_ptr <residentLog>> logs;
+
+    for (const auto &filePath: filePaths)
+    {
+        // The existing contents are read from the start of the log, FOLLOW_POLL_SIZE bytes at a time
+        size_t bytesRead = 0;
+        std::string logError;
+        logs.push_back( std::make_unique <residentLog>() );
+        logs.back()->follower = std::make_unique <logFollower>( filePath, true );
+        do
+        {
+            if ( !appendResident( *logs.back(), bytesRead, logError ) )
+            {
+                error = filePath + " " + logError;
+                return false;
+            }
+        } while ( bytesRead >= FOLLOW_POLL_SIZE / 2 );
+    }
+
+    std::unique_lock <std::shared_mutex> guard( residentLock );
+    residentLogs = std::move( logs );
+
+    return true;
+}
+
+/*
+ * @method: refreshResident
+ * @brief: appends the lines written to the resident logs since the last load or refresh to their columns
+ *         Queries running on other threads (see queryResident) wait for the append to complete
+ * @return: returns the number of lines appended
+ */
+size_t webServerAnalyser::refreshResident()
+{
+    size_t appended = 0;
+
+    // Only this thread changes the columns: they can be read without the lock
+    for (auto &log: residentLogs)
+    {
+        uint64_t rows = log->index.rows();
+        size_t bytesRead;
+        std::string error;
+        if ( appendResident( *log, bytesRead, error ) )
+        {
+            appended += log->index.rows() - rows;
+        }
+    }
+
+    return appended;
+}
+
+/*
+ * @method: queryResident
+ * @brief: evaluates queries over the columns of the resident logs (see loadResident) like runQueries over the logs
+ *         Can be called from several threads at once, each batch is counted by the calling thread
+ * @input - batch: the queries to evaluate
+ * @input - topKeys: only output the topKeys most accessed keys of each query, 0 outputs every key (counts are exact)
+ * @return: returns the ranked results of each query, in the order of the batch
+ */
+std::vector <queryResult> webServerAnalyser::queryResident( const std::vector <accessQuery> &batch, size_t topKeys )
+{
+    batchState state;
+
+    // Step 1: compile the queries, the columns are counted exactly: no heavy hitters summaries and no spills
+    prepareBatch( batch, false, state );
+    state.topKeys = topKeys;
+    state.approximateTop = false;
+    state.topCount.clear();
+    state.spills.clear();
+    state.spills.resize( batch.size() );
+
+    // Step 2: count the columns of each log, rows are positioned by number so that ties rank like a scan of the logs
+    std::shared_lock <std::shared_mutex> guard( residentLock );
+    for (size_t file = 0; file < residentLogs.size(); file++)
+    {
+        std::vector <timeHistogram> histograms;
+        std::vector <sketchCounter> sketches;
+        std::vector <keyCounter> counts = runIndexedBatch( residentLogs[file]->index, batch, state.ranges, state.filters, state.spills, 0,
+                                                           static_cast <uint64_t>( file ) << FILE_POSITION_BITS, histograms, sketches, nullptr );
+
+        // Step 3: merge the results of each log, as if the logs had been concatenated
+        for (size_t query = 0; query < batch.size(); query++)
+        {
+            if ( batch[query].bucket != timeBucket::none )
+            {
+                state.histograms[0][query].merge( histograms[query] );
+            }
+            else if ( batch[query].metric != queryMetric::accesses )
+            {
+                state.sketches[0][query].merge( sketches[query] );
+            }
+            else
+            {
+                state.accessCount[0][query].merge( counts[query] );
+            }
+        }
+    }
+
+    // Step 4: sort entries based on the # of accesses, most # of entries at the top
+    return rankBatch( state, false );
+}
+
+/*
+ * @method: residentRows
+ * @return: returns the number of log lines held by the resident logs
+ */
+uint64_t webServerAnalyser::residentRows()
+{
+    std::shared_lock <std::shared_mutex> guard( residentLock );
+    uint64_t rows = 0;
+
+    for (const auto &log: residentLogs)
+    {
+        rows += log->index.rows();
+    }
+
+    return rows;
+}
+
+/*
+ * @method: actionQuery
+ * @brief: builds the query of a command line action (ex. "webserver", see logParser --action), without filters
+ * @input - action: webserver, resource, status, traffic, visitors or sizes
+ * @input - bucket: width of the time buckets of traffic
+ * @input - splitBy: host, resource, status or empty: key splitting traffic buckets, or keying visitors and sizes
+ * @output - query: the query of the action
+ * @return: returns false if the action is unknown, true otherwise
+ */
+bool webServerAnalyser::actionQuery( const std::string &action, timeBucket bucket, const std::string &splitBy, accessQuery &query )
+{
+    if ( action == "webserver" )
+    {
+        query.key = queryKey::host;
+    }
+    else if ( action == "resource" )
+    {
+        query.key = queryKey::resource;
+        query.httpMethod = "GET";
+        query.httpResponse = HTTP_OK;
+    }
+    else if ( action == "status" )
+    {
+        query.key = queryKey::httpResponse;
+    }
+    else if ( action == "traffic" )
+    {
+        query.bucket = bucket;
+        query.splitByKey = !splitBy.empty();
+        query.key = splitBy == "resource" ? queryKey::resource : splitBy == "status" ? queryKey::httpResponse : queryKey::host;
+    }
+    else if ( action == "visitors" || action == "sizes" )
+    {
+        query.metric = action == "visitors" ? queryMetric::distinctHosts : queryMetric::sizeQuantiles;
+        query.key = splitBy == "host" ? queryKey::host : splitBy == "status" ? queryKey::httpResponse : queryKey::resource;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * @method: actionName
+ * @return: returns the action a query was built for (see actionQuery)
+ */
+std::string webServerAnalyser::actionName( const accessQuery &query )
+{
+    if ( query.bucket != timeBucket::none )
+    {
+        return "traffic";
+    }
+    if ( query.metric != queryMetric::accesses )
+    {
+        return query.metric == queryMetric::distinctHosts ? "visitors" : "sizes";
+    }
+    return query.key == queryKey::host ? "webserver" : query.key == queryKey::resource ? "resource" : "status";
 }
@@ -1,85 +1,660 @@
+#pragma once
+
 #include <iostream>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
 #include <vector>
 #include <string>
+#include <string_view>
+
+#include "workerPool.h"
+#include "logIndex.h"
+#include "logTokenizer.h"
+#include "analyserStats.h"
+#include "timeHistogram.h"
+#include "keyCounter.h"
+#include "heavyHitters.h"
+#include "logFilter.h"
+#include "logFormat.h"
+#include "stateFile.h"
+#include "keySpill.h"
+#include "keySketch.h"
+#include "readBackend.h"
+#include "logFollower.h"
+#include "queryResult.h"
 
 #define HTTP_OK "200"
 
-#define MAX_COLUMNS 5 // number of entries within the webServerLog
-#define REQUEST_INDEX 3
 /*
  * @struct: webServerLog
  * @brief: stores the components of the webserver logs
+ *         Members are views into the parsed line (ex. into the memory-mapped log file), no data is copied
+ *         Members that the log format does not hold, or that no query of the run needs, are left empty (see logFormat)
  * @member - host: hostname / IP address of the host making the request
- * @member - date: date time in [DD:HH:MM:SS] format
+ * @member - date: date time in [DD:HH:MM:SS] format, or [DD/Mon/YYYY:HH:MM:SS +ZZZZ] (Common Log Format)
  * @member - request: request URI
  * @member - httpResponse: HTTP reply code
  * @member - retSize: number of bytes in the reply
  */
 typedef struct webServerLog
 {
-    std::string host;
-    std::string date;
-    std::string request; // REQUEST_INDEX offset
-    std::string httpResponse;
-    std::string retSize;
+    std::string_view host;
+    std::string_view date;
+    std::string_view request;
+    std::string_view httpResponse;
+    std::string_view retSize;
 } webServerLog;
 
 #define DATE_ENTRIES 4 // number of entries within webServerLog.date
+#define INVALID_DATE UINT32_MAX // packed date of a date time that could not be parsed
 #define REQUEST_ENTRIES 3 // number of entries within webServerLog.request
 
+/*
+ * @enum: queryKey
+ * @brief: column of the webServerLog that a query counts accesses by
+ */
+enum class queryKey
+{
+    host,        // webServerLog.host
+    resource,    // URI of webServerLog.request
+    httpResponse // webServerLog.httpResponse
+};
+
+/*
+ * @enum: timeBucket
+ * @brief: width of the time buckets of a traffic histogram query
+ */
+enum class timeBucket
+{
+    none,   // not a histogram: count accesses per key
+    second,
+    minute,
+    hour
+};
+
+/*
+ * @struct: accessQuery
+ * @brief: one aggregation evaluated during a batch scan (see webServerAnalyser::addQuery)
+ * @member - key: the column that accesses are counted by
+ * @member - httpMethod: only count requests using this HTTP method (blank: any method)
+ * @member - httpResponse: only count requests answered with this HTTP response (blank: any response)
+ * @member - minDate: minimum date time used to filter the webserver logs
+ * @member - maxDate: maximum date time used to filter the webserver logs
+ *           Note: both minDate and maxDate are optional, see hostAccesses
+ * @member - bucket: count requests and reply bytes per time bucket instead of accesses per key (see timeHistogram)
+ * @member - splitByKey: with bucket, split the traffic of each time bucket by the query key
+ * @member - filter: further predicates on the columns of the line (see logFilter::compile), combined with the filters above
+ * @member - metric: without bucket, what is aggregated per key: accesses, or a sketch of the hosts or reply sizes (see sketchCounter)
+ */
+typedef struct accessQuery
+{
+    queryKey key = queryKey::host;
+    std::string httpMethod;
+    std::string httpResponse;
+    std::string minDate;
+    std::string maxDate;
+    timeBucket bucket = timeBucket::none;
+    bool splitByKey = false;
+    logFilter filter;
+    queryMetric metric = queryMetric::accesses;
+} accessQuery;
+
+/*
+ * @struct: dateRange
+ * @brief: date time range used to filter the webserver logs, compiled once into packed dates (see parseDate)
+ * @member - filtered: false if the range does not filter anything
+ * @member - minDate: packed minimum date time (inclusive)
+ * @member - maxDate: packed maximum date time (inclusive)
+ */
+typedef struct dateRange
+{
+    bool filtered = false;
+    uint32_t minDate = 0;
+    uint32_t maxDate = INVALID_DATE - 1;
+} dateRange;
+
+#define DEFAULT_CHUNK_SIZE ( 4 << 20 ) // bytes of log handed to a worker thread at a time
+#define DATE_SEARCH_LINEAR_SIZE 4096 // bytes below which findDateOffset stops bisecting and scans lines
+#define FILE_POSITION_BITS 40 // position of a line of a multi-file run: (file number << FILE_POSITION_BITS) + offset in the file
+#define STREAM_CARRY_SIZE ( 64 << 10 ) // bytes preallocated for a line split across pushed chunks (see pushChunk)
+#define SAMPLE_BLOCK_BITS 16 // sampled runs read blocks of 1 << SAMPLE_BLOCK_BITS bytes of each log (see analyserConfig.sampleFraction)
+#define SAMPLE_CONFIDENCE_Z 1.96 // normal quantile of the error margins of sampled counts: 95% confidence intervals
+
+#define DEFAULT_FOLLOW_WINDOW 300 // seconds of log time counted by a follow
+#define DEFAULT_FOLLOW_BUCKETS 60 // slices of the follow window, the window moves one slice at a time
+#define DEFAULT_FOLLOW_REFRESH 5000 // milliseconds between two reports of a follow
+#define FOLLOW_POLL_INTERVAL 200 // milliseconds between two reads of a followed log
+
+/*
+ * @struct: followConfig
+ * @brief: options of webServerAnalyser::followLog
+ * @member - windowSeconds: the rankings count the accesses of the last windowSeconds of log time
+ * @member - windowBuckets: number of slices of the window, expired one at a time as the log moves forward
+ * @member - refreshMilliseconds: interval between two reports of the rankings
+ * @member - fromStart: count the existing contents of the log first instead of only the lines appended from now on
+ */
+typedef struct followConfig
+{
+    uint32_t windowSeconds = DEFAULT_FOLLOW_WINDOW;
+    uint32_t windowBuckets = DEFAULT_FOLLOW_BUCKETS;
+    unsigned int refreshMilliseconds = DEFAULT_FOLLOW_REFRESH;
+    bool fromStart = false;
+} followConfig;
+
+/*
+ * @struct: analyserConfig
+ * @brief: tuning options of the webServerAnalyser, the defaults reproduce a serial scan
+ * @member - threads: number of worker threads scanning a log file, 0 selects the number of hardware threads
+ * @member - chunkSize: approximate number of bytes of log per worker task (chunks are aligned to newlines)
+ * @member - timeOrdered: the logs are sorted by date time, date time filtered scans binary search the start of
+ *           the range and stop at its end instead of reading the whole file
+ * @member - useIndex: answer queries from the sidecar index of the log (see buildIndex) when it exists and is fresh
+ * @member - topKeys: only output the topKeys most accessed keys of each query, 0 outputs every key
+ * @member - exactTop: with topKeys, count every key exactly instead of using a fixed memory heavy hitters summary
+ *           (summary counts are estimates, reported with their error bound)
+ * @member - collectStats: time the stages of each run and count lines, rejections and keys (see lastStats)
+ *           When disabled, the scan is compiled without any instrumentation
+ * @member - format: layout of the log lines (see logFormat::compile), this tool's format by default
+ * @member - shard: with shards, the part of the logs counted by this analyser, from 0 to shards - 1
+ * @member - shards: number of analysers sharing the logs (ex. one process per node), each plain text log is split into
+ *           shards newline aligned parts, compressed logs are assigned whole (file number modulo shards)
+ *           Sharded runs do not use indexes: the parts of a log do not depend on which nodes have its index
+ *           Lines keep their position in the whole logs so that merged states rank ties like a single run (see saveState)
+ * @member - memoryLimit: bytes the exact key counts may hold in memory, 0 for no limit; over it, the counts of a worker are
+ *           spilled to a temporary file and merged back when ranking (see keySpill), results are unchanged
+ *           Sampled runs do not apply it: their estimates need the block spread of every key, kept in memory (see blockSpread)
+ * @member - spillDirectory: directory of the spill files, the system temporary directory if empty
+ * @member - sampleFraction: fraction of the plain text logs read, from 0 to 1 (1 reads everything)
+ *           Below 1, each block of 1 << SAMPLE_BLOCK_BITS bytes is read with this probability and the blocks left out are never
+ *           read from disk; the counts of the exact access queries are scaled up and output with their error margin
+ *           ("key estimate (error +/- margin)"), indexes are not used and the other queries only count the lines read
+ * @member - sampleSeed: seed of the selection of the sampled blocks, the same seed reads the same blocks
+ * @member - input: how plain text logs are read: parsed straight from the memory mapping, or read ahead in large buffers
+ *           by a reader thread per log (pread, or io_uring with readDepth reads in flight), see readStream
+ *           The mapping is still used to find the boundaries of the scanned ranges; sampled runs always read the mapping
+ * @member - readDepth: number of READ_BUFFER_SIZE reads kept in flight per log by the read ahead backends
+ * @member - directIO: the read ahead backends open the logs with O_DIRECT, bypassing the page cache (ex. logs larger than memory)
+ */
+typedef struct analyserConfig
+{
+    unsigned int threads = 1;
+    size_t chunkSize = DEFAULT_CHUNK_SIZE;
+    bool timeOrdered = false;
+    bool useIndex = true;
+    size_t topKeys = 0;
+    bool exactTop = false;
+    bool collectStats = false;
+    logFormat format;
+    unsigned int shard = 0;
+    unsigned int shards = 1;
+    size_t memoryLimit = 0;
+    std::string spillDirectory;
+    double sampleFraction = 1;
+    uint64_t sampleSeed = 0;
+    inputBackend input = inputBackend::mmap;
+    unsigned int readDepth = DEFAULT_READ_DEPTH;
+    bool directIO = false;
+} analyserConfig;
+
 class webServerAnalyser
 {
     private:
+        analyserConfig config;
+        workerPool pool;
+        std::vector <accessQuery> queries; // registered with addQuery, evaluated by runQueries
+        analyserStats stats; // instrumentation of the last run, only filled when config.collectStats is set
+
        /*
-        * @method: parseDate
-        * @brief: converts a date time into a vector format
-        *         ex. "[29:23:54:18] -> [29] [23] [54] [18]
-        * @input - request: the date time to be converted
-        * @return: returns the vector form of the date time, split using the ":" delimiter
+        * @struct: workerStats
+        * @brief: instrumentation counters of a worker thread, padded so that workers do not share cache lines
+        */
+        struct alignas( 64 ) workerStats
+        {
+            uint64_t lines = 0;
+            std::vector <queryStats> queries;
+        };
+
+       /*
+        * @struct: blockSpread
+        * @brief: how the accesses of a key of a sampled run are spread across the sampled blocks, from which the variance
+        *         of its scaled count is estimated (the blocks are the sampling units)
+        * @member - block: the block being counted (position >> SAMPLE_BLOCK_BITS)
+        * @member - blockCount: accesses of the key within that block
+        * @member - squares: sum of the squared accesses of the key within each of the blocks counted before
+        */
+        struct blockSpread
+        {
+            uint64_t block = UINT64_MAX;
+            uint64_t blockCount = 0;
+            uint64_t squares = 0;
+        };
+
+       /*
+        * @struct: batchState
+        * @brief: a compiled batch of queries and its partial results, kept per worker thread so that workers share nothing
+        * @member - batch: the queries to evaluate
+        * @member - ranges: the packed date time range of each query
+        * @member - filters: the compiled predicates of each query (see compileQueryFilter)
+        * @member - format: the log format restricted to the columns the queries need (see queryColumns)
+        * @member - scannedRange: union of the query ranges
+        * @member - anyDateFilter: a query filters on date times (range or predicate)
+        * @member - anyHistogram: a query counts traffic per time bucket
+        * @member - calendarDates: the date times of the logs are calendar dates (see logFormat::calendarDates)
+        * @member - topKeys: number of top keys of each query (see analyserConfig.topKeys)
+        * @member - approximateTop: heavy hitters summaries (topCount) replace the exact counters (accessCount)
+        * @member - sampled: only sampled blocks of the logs are counted (see analyserConfig.sampleFraction)
+        * @member - accessCount: exact counts, indexed [worker][query]
+        * @member - spills: exact counts spilled to disk, indexed [query], only with config.memoryLimit (null for the others)
+        * @member - spillBudget: bytes a keyCounter of accessCount may hold before it is spilled, 0 for no limit
+        * @member - topCount: top keys summaries, indexed [worker][query]
+        * @member - histograms: traffic histograms, indexed [worker][query]
+        * @member - sketches: distinct hosts or reply size sketches per key, indexed [worker][query]
+        * @member - spreads: block spread of the exact counts of a sampled run, indexed [worker][query][key ID of accessCount]
+        * @member - workerCounters: instrumentation counters of each worker, only when config.collectStats is set
         */
-        std::vector <int> parseDate( std::string date );
+        typedef struct batchState
+        {
+            std::vector <accessQuery> batch;
+            std::vector <dateRange> ranges;
+            std::vector <logFilter> filters;
+            logFormat format;
+            dateRange scannedRange;
+            bool anyDateFilter = false;
+            bool anyHistogram = false;
+            bool calendarDates = false;
+            size_t topKeys = 0;
+            bool approximateTop = false;
+            bool sampled = false;
+            std::vector <std::vector <keyCounter>> accessCount;
+            std::vector <std::unique_ptr <keySpill>> spills;
+            size_t spillBudget = 0;
+            std::vector <std::vector <heavyHitters>> topCount;
+            std::vector <std::vector <timeHistogram>> histograms;
+            std::vector <std::vector <sketchCounter>> sketches;
+            std::vector <std::vector <std::vector <blockSpread>>> spreads;
+            std::vector <workerStats> workerCounters;
+        } batchState;
+
+       /*
+        * @struct: streamState
+        * @brief: a push session (see pushChunk)
+        * @member - counts: the registered queries and their partial results
+        * @member - carry: start of a line split across pushed chunks
+        * @member - carryPosition: position of the carry in the stream
+        * @member - pushed: number of bytes pushed since the start of the session
+        * @member - active: a session is started
+        */
+        typedef struct streamState
+        {
+            batchState counts;
+            std::string carry;
+            uint64_t carryPosition = 0;
+            uint64_t pushed = 0;
+            bool active = false;
+        } streamState;
+
+        streamState stream;
+
+       /*
+        * @struct: residentLog
+        * @brief: a log held in memory by a resident analyser (see loadResident), as dictionary-encoded columns
+        * @member - follower: reads the log from its start, then the lines appended to it (rotations are followed)
+        * @member - columns: the parsed lines
+        * @member - index: view of the columns queried by queryResident, attached again after each append
+        */
+        struct residentLog
+        {
+            std::unique_ptr <logFollower> follower;
+            logIndexWriter columns;
+            logIndex index;
+        };
+
+        std::vector <std::unique_ptr <residentLog>> residentLogs;
+        std::shared_mutex residentLock; // appends are exclusive, queries are shared
+
+       /*
+        * @method: appendIndexRow
+        * @brief: appends a parsed line to dictionary-encoded columns (see buildIndex)
+        * @input - parsedLine: the parsed webserver log line
+        * @output - columns: the columns of the log
+        */
+        static void appendIndexRow( const webServerLog &parsedLine, logIndexWriter &columns );
+
+       /*
+        * @method: appendResident
+        * @brief: parses the lines appended to a resident log since its last poll into its columns (FOLLOW_POLL_SIZE bytes at most)
+        * @output - log: the resident log, its index is attached to the extended columns
+        * @output - bytesRead: number of bytes of log read
+        * @output - error: why the log cannot be held
+        * @return: returns false if the log is missing or compressed, true otherwise
+        */
+        bool appendResident( residentLog &log, size_t &bytesRead, std::string &error );
+
+       /*
+        * @method: shardBoundaries
+        * @brief: cuts the log contents into equal parts, moving each cut forward to the start of the next line
+        * @input - contents: the webserver log contents
+        * @input - shards: number of parts
+        * @return: returns the start of each part followed by contents.size() (shards + 1 offsets, parts may be empty)
+        */
+        static std::vector <size_t> shardBoundaries( std::string_view contents, unsigned int shards );
+
+       /*
+        * @method: scanContents
+        * @brief: splits the log contents into newline aligned chunks and parses them on the worker pool
+        * @input - format: the log format to parse the lines with
+        * @input - contents: the webserver log contents (ex. a memory-mapped file)
+        * @input - recordHandler: called with each parsed non-empty line, the byte offset of the line and the index of the worker
+        *          Note: recordHandler is called concurrently by different workers, state must be kept per worker
+        */
+        template <typename RecordHandler>
+        void scanContents( const logFormat &format, std::string_view contents, RecordHandler &&recordHandler );
+
+       /*
+        * @method: scanFiles
+        * @brief: parses the contents of several log files on the worker pool
+        *         Plain text logs are split into newline aligned chunks, compressed logs are decompressed on the fly by one stream per
+        *         log shared by its consumer tasks; the tasks of every file are handed out from a single queue so that small and
+        *         large files balance out between the workers
+        *         Plain text logs read through a read ahead backend are streamed like compressed logs (see readStream)
+        *         Sampled runs only parse the lines of the sampled blocks (see sampleBoundaries)
+        * @input - format: the log format to parse the lines with
+        * @input - contents: the contents of each log file (ex. memory-mapped files), empty for files that must not be parsed
+        * @input - fileStarts: offset of the contents of each file in the whole file (ex. the start of a shard)
+        * @input - streamPaths: path of the plain text files read through config.input instead of their contents, empty for the others
+        * @input - recordHandler: called with each parsed non-empty line, the number of its file, the byte offset of the line
+        *          (in the decompressed contents) and the index of the worker
+        * @return: returns the numbers of the streamed files that could not be decompressed or read entirely
+        */
+        template <typename RecordHandler>
+        std::vector <size_t> scanFiles( const logFormat &format, const std::vector <std::string_view> &contents, const std::vector <size_t> &fileStarts,
+                                        const std::vector <std::string> &streamPaths, RecordHandler &&recordHandler );
+
+       /*
+        * @method: chunkBoundaries
+        * @brief: cuts the log contents every chunkSize bytes, moving each cut forward to the start of the next line
+        * @input - contents: the webserver log contents
+        * @input - chunkSize: approximate number of bytes per chunk
+        * @return: returns the start of each chunk followed by contents.size()
+        */
+        static std::vector <size_t> chunkBoundaries( std::string_view contents, size_t chunkSize );
+
+       /*
+        * @method: sampledBlock
+        * @brief: draws whether a block of a log is read by a sampled run, from a hash of the seed, the file and the block
+        * @input - file: number of the log file
+        * @input - block: number of the block in the whole file (offset >> SAMPLE_BLOCK_BITS)
+        * @return: returns true with probability config.sampleFraction, always the same answer for the same block
+        */
+        bool sampledBlock( size_t file, uint64_t block ) const;
+
+       /*
+        * @method: sampleBoundaries
+        * @brief: finds the lines of the contents that belong to a sampled block, a line belongs to the block it starts in
+        * @input - contents: the webserver log contents
+        * @input - contentsStart: offset of the contents in the whole file, blocks are aligned on the whole file
+        * @input - file: number of the log file
+        * @return: returns the start and end of the lines of each sampled block, flattened ({ start, end, start, end, ... })
+        */
+        std::vector <size_t> sampleBoundaries( std::string_view contents, uint64_t contentsStart, size_t file ) const;
+
+       /*
+        * @method: scanInput
+        * @brief: parses the contents of a log file on the worker pool, decompressing it on the fly if it is compressed
+        *         Compressed logs are decompressed by a dedicated thread while the workers parse the decompressed chunks
+        * @input - format: the log format to parse the lines with
+        * @input - contents: the contents of the log file (ex. a memory-mapped file), plain text or compressed
+        * @input - inOrder: the records must be handed out in file order (a single worker parses every chunk)
+        * @input - recordHandler: called with each parsed non-empty line, the byte offset of the line (in the decompressed log)
+        *          and the index of the worker
+        * @return: returns false if the log is compressed and could not be decompressed entirely, true otherwise
+        */
+        template <typename RecordHandler>
+        bool scanInput( const logFormat &format, std::string_view contents, bool inOrder, RecordHandler &&recordHandler );
+
+       /*
+        * @method: forEachRecord
+        * @brief: splits the provided log contents into lines and parses them, without copying them
+        * @input - format: the log format to parse the lines with
+        * @input - contents: the webserver log contents (ex. a memory-mapped file)
+        * @input - recordHandler: called with each parsed non-empty line and the byte offset of the line in contents
+        */
+        template <typename RecordHandler>
+        static void forEachRecord( const logFormat &format, std::string_view contents, RecordHandler &&recordHandler );
 
        /*
         * @method: parseHTTPRequest
         * @brief: converts an HTTP request at column #3 into a vector format
         *         ex. "GET /Software.html HTTP/1.0" -> ["GET"] ["/Software.html"] ["HTTP/1.0"]
         * @input - request: the HTTP request to be converted
-        * @return: returns the vector form of the HTTP request, split using the " " delimiter
+        * @return: returns the array form of the HTTP request, split using the " " delimiter
         */
-        std::vector <std::string> parseHTTPRequest( std::string request );
+        static std::array <std::string_view, REQUEST_ENTRIES> parseHTTPRequest( std::string_view request );
 
        /*
-        * @method: verifyDateTimeRange
-        * @brief: verifies that the provided inputDate ranges between the minDate and the maxDate
-        * @input - inputDate: the date time to be compared
+        * @method: parseSize
+        * @brief: converts the number of bytes in the reply into an integer
+        * @input - retSize: the reply size column, "-" when no body was sent
+        * @return: returns the number of bytes in the reply, 0 if the column is not a number
+        */
+        static uint64_t parseSize( std::string_view retSize );
+
+       /*
+        * @method: compileDateTimeRange
+        * @brief: converts the minDate and maxDate of a query into a packed dateRange, once per scan
         * @input - minDate: the date time located at the minimum range of comparison
         * @input - maxDate: the date time located at the maximum range of comparison
+        * @return: returns the packed range, not filtered if minDate or maxDate are not populated or malformed
+        */
+        static dateRange compileDateTimeRange( const std::string &minDate, const std::string &maxDate );
+
+       /*
+        * @method: verifyDateTimeRange
+        * @brief: verifies that the provided inputDate ranges between the minimum and the maximum of the range (inclusive)
+        * @input - inputDate: the packed date time to be compared
+        * @input - range: the packed date time range of comparison
         * @return: returns true if the provided input date time is between the minimum and maximum input ranges, false otherwise
-        *          returns true if minDate or maxDate are not populated (not used to filter the input date time)
+        *          returns true if the range is not filtered
+        */
+        static bool verifyDateTimeRange( uint32_t inputDate, const dateRange &range )
+        {
+            return !range.filtered || ( inputDate >= range.minDate && inputDate <= range.maxDate );
+        }
+
+       /*
+        * @method: findDateOffset
+        * @brief: binary searches time ordered log contents for the first line dated at or after the provided date
+        * @input - format: the log format to parse the lines with
+        * @input - contents: the webserver log contents, lines must be sorted by date time
+        * @input - date: the packed date time to look for
+        * @return: returns the byte offset of the first line with a date time >= date, contents.size() if there is none
+        */
+        static size_t findDateOffset( const logFormat &format, std::string_view contents, uint32_t date );
+
+       /*
+        * @method: compileQueryFilter
+        * @brief: combines the HTTP method and response of a query with its filter expression into a single predicate chain
+        * @input - query: the query to compile
+        * @return: returns the predicates of the query, in evaluation order
+        */
+        static logFilter compileQueryFilter( const accessQuery &query );
+
+       /*
+        * @method: queryColumns
+        * @brief: lists the columns of the log lines that a query reads: its key, its filters, the date time and size of histograms
+        * @input - query: the query
+        * @input - filter: the compiled predicates of the query (see compileQueryFilter)
+        * @input - range: the packed date time range of the query
+        * @return: returns the combination of logColumn flags read by the query
+        */
+        static unsigned int queryColumns( const accessQuery &query, const logFilter &filter, const dateRange &range );
+
+       /*
+        * @method: selectQueryKey
+        * @brief: applies the filters of a query to a webServerLog and extracts the key to count
+        *         The columns tested by the filter are only extracted (request split, size converted) when a predicate needs them
+        * @input - query: the query to evaluate
+        * @input - filter: the compiled predicates of the query (see compileQueryFilter)
+        * @input - range: the packed date time range of the query (see compileDateTimeRange)
+        * @input - inputEntry: the parsed webserver log line
+        * @input - inputDate: the packed date time of the inputEntry (only parsed if a query filters on date times)
+        * @output - key: the value of the query key column (view into the inputEntry)
+        * @return: returns FILTER_PASSED if the entry passes the query filters and must be counted,
+        *          the first predicate rejecting the entry otherwise (see queryFilter)
+        */
+        static queryFilter selectQueryKey( const accessQuery &query, const logFilter &filter, const dateRange &range, const webServerLog &inputEntry,
+                                           uint32_t inputDate, std::string_view &key );
+
+       /*
+        * @method: prepareBatch
+        * @brief: compiles a batch of queries and builds the empty partial results of every worker
+        * @input - batch: the queries to evaluate
+        * @input - sampled: only sampled blocks of the logs will be counted (see analyserConfig.sampleFraction)
+        * @output - state: the compiled queries and their partial results
+        */
+        void prepareBatch( const std::vector <accessQuery> &batch, bool sampled, batchState &state );
+
+       /*
+        * @method: countRecord
+        * @brief: evaluates every query of a batch against a parsed line and counts it in the partial results of the worker
+        *         Instantiated with and without instrumentation, a run without stats pays nothing for it
+        * @input - parsedLine: the parsed webserver log line
+        * @input - position: position of the line in the input (see FILE_POSITION_BITS), orders keys with the same count
+        * @input - worker: index of the worker counting the line
+        * @output - state: the partial results of the worker
+        */
+        template <bool collectStats>
+        void countRecord( const webServerLog &parsedLine, uint64_t position, unsigned int worker, batchState &state );
+
+       /*
+        * @method: mergeBatch
+        * @brief: merges the partial results of every worker into the results of worker 0, the other workers start over empty
+        *         Keys are ordered by their first position: the merge order does not matter
+        * @output - state: the partial results to merge
+        */
+        void mergeBatch( batchState &state );
+
+       /*
+        * @method: rankBatch
+        * @brief: sorts the merged results of each query, most # of accesses at the top (see mergeBatch)
+        * @input - state: the merged results
+        * @input - summarized: the top keys are ranked from the heavy hitters summaries, not from the exact counters
+        * @return: returns the ranked results of each query (time buckets of a histogram query), in the order of the batch
+        */
+        std::vector <queryResult> rankBatch( const batchState &state, bool summarized ) const;
+
+       /*
+        * @method: sampledResult
+        * @brief: scales the counts of a sampled run up to the whole logs, with the margin of their 95% confidence interval
+        * @input - counter: the merged exact counts of the sampled blocks
+        * @input - spreads: the block spread of each key of counter (see blockSpread)
+        * @input - limit: maximum number of entries to output, 0 outputs every key
+        * @return: returns the keys, their estimates and margins in ranked order (resultKind::sampledCounts)
+        */
+        queryResult sampledResult( const keyCounter &counter, const std::vector <blockSpread> &spreads, size_t limit ) const;
+
+       /*
+        * @method: resultText
+        * @brief: formats the results of each query as logParser prints them (see queryResult::text)
+        * @input - results: the ranked results of each query
+        * @return: returns the lines of each query, in the order of results
+        */
+        static std::vector <std::vector <std::string>> resultText( const std::vector <queryResult> &results );
+
+       /*
+        * @method: collectBatchStats
+        * @brief: sums the instrumentation counters of the workers into the stats of the run and measures the merged results
+        * @input - state: the merged results (see mergeBatch)
+        * @input - summarized: the top keys are ranked from the heavy hitters summaries, not from the exact counters
         */
-        bool verifyDateTimeRange( std::string inputDate, std::string minDate, std::string maxDate );
+        void collectBatchStats( const batchState &state, bool summarized );
 
        /*
-        * @method: verifyHTTPRequest
-        * @brief: verifies the request member of the webServerLog with the filtered inputs and extracts the requested resource
-        * @input - inputEntry: the webServerLog struct that contains the request to be verified
-        * @input - filteredHTTPMethod: the HTTP method to compare against in the request
-        * @input - filteredHTTPResponse: the HTTP response to compare against in the request
-        * @output - resource: the resource that is being accessed in the URI
-        * @return: returns true if the request member has been verified with the expected filtered inputs, false otherwise
+        * @method: countChunk
+        * @brief: parses complete lines of a pushed chunk in place and counts them in the stream results
+        *         Large chunks are split across the worker threads, smaller ones are counted by the calling thread
+        * @input - lines: complete lines, the last one ending with a newline
+        * @input - position: position of the first line in the stream
         */
-        bool verifyHTTPRequest( webServerLog inputEntry, std::string filteredHTTPMethod, std::string filteredHTTPResponse, std::string &resource );
+        template <bool collectStats>
+        void countChunk( std::string_view lines, uint64_t position );
+
+       /*
+        * @method: countBatch
+        * @brief: evaluates all the provided queries during a single pass over the log files, up to the merged partial results
+        *         With config.shards, only the part of the logs assigned to config.shard is counted
+        * @input - filePaths: files containing the webserver logs to process, counted as if they were concatenated in this order
+        * @input - batch: the queries to evaluate
+        * @output - state: the merged results of every query (see mergeBatch)
+        * @return: returns true if the top keys are summarized (heavy hitters) rather than counted exactly
+        */
+        bool countBatch( const std::vector <std::string> &filePaths, const std::vector <accessQuery> &batch, batchState &state );
+
+       /*
+        * @method: runBatch
+        * @brief: evaluates all the provided queries during a single pass over the log files
+        * @input - filePaths: files containing the webserver logs to process, counted as if they were concatenated in this order
+        * @input - batch: the queries to evaluate
+        * @return: returns the ranked results of each query, in the order of the batch
+        *          (the time buckets of a histogram query, see timeHistogram::result)
+        */
+        std::vector <queryResult> runBatch( const std::vector <std::string> &filePaths, const std::vector <accessQuery> &batch );
+
+       /*
+        * @method: runIndexedBatch
+        * @brief: evaluates all the provided queries over the columns of a log index instead of the log text
+        * @input - index: the loaded index of the log file
+        * @input - batch: the queries to evaluate
+        * @input - ranges: the packed date time range of each query
+        * @input - filters: the compiled predicates of each query, dictionary columns are tested once per dictionary entry
+        * @input - spills: where the exact counts of each query are spilled over spillBudget (see batchState.spills)
+        * @input - spillBudget: bytes the exact counts of a query may hold before they are spilled, 0 for no limit
+        * @input - positionBase: position of the first row of the index (see FILE_POSITION_BITS), rows are positioned by number
+        * @output - histograms: the traffic histogram of each query, only updated for histogram queries
+        * @output - sketches: the sketches per key of each query, only updated for sketch queries (see accessQuery.metric)
+        * @output - queryCounters: the rejection counters of each query, updated when not nullptr
+        * @return: returns the exact counts of each query not spilled yet, in the order of the batch (empty for histogram and
+        *         sketch queries)
+        */
+        std::vector <keyCounter> runIndexedBatch( const logIndex &index, const std::vector <accessQuery> &batch, const std::vector <dateRange> &ranges,
+                                                  const std::vector <logFilter> &filters, const std::vector <std::unique_ptr <keySpill>> &spills,
+                                                  size_t spillBudget, uint64_t positionBase, std::vector <timeHistogram> &histograms,
+                                                  std::vector <sketchCounter> &sketches, std::vector <queryStats> *queryCounters );
+
+       /*
+        * @method: bucketSeconds
+        * @return: returns the width in seconds of the provided time bucket, 0 for timeBucket::none
+        */
+        static uint32_t bucketSeconds( timeBucket bucket );
+
+       /*
+        * @method: parseRecord
+        * @brief: converts the line starting at lineStart into a webServerLog structure format, using the structural characters
+        *         found by the tokenizer instead of searching the delimiters byte by byte
+        * @input - format: the log format to parse the lines with
+        * @input - contents: the webserver log contents the tokenizer was built on
+        * @input - tokens: the tokenizer of the contents
+        * @input - lineStart: offset of the first character of the line
+        * @output - outputLine: the corresponding webServerLog structure, members point into the contents
+        * @return: returns the offset of the newline ending the line, contents.size() for the last line without a newline
+        */
+        static size_t parseRecord( const logFormat &format, std::string_view contents, logTokenizer &tokens, size_t lineStart, webServerLog &outputLine );
 
        /*
         * @method: parseLine
         * @brief: converts a line of the webserver logs into a webServerLog structure format
+        * @input - format: the log format to parse the lines with
         * @input - line: the webserver log line to be converted
-        * @return: returns the corresponding webServerLog structure from the line input
+        * @return: returns the corresponding webServerLog structure from the line input, members point into the line
         */
-        webServerLog parseLine( std::string line );
+        static webServerLog parseLine( const logFormat &format, std::string_view line );
 
     public:
-        webServerAnalyser() = default;
+        webServerAnalyser() : webServerAnalyser( analyserConfig() ) {}
+        explicit webServerAnalyser( const analyserConfig &config ) : config( config ), pool( config.threads ) {}
 
        /*
         * @method: hostAccesses
@@ -104,4 +679,231 @@ class webServerAnalyser
         * @return: returns the number of successful accesses to a resource per host in vector format
         */
         std::vector <std::string> resourceAccesses( std::string filePath, std::string minDate, std::string maxDate );
+
+       /*
+        * @method: addQuery
+        * @brief: registers a query to be evaluated by the next runQueries call
+        * @input - query: the aggregation to compute, with its own filters
+        * @return: returns the index of the query's output in the runQueries result
+        */
+        size_t addQuery( const accessQuery &query );
+
+       /*
+        * @method: checkColumns
+        * @brief: verifies that the log format holds every column a query reads (see queryColumns): lines missing a column
+        *         would never pass the query and it would silently output nothing
+        * @input - query: the query
+        * @output - error: names the missing columns, and whether the query itself or its filter reads them
+        * @return: returns true if the format holds every column of the query, false otherwise
+        */
+        bool checkColumns( const accessQuery &query, std::string &error ) const;
+
+       /*
+        * @method: clearQueries
+        * @brief: removes all the queries registered with addQuery
+        */
+        void clearQueries();
+
+       /*
+        * @method: runQueries
+        * @brief: evaluates every registered query during a single pass over the log file
+        * @input - filePath: file containing the webserver logs to process
+        * @return: returns the ranked "key count" output of each query, indexed as returned by addQuery
+        */
+        std::vector <std::vector <std::string>> runQueries( std::string filePath );
+
+       /*
+        * @method: runQueries
+        * @brief: evaluates every registered query during a single pass over several log files (ex. rotated logs)
+        *         The files are processed in parallel and their results merged, as if the files had been concatenated
+        * @input - filePaths: files containing the webserver logs to process, see expandInputs for globs and directories
+        * @return: returns the ranked "key count" output of each query, indexed as returned by addQuery
+        */
+        std::vector <std::vector <std::string>> runQueries( const std::vector <std::string> &filePaths );
+
+       /*
+        * @method: runResults
+        * @brief: evaluates every registered query like runQueries, without formatting the results as text
+        * @input - filePaths: files containing the webserver logs to process, see expandInputs for globs and directories
+        * @return: returns the ranked results of each query, indexed as returned by addQuery (see resultWriter to print them)
+        */
+        std::vector <queryResult> runResults( const std::vector <std::string> &filePaths );
+
+       /*
+        * @method: saveState
+        * @brief: evaluates every registered query over the log files like runQueries, but writes the merged partial results
+        *         to a state file instead of ranking them: the queries, then the keys of each query (a dictionary) with their
+        *         counts and first positions, or the buckets of a histogram query (see stateWriter)
+        *         The states of several analysers (ex. one per shard of the logs, see analyserConfig.shards) are combined
+        *         with mergeStates
+        * @input - filePaths: files containing the webserver logs to process, see expandInputs for globs and directories
+        * @input - statePath: path of the state file to write
+        * @return: returns true if the state file was written successfully, false otherwise (or if the run is sampled, its
+        *          scaled counts cannot be merged exactly)
+        */
+        bool saveState( const std::vector <std::string> &filePaths, const std::string &statePath );
+
+       /*
+        * @method: mergeStates
+        * @brief: combines state files written by saveState into the final ranking of their queries, as if a single analyser had
+        *         counted all their logs: counts are summed and ties are ranked by the earliest first position
+        *         The queries of the state files replace the registered queries (see registeredQueries)
+        * @input - statePaths: state files, written for the same queries and top keys
+        * @output - output: the ranked "key count" output of each query of the state files
+        * @output - error: description of the first state file that could not be merged
+        * @return: returns true if every state file was merged, false otherwise
+        */
+        bool mergeStates( const std::vector <std::string> &statePaths, std::vector <std::vector <std::string>> &output, std::string &error );
+
+       /*
+        * @method: mergeStates
+        * @brief: combines state files written by saveState like mergeStates above, without formatting the results as text
+        * @input - statePaths: state files, written for the same queries and top keys
+        * @output - results: the ranked results of each query of the state files
+        * @output - error: description of the first state file that could not be merged
+        * @return: returns true if every state file was merged, false otherwise
+        */
+        bool mergeStates( const std::vector <std::string> &statePaths, std::vector <queryResult> &results, std::string &error );
+
+       /*
+        * @method: registeredQueries
+        * @return: returns the queries registered with addQuery (or merged by mergeStates), in the order of their outputs
+        */
+        const std::vector <accessQuery> &registeredQueries() const { return queries; }
+
+       /*
+        * @method: beginStream
+        * @brief: starts a push session evaluating the registered queries (see pushChunk), discarding the previous session
+        */
+        void beginStream();
+
+       /*
+        * @method: pushChunk
+        * @brief: counts the lines of a chunk of log pushed by the caller (ex. a network buffer), starting a session if needed
+        *         Complete lines are parsed straight from the chunk, only a line split across chunks is copied (into a
+        *         preallocated carry buffer) until the chunk holding its end is pushed
+        * @input - chunk: the next bytes of the log, of any size, lines may be split across chunks
+        *          Note: the chunk only needs to stay valid during the call
+        */
+        void pushChunk( std::string_view chunk );
+
+       /*
+        * @method: streamResults
+        * @brief: provides the results of the lines pushed so far, the line still being carried over is not counted yet
+        * @return: returns the ranked "key count" output of each query, indexed as returned by addQuery
+        */
+        std::vector <std::vector <std::string>> streamResults();
+
+       /*
+        * @method: endStream
+        * @brief: ends the push session, counting the last line even without its newline
+        * @return: returns the final ranked "key count" output of each query, indexed as returned by addQuery
+        */
+        std::vector <std::vector <std::string>> endStream();
+
+       /*
+        * @method: followLog
+        * @brief: follows a growing log file (see logFollower) and keeps every registered query counted over a sliding window
+        *         of log time (see slidingWindow): only the appended lines are parsed and expired accesses are subtracted
+        *         The window ends at the latest date time of the log, plus the wall time elapsed since that line was read so
+        *         that the rankings of an idle log keep expiring. Histogram and sketch queries are ranked by their key like the others
+        * @input - filePath: file containing the webserver logs to follow, rotations are followed
+        * @input - follow: window and report options
+        * @input - reportHandler: called every follow.refreshMilliseconds with the packed date time the window ends at and the
+        *          ranked "key count" output of each query (config.topKeys entries at most), returns false to stop following
+        * @return: returns false if the log could not be opened, true once the reportHandler stopped the follow
+        */
+        bool followLog( const std::string &filePath, const followConfig &follow,
+                        const std::function <bool( uint64_t windowEnd, const std::vector <std::vector <std::string>> &output )> &reportHandler );
+
+       /*
+        * @method: expandInputs
+        * @brief: converts input arguments into a list of log files
+        *         ex. "logs/access.log*" -> the matching files, "logs/" -> the files of the directory (sorted by name)
+        * @input - inputs: files, glob patterns or directories
+        * @return: returns the log files in the order of the inputs, index files (INDEX_EXTENSION) are skipped
+        *          Note: an input that does not match anything is kept as is (processed as a missing file)
+        */
+        static std::vector <std::string> expandInputs( const std::vector <std::string> &inputs );
+
+       /*
+        * @method: buildIndex
+        * @brief: parses the log file once and writes its sidecar index (filePath + INDEX_EXTENSION)
+        *         The index holds dictionary-encoded hosts, resources, methods and responses, packed date times and reply sizes,
+        *         later queries on the same unmodified log are answered from the index instead of parsing the text
+        * @input - filePath: file containing the webserver logs to index
+        * @return: returns true if the index was written successfully, false otherwise
+        */
+        bool buildIndex( std::string filePath );
+
+       /*
+        * @method: loadResident
+        * @brief: parses the log files once into dictionary-encoded columns held in memory (see logIndex::attach): queries
+        *         are then answered from the columns (see queryResident) without reading or parsing the logs again
+        *         The logs stay open, refreshResident appends the lines written to them since (rotations are followed)
+        * @input - filePaths: plain text logs to hold, counted as if they were concatenated in this order
+        * @output - error: description of the first log that could not be loaded
+        * @return: returns true if every log was loaded, false otherwise
+        */
+        bool loadResident( const std::vector <std::string> &filePaths, std::string &error );
+
+       /*
+        * @method: refreshResident
+        * @brief: appends the lines written to the resident logs since the last load or refresh to their columns
+        *         Queries running on other threads (see queryResident) wait for the append to complete
+        * @return: returns the number of lines appended
+        */
+        size_t refreshResident();
+
+       /*
+        * @method: queryResident
+        * @brief: evaluates queries over the columns of the resident logs (see loadResident) like runQueries over the logs
+        *         Can be called from several threads at once, each batch is counted by the calling thread
+        * @input - batch: the queries to evaluate
+        * @input - topKeys: only output the topKeys most accessed keys of each query, 0 outputs every key (counts are exact)
+        * @return: returns the ranked results of each query, in the order of the batch
+        */
+        std::vector <queryResult> queryResident( const std::vector <accessQuery> &batch, size_t topKeys );
+
+       /*
+        * @method: residentRows
+        * @return: returns the number of log lines held by the resident logs
+        */
+        uint64_t residentRows();
+
+       /*
+        * @method: actionQuery
+        * @brief: builds the query of a command line action (ex. "webserver", see logParser --action), without filters
+        * @input - action: webserver, resource, status, traffic, visitors or sizes
+        * @input - bucket: width of the time buckets of traffic
+        * @input - splitBy: host, resource, status or empty: key splitting traffic buckets, or keying visitors and sizes
+        * @output - query: the query of the action
+        * @return: returns false if the action is unknown, true otherwise
+        */
+        static bool actionQuery( const std::string &action, timeBucket bucket, const std::string &splitBy, accessQuery &query );
+
+       /*
+        * @method: actionName
+        * @return: returns the action a query was built for (see actionQuery)
+        */
+        static std::string actionName( const accessQuery &query );
+
+       /*
+        * @method: lastStats
+        * @brief: provides the instrumentation of the last run (see analyserConfig.collectStats, formatStats)
+        * @return: returns the stats of the last run, empty if stats are not collected
+        */
+        const analyserStats &lastStats() const { return stats; }
+
+       /*
+        * @method: parseDate
+        * @brief: converts a date time into a packed integer format: number of seconds since day 0
+        *         ex. "[29:23:54:18]" -> ((29 * 24 + 23) * 60 + 54) * 60 + 18
+        *         Common Log Format date times are converted into seconds since the Unix epoch (UTC)
+        *         ex. "[10/Oct/2000:13:55:36 -0700]" -> 971211336
+        *         Packed dates compare in the same order as the date times they were converted from
+        * @input - date: the date time to be converted
+        * @return: returns the packed form of the date time, INVALID_DATE if the date time is malformed
+        */
+        static uint32_t parseDate( std::string_view date );
 };
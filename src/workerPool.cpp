@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "workerPool.h"
+
+/*
+ * @method: workerPool
+ * @input - workers: number of worker threads, 0 selects the number of hardware threads
+ */
+workerPool::workerPool( unsigned int workers ) : workerCount( workers )
+{
+    if ( workerCount == 0 )
+    {
+        workerCount = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+}
+
+/*
+ * @method: run
+ * @brief: executes taskCount tasks and returns once all of them are complete
+ * @input - taskCount: number of tasks to execute
+ * @input - task: called once per task with the task index and the index of the worker running it
+ */
+void workerPool::run( size_t taskCount, const std::function <void( size_t task, unsigned int worker )> &task )
+{
+    std::atomic <size_t> nextTask( 0 );
+    std::vector <std::thread> threads;
+    unsigned int threadCount = static_cast <unsigned int>( std::min <size_t>( workerCount, taskCount ) );
+
+    auto workerLoop = [&]( unsigned int worker )
+    {
+        for (size_t current = nextTask++; current < taskCount; current = nextTask++)
+        {
+            task( current, worker );
+        }
+    };
+
+    // The calling thread acts as worker 0
+    for (unsigned int worker = 1; worker < threadCount; worker++)
+    {
+        threads.emplace_back( workerLoop, worker );
+    }
+    workerLoop( 0 );
+
+    for (auto &thread: threads)
+    {
+        thread.join();
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+/*
+ * @class: workerPool
+ * @brief: runs a batch of independent tasks on a fixed number of worker threads
+ *         Tasks are handed out dynamically so that uneven tasks balance out between workers
+ */
+class workerPool
+{
+    private:
+        unsigned int workerCount;
+
+    public:
+       /*
+        * @method: workerPool
+        * @input - workers: number of worker threads, 0 selects the number of hardware threads
+        */
+        explicit workerPool( unsigned int workers );
+
+       /*
+        * @method: run
+        * @brief: executes taskCount tasks and returns once all of them are complete
+        * @input - taskCount: number of tasks to execute
+        * @input - task: called once per task with the task index and the index of the worker running it
+        *          Note: a worker runs one task at a time, so per-worker state indexed by the worker index needs no locking
+        */
+        void run( size_t taskCount, const std::function <void( size_t task, unsigned int worker )> &task );
+
+       /*
+        * @method: size
+        * @return: returns the number of worker threads
+        */
+        unsigned int size() const { return workerCount; }
+};
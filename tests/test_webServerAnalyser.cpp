@@ -1,7 +1,110 @@
 #include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
 #include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include "../src/webServerAnalyser.h"
+#include "../src/heavyHitters.h"
+#include "../src/keyCounter.h"
+#include "../src/logTokenizer.h"
+#include "../src/queryServer.h"
+#include "../src/resultWriter.h"
+#include "../bench/logGenerator.h"
+
+#ifdef WEBSERVER_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+/*
+ * @class: temporaryFiles
+ * @brief: files and directories of the test temporary directory written by a test, removed with their sidecar indexes
+ *         when the test ends, whether it passes or not
+ */
+class temporaryFiles
+{
+    private:
+        std::vector <std::string> paths;
+
+    public:
+        temporaryFiles() = default;
+        ~temporaryFiles()
+        {
+            std::error_code error;
+            for (const auto &filePath: paths)
+            {
+                std::filesystem::remove_all( filePath, error );
+                std::filesystem::remove( filePath + INDEX_EXTENSION, error );
+            }
+        }
+
+        temporaryFiles( const temporaryFiles & ) = delete;
+        temporaryFiles &operator=( const temporaryFiles & ) = delete;
+
+       /*
+        * @method: path
+        * @brief: names a file or directory of the test temporary directory, removed when the test ends
+        * @input - name: name of the file within the temporary directory
+        * @return: returns the path of the file
+        */
+        std::string path( const std::string &name )
+        {
+            paths.push_back( testing::TempDir() + name );
+            return paths.back();
+        }
+
+       /*
+        * @method: generate
+        * @brief: writes a synthetic log (see logGenerator) to the test temporary directory, removed when the test ends
+        * @input - name: name of the log within the temporary directory
+        * @input - generator: shape of the log
+        * @output - lines: number of lines written, when not nullptr
+        * @return: returns the path of the log
+        */
+        std::string generate( const std::string &name, const generatorConfig &generator, uint64_t *lines = nullptr )
+        {
+            std::string filePath = path( name );
+            uint64_t written = logGenerator( generator ).generate( filePath );
+            if ( lines != nullptr )
+            {
+                *lines = written;
+            }
+            return filePath;
+        }
+};
+
+/*
+ * @method: addQueries
+ * @brief: registers the queries with an analyser, in order
+ */
+static void addQueries( webServerAnalyser &analyserObj, const std::vector <accessQuery> &queries )
+{
+    for (const auto &query: queries)
+    {
+        analyserObj.addQuery( query );
+    }
+}
+
+/*
+ * @method: queryOutput
+ * @brief: counts the queries over the logs with an analyser of the provided configuration
+ * @return: returns the output of each query, in order (see webServerAnalyser::runQueries)
+ */
+static std::vector <std::vector <std::string>> queryOutput( const analyserConfig &config, const std::vector <accessQuery> &queries,
+                                                          const std::vector <std::string> &filePaths )
+{
+    webServerAnalyser analyserObj( config );
+    addQueries( analyserObj, queries );
+    return analyserObj.runQueries( filePaths );
+}
 
 /*
  * @brief: verifies webServerAnalyser::hostAccesses without a date time range specified
@@ -135,6 +238,1569 @@ TEST( resourceAccessTest, smallFile_dateTimeRange_test )
     }
 }
 
+/*
+ * @brief: verifies webServerAnalyser::hostAccesses on a missing file (nothing to map, no output)
+ */
+TEST( hostAccessTest, missingFile_test )
+{
+    // Generate output:
+    webServerAnalyser testObj;
+    std::vector <std::string> output = testObj.hostAccesses( "../tests/doesNotExist.txt", "", "" );
+
+    EXPECT_TRUE( output.empty() );
+}
+
+/*
+ * @brief: verifies that a multi-threaded scan over small chunks matches the serial scan, including tie order
+ */
+TEST( parallelScanTest, smallFile_matchesSerial_test )
+{
+    analyserConfig parallelConfig;
+    parallelConfig.threads = 4;
+    parallelConfig.chunkSize = 64; // a few lines per chunk
+
+    webServerAnalyser serialObj;
+    webServerAnalyser parallelObj( parallelConfig );
+
+    EXPECT_EQ( parallelObj.hostAccesses( "../tests/hostAccessTest_small.txt", "", "" ),
+               serialObj.hostAccesses( "../tests/hostAccessTest_small.txt", "", "" ) );
+    EXPECT_EQ( parallelObj.resourceAccesses( "../tests/resourceAccessTest_small.txt", "[29:23:53:27]", "[29:23:54:18]" ),
+               serialObj.resourceAccesses( "../tests/resourceAccessTest_small.txt", "[29:23:53:27]", "[29:23:54:18]" ) );
+}
+
+/*
+ * @brief: verifies that a batch of queries evaluated in a single pass matches the individual queries
+ */
+TEST( queryBatchTest, smallFile_matchesSingleQueries_test )
+{
+    webServerAnalyser testObj;
+    accessQuery hostQuery, resourceQuery, statusQuery;
+
+    hostQuery.key = queryKey::host;
+    hostQuery.minDate = "[29:23:53:27]";
+    hostQuery.maxDate = "[29:23:54:18]";
+    resourceQuery.key = queryKey::resource;
+    resourceQuery.httpMethod = "GET";
+    resourceQuery.httpResponse = HTTP_OK;
+    statusQuery.key = queryKey::httpResponse;
+
+    size_t hostIndex = testObj.addQuery( hostQuery );
+    size_t resourceIndex = testObj.addQuery( resourceQuery );
+    size_t statusIndex = testObj.addQuery( statusQuery );
+    std::vector <std::vector <std::string>> output = testObj.runQueries( "../tests/resourceAccessTest_small.txt" );
+
+    ASSERT_EQ( output.size(), 3 );
+    EXPECT_EQ( output[hostIndex], testObj.hostAccesses( "../tests/resourceAccessTest_small.txt", "[29:23:53:27]", "[29:23:54:18]" ) );
+    EXPECT_EQ( output[resourceIndex], testObj.resourceAccesses( "../tests/resourceAccessTest_small.txt", "", "" ) );
+
+    std::vector <std::string> expectedStatus = { "200 11", "404 1" };
+    EXPECT_EQ( output[statusIndex], expectedStatus );
+}
+
+/*
+ * @brief: verifies that time ordered scans (binary search of the date time range) match full scans
+ */
+TEST( timeOrderedTest, largeFile_matchesFullScan_test )
+{
+    // Generate a time ordered log spanning about an hour, a few lines per second
+    temporaryFiles files;
+    std::string filePath = files.path( "timeOrderedTest.txt" );
+    std::ofstream logFile( filePath );
+    for (int line = 0; line < 10000; line++)
+    {
+        int second = line / 3;
+        logFile << "host" << line % 7 << " [29:" << 10 + second / 3600 << ":" << second / 60 % 60 / 10 << second / 60 % 10 << ":"
+                << second % 60 / 10 << second % 10 << "] \"GET /page" << line % 5 << ".html HTTP/1.0\" 200 100\n";
+    }
+    logFile.close();
+
+    analyserConfig orderedConfig;
+    orderedConfig.timeOrdered = true;
+    webServerAnalyser fullObj;
+    webServerAnalyser orderedObj( orderedConfig );
+
+    std::vector <std::pair <std::string, std::string>> ranges = { { "[29:10:05:00]", "[29:10:05:00]" },
+                                                                 { "[29:10:13:07]", "[29:10:40:59]" },
+                                                                 { "[29:00:00:00]", "[29:10:00:01]" },
+                                                                 { "[29:10:55:00]", "[30:00:00:00]" },
+                                                                 { "[30:00:00:00]", "[30:01:00:00]" } };
+    for (const auto &range: ranges)
+    {
+        std::vector <std::string> fullOutput = fullObj.hostAccesses( filePath, range.first, range.second );
+        EXPECT_EQ( orderedObj.hostAccesses( filePath, range.first, range.second ), fullOutput );
+        EXPECT_EQ( orderedObj.resourceAccesses( filePath, range.first, range.second ),
+                   fullObj.resourceAccesses( filePath, range.first, range.second ) );
+    }
+
+    // Second 300 of the log holds lines 900 to 902
+    std::vector <std::string> expectedOut = { "host4 1", "host5 1", "host6 1" };
+    EXPECT_EQ( orderedObj.hostAccesses( filePath, "[29:10:05:00]", "[29:10:05:00]" ), expectedOut );
+}
+
+/*
+ * @brief: verifies that queries answered from a sidecar index match the text scan, and that stale indexes are ignored
+ */
+TEST( logIndexTest, smallFile_matchesTextScan_test )
+{
+    // Work on a copy of the log so that the index is not written next to the test files
+    temporaryFiles files;
+    std::string filePath = files.path( "logIndexTest.txt" );
+    std::ifstream sourceFile( "../tests/resourceAccessTest_small.txt" );
+    std::ofstream( filePath ) << sourceFile.rdbuf();
+
+    analyserConfig textConfig;
+    textConfig.useIndex = false;
+    webServerAnalyser textObj( textConfig );
+    webServerAnalyser indexedObj;
+
+    ASSERT_TRUE( indexedObj.buildIndex( filePath ) );
+    logIndex index;
+    ASSERT_TRUE( index.load( filePath + INDEX_EXTENSION ) );
+    EXPECT_TRUE( index.isFresh( filePath, logFormat().fingerprint() ) );
+    EXPECT_EQ( index.rows(), 12 );
+
+    EXPECT_EQ( indexedObj.hostAccesses( filePath, "", "" ), textObj.hostAccesses( filePath, "", "" ) );
+    EXPECT_EQ( indexedObj.resourceAccesses( filePath, "", "" ), textObj.resourceAccesses( filePath, "", "" ) );
+    EXPECT_EQ( indexedObj.resourceAccesses( filePath, "[29:23:53:27]", "[29:23:54:18]" ),
+               textObj.resourceAccesses( filePath, "[29:23:53:27]", "[29:23:54:18]" ) );
+
+    // Appending to the log makes the index stale: the text is parsed again
+    std::ofstream( filePath, std::ios::app ) << "new.host.com [29:23:55:00] \"GET /new.html HTTP/1.0\" 200 10\n";
+    EXPECT_EQ( indexedObj.hostAccesses( filePath, "", "" ), textObj.hostAccesses( filePath, "", "" ) );
+    EXPECT_EQ( indexedObj.hostAccesses( filePath, "", "" ).back(), "new.host.com 1" );
+}
+
+/*
+ * @brief: verifies that exact top keys (partial selection) are the first entries of the full ranking
+ */
+TEST( topKeysTest, smallFile_exactTop_test )
+{
+    analyserConfig topConfig;
+    topConfig.topKeys = 2;
+    topConfig.exactTop = true;
+
+    webServerAnalyser fullObj;
+    webServerAnalyser topObj( topConfig );
+
+    std::vector <std::string> fullOutput = fullObj.resourceAccesses( "../tests/resourceAccessTest_small.txt", "", "" );
+    std::vector <std::string> expectedOut( fullOutput.begin(), fullOutput.begin() + 2 );
+    EXPECT_EQ( topObj.resourceAccesses( "../tests/resourceAccessTest_small.txt", "", "" ), expectedOut );
+}
+
+/*
+ * @brief: verifies that the heavy hitters summary finds the heavy keys among many more distinct keys than counters,
+ *         within its reported error bound, including after merging partial summaries
+ */
+TEST( topKeysTest, heavyHitters_errorBound_test )
+{
+    heavyHitters firstHalf( 5 ), secondHalf( 5 );
+    uint64_t position = 0;
+
+    // 5 heavy keys hidden among 40000 unique keys: heavy0 to heavy3 accessed 3000 + 2 * i times, heavy4 accessed 4000 times
+    for (int round = 0; round < 2000; round++)
+    {
+        heavyHitters &summary = round < 1000 ? firstHalf : secondHalf;
+        for (int heavy = 0; heavy < 5; heavy++)
+        {
+            if ( round % 1000 < 500 || heavy == 4 || round % 1000 < 500 + heavy )
+            {
+                summary.increment( "heavy" + std::to_string( heavy ), position++ );
+            }
+            summary.increment( "heavy" + std::to_string( heavy ), position++ );
+        }
+        for (int unique = 0; unique < 20; unique++)
+        {
+            summary.increment( "unique" + std::to_string( position ), position );
+            position++;
+        }
+    }
+    firstHalf.merge( secondHalf );
+
+    std::vector <std::string> output = firstHalf.rankedOutput( 5 );
+    ASSERT_EQ( output.size(), 5 );
+    EXPECT_EQ( output[0].substr( 0, 7 ), "heavy4 " );
+
+    // heavy4 is accessed 4000 times: the estimate never undercounts and overcounts by at most its error
+    uint64_t count = std::stoull( output[0].substr( 7 ) ), error = 0;
+    size_t errorPos = output[0].find( "<= " );
+    if ( errorPos != std::string::npos )
+    {
+        error = std::stoull( output[0].substr( errorPos + 3 ) );
+    }
+    EXPECT_GE( count, 4000 );
+    EXPECT_LE( count - error, 4000 );
+
+    for (const auto &entry: output)
+    {
+        EXPECT_EQ( entry.substr( 0, 5 ), "heavy" );
+    }
+}
+
+/*
+ * @brief: verifies that the summaries used by the analyser keep every heavy key of a skewed log
+ */
+TEST( topKeysTest, generatedLog_matchesExactTop_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 2 << 20;
+    generator.hosts = 5000;
+    temporaryFiles files;
+    std::string filePath = files.generate( "topKeysTest.txt", generator );
+
+    for (unsigned int threads: { 1u, 3u })
+    {
+        analyserConfig approximateConfig, exactConfig;
+        approximateConfig.threads = exactConfig.threads = threads;
+        approximateConfig.chunkSize = exactConfig.chunkSize = 256 << 10;
+        approximateConfig.topKeys = exactConfig.topKeys = 10;
+        exactConfig.exactTop = true;
+
+        auto keysOf = []( const std::vector <std::string> &output )
+        {
+            std::vector <std::string> keys;
+            for (const auto &entry: output)
+            {
+                keys.push_back( entry.substr( 0, entry.find( ' ' ) ) );
+            }
+            std::sort( keys.begin(), keys.end() );
+            return keys;
+        };
+        EXPECT_EQ( keysOf( webServerAnalyser( approximateConfig ).hostAccesses( filePath, "", "" ) ),
+                   keysOf( webServerAnalyser( exactConfig ).hostAccesses( filePath, "", "" ) ) );
+    }
+}
+
+/*
+ * @brief: verifies that every instruction set supported by the CPU classifies the structural characters identically
+ */
+TEST( tokenizerTest, levels_matchScalar_test )
+{
+    std::string bytes;
+    const std::string alphabet = "ab \"[]:\n019/.-";
+    for (int i = 0; i < 64 * 64; i++)
+    {
+        bytes += alphabet[( i * 7 + i / 13 ) % alphabet.size()];
+    }
+
+    std::vector <structuralMasks> expected;
+    ASSERT_TRUE( logTokenizer::selectLevel( tokenizerLevel::scalar ) );
+    for (size_t block = 0; block < bytes.size(); block += TOKENIZER_BLOCK_SIZE)
+    {
+        expected.push_back( logTokenizer::classify( bytes.data() + block ) );
+    }
+
+    for (tokenizerLevel level: { tokenizerLevel::sse2, tokenizerLevel::avx2 })
+    {
+        if ( !logTokenizer::selectLevel( level ) )
+        {
+            continue;
+        }
+        for (size_t block = 0; block < bytes.size(); block += TOKENIZER_BLOCK_SIZE)
+        {
+            structuralMasks masks = logTokenizer::classify( bytes.data() + block );
+            for (size_t tokenIndex = 0; tokenIndex < TOKEN_CLASSES; tokenIndex++)
+            {
+                EXPECT_EQ( masks.masks[tokenIndex], expected[block / TOKENIZER_BLOCK_SIZE].masks[tokenIndex] );
+            }
+        }
+    }
+    logTokenizer::selectLevel( logTokenizer::bestLevel() );
+}
+
+/*
+ * @brief: verifies the tokenized scan on lines spanning several blocks, truncated lines and quotes inside requests
+ */
+TEST( tokenizerTest, queries_edgeCases_test )
+{
+    temporaryFiles files;
+    std::string filePath = files.path( "tokenizerTest.txt" );
+    std::ofstream logFile( filePath );
+    logFile << "host.a [29:23:53:25] \"GET /" << std::string( 150, 'x' ) << " HTTP/1.0\" 200 1497\n"
+            << "\n"
+            << "host.b [29:23:53:26] \"GET /say\"hi\".html HTTP/1.0\" 200 10\n"
+            << "host.b [29:23:53:27] \"GET /truncated.html\n"
+            << "host.c [29:23:53:28] \"GET /last.html HTTP/1.0\" 200 1";
+    logFile.close();
+
+    webServerAnalyser testObj;
+    std::vector <std::string> expectedHosts = { "host.b 2", "host.a 1", "host.c 1" };
+    std::vector <std::string> expectedResources = { "/" + std::string( 150, 'x' ) + " 1", "/say\"hi\".html 1", "/last.html 1" };
+    EXPECT_EQ( testObj.hostAccesses( filePath, "", "" ), expectedHosts );
+    EXPECT_EQ( testObj.resourceAccesses( filePath, "", "" ), expectedResources );
+}
+
+/*
+ * @brief: verifies the interned keys and counts of keyCounter across table growth, arena blocks and merges
+ */
+TEST( keyCounterTest, manyKeys_internedOnce_test )
+{
+    keyCounter firstHalf, secondHalf;
+    std::string largeKey( 3 << 20, 'L' ); // larger than an arena block
+
+    for (int access = 0; access < 100000; access++)
+    {
+        keyCounter &counter = access % 2 == 0 ? firstHalf : secondHalf;
+        std::string key = "/resource/" + std::to_string( access % 5000 );
+        EXPECT_EQ( std::string( counter.key( counter.increment( key, access ) ) ), key );
+    }
+    secondHalf.increment( largeKey, 100000 );
+    firstHalf.merge( secondHalf );
+
+    ASSERT_EQ( firstHalf.size(), 5001 );
+    std::vector <std::string> output = firstHalf.rankedOutput();
+    EXPECT_EQ( output.front(), "/resource/0 20" );
+    EXPECT_EQ( output[4999], "/resource/4999 20" );
+    EXPECT_EQ( output.back(), largeKey + " 1" );
+}
+
+/*
+ * @brief: verifies that an empty key can be the first key interned (ex. a request without URI, a line without host)
+ */
+TEST( keyCounterTest, emptyFirstKey_interned_test )
+{
+    keyCounter counter;
+    EXPECT_EQ( counter.increment( "", 0 ), 0 );
+    EXPECT_EQ( counter.increment( "/a", 1 ), 1 );
+    EXPECT_EQ( counter.increment( "", 2 ), 0 );
+    EXPECT_EQ( counter.rankedOutput(), std::vector <std::string>( { " 2", "/a 1" } ) );
+
+    // The same lines counted by every kind of query, from the text and from the index
+    temporaryFiles files;
+    std::string filePath = files.path( "emptyFirstKeyTest.txt" );
+    std::ofstream( filePath ) << "h1 [01:00:00:00] \"GET\" 200 10\n"
+                              << " [01:00:00:01] \"GET /a HTTP/1.0\" 200 20\n"
+                              << "h1 [01:00:00:02] \"GET /a HTTP/1.0\" 200 30\n";
+    std::vector <std::vector <std::string>> expected = { { "/a 2", " 1" }, { "h1 2", " 1" }, { "[01:00:00:00] /a 2 50", "[01:00:00:00]  1 10" },
+                                                         { "/a 2", " 1" } };
+    for (bool indexed: { false, true })
+    {
+        webServerAnalyser testObj;
+        for (const auto &action: { "resource", "webserver", "traffic", "visitors" })
+        {
+            accessQuery query;
+            ASSERT_TRUE( webServerAnalyser::actionQuery( action, timeBucket::hour, std::string( action ) == "traffic" ? "resource" : "", query ) );
+            testObj.addQuery( query );
+        }
+        if ( indexed )
+        {
+            ASSERT_TRUE( testObj.buildIndex( filePath ) );
+        }
+        EXPECT_EQ( testObj.runQueries( filePath ), expected );
+    }
+}
+
+/*
+ * @brief: verifies that gzip compressed logs (several members, small decompressed chunks) match the plain text log
+ */
+#ifdef WEBSERVER_HAVE_ZLIB
+TEST( compressedInputTest, gzipFile_matchesPlainText_test )
+{
+    // Compress the log as two gzip members, as produced by appending to a rotated log (ex. cat a.gz b.gz)
+    temporaryFiles files;
+    std::string filePath = files.path( "compressedInputTest.txt.gz" );
+    std::ifstream sourceFile( "../tests/resourceAccessTest_small.txt" );
+    std::string contents( ( std::istreambuf_iterator <char>( sourceFile ) ), std::istreambuf_iterator <char>() );
+    size_t split = contents.find( '\n', contents.size() / 2 ) + 1;
+    for (int member = 0; member < 2; member++)
+    {
+        gzFile compressedFile = gzopen( filePath.c_str(), member == 0 ? "wb" : "ab" );
+        ASSERT_NE( compressedFile, nullptr );
+        std::string_view part = member == 0 ? std::string_view( contents ).substr( 0, split ) : std::string_view( contents ).substr( split );
+        gzwrite( compressedFile, part.data(), part.size() );
+        gzclose( compressedFile );
+    }
+
+    // Small chunks so that lines straddle the decompressed chunk boundaries
+    analyserConfig config;
+    config.threads = 3;
+    config.chunkSize = 64;
+    config.useIndex = false;
+    webServerAnalyser plainObj;
+    webServerAnalyser compressedObj( config );
+
+    EXPECT_EQ( compressedObj.hostAccesses( filePath, "", "" ),
+               plainObj.hostAccesses( "../tests/resourceAccessTest_small.txt", "", "" ) );
+    EXPECT_EQ( compressedObj.resourceAccesses( filePath, "[29:23:53:27]", "[29:23:54:18]" ),
+               plainObj.resourceAccesses( "../tests/resourceAccessTest_small.txt", "[29:23:53:27]", "[29:23:54:18]" ) );
+
+    // A truncated archive is reported, only the lines decompressed before the error are counted (none here)
+    std::ofstream( filePath, std::ios::binary ).write( "\x1f\x8b\x08\x00", 4 );
+    EXPECT_TRUE( compressedObj.hostAccesses( filePath, "", "" ).empty() );
+}
+#endif
+
+/*
+ * @brief: verifies that the synthetic log generator is deterministic and writes logs that the analyser parses entirely
+ */
+TEST( logGeneratorTest, generatedLog_deterministic_test )
+{
+    generatorConfig config;
+    config.targetBytes = 256 << 10;
+    config.hosts = 50;
+    config.statusMix = { { "200", 3 }, { "404", 1 } };
+
+    std::ostringstream first, second, reseeded;
+    uint64_t lines = logGenerator( config ).generate( first );
+    EXPECT_EQ( logGenerator( config ).generate( second ), lines );
+    EXPECT_EQ( first.str(), second.str() );
+    config.seed++;
+    logGenerator( config ).generate( reseeded );
+    EXPECT_NE( first.str(), reseeded.str() );
+
+    // Every generated line is parsed: the replies per HTTP response add up to the number of lines
+    temporaryFiles files;
+    std::string filePath = files.path( "logGeneratorTest.txt" );
+    std::ofstream( filePath ) << first.str();
+    accessQuery statusQuery;
+    statusQuery.key = queryKey::httpResponse;
+    webServerAnalyser analyserObj;
+    analyserObj.addQuery( statusQuery );
+    std::vector <std::string> statusOutput = analyserObj.runQueries( filePath )[0];
+    ASSERT_EQ( statusOutput.size(), 2 );
+    EXPECT_EQ( statusOutput[0].substr( 0, 4 ), "200 " );
+    EXPECT_EQ( std::stoull( statusOutput[0].substr( 4 ) ) + std::stoull( statusOutput[1].substr( 4 ) ), lines );
+    EXPECT_LE( analyserObj.hostAccesses( filePath, "", "" ).size(), config.hosts );
+}
+
+/*
+ * @brief: verifies that the stats account every line to exactly one predicate or to the counted lines
+ */
+TEST( analyserStatsTest, smallFile_linesAccounted_test )
+{
+    analyserConfig config;
+    config.collectStats = true;
+    config.useIndex = false;
+    webServerAnalyser analyserObj( config );
+
+    std::vector <std::string> output = analyserObj.resourceAccesses( "../tests/resourceAccessTest_small.txt", "[29:23:53:27]", "[29:23:54:18]" );
+    const analyserStats &stats = analyserObj.lastStats();
+    ASSERT_EQ( stats.queries.size(), 1 );
+    EXPECT_EQ( stats.lines, 12 );
+    EXPECT_GT( stats.bytes, 0 );
+    EXPECT_EQ( stats.indexedFiles, 0 );
+
+    const queryStats &counters = stats.queries[0];
+    EXPECT_EQ( counters.counted + counters.rejected[FILTER_DATE] + counters.rejected[FILTER_RESPONSE] + counters.rejected[FILTER_METHOD], stats.lines );
+    EXPECT_GT( counters.rejected[FILTER_DATE], 0 );
+    EXPECT_EQ( counters.distinctKeys, output.size() );
+    EXPECT_GT( stats.peakMemory, 0 );
+    EXPECT_NE( formatStats( stats, true ).find( "\"counted\":" + std::to_string( counters.counted ) ), std::string::npos );
+
+    // Without collectStats nothing is recorded
+    webServerAnalyser plainObj;
+    plainObj.resourceAccesses( "../tests/resourceAccessTest_small.txt", "", "" );
+    EXPECT_EQ( plainObj.lastStats().lines, 0 );
+    EXPECT_TRUE( plainObj.lastStats().queries.empty() );
+}
+
+/*
+ * @brief: verifies that a log split into several files (plain, indexed) gives the results of the whole log
+ */
+TEST( multiFileTest, splitLog_matchesWholeLog_test )
+{
+    // Split the log into 3 rotated files in their own directory
+    temporaryFiles files;
+    std::string directory = files.path( "multiFileTest/" );
+    std::filesystem::remove_all( directory );
+    std::filesystem::create_directories( directory );
+    std::ifstream sourceFile( "../tests/resourceAccessTest_small.txt" );
+    std::vector <std::string> lines;
+    for (std::string line; std::getline( sourceFile, line ); )
+    {
+        lines.push_back( line );
+    }
+    for (size_t part = 0; part < 3; part++)
+    {
+        std::ofstream partFile( directory + "access.log." + std::to_string( part ) );
+        for (size_t line = part * lines.size() / 3; line < ( part + 1 ) * lines.size() / 3; line++)
+        {
+            partFile << lines[line] << "\n";
+        }
+    }
+
+    analyserConfig config;
+    config.threads = 3;
+    config.chunkSize = 64;
+    webServerAnalyser splitObj( config );
+    ASSERT_TRUE( splitObj.buildIndex( directory + "access.log.1" ) ); // the middle file is answered from its index
+
+    std::vector <std::string> filePaths = webServerAnalyser::expandInputs( { directory } );
+    ASSERT_EQ( filePaths.size(), 3 );
+    EXPECT_EQ( webServerAnalyser::expandInputs( { directory + "access.log.*" } ), filePaths );
+
+    accessQuery hostQuery, resourceQuery;
+    resourceQuery.key = queryKey::resource;
+    resourceQuery.httpMethod = "GET";
+    resourceQuery.httpResponse = HTTP_OK;
+    resourceQuery.minDate = "[29:23:53:27]";
+    resourceQuery.maxDate = "[29:23:54:18]";
+    addQueries( splitObj, { hostQuery, resourceQuery } );
+
+    EXPECT_EQ( splitObj.runQueries( filePaths ), queryOutput( analyserConfig(), { hostQuery, resourceQuery }, { "../tests/resourceAccessTest_small.txt" } ) );
+}
+
+/*
+ * @brief: verifies the traffic histograms against the log, split or not, scanned in parallel or answered from an index
+ */
+TEST( timeHistogramTest, generatedLog_matchesLog_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 256 << 10;
+    generator.linesPerSecond = 5;
+    temporaryFiles files;
+    uint64_t lines;
+    std::string filePath = files.generate( "timeHistogramTest.txt", generator, &lines );
+
+    accessQuery trafficQuery, statusQuery;
+    trafficQuery.bucket = statusQuery.bucket = timeBucket::minute;
+    statusQuery.key = queryKey::httpResponse;
+    statusQuery.splitByKey = true;
+
+    // Every line is counted once in the bucket of its minute, with its reply size
+    analyserConfig serialConfig, parallelConfig;
+    serialConfig.useIndex = false;
+    parallelConfig.threads = 3;
+    parallelConfig.chunkSize = 4096;
+    parallelConfig.collectStats = true;
+    webServerAnalyser parallelObj( parallelConfig );
+    addQueries( parallelObj, { trafficQuery, statusQuery } );
+    std::vector <std::vector <std::string>> serialOutput = queryOutput( serialConfig, { trafficQuery, statusQuery }, { filePath } );
+
+    uint64_t requests = 0, bytes = 0;
+    std::ifstream logFile( filePath );
+    std::string line, date, response;
+    while ( std::getline( logFile, line ) )
+    {
+        std::string size = line.substr( line.rfind( ' ' ) + 1 );
+        bytes += size == "-" ? 0 : std::stoull( size );
+    }
+    std::map <std::string, std::pair <uint64_t, uint64_t>> statusTotals;
+    for (const auto &entry: serialOutput[0])
+    {
+        std::istringstream fields( entry );
+        uint64_t bucketRequests, bucketBytes;
+        fields >> date >> bucketRequests >> bucketBytes;
+        EXPECT_EQ( date.substr( 10 ), "00]" );
+        requests += bucketRequests;
+        bytes -= bucketBytes;
+    }
+    EXPECT_EQ( requests, lines );
+    EXPECT_EQ( bytes, 0 );
+    for (const auto &entry: serialOutput[1])
+    {
+        std::istringstream fields( entry );
+        uint64_t cellRequests, cellBytes;
+        fields >> date >> response >> cellRequests >> cellBytes;
+        statusTotals[date].first += cellRequests;
+        statusTotals[date].second += cellBytes;
+    }
+    for (const auto &entry: serialOutput[0])
+    {
+        std::istringstream fields( entry );
+        uint64_t bucketRequests, bucketBytes;
+        fields >> date >> bucketRequests >> bucketBytes;
+        EXPECT_EQ( statusTotals[date], std::make_pair( bucketRequests, bucketBytes ) );
+    }
+
+    // Parallel scans and indexed logs produce the same histograms
+    EXPECT_EQ( parallelObj.runQueries( filePath ), serialOutput );
+    ASSERT_TRUE( parallelObj.buildIndex( filePath ) );
+    EXPECT_EQ( parallelObj.runQueries( filePath ), serialOutput );
+    EXPECT_EQ( parallelObj.lastStats().indexedFiles, 1 );
+}
+
+/*
+ * @brief: verifies that a followed log is counted over a sliding window across appends, partial lines and a rotation
+ */
+TEST( followTest, appendedLog_slidingWindow_test )
+{
+    temporaryFiles files;
+    std::string filePath = files.path( "followTest.txt" ), rotatedPath = files.path( "followTest.txt.1" );
+    auto line = []( const std::string &host, const std::string &date )
+    {
+        return host + " [" + date + "] \"GET /index.html HTTP/1.0\" 200 100\n";
+    };
+    std::ofstream( filePath ) << line( "hostA", "01:00:00:00" ) << line( "hostA", "01:00:00:01" ) << line( "hostB", "01:00:00:05" );
+
+    // 60 s window sliced into 10 s buckets
+    followConfig follow;
+    follow.windowSeconds = 60;
+    follow.windowBuckets = 6;
+    follow.refreshMilliseconds = 10;
+    follow.fromStart = true;
+    webServerAnalyser analyserObj;
+    analyserObj.addQuery( accessQuery() );
+
+    std::vector <std::vector <std::string>> reports;
+    bool opened = analyserObj.followLog( filePath, follow, [&]( uint64_t, const std::vector <std::vector <std::string>> &output )
+    {
+        reports.push_back( output[0] );
+        if ( reports.size() == 1 )
+        {
+            // One minute later: the first bucket expires, the line being written is not counted yet
+            std::ofstream( filePath, std::ios::app ) << line( "hostB", "01:00:01:05" ) << line( "hostC", "01:00:01:06" )
+                                                     << "hostE [01:00:01:07] \"GET / HTTP/1.0\" 200 1";
+        }
+        else if ( reports.size() == 2 )
+        {
+            // Rotation: the rest of the rotated log is read first (its unfinished line included), then the new log
+            std::filesystem::rename( filePath, rotatedPath );
+            std::ofstream( filePath ) << line( "hostC", "01:00:01:10" ) << line( "hostD", "01:00:01:10" );
+        }
+        return reports.size() < 3;
+    } );
+
+    EXPECT_TRUE( opened );
+    ASSERT_EQ( reports.size(), 3 );
+    EXPECT_EQ( reports[0], std::vector <std::string>( { "hostA 2", "hostB 1" } ) );
+    EXPECT_EQ( reports[1], std::vector <std::string>( { "hostB 1", "hostC 1" } ) );
+    EXPECT_EQ( reports[2], std::vector <std::string>( { "hostC 2", "hostB 1", "hostE 1", "hostD 1" } ) );
+    EXPECT_FALSE( analyserObj.followLog( testing::TempDir() + "followTest_missing.txt", follow, []( uint64_t, const std::vector <std::vector <std::string>> & )
+    {
+        return false;
+    } ) );
+}
+
+/*
+ * @brief: verifies that a log pushed in chunks of any size, lines split across chunks, matches the scan of the file
+ */
+TEST( streamTest, pushedChunks_matchFileScan_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 256 << 10;
+    temporaryFiles files;
+    std::string filePath = files.generate( "streamTest.txt", generator );
+    std::ifstream logFile( filePath );
+    std::string contents( ( std::istreambuf_iterator <char>( logFile ) ), std::istreambuf_iterator <char>() );
+
+    accessQuery hostQuery, resourceQuery, trafficQuery;
+    resourceQuery.key = queryKey::resource;
+    resourceQuery.httpMethod = "GET";
+    trafficQuery.bucket = timeBucket::minute;
+    analyserConfig fileConfig, streamConfig;
+    fileConfig.useIndex = false;
+    streamConfig.threads = 3;
+    streamConfig.chunkSize = 16 << 10;
+    webServerAnalyser streamObj( streamConfig );
+    addQueries( streamObj, { hostQuery, resourceQuery, trafficQuery } );
+    std::vector <std::vector <std::string>> fileOutput = queryOutput( fileConfig, { hostQuery, resourceQuery, trafficQuery }, { filePath } );
+
+    // Chunks from a few bytes (lines split several times) to larger than a worker chunk (counted in parallel)
+    // The last line is pushed without its newline: it is only counted at the end of the stream
+    size_t pushed = 0, chunkSize = 1;
+    contents.pop_back();
+    while ( pushed < contents.size() )
+    {
+        size_t size = std::min( chunkSize, contents.size() - pushed );
+        streamObj.pushChunk( std::string( contents, pushed, size ) ); // temporary copy: the chunk is not kept after the call
+        pushed += size;
+        chunkSize = chunkSize < ( 64 << 10 ) ? chunkSize * 3 + 1 : 1;
+        if ( pushed > contents.size() / 2 && pushed - size <= contents.size() / 2 )
+        {
+            EXPECT_FALSE( streamObj.streamResults()[0].empty() ); // intermediate results do not disturb the final ones
+        }
+    }
+    EXPECT_EQ( streamObj.endStream(), fileOutput );
+
+    // A new session starts from scratch
+    streamObj.pushChunk( "host.com [01:00:00:00] \"GET /a.html HTTP/1.0\" 200 10" );
+    EXPECT_TRUE( streamObj.streamResults()[0].empty() );
+    EXPECT_EQ( streamObj.endStream()[0], std::vector <std::string>( { "host.com 1" } ) );
+}
+
+/*
+ * @brief: verifies filter expressions against a manual filtering of the log, scanned as text or answered from an index
+ */
+TEST( logFilterTest, generatedLog_matchesManualFilter_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 256 << 10;
+    generator.linesPerSecond = 5;
+    temporaryFiles files;
+    uint64_t lines;
+    std::string filePath = files.generate( "logFilterTest.txt", generator, &lines );
+
+    // Status classes, CIDR networks, prefixes, suffixes, exclusions and numeric comparisons
+    std::vector <std::string> expressions = { "status=4xx,5xx and host=10.0.0.0/8",
+                                              "uri=/dir1*,*.gif and size>5000 and method!=HEAD and time<[01:00:30:00]",
+                                              "status>=300 && status<500 and host=*.example.net" };
+    auto endsWith = []( const std::string &value, const std::string &suffix )
+    {
+        return value.size() >= suffix.size() && value.compare( value.size() - suffix.size(), suffix.size(), suffix ) == 0;
+    };
+    auto manualFilter = [&endsWith]( size_t expression, const std::string &host, const std::string &date, const std::string &method,
+                            const std::string &resource, const std::string &response, uint64_t size )
+    {
+        switch ( expression )
+        {
+            case 0:
+                return ( response[0] == '4' || response[0] == '5' ) && host.compare( 0, 3, "10." ) == 0;
+            case 1:
+                return ( resource.compare( 0, 5, "/dir1" ) == 0 || endsWith( resource, ".gif" ) ) &&
+                       size > 5000 && method != "HEAD" && date < "[01:00:30:00]";
+            default:
+                return std::stoi( response ) >= 300 && std::stoi( response ) < 500 && endsWith( host, ".example.net" );
+        }
+    };
+
+    analyserConfig textConfig, indexedConfig;
+    textConfig.useIndex = false;
+    textConfig.collectStats = true;
+    indexedConfig.threads = 3;
+    indexedConfig.chunkSize = 4096;
+    webServerAnalyser textObj( textConfig ), indexedObj( indexedConfig );
+    for (const auto &expression: expressions)
+    {
+        std::string error;
+        accessQuery query;
+        ASSERT_TRUE( logFilter::compile( expression, query.filter, error ) ) << error;
+        textObj.addQuery( query );
+        indexedObj.addQuery( query );
+    }
+    std::vector <std::vector <std::string>> textOutput = textObj.runQueries( filePath );
+
+    std::vector <std::map <std::string, uint64_t>> expected( expressions.size() );
+    std::ifstream logFile( filePath );
+    std::string line, host, date, method, resource, protocol, response, size;
+    while ( std::getline( logFile, line ) )
+    {
+        std::istringstream fields( line );
+        fields >> host >> date >> method >> resource >> protocol >> response >> size;
+        for (size_t expression = 0; expression < expressions.size(); expression++)
+        {
+            if ( manualFilter( expression, host, date, method.substr( 1 ), resource, response, size == "-" ? 0 : std::stoull( size ) ) )
+            {
+                expected[expression][host]++;
+            }
+        }
+    }
+    for (size_t expression = 0; expression < expressions.size(); expression++)
+    {
+        std::map <std::string, uint64_t> counted;
+        for (const auto &entry: textOutput[expression])
+        {
+            counted[entry.substr( 0, entry.find( ' ' ) )] = std::stoull( entry.substr( entry.find( ' ' ) + 1 ) );
+        }
+        EXPECT_FALSE( counted.empty() ) << expressions[expression];
+        EXPECT_EQ( counted, expected[expression] ) << expressions[expression];
+
+        // Every line is either counted or rejected by a single predicate
+        const queryStats &counters = textObj.lastStats().queries[expression];
+        uint64_t rejected = 0;
+        for (uint64_t filtered: counters.rejected)
+        {
+            rejected += filtered;
+        }
+        EXPECT_EQ( counters.counted + rejected, lines );
+    }
+    EXPECT_GT( textObj.lastStats().queries[0].rejected[FILTER_RESPONSE], 0 );
+    EXPECT_GT( textObj.lastStats().queries[0].rejected[FILTER_HOST], 0 );
+
+    // Parallel scans and indexed logs apply the same predicates
+    EXPECT_EQ( indexedObj.runQueries( filePath ), textOutput );
+    ASSERT_TRUE( indexedObj.buildIndex( filePath ) );
+    EXPECT_EQ( indexedObj.runQueries( filePath ), textOutput );
+
+    // Cheap columns are tested first, malformed expressions are reported
+    logFilter filter;
+    std::string error;
+    ASSERT_TRUE( logFilter::compile( "uri=/a* and method=GET and status=200", filter, error ) );
+    ASSERT_EQ( filter.chain().size(), 3 );
+    EXPECT_EQ( filter.chain()[0].field, filterField::status );
+    EXPECT_EQ( filter.chain()[2].field, filterField::resource );
+    EXPECT_TRUE( logFilter::compile( "", filter, error ) && filter.empty() );
+    for (const char *malformed: { "colour=red", "size>big", "host=10.0.0.0/33", "status=200 or method=GET", "uri<a", "time>[1:2]", "method=" })
+    {
+        error.clear();
+        EXPECT_FALSE( logFilter::compile( malformed, filter, error ) ) << malformed;
+        EXPECT_FALSE( error.empty() ) << malformed;
+    }
+}
+
+/*
+ * @brief: verifies that a Combined Log Format log is counted like the same log in the default format
+ */
+TEST( logFormatTest, combinedLog_matchesDefaultLog_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 256 << 10;
+    generator.linesPerSecond = 5;
+    temporaryFiles files;
+    std::string defaultPath = files.generate( "logFormatTest.txt", generator ), combinedPath = files.path( "logFormatTest.combined.txt" );
+
+    // Same requests with an ident, a user, calendar date times with a time zone, a referer and a user agent holding quotes
+    std::ifstream defaultLog( defaultPath );
+    std::ofstream combinedLog( combinedPath );
+    std::string line;
+    for (size_t row = 0; std::getline( defaultLog, line ); row++)
+    {
+        size_t dateStart = line.find( '[' ), dateEnd = line.find( ']' );
+        std::string date = line.substr( dateStart + 1, dateEnd - dateStart - 1 );
+        std::string day = std::to_string( std::stoi( date.substr( 0, 2 ) ) + 1 );
+        combinedLog << line.substr( 0, dateStart ) << "- " << ( row % 3 ? "-" : "frank" ) << " [" << ( day.size() == 1 ? "0" : "" ) << day
+                    << "/Jan/2024" << date.substr( 2 ) << " -0700]" << line.substr( dateEnd + 1 ) << " \"http://example.com/?q=\\\"x\\\" y\""
+                    << " \"Mozilla/5.0 (\\\"compatible\\\"; bot " << row << ")\"\n";
+    }
+    combinedLog.close();
+
+    std::vector <accessQuery> queries( 4 );
+    queries[0].key = queryKey::host;
+    queries[1].key = queryKey::resource;
+    queries[1].httpMethod = "GET";
+    queries[1].httpResponse = HTTP_OK;
+    queries[2].key = queryKey::httpResponse;
+    queries[3].key = queryKey::host;
+    queries[3].minDate = "[01:00:10:00]";
+    queries[3].maxDate = "[01:00:20:00]";
+
+    analyserConfig defaultConfig, combinedConfig;
+    std::string error;
+    defaultConfig.useIndex = combinedConfig.useIndex = false;
+    ASSERT_TRUE( logFormat::compile( "combined", combinedConfig.format, error ) ) << error;
+    combinedConfig.threads = 3;
+    combinedConfig.chunkSize = 4096;
+    webServerAnalyser defaultObj( defaultConfig ), combinedObj( combinedConfig );
+    for (auto &query: queries)
+    {
+        defaultObj.addQuery( query );
+        if ( !query.minDate.empty() )
+        {
+            query.minDate = "[02/Jan/2024:00:10:00 -0700]";
+            query.maxDate = "[02/Jan/2024:00:20:00 -0700]";
+        }
+        combinedObj.addQuery( query );
+    }
+    std::vector <std::vector <std::string>> defaultOutput = defaultObj.runQueries( defaultPath );
+    EXPECT_FALSE( defaultOutput[3].empty() );
+    EXPECT_EQ( combinedObj.runQueries( combinedPath ), defaultOutput );
+    ASSERT_TRUE( combinedObj.buildIndex( combinedPath ) );
+    EXPECT_EQ( combinedObj.runQueries( combinedPath ), defaultOutput );
+
+    // The index is only used with the format it was built with: an index built with another format is ignored
+    analyserConfig indexedConfig = combinedConfig;
+    indexedConfig.useIndex = true;
+    webServerAnalyser indexedObj( indexedConfig );
+    for (const auto &query: combinedObj.registeredQueries())
+    {
+        indexedObj.addQuery( query );
+    }
+    logIndex index;
+    ASSERT_TRUE( index.load( combinedPath + INDEX_EXTENSION ) );
+    EXPECT_TRUE( index.isFresh( combinedPath, combinedConfig.format.fingerprint() ) );
+    EXPECT_FALSE( index.isFresh( combinedPath, defaultConfig.format.fingerprint() ) );
+    EXPECT_EQ( indexedObj.runQueries( combinedPath ), defaultOutput );
+    ASSERT_TRUE( defaultObj.buildIndex( combinedPath ) );
+    EXPECT_EQ( indexedObj.runQueries( combinedPath ), defaultOutput );
+
+    // Time buckets of calendar date times are printed as calendar date times (UTC), with the same traffic
+    accessQuery trafficQuery;
+    trafficQuery.bucket = timeBucket::hour;
+    webServerAnalyser defaultTraffic( defaultConfig ), combinedTraffic( combinedConfig );
+    defaultTraffic.addQuery( trafficQuery );
+    combinedTraffic.addQuery( trafficQuery );
+    std::vector <std::string> defaultBuckets = defaultTraffic.runQueries( defaultPath )[0];
+    std::vector <std::string> combinedBuckets = combinedTraffic.runQueries( combinedPath )[0];
+    ASSERT_FALSE( defaultBuckets.empty() );
+    ASSERT_EQ( combinedBuckets.size(), defaultBuckets.size() );
+    for (size_t bucket = 0; bucket < defaultBuckets.size(); bucket++)
+    {
+        EXPECT_EQ( combinedBuckets[bucket].substr( 3, 10 ), "/Jan/2024:" ) << combinedBuckets[bucket];
+        EXPECT_EQ( combinedBuckets[bucket].substr( combinedBuckets[bucket].find( ']' ) ), defaultBuckets[bucket].substr( defaultBuckets[bucket].find( ']' ) ) );
+    }
+    std::string date;
+    queryResult::appendDate( 971211336, true, date );
+    EXPECT_EQ( date, "[10/Oct/2000:20:55:36 +0000]" );
+    date.clear();
+    queryResult::appendDate( 951782400, true, date );
+    EXPECT_EQ( date, "[29/Feb/2000:00:00:00 +0000]" );
+    date.clear();
+    queryResult::appendDate( 93784, false, date );
+    EXPECT_EQ( date, "[01:02:03:04]" );
+
+    // Only the columns of a run are scanned, calendar date times are packed as seconds since the Unix epoch
+    logFormat format;
+    ASSERT_TRUE( logFormat::compile( "common", format, error ) );
+    EXPECT_EQ( format.columns(), COLUMN_ALL );
+    EXPECT_EQ( format.restrict( COLUMN_HOST ).parsedFields(), 1 );
+    EXPECT_EQ( format.restrict( COLUMN_DATE | COLUMN_REQUEST ).parsedFields(), 5 );
+    EXPECT_EQ( webServerAnalyser::parseDate( "[10/Oct/2000:13:55:36 -0700]" ), 971211336 );
+    EXPECT_EQ( webServerAnalyser::parseDate( "[10/Oct/2000:20:55:36]" ), 971211336 );
+    EXPECT_EQ( webServerAnalyser::parseDate( "[10/Foo/2000:20:55:36]" ), INVALID_DATE );
+    EXPECT_EQ( webServerAnalyser::parseDate( "[10/Oct/1969:20:55:36]" ), INVALID_DATE );
+    for (const char *malformed: { "", "no variable", "$a$b", "$remote_addr:$status", "$status $status" })
+    {
+        error.clear();
+        EXPECT_FALSE( logFormat::compile( malformed, format, error ) ) << malformed;
+        EXPECT_FALSE( error.empty() ) << malformed;
+    }
+
+    // Queries reading a column the format does not hold are rejected, whether the query or its filter reads it
+    analyserConfig noStatusConfig;
+    ASSERT_TRUE( logFormat::compile( "$remote_addr [$time_local] \"$request\" $body_bytes_sent", noStatusConfig.format, error ) ) << error;
+    webServerAnalyser noStatusObj( noStatusConfig );
+    accessQuery hostQuery, resourceQuery;
+    resourceQuery.key = queryKey::resource;
+    resourceQuery.httpResponse = HTTP_OK;
+    EXPECT_TRUE( noStatusObj.checkColumns( hostQuery, error ) );
+    error.clear();
+    EXPECT_FALSE( noStatusObj.checkColumns( resourceQuery, error ) );
+    EXPECT_EQ( error, "the log format has no $status, read by the query" );
+    ASSERT_TRUE( logFilter::compile( "status=4xx", hostQuery.filter, error ) ) << error;
+    EXPECT_FALSE( noStatusObj.checkColumns( hostQuery, error ) );
+    EXPECT_EQ( error, "the log format has no $status, read by its filter" );
+    EXPECT_TRUE( webServerAnalyser().checkColumns( hostQuery, error ) );
+}
+
+/*
+ * @brief: verifies that the merged states of the shards of a log rank like a single run over the whole log
+ */
+TEST( stateFileTest, shardedStates_matchSingleRun_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 256 << 10;
+    generator.linesPerSecond = 5;
+    temporaryFiles files;
+    std::string filePath = files.generate( "stateFileTest.txt", generator );
+
+    std::vector <accessQuery> queries( 4 );
+    std::string error;
+    queries[1].key = queryKey::resource;
+    queries[1].httpMethod = "GET";
+    queries[1].httpResponse = HTTP_OK;
+    queries[2].key = queryKey::httpResponse;
+    ASSERT_TRUE( logFilter::compile( "host=10.0.0.0/8", queries[2].filter, error ) ) << error;
+    queries[3].bucket = timeBucket::minute;
+    queries[3].splitByKey = true;
+
+    analyserConfig config;
+    config.useIndex = false;
+    std::vector <std::vector <std::string>> wholeOutput = queryOutput( config, queries, { filePath } );
+
+    // Each shard is counted by its own analyser, with its own number of threads; only one of them sees an index of the log
+    std::vector <std::string> statePaths;
+    for (unsigned int shard = 0; shard < 3; shard++)
+    {
+        analyserConfig shardConfig = config;
+        shardConfig.useIndex = shard == 1;
+        if ( shard == 1 )
+        {
+            ASSERT_TRUE( webServerAnalyser().buildIndex( filePath ) );
+        }
+        shardConfig.shard = shard;
+        shardConfig.shards = 3;
+        shardConfig.threads = shard + 1;
+        shardConfig.chunkSize = 4096;
+        webServerAnalyser shardObj( shardConfig );
+        addQueries( shardObj, queries );
+        statePaths.push_back( files.path( "stateFileTest." + std::to_string( shard ) + ".state" ) );
+        ASSERT_TRUE( shardObj.saveState( { filePath }, statePaths.back() ) );
+    }
+
+    webServerAnalyser mergeObj;
+    std::vector <std::vector <std::string>> mergedOutput;
+    ASSERT_TRUE( mergeObj.mergeStates( statePaths, mergedOutput, error ) ) << error;
+    EXPECT_EQ( mergedOutput, wholeOutput );
+    ASSERT_EQ( mergeObj.registeredQueries().size(), queries.size() );
+    EXPECT_EQ( mergeObj.registeredQueries()[3].bucket, timeBucket::minute );
+    EXPECT_EQ( mergeObj.registeredQueries()[2].filter.chain().size(), 1 );
+
+    // States of other queries, truncated states and other files are refused
+    webServerAnalyser otherObj( config );
+    otherObj.addQuery( queries[0] );
+    std::string otherPath = files.path( "stateFileTest.other.state" );
+    ASSERT_TRUE( otherObj.saveState( { filePath }, otherPath ) );
+    EXPECT_FALSE( mergeObj.mergeStates( { statePaths[0], otherPath }, mergedOutput, error ) );
+    std::filesystem::resize_file( statePaths[1], std::filesystem::file_size( statePaths[1] ) - 1 );
+    EXPECT_FALSE( mergeObj.mergeStates( statePaths, mergedOutput, error ) );
+    EXPECT_FALSE( mergeObj.mergeStates( { filePath }, mergedOutput, error ) );
+    EXPECT_FALSE( error.empty() );
+}
+
+/*
+ * @brief: verifies that exact counts spilled to disk under a memory limit give the same results as counts kept in memory
+ */
+TEST( keySpillTest, memoryLimit_matchesInMemory_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 1 << 20;
+    temporaryFiles files;
+    std::string filePath = files.generate( "keySpillTest.txt", generator );
+
+    std::vector <accessQuery> queries( 3 );
+    queries[1].key = queryKey::resource;
+    queries[1].httpMethod = "GET";
+    queries[1].httpResponse = HTTP_OK;
+    queries[2].key = queryKey::httpResponse;
+
+    analyserConfig config;
+    config.useIndex = false;
+    config.threads = 3;
+    config.chunkSize = 16 << 10;
+    std::vector <std::vector <std::string>> memoryOutput = queryOutput( config, queries, { filePath } );
+
+    // A few KB per worker and per query: every query spills many runs
+    analyserConfig spillConfig = config;
+    spillConfig.memoryLimit = 64 << 10;
+    spillConfig.spillDirectory = testing::TempDir();
+    spillConfig.collectStats = true;
+    webServerAnalyser spillObj( spillConfig );
+    addQueries( spillObj, queries );
+    EXPECT_EQ( spillObj.runQueries( filePath ), memoryOutput );
+    EXPECT_GT( spillObj.lastStats().queries[0].spilledBytes, 0 );
+    EXPECT_GT( spillObj.lastStats().queries[1].spilledBytes, 0 );
+
+    // The counts of an indexed log are spilled within the same limit
+    analyserConfig indexedConfig = spillConfig;
+    indexedConfig.useIndex = true;
+    webServerAnalyser indexedObj( indexedConfig );
+    ASSERT_TRUE( indexedObj.buildIndex( filePath ) );
+    addQueries( indexedObj, queries );
+    EXPECT_EQ( indexedObj.runQueries( filePath ), memoryOutput );
+    EXPECT_EQ( indexedObj.lastStats().indexedFiles, 1 );
+    EXPECT_GT( indexedObj.lastStats().queries[0].spilledBytes, 0 );
+    EXPECT_GT( indexedObj.lastStats().queries[1].spilledBytes, 0 );
+
+    // Ranking within the limit as well: the ranked keys are read back from a file as they are written
+    auto spillFiles = [&]()
+    {
+        size_t files = 0;
+        for (const auto &entry: std::filesystem::directory_iterator( testing::TempDir() ))
+        {
+            files += entry.path().filename().string().rfind( "logParser.spill.", 0 ) == 0 ? 1 : 0;
+        }
+        return files;
+    };
+    {
+        std::vector <queryResult> results = spillObj.runResults( { filePath } );
+        ASSERT_TRUE( results[0].isSpilled() );
+        EXPECT_EQ( results[0].size(), memoryOutput[0].size() );
+        EXPECT_EQ( results[0].text(), memoryOutput[0] );
+        EXPECT_EQ( spillFiles(), 2 );
+
+        FILE *output = std::tmpfile();
+        {
+            resultWriter writer( fileno( output ), outputFormat::text, 3 );
+            EXPECT_TRUE( writer.write( { "webserver" }, { results[0] } ) );
+        }
+        std::string contents( static_cast <size_t>( ftell( output ) ), '\0' );
+        rewind( output );
+        EXPECT_EQ( fread( &contents[0], 1, contents.size(), output ), contents.size() );
+        fclose( output );
+        EXPECT_EQ( contents, memoryOutput[0][0] + "\n" + memoryOutput[0][1] + "\n" + memoryOutput[0][2] + "\n" );
+    }
+    EXPECT_EQ( spillFiles(), 0 );
+
+    // Exact top keys are ranked from the merged runs as well
+    config.topKeys = 5;
+    config.exactTop = true;
+    spillConfig.topKeys = 5;
+    spillConfig.exactTop = true;
+    webServerAnalyser spillTopObj( spillConfig );
+    spillTopObj.addQuery( queries[1] );
+    std::vector <std::vector <std::string>> topOutput = spillTopObj.runQueries( filePath );
+    EXPECT_EQ( topOutput, queryOutput( config, { queries[1] }, { filePath } ) );
+    EXPECT_EQ( topOutput[0].size(), 5 );
+    EXPECT_GT( spillTopObj.lastStats().queries[0].spilledBytes, 0 );
+}
+
+/*
+ * @brief: verifies the distinct hosts and reply size percentiles per resource against exact values, and that parallel,
+ *         indexed and sharded runs give the very same sketches
+ */
+TEST( keySketchTest, generatedLog_withinErrorBounds_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 1 << 20;
+    temporaryFiles files;
+    std::string filePath = files.generate( "keySketchTest.txt", generator );
+
+    std::vector <accessQuery> queries( 2 );
+    queries[0].key = queryKey::resource;
+    queries[0].metric = queryMetric::distinctHosts;
+    queries[1].key = queryKey::resource;
+    queries[1].metric = queryMetric::sizeQuantiles;
+
+    analyserConfig config;
+    config.useIndex = false;
+    std::vector <std::vector <std::string>> serialOutput = queryOutput( config, queries, { filePath } );
+
+    std::map <std::string, std::set <std::string>> hosts;
+    std::map <std::string, std::vector <uint64_t>> sizes;
+    std::ifstream logFile( filePath );
+    std::string line, host, date, method, resource, protocol, response, size;
+    while ( std::getline( logFile, line ) )
+    {
+        std::istringstream fields( line );
+        fields >> host >> date >> method >> resource >> protocol >> response >> size;
+        hosts[resource].insert( host );
+        sizes[resource].push_back( size == "-" ? 0 : std::stoull( size ) );
+    }
+
+    // Distinct hosts within 5% (exact while few registers are in use), percentiles within their bucket
+    ASSERT_EQ( serialOutput[0].size(), hosts.size() );
+    for (const auto &entry: serialOutput[0])
+    {
+        std::istringstream fields( entry );
+        uint64_t distinct;
+        fields >> resource >> distinct;
+        double exact = hosts[resource].size();
+        EXPECT_NEAR( distinct, exact, exact * 0.05 + 1 ) << entry;
+    }
+    ASSERT_EQ( serialOutput[1].size(), sizes.size() );
+    for (const auto &entry: serialOutput[1])
+    {
+        std::istringstream fields( entry );
+        uint64_t requests, percentiles[3];
+        fields >> resource >> requests >> percentiles[0] >> percentiles[1] >> percentiles[2];
+        std::vector <uint64_t> &values = sizes[resource];
+        std::sort( values.begin(), values.end() );
+        EXPECT_EQ( requests, values.size() ) << entry;
+        const double fractions[] = { 0.5, 0.95, 0.99 };
+        for (int percentile = 0; percentile < 3; percentile++)
+        {
+            size_t rank = std::max <size_t>( static_cast <size_t>( std::ceil( fractions[percentile] * values.size() ) ), 1 );
+            double exact = values[rank - 1];
+            EXPECT_NEAR( percentiles[percentile], exact, exact / 128 + 1 ) << entry;
+        }
+    }
+
+    // Sketches merge in any order: threads, indexes and shards give the same output
+    analyserConfig parallelConfig;
+    parallelConfig.threads = 3;
+    parallelConfig.chunkSize = 4096;
+    webServerAnalyser parallelObj( parallelConfig );
+    std::vector <std::string> statePaths;
+    for (unsigned int shard = 0; shard < 2; shard++)
+    {
+        analyserConfig shardConfig = parallelConfig;
+        shardConfig.useIndex = false;
+        shardConfig.shard = shard;
+        shardConfig.shards = 2;
+        webServerAnalyser shardObj( shardConfig );
+        addQueries( shardObj, queries );
+        statePaths.push_back( files.path( "keySketchTest." + std::to_string( shard ) + ".state" ) );
+        ASSERT_TRUE( shardObj.saveState( { filePath }, statePaths.back() ) );
+    }
+    addQueries( parallelObj, queries );
+    EXPECT_EQ( parallelObj.runQueries( filePath ), serialOutput );
+    ASSERT_TRUE( parallelObj.buildIndex( filePath ) );
+    EXPECT_EQ( parallelObj.runQueries( filePath ), serialOutput );
+
+    webServerAnalyser mergeObj;
+    std::vector <std::vector <std::string>> mergedOutput;
+    std::string error;
+    ASSERT_TRUE( mergeObj.mergeStates( statePaths, mergedOutput, error ) ) << error;
+    EXPECT_EQ( mergedOutput, serialOutput );
+    EXPECT_EQ( mergeObj.registeredQueries()[1].metric, queryMetric::sizeQuantiles );
+}
+
+/*
+ * @brief: verifies that the size percentiles stay within the error bound of the sketch for reply sizes spanning several
+ *         orders of magnitude, the same way whatever the order in which the sizes are counted or merged
+ */
+TEST( keySketchTest, quantiles_wideRange_test )
+{
+    // Reply sizes spread from 100 bytes to 10 MB, 18 powers of two
+    std::vector <uint64_t> replySizes;
+    for (uint64_t size = 100; size <= 10000000; size += size / 1000 + 1)
+    {
+        replySizes.push_back( size );
+    }
+    quantileSketch ascending, descending, evens, odds;
+    for (size_t value = 0; value < replySizes.size(); value++)
+    {
+        ascending.add( replySizes[value] );
+        descending.add( replySizes[replySizes.size() - 1 - value] );
+        ( value % 2 == 0 ? evens : odds ).add( replySizes[value] );
+    }
+    evens.merge( odds );
+    for (double fraction: { 0.01, 0.5, 0.95, 0.99 })
+    {
+        double exact = static_cast <double>( replySizes[static_cast <size_t>( std::ceil( fraction * replySizes.size() ) ) - 1] );
+        EXPECT_NEAR( ascending.quantile( fraction ), exact, exact / 128 );
+        EXPECT_EQ( ascending.quantile( fraction ), descending.quantile( fraction ) );
+        EXPECT_EQ( ascending.quantile( fraction ), evens.quantile( fraction ) );
+    }
+}
+
+/*
+ * @brief: verifies that a sampled run reads a fraction of the log and estimates the top counts within their error margins,
+ *         the same way whatever the number of threads, and that sampling everything gives the exact counts
+ */
+TEST( keySampleTest, generatedLog_withinMargins_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 4 << 20;
+    temporaryFiles files;
+    std::string filePath = files.generate( "keySampleTest.txt", generator );
+
+    accessQuery query;
+    query.key = queryKey::host;
+    analyserConfig config;
+    std::vector <std::vector <std::string>> exactOutput = queryOutput( config, { query }, { filePath } );
+    std::map <std::string, double> exactCounts;
+    for (const auto &entry: exactOutput[0])
+    {
+        std::istringstream fields( entry );
+        std::string host;
+        double count;
+        fields >> host >> count;
+        exactCounts[host] = count;
+    }
+
+    config.topKeys = 20;
+    config.sampleFraction = 0.25;
+    config.sampleSeed = 42;
+    config.collectStats = true;
+    webServerAnalyser sampledObj( config );
+    sampledObj.addQuery( query );
+    std::vector <std::vector <std::string>> sampledOutput = sampledObj.runQueries( filePath );
+    ASSERT_EQ( sampledOutput[0].size(), 20 );
+    EXPECT_GT( sampledObj.lastStats().bytes, 0 );
+    EXPECT_LT( sampledObj.lastStats().bytes, std::filesystem::file_size( filePath ) / 2 );
+
+    // 95% confidence intervals: nearly every top key of the sample is within its margin of its exact count
+    size_t withinMargin = 0;
+    for (const auto &entry: sampledOutput[0])
+    {
+        std::istringstream fields( entry );
+        std::string host, error, plusMinus;
+        double estimate, margin;
+        fields >> host >> estimate >> error >> plusMinus >> margin;
+        ASSERT_EQ( exactCounts.count( host ), 1 ) << entry;
+        EXPECT_GT( margin, 0 ) << entry;
+        withinMargin += std::abs( estimate - exactCounts[host] ) <= margin;
+    }
+    EXPECT_GE( withinMargin, 16 );
+
+    // The same seed reads the same blocks: the estimates do not depend on the threads, another seed reads other blocks
+    config.threads = 3;
+    EXPECT_EQ( queryOutput( config, { query }, { filePath } ), sampledOutput );
+    config.sampleSeed = 7;
+    webServerAnalyser reseededObj( config );
+    reseededObj.addQuery( query );
+    EXPECT_NE( reseededObj.runQueries( filePath ), sampledOutput );
+    EXPECT_FALSE( reseededObj.saveState( { filePath }, files.path( "keySampleTest.state" ) ) );
+
+    config.sampleFraction = 1;
+    config.topKeys = 0;
+    EXPECT_EQ( queryOutput( config, { query }, { filePath } ), exactOutput );
+}
+
+/*
+ * @brief: verifies that the read ahead backends (pread, io_uring, with and without O_DIRECT) hand out the very same lines as
+ *         the memory mapping, for unaligned ranges (shards) and several consumers per log
+ */
+TEST( readBackendTest, generatedLog_matchesMemoryMapped_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 3 << 20;
+    temporaryFiles files;
+    std::string filePath = files.generate( "readBackendTest.txt", generator );
+    std::string contents;
+    {
+        std::ifstream logFile( filePath, std::ios::binary );
+        contents.assign( std::istreambuf_iterator <char>( logFile ), std::istreambuf_iterator <char>() );
+    }
+
+    // A range starting and ending within the read buffers is handed out whole, in order, in newline aligned chunks
+    uint64_t start = contents.find( '\n', 12345 ) + 1, end = contents.find( '\n', contents.size() - 54321 ) + 1;
+    for (inputBackend backend: { inputBackend::pread, inputBackend::uring })
+    {
+        readStream stream( filePath, start, end, backend, 3, true, 100000, 4 );
+        decompressedChunk chunk;
+        std::string streamed;
+        while ( stream.next( chunk ) )
+        {
+            EXPECT_EQ( chunk.offset, streamed.size() );
+            EXPECT_EQ( chunk.data.back(), '\n' );
+            streamed += chunk.data;
+        }
+        EXPECT_FALSE( stream.failed() );
+        EXPECT_EQ( streamed, contents.substr( start, end - start ) );
+    }
+
+    std::vector <accessQuery> queries( 2 );
+    queries[1].key = queryKey::resource;
+    queries[1].httpMethod = "GET";
+    analyserConfig config;
+    config.threads = 3;
+    config.chunkSize = 64 << 10;
+    config.shards = 2;
+    config.shard = 1;
+    std::vector <std::vector <std::string>> mappedOutput = queryOutput( config, queries, { filePath } );
+    ASSERT_FALSE( mappedOutput[0].empty() );
+
+    for (inputBackend backend: { inputBackend::pread, inputBackend::uring })
+    {
+        for (bool directIO: { false, true })
+        {
+            config.input = backend;
+            config.directIO = directIO;
+            config.readDepth = 2;
+            EXPECT_EQ( queryOutput( config, queries, { filePath } ), mappedOutput );
+        }
+    }
+
+    // A missing log is reported as failed, not as an empty range
+    readStream missing( filePath + ".missing", 0, 100, inputBackend::uring, 2, false, 100000, 4 );
+    decompressedChunk chunk;
+    EXPECT_FALSE( missing.next( chunk ) );
+    EXPECT_TRUE( missing.failed() );
+}
+
+/*
+ * @brief: verifies that a query server answers concurrent clients from the resident logs like runQueries over the logs,
+ *         and follows the lines appended to the logs
+ */
+TEST( queryServerTest, residentLogs_matchRunQueries_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 1 << 20;
+    generator.linesPerSecond = 50;
+    temporaryFiles files;
+    std::vector <std::string> filePaths = { files.generate( "queryServerTest_1.txt", generator ) };
+    generator.seed++;
+    generator.startDay = 2;
+    filePaths.push_back( files.generate( "queryServerTest_2.txt", generator ) );
+    std::string socketPath = testing::TempDir() + "queryServerTest.sock";
+
+    // Reference: the same actions counted from the logs by runQueries
+    std::vector <std::string> actions = { "webserver", "resource", "traffic", "visitors", "status" };
+    std::string request = "action=webserver\taction=resource\taction=traffic\taction=visitors\taction=status\tby=host\tbucket=minute"
+                          "\ttop=7\tminimum_date=[01:00:01:00]\tmaximum_date=[02:00:02:00]\tfilter=method!=HEAD";
+    auto expectedLines = [&]()
+    {
+        analyserConfig config;
+        config.topKeys = 7;
+        config.exactTop = true;
+        webServerAnalyser referenceObj( config );
+        std::string filterError;
+        for (const auto &action: actions)
+        {
+            accessQuery query;
+            query.minDate = "[01:00:01:00]";
+            query.maxDate = "[02:00:02:00]";
+            EXPECT_TRUE( logFilter::compile( "method!=HEAD", query.filter, filterError ) );
+            EXPECT_TRUE( webServerAnalyser::actionQuery( action, timeBucket::minute, "host", query ) );
+            referenceObj.addQuery( query );
+        }
+        std::vector <std::vector <std::string>> output = referenceObj.runQueries( filePaths );
+        std::vector <std::string> lines;
+        for (size_t query = 0; query < output.size(); query++)
+        {
+            if ( query > 0 )
+            {
+                lines.push_back( "" );
+            }
+            lines.push_back( "# " + actions[query] );
+            lines.insert( lines.end(), output[query].begin(), output[query].end() );
+        }
+        return lines;
+    };
+    std::vector <std::string> expected = expectedLines();
+
+    analyserConfig config;
+    config.threads = 2;
+    webServerAnalyser residentObj( config );
+    std::string error;
+    ASSERT_TRUE( residentObj.loadResident( filePaths, error ) ) << error;
+    queryServer server( residentObj, socketPath, 0, 3 );
+    ASSERT_TRUE( server.listen( error ) ) << error;
+    std::thread serving( [&server]() { server.serve(); } );
+
+    // Several clients at once, each one waits for its answer
+    std::vector <std::thread> clients;
+    std::vector <std::vector <std::string>> answers( 6 );
+    for (size_t client = 0; client < answers.size(); client++)
+    {
+        clients.emplace_back( [&, client]()
+        {
+            std::string clientError;
+            EXPECT_TRUE( queryServer::query( socketPath, request, answers[client], clientError ) ) << clientError;
+        } );
+    }
+    for (auto &client: clients)
+    {
+        client.join();
+    }
+    for (const auto &answer: answers)
+    {
+        EXPECT_EQ( answer, expected );
+    }
+
+    // Invalid requests are answered with an error, the server keeps serving
+    std::vector <std::string> answer;
+    EXPECT_FALSE( queryServer::query( socketPath, "action=bogus", answer, error ) );
+    EXPECT_EQ( error, "unknown action bogus" );
+    EXPECT_FALSE( queryServer::query( socketPath, "top=3", answer, error ) );
+    EXPECT_FALSE( queryServer::query( socketPath, "action=webserver\tfilter=size>", answer, error ) );
+    EXPECT_FALSE( queryServer::query( socketPath + ".missing", request, answer, error ) );
+
+    // Lines appended to a log are picked up by the server within a few polls
+    std::string appended;
+    for (int line = 0; line < 2000; line++)
+    {
+        appended += "appendedHost [02:00:01:30] \"GET /appended.html HTTP/1.0\" 200 " + std::to_string( line ) + "\n";
+    }
+    std::ofstream( filePaths[1], std::ios::app ) << appended;
+    expected = expectedLines();
+    EXPECT_NE( std::find( expected.begin(), expected.end(), "appendedHost 2000" ), expected.end() );
+    for (int attempt = 0; attempt < 50 && answer != expected; attempt++)
+    {
+        std::this_thread::sleep_for( std::chrono::milliseconds( FOLLOW_POLL_INTERVAL ) );
+        EXPECT_TRUE( queryServer::query( socketPath, request, answer, error ) ) << error;
+    }
+    EXPECT_EQ( answer, expected );
+
+    // Idle connections hold every handler, then fill the queue: the next one is turned away, the listener keeps serving
+    std::vector <int> idleFds;
+    for (int connections: { 3, SERVER_QUEUED_CONNECTIONS })
+    {
+        for (int connection = 0; connection < connections; connection++)
+        {
+            sockaddr_un address = {};
+            address.sun_family = AF_UNIX;
+            socketPath.copy( address.sun_path, sizeof( address.sun_path ) - 1 );
+            idleFds.push_back( socket( AF_UNIX, SOCK_STREAM, 0 ) );
+            ASSERT_EQ( connect( idleFds.back(), reinterpret_cast <sockaddr *>( &address ), sizeof( address ) ), 0 );
+        }
+        std::this_thread::sleep_for( std::chrono::milliseconds( 2 * FOLLOW_POLL_INTERVAL ) );
+    }
+    EXPECT_FALSE( queryServer::query( socketPath, request, answer, error ) );
+    EXPECT_EQ( error, "server busy" );
+    for (int idleFd: idleFds)
+    {
+        close( idleFd );
+    }
+    EXPECT_TRUE( queryServer::query( socketPath, request, answer, error ) ) << error;
+    EXPECT_EQ( answer, expected );
+
+    server.stop();
+    serving.join();
+    EXPECT_FALSE( std::filesystem::exists( socketPath ) );
+
+    // A missing log cannot be held
+    EXPECT_FALSE( residentObj.loadResident( { filePaths[0] + ".missing" }, error ) );
+    EXPECT_NE( error.find( "cannot be opened" ), std::string::npos );
+}
+
+/*
+ * @brief: verifies that resultWriter lays the typed results out as the text output, CSV, JSON and binary documents
+ */
+TEST( resultWriterTest, generatedLog_formatsMatchText_test )
+{
+    generatorConfig generator;
+    generator.targetBytes = 1 << 20;
+    temporaryFiles files;
+    std::string filePath = files.generate( "resultWriterTest.txt", generator );
+
+    // One action of each result kind (bounded counts, keyed traffic, size quantiles)
+    std::vector <std::string> actions = { "webserver", "traffic", "sizes" };
+    analyserConfig config;
+    config.topKeys = 5;
+    webServerAnalyser testObj( config );
+    for (const auto &action: actions)
+    {
+        accessQuery query;
+        ASSERT_TRUE( webServerAnalyser::actionQuery( action, timeBucket::minute, action == "traffic" ? "host" : "", query ) );
+        testObj.addQuery( query );
+    }
+    std::vector <queryResult> results = testObj.runResults( { filePath } );
+    std::vector <std::vector <std::string>> lines = testObj.runQueries( { filePath } );
+    ASSERT_EQ( results.size(), actions.size() );
+    for (size_t action = 0; action < actions.size(); action++)
+    {
+        EXPECT_EQ( results[action].text(), lines[action] );
+    }
+    EXPECT_EQ( results[0].kind(), resultKind::boundedCounts );
+    EXPECT_EQ( results[1].kind(), resultKind::keyedTraffic );
+    EXPECT_EQ( results[2].kind(), resultKind::sizeQuantiles );
+
+    auto written = [&]( outputFormat format, size_t limit )
+    {
+        FILE *output = std::tmpfile();
+        {
+            resultWriter writer( fileno( output ), format, limit );
+            EXPECT_TRUE( writer.write( actions, results ) );
+        }
+        std::string contents( static_cast <size_t>( ftell( output ) ), '\0' );
+        rewind( output );
+        EXPECT_EQ( fread( &contents[0], 1, contents.size(), output ), contents.size() );
+        fclose( output );
+        return contents;
+    };
+
+    // Text: the sections logParser prints, truncated to the limit
+    std::string expectedText;
+    std::string limitedText;
+    for (size_t action = 0; action < actions.size(); action++)
+    {
+        expectedText += ( action > 0 ? "\n# " : "# " ) + actions[action] + "\n";
+        limitedText += ( action > 0 ? "\n# " : "# " ) + actions[action] + "\n";
+        for (size_t row = 0; row < lines[action].size(); row++)
+        {
+            expectedText += lines[action][row] + "\n";
+            limitedText += row < 2 ? lines[action][row] + "\n" : "";
+        }
+    }
+    EXPECT_EQ( written( outputFormat::text, 0 ), expectedText );
+    EXPECT_EQ( written( outputFormat::text, 2 ), limitedText );
+
+    // CSV: a header, then one row per entry with the fields of its kind
+    std::istringstream csv( written( outputFormat::csv, 0 ) );
+    std::string row;
+    std::getline( csv, row );
+    EXPECT_EQ( row, "action,bucket,key,count,error,bytes,p50,p95,p99" );
+    std::getline( csv, row );
+    EXPECT_EQ( row, "webserver,," + std::string( results[0].key( 0 ) ) + "," + std::to_string( results[0].row( 0 ).count ) + ",0,,,," );
+    size_t csvRows = 2;
+    while ( std::getline( csv, row ) )
+    {
+        csvRows++;
+    }
+    EXPECT_EQ( csvRows, 1 + results[0].size() + results[1].size() + results[2].size() );
+
+    // JSON: an array of the actions, only the fields used by each kind
+    std::string json = written( outputFormat::json, 1 );
+    std::string firstSize = results[2].text()[0];
+    std::istringstream sizeFields( firstSize );
+    std::string sizeKey, sizeCount, p50, p95, p99;
+    sizeFields >> sizeKey >> sizeCount >> p50 >> p95 >> p99;
+    EXPECT_EQ( json.substr( 0, json.find( "]}" ) + 2 ), "[{\"action\":\"webserver\",\"results\":[{\"key\":\"" + std::string( results[0].key( 0 ) ) +
+                                                      "\",\"count\":" + std::to_string( results[0].row( 0 ).count ) + ",\"error\":0}]}" );
+    EXPECT_NE( json.find( "{\"action\":\"sizes\",\"results\":[{\"key\":\"" + sizeKey + "\",\"count\":" + sizeCount + ",\"p50\":" + p50 +
+                          ",\"p95\":" + p95 + ",\"p99\":" + p99 + "}]}]\n" ), std::string::npos );
+    EXPECT_NE( json.find( "\"bucket\":\"[" ), std::string::npos );
+    EXPECT_EQ( std::count( json.begin(), json.end(), '{' ), 6 );
+
+    // Binary: reads back as the same results, a truncated document is rejected
+    std::string binary = written( outputFormat::binary, 0 );
+    std::vector <std::string> readActions;
+    std::vector <queryResult> readResults;
+    ASSERT_TRUE( resultWriter::readBinary( binary, readActions, readResults ) );
+    EXPECT_EQ( readActions, actions );
+    ASSERT_EQ( readResults.size(), results.size() );
+    for (size_t action = 0; action < actions.size(); action++)
+    {
+        EXPECT_EQ( readResults[action].kind(), results[action].kind() );
+        EXPECT_EQ( readResults[action].text(), lines[action] );
+    }
+    EXPECT_LT( binary.size(), expectedText.size() );
+    EXPECT_FALSE( resultWriter::readBinary( binary.substr( 0, binary.size() - 1 ), readActions, readResults ) );
+    EXPECT_FALSE( resultWriter::readBinary( expectedText, readActions, readResults ) );
+
+    // Keys needing quotes in CSV and escapes in JSON
+    queryResult quoted( resultKind::counts );
+    resultRow quotedRow;
+    quotedRow.count = 3;
+    quoted.add( "/a,b\"c\\d", quotedRow );
+    results = { quoted };
+    actions = { "resource" };
+    EXPECT_EQ( written( outputFormat::csv, 0 ), "action,bucket,key,count,error,bytes,p50,p95,p99\nresource,,\"/a,b\"\"c\\d\",3,,,,,\n" );
+    EXPECT_EQ( written( outputFormat::json, 0 ), "[{\"action\":\"resource\",\"results\":[{\"key\":\"/a,b\\\"c\\\\d\",\"count\":3}]}]\n" );
+}
+
 int main( int argc, char **argv )
 {
     testing::InitGoogleTest( &argc, argv );